@@ -0,0 +1,254 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <linux/perf_event.h>
+
+#include "hugepage.h"
+#include "timing.h"
+
+/*
+ * huge page のベンチマーク:
+ *  - 大きなバッファ上のランダムな循環リストをたどる (1 アクセスごとに別のページに飛ぶ)
+ *  - 4K ページ / THP (madvise) / hugetlb (MAP_HUGETLB) の 3 通りで、
+ *    1 アクセスあたりの ns と dTLB ミス (perf_event_open が使えれば) を JSON で標準出力に出す
+ *  - -t で、コンテナと同じ THP の方針 (prctl) を設定してから測る
+ */
+
+#define NODE_SIZE 64  // 1 ノード = 1 キャッシュライン
+
+enum bench_mode { MODE_4K, MODE_THP, MODE_HUGETLB, MODE_MAX };
+
+static const char *mode_names[MODE_MAX] = {
+    [MODE_4K]      = "4k",
+    [MODE_THP]     = "thp",
+    [MODE_HUGETLB] = "hugetlb",
+};
+
+// 子プロセスが結果を書き込む共有メモリ
+struct bench_result {
+    int      ok;
+    int      have_tlb;         // dTLB カウンタが読めたか
+    uint64_t ns_per_access_x100;
+    uint64_t dtlb_misses;
+    uint64_t huge_bytes;       // 実際に huge page になった量
+};
+
+static uint64_t next_random(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// dTLB の読み込みミス (ユーザー空間分)
+static int open_dtlb_counter(void) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB
+                | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// /proc/self/smaps_rollup の AnonHugePages (THP になった量)
+static uint64_t anon_huge_bytes(void) {
+    FILE *f = fopen("/proc/self/smaps_rollup", "r");
+    char line[256];
+    unsigned long long kb = 0;
+    while (f && fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "AnonHugePages: %llu kB", &kb) == 1) {
+            break;
+        }
+    }
+    if (f) {
+        fclose(f);
+    }
+    return kb * 1024;
+}
+
+static void *map_buffer(enum bench_mode mode, size_t size) {
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    if (mode == MODE_HUGETLB) {
+        // 既定の大きさ (通常 2MB) の huge page. 事前に nr_hugepages の確保が必要
+        flags |= MAP_HUGETLB;
+    }
+    void *buf = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (buf == MAP_FAILED) {
+        fprintf(stderr, "mmap %s (%zu bytes) failed: %m\n", mode_names[mode], size);
+        return NULL;
+    }
+    // ページを触る前に指定する (fault 時に THP を割り当てるかが決まる)
+    if (mode == MODE_4K) {
+        madvise(buf, size, MADV_NOHUGEPAGE);
+    } else if (mode == MODE_THP) {
+        madvise(buf, size, MADV_HUGEPAGE);
+    }
+    return buf;
+}
+
+/**
+ * @brief バッファ全体をランダムな順の 1 つの輪にする (Fisher-Yates で並べた順につなぐ)
+ */
+static int build_chain(char *buf, size_t nodes) {
+    uint32_t *order = malloc(nodes * sizeof(*order));
+    if (!order) {
+        perror("malloc failed");
+        return -1;
+    }
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    for (size_t i = 0; i < nodes; i++) {
+        order[i] = (uint32_t)i;
+    }
+    for (size_t i = nodes - 1; i > 0; i--) {
+        size_t j = next_random(&seed) % (i + 1);
+        uint32_t tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+    for (size_t i = 0; i < nodes; i++) {
+        char *node = buf + (size_t)order[i] * NODE_SIZE;
+        *(char **)node = buf + (size_t)order[(i + 1) % nodes] * NODE_SIZE;
+    }
+    free(order);
+    return 0;
+}
+
+static void run_mode(enum bench_mode mode, size_t size, long accesses, struct bench_result *result) {
+    char *buf = map_buffer(mode, size);
+    if (!buf || build_chain(buf, size / NODE_SIZE) != 0) {
+        return;
+    }
+    result->huge_bytes = mode == MODE_HUGETLB ? size : anon_huge_bytes();
+
+    int counter = open_dtlb_counter();
+    if (counter >= 0) {
+        ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+        ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    char **p = (char **)buf;
+    uint64_t start = timing_now_ns();
+    for (long i = 0; i < accesses; i++) {
+        p = (char **)*p;
+    }
+    uint64_t elapsed = timing_now_ns() - start;
+    if (counter >= 0) {
+        ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+        uint64_t value = 0;
+        result->have_tlb = read(counter, &value, sizeof(value)) == sizeof(value);
+        result->dtlb_misses = value;
+        close(counter);
+    }
+    // 最適化で消されないようにたどった先を使う
+    if (p == NULL) {
+        fprintf(stderr, "broken chain\n");
+        return;
+    }
+    result->ns_per_access_x100 = elapsed * 100 / (uint64_t)accesses;
+    result->ok = 1;
+    munmap(buf, size);
+}
+
+/**
+ * @brief 各モードを fork した子で測る (前のモードのメモリや THP の状態を持ち越さない)
+ */
+static void measure(enum bench_mode mode, size_t size, long accesses, enum thp_policy thp,
+                    struct bench_result *result) {
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork failed");
+        return;
+    }
+    if (pid == 0) {
+        if (set_thp_policy(thp) != 0) {
+            _exit(EXIT_FAILURE);
+        }
+        run_mode(mode, size, accesses, result);
+        _exit(result->ok ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    waitpid(pid, NULL, 0);
+}
+
+int main(int argc, char **argv) {
+    size_t size_mb = 1024;
+    long accesses = 20000000;
+    enum thp_policy thp = THP_POLICY_SYSTEM;
+    const char *thp_name = "system";
+    int opt = 0;
+
+    while ((opt = getopt(argc, argv, "s:n:t:")) != -1) {
+        switch (opt) {
+        case 's':
+            size_mb = strtoul(optarg, NULL, 10);
+            break;
+        case 'n':
+            accesses = atol(optarg);
+            break;
+        case 't':
+            if (parse_thp_policy(optarg, &thp) != 0) {
+                fprintf(stderr, "unknown THP policy: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            thp_name = optarg;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-s MB] [-n ACCESSES] [-t system|never|madvise]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    // huge page (2MB) の倍数にそろえる
+    size_t size = ((size_mb + 1) & ~(size_t)1) << 20;
+    if (size_mb == 0 || accesses <= 0 || size / NODE_SIZE > UINT32_MAX) {
+        fprintf(stderr, "Usage: %s [-s MB] [-n ACCESSES] [-t system|never|madvise]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    struct bench_result *results = mmap(NULL, MODE_MAX * sizeof(*results), PROT_READ | PROT_WRITE,
+                                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (results == MAP_FAILED) {
+        perror("mmap failed");
+        return EXIT_FAILURE;
+    }
+    memset(results, 0, MODE_MAX * sizeof(*results));
+    for (int m = 0; m < MODE_MAX; m++) {
+        measure((enum bench_mode)m, size, accesses, thp, &results[m]);
+    }
+
+    printf("{\n");
+    printf("  \"buffer_bytes\": %zu,\n", size);
+    printf("  \"accesses\": %ld,\n", accesses);
+    printf("  \"thp_policy\": \"%s\",\n", thp_name);
+    printf("  \"modes\": {\n");
+    for (int m = 0; m < MODE_MAX; m++) {
+        const struct bench_result *r = &results[m];
+        printf("    \"%s\": {\"ok\": %s", mode_names[m], r->ok ? "true" : "false");
+        if (r->ok) {
+            printf(", \"ns_per_access\": %lu.%02lu, \"huge_bytes\": %lu",
+                   (unsigned long)(r->ns_per_access_x100 / 100), (unsigned long)(r->ns_per_access_x100 % 100),
+                   (unsigned long)r->huge_bytes);
+            if (r->have_tlb) {
+                printf(", \"dtlb_load_misses\": %lu, \"dtlb_misses_per_access\": %.3f",
+                       (unsigned long)r->dtlb_misses, (double)r->dtlb_misses / (double)accesses);
+            } else {
+                printf(", \"dtlb_load_misses\": null");
+            }
+        }
+        printf("}%s\n", m + 1 < MODE_MAX ? "," : "");
+    }
+    printf("  }\n");
+    printf("}\n");
+
+    munmap(results, MODE_MAX * sizeof(*results));
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,371 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/wait.h>
+
+#include "blkio.h"
+#include "timing.h"
+
+/*
+ * ブロック I/O の QoS のベンチマーク (fio の randread + 隣の seqwrite 相当):
+ *  - 保護したいコンテナ役が -f のファイルを 4K の O_DIRECT でランダムに読み、1 回ごとの遅延を記録する
+ *  - 隣人役 (-j 個) は自分のファイルへ 1M の O_DIRECT 書き込みを続けてディスクを埋める
+ *  - 単独 / 隣人あり (QoS 無し) / 隣人あり (保護側 io.latency, 隣人側 io.max) の 3 通りで
+ *    p50/p99/p99.9/max と隣人の書き込み量を JSON で標準出力に出す
+ *  - QoS 付きは /sys/fs/cgroup/io-bench/{protected,neighbour} を作って測る (使えなければ ok: false)
+ */
+
+#define BLOCK_SIZE   4096
+#define WRITE_SIZE   (1 << 20)
+#define MAX_SAMPLES  (1 << 20)
+#define BENCH_CGROUP "/sys/fs/cgroup/io-bench"
+
+enum bench_phase { PHASE_ALONE, PHASE_CONTENDED, PHASE_QOS, PHASE_COUNT };
+
+static const char *phase_names[PHASE_COUNT] = {
+    [PHASE_ALONE]     = "alone",
+    [PHASE_CONTENDED] = "contended",
+    [PHASE_QOS]       = "contended_qos",
+};
+
+// 子プロセスが結果を書き込む共有メモリ
+struct bench_result {
+    int      ok;
+    uint64_t reads;
+    uint64_t neighbour_bytes;
+    uint64_t samples[MAX_SAMPLES];  // 読み込み 1 回の遅延 (ns)
+};
+
+static uint64_t next_random(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// ソート済み配列からパーセンタイル (nearest-rank)
+static uint64_t percentile(const uint64_t *sorted, size_t n, double p) {
+    if (n == 0) {
+        return 0;
+    }
+    size_t rank = (size_t)(p / 100.0 * (double)n + 0.999999);
+    if (rank == 0) {
+        rank = 1;
+    }
+    return sorted[(rank > n ? n : rank) - 1];
+}
+
+static int write_file(const char *path, const char *value) {
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "open %s failed: %m\n", path);
+        return -1;
+    }
+    if (write(fd, value, strlen(value)) == -1) {
+        fprintf(stderr, "write \"%s\" to %s failed: %m\n", value, path);
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+// 自分を cgroup に入れる (QoS 無しの回は NULL)
+static int join_cgroup(const char *name) {
+    if (!name) {
+        return 0;
+    }
+    char path[128];
+    snprintf(path, sizeof(path), "%s/%s/cgroup.procs", BENCH_CGROUP, name);
+    return write_file(path, "0");
+}
+
+/**
+ * @brief 保護側と隣人側の cgroup を兄弟として作り, io.latency と io.max を書く
+ *        io.latency は兄弟の間で効く (目標を外すと遅延の緩い兄弟が絞られる)
+ */
+static int setup_cgroups(dev_t dev, const struct io_config *protected_io, const struct io_config *neighbour_io) {
+    char line[160];
+    if (mkdir(BENCH_CGROUP, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "mkdir %s failed: %m\n", BENCH_CGROUP);
+        return -1;
+    }
+    if (write_file("/sys/fs/cgroup/cgroup.subtree_control", "+io") != 0
+        || write_file(BENCH_CGROUP "/cgroup.subtree_control", "+io") != 0) {
+        return -1;
+    }
+    for (const char **name = (const char *[]){ "protected", "neighbour", NULL }; *name; name++) {
+        char path[128];
+        snprintf(path, sizeof(path), "%s/%s", BENCH_CGROUP, *name);
+        if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+            fprintf(stderr, "mkdir %s failed: %m\n", path);
+            return -1;
+        }
+    }
+    if (io_format_latency(protected_io, dev, 0, line, sizeof(line)) > 0
+        && write_file(BENCH_CGROUP "/protected/io.latency", line) != 0) {
+        return -1;
+    }
+    if (io_format_max(neighbour_io, dev, 0, line, sizeof(line)) > 0
+        && write_file(BENCH_CGROUP "/neighbour/io.max", line) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+static void cleanup_cgroups(void) {
+    rmdir(BENCH_CGROUP "/protected");
+    rmdir(BENCH_CGROUP "/neighbour");
+    rmdir(BENCH_CGROUP);
+}
+
+static void *aligned_buffer(size_t size) {
+    void *buf = NULL;
+    if (posix_memalign(&buf, BLOCK_SIZE, size) != 0) {
+        fprintf(stderr, "posix_memalign failed\n");
+        return NULL;
+    }
+    memset(buf, 0xa5, size);
+    return buf;
+}
+
+// 読み込み用のファイルを size まで埋める (ページキャッシュを経由しないよう O_DIRECT)
+static int prepare_file(const char *path, size_t size) {
+    struct stat st;
+    if (stat(path, &st) == 0 && (size_t)st.st_size >= size) {
+        return 0;
+    }
+    int fd = open(path, O_WRONLY | O_CREAT | O_DIRECT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "open %s (O_DIRECT) failed: %m\n", path);
+        return -1;
+    }
+    char *buf = aligned_buffer(WRITE_SIZE);
+    int ret = buf ? 0 : -1;
+    for (size_t off = 0; buf && off < size; off += WRITE_SIZE) {
+        if (pwrite(fd, buf, WRITE_SIZE, (off_t)off) != WRITE_SIZE) {
+            fprintf(stderr, "write %s failed: %m\n", path);
+            ret = -1;
+            break;
+        }
+    }
+    free(buf);
+    if (ret == 0 && fsync(fd) != 0) {
+        fprintf(stderr, "fsync %s failed: %m\n", path);
+        ret = -1;
+    }
+    close(fd);
+    return ret;
+}
+
+static void run_reader(const char *path, size_t size, uint64_t deadline, struct bench_result *result) {
+    int fd = open(path, O_RDONLY | O_DIRECT | O_CLOEXEC);
+    char *buf = aligned_buffer(BLOCK_SIZE);
+    if (fd < 0 || !buf) {
+        fprintf(stderr, "open %s (O_DIRECT) failed: %m\n", path);
+        return;
+    }
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    size_t blocks = size / BLOCK_SIZE;
+    while (timing_now_ns() < deadline) {
+        off_t off = (off_t)(next_random(&seed) % blocks) * BLOCK_SIZE;
+        uint64_t start = timing_now_ns();
+        if (pread(fd, buf, BLOCK_SIZE, off) != BLOCK_SIZE) {
+            fprintf(stderr, "read %s failed: %m\n", path);
+            return;
+        }
+        if (result->reads < MAX_SAMPLES) {
+            result->samples[result->reads] = timing_now_ns() - start;
+        }
+        result->reads++;
+    }
+    free(buf);
+    close(fd);
+    result->ok = 1;
+}
+
+// 隣人: 自分のファイルへ 1M ずつ書き続ける (size で先頭に戻る)
+static void run_neighbour(const char *path, size_t size, struct bench_result *result) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_DIRECT | O_CLOEXEC, 0644);
+    char *buf = aligned_buffer(WRITE_SIZE);
+    if (fd < 0 || !buf) {
+        fprintf(stderr, "open %s (O_DIRECT) failed: %m\n", path);
+        _exit(EXIT_FAILURE);
+    }
+    for (size_t off = 0;; off = (off + WRITE_SIZE) % size) {
+        if (pwrite(fd, buf, WRITE_SIZE, (off_t)off) != WRITE_SIZE) {
+            fprintf(stderr, "write %s failed: %m\n", path);
+            _exit(EXIT_FAILURE);
+        }
+        __atomic_add_fetch(&result->neighbour_bytes, WRITE_SIZE, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * @brief 1 回分: 隣人を起こしてから読み手を fork し, 読み終えたら隣人を止める
+ */
+static void measure(enum bench_phase phase, const char *path, size_t size, int seconds, int neighbours,
+                    struct bench_result *result) {
+    int qos = phase == PHASE_QOS;
+    pid_t pids[64];
+    int started = 0;
+    for (int i = 0; phase != PHASE_ALONE && i < neighbours; i++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork failed");
+            break;
+        }
+        if (pid == 0) {
+            char own[4096];
+            snprintf(own, sizeof(own), "%s.neighbour%d", path, i);
+            if (join_cgroup(qos ? "neighbour" : NULL) != 0) {
+                _exit(EXIT_FAILURE);
+            }
+            run_neighbour(own, size, result);
+        }
+        pids[started++] = pid;
+    }
+
+    pid_t reader = fork();
+    if (reader == 0) {
+        if (join_cgroup(qos ? "protected" : NULL) != 0) {
+            _exit(EXIT_FAILURE);
+        }
+        // 隣人が書き始めるのを少し待ってから測る
+        if (started) {
+            usleep(200000);
+        }
+        run_reader(path, size, timing_now_ns() + (uint64_t)seconds * 1000000000ULL, result);
+        _exit(result->ok ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    if (reader > 0) {
+        waitpid(reader, NULL, 0);
+    }
+    for (int i = 0; i < started; i++) {
+        kill(pids[i], SIGKILL);
+        waitpid(pids[i], NULL, 0);
+        char own[4096];
+        snprintf(own, sizeof(own), "%s.neighbour%d", path, i);
+        unlink(own);
+    }
+}
+
+static void print_phase(enum bench_phase phase, struct bench_result *r, int seconds, int last) {
+    printf("    \"%s\": {\"ok\": %s", phase_names[phase], r->ok ? "true" : "false");
+    if (r->ok) {
+        size_t n = r->reads < MAX_SAMPLES ? r->reads : MAX_SAMPLES;
+        qsort(r->samples, n, sizeof(r->samples[0]), compare_u64);
+        printf(", \"reads\": %lu, \"iops\": %lu, \"p50_us\": %lu, \"p99_us\": %lu, \"p999_us\": %lu, \"max_us\": %lu,"
+               " \"neighbour_write_mb_per_sec\": %lu",
+               (unsigned long)r->reads, (unsigned long)(r->reads / (uint64_t)seconds),
+               (unsigned long)(percentile(r->samples, n, 50.0) / 1000),
+               (unsigned long)(percentile(r->samples, n, 99.0) / 1000),
+               (unsigned long)(percentile(r->samples, n, 99.9) / 1000),
+               (unsigned long)(n ? r->samples[n - 1] / 1000 : 0),
+               (unsigned long)(r->neighbour_bytes / (uint64_t)seconds >> 20));
+    }
+    printf("}%s\n", last ? "" : ",");
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s -f FILE [-s MB] [-d SEC] [-j NEIGHBOURS] [-l LATENCY_US] [-q NEIGHBOUR_IO]\n", prog);
+}
+
+int main(int argc, char **argv) {
+    const char *path = NULL;
+    size_t size_mb = 1024;
+    int seconds = 10;
+    int neighbours = 2;
+    const char *latency = "latency=2000";
+    const char *neighbour_spec = "wbps=104857600";
+    int opt = 0;
+    char latency_spec[64];
+
+    while ((opt = getopt(argc, argv, "f:s:d:j:l:q:")) != -1) {
+        switch (opt) {
+        case 'f':
+            path = optarg;
+            break;
+        case 's':
+            size_mb = strtoul(optarg, NULL, 10);
+            break;
+        case 'd':
+            seconds = atoi(optarg);
+            break;
+        case 'j':
+            neighbours = atoi(optarg);
+            break;
+        case 'l':
+            snprintf(latency_spec, sizeof(latency_spec), "latency=%s", optarg);
+            latency = latency_spec;
+            break;
+        case 'q':
+            neighbour_spec = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    struct io_config protected_io, neighbour_io;
+    if (!path || size_mb == 0 || seconds <= 0 || neighbours <= 0 || neighbours > 64
+        || parse_io_config(latency, &protected_io) != 0 || parse_io_config(neighbour_spec, &neighbour_io) != 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    size_t size = size_mb << 20;
+    if (prepare_file(path, size) != 0) {
+        return EXIT_FAILURE;
+    }
+    dev_t dev = io_backing_device(NULL, path);
+
+    struct bench_result *results = mmap(NULL, PHASE_COUNT * sizeof(*results), PROT_READ | PROT_WRITE,
+                                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (results == MAP_FAILED) {
+        perror("mmap failed");
+        return EXIT_FAILURE;
+    }
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        results[p].ok = 0;
+        results[p].reads = 0;
+        results[p].neighbour_bytes = 0;
+    }
+    measure(PHASE_ALONE, path, size, seconds, neighbours, &results[PHASE_ALONE]);
+    measure(PHASE_CONTENDED, path, size, seconds, neighbours, &results[PHASE_CONTENDED]);
+    if (dev != 0 && setup_cgroups(dev, &protected_io, &neighbour_io) == 0) {
+        measure(PHASE_QOS, path, size, seconds, neighbours, &results[PHASE_QOS]);
+    }
+    cleanup_cgroups();
+
+    printf("{\n");
+    printf("  \"device\": \"%u:%u\",\n", major(dev), minor(dev));
+    printf("  \"file_bytes\": %zu,\n", size);
+    printf("  \"seconds\": %d,\n", seconds);
+    printf("  \"neighbours\": %d,\n", neighbours);
+    printf("  \"protected\": \"%s\",\n", latency);
+    printf("  \"neighbour\": \"%s\",\n", neighbour_spec);
+    printf("  \"phases\": {\n");
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        print_phase((enum bench_phase)p, &results[p], seconds, p + 1 == PHASE_COUNT);
+    }
+    printf("  }\n");
+    printf("}\n");
+
+    munmap(results, PHASE_COUNT * sizeof(*results));
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,177 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "container.h"
+#include "launch.h"
+#include "timing.h"
+
+/*
+ * 起動ベンチマーク:
+ *  - main.c と同じ起動処理 (launch_container) を N 回繰り返す
+ *  - フェーズごとの p50/p99/max と log2 ヒストグラム、全体の launches/sec を
+ *    JSON で標準出力に出す (コンテナ側のログは stderr)
+ */
+
+#define HIST_BUCKETS 32  // log2(us) ごとのバケット
+
+static const char *phase_names[PHASE_MAX] = {
+    [PHASE_RESOURCES] = "resources",
+    [PHASE_CLONE]     = "clone",
+    [PHASE_USERNS]    = "userns",
+    [PHASE_MOUNTS]    = "mounts",
+    [PHASE_CAPS]      = "drop_capabilities",
+    [PHASE_SECCOMP]   = "restrict_syscalls",
+    [PHASE_EXECVE]    = "execve",
+    [PHASE_WAITPID]   = "waitpid",
+    [PHASE_FREE]      = "free_resources",
+};
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// ソート済み配列からパーセンタイル (nearest-rank)
+static uint64_t percentile(const uint64_t *sorted, size_t n, double p) {
+    if (n == 0) {
+        return 0;
+    }
+    size_t rank = (size_t)(p / 100.0 * (double)n + 0.999999);
+    if (rank == 0) {
+        rank = 1;
+    }
+    if (rank > n) {
+        rank = n;
+    }
+    return sorted[rank - 1];
+}
+
+static void print_phase(const char *name, uint64_t *samples, size_t n, int last) {
+    uint64_t hist[HIST_BUCKETS] = {0};
+    for (size_t i = 0; i < n; i++) {
+        uint64_t us = samples[i] / 1000;
+        int bucket = 0;
+        while (us > 1 && bucket < HIST_BUCKETS - 1) {
+            us >>= 1;
+            bucket++;
+        }
+        hist[bucket]++;
+    }
+    qsort(samples, n, sizeof(samples[0]), compare_u64);
+
+    printf("    \"%s\": {\"count\": %zu, \"p50_ns\": %lu, \"p99_ns\": %lu, \"max_ns\": %lu, \"hist_log2_us\": [",
+           name, n,
+           (unsigned long)percentile(samples, n, 50.0),
+           (unsigned long)percentile(samples, n, 99.0),
+           (unsigned long)(n ? samples[n - 1] : 0));
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        printf("%s%lu", i ? ", " : "", (unsigned long)hist[i]);
+    }
+    printf("]}%s\n", last ? "" : ",");
+}
+
+int main(int argc, char **argv) {
+    struct child_config config;
+    memset(&config, 0, sizeof(config));
+
+    long iterations = 1000;
+    int opt = 0;
+
+    config.uid = 1000;
+    config.mount_dir = NULL;
+
+    // オプション解析 (main.c と同じ + -n 回数)
+    while ((opt = getopt(argc, argv, "n:u:m:c:")) != -1) {
+        switch (opt) {
+        case 'n':
+            iterations = atol(optarg);
+            break;
+        case 'u':
+            config.uid = atoi(optarg);
+            break;
+        case 'm':
+            config.mount_dir = optarg;
+            break;
+        case 'c':
+            config.argc = argc - optind + 1;
+            config.argv = &argv[optind - 1];
+            optind = argc;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-n N] -u UID -m MOUNTDIR -c COMMAND [ARGS...]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!config.argc || !config.mount_dir || iterations <= 0) {
+        fprintf(stderr, "Usage: %s [-n N] -u UID -m /path -c /bin/true [args]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // 子プロセスも書き込むので共有メモリに置く
+    struct launch_timing *timing = mmap(NULL, sizeof(*timing), PROT_READ | PROT_WRITE,
+                                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (timing == MAP_FAILED) {
+        perror("mmap failed");
+        return EXIT_FAILURE;
+    }
+    config.timing = timing;
+
+    uint64_t *samples[PHASE_MAX + 1];
+    for (int p = 0; p <= PHASE_MAX; p++) {
+        samples[p] = calloc((size_t)iterations, sizeof(uint64_t));
+        if (!samples[p]) {
+            perror("calloc failed");
+            return EXIT_FAILURE;
+        }
+    }
+
+    char hostname[256] = {0};
+    config.hostname = hostname;
+
+    size_t ok = 0;
+    long failures = 0;
+    uint64_t bench_start = timing_now_ns();
+    for (long i = 0; i < iterations; i++) {
+        snprintf(hostname, sizeof(hostname), "mycontainer-bench-%d-%ld", getpid(), i);
+        memset(timing, 0, sizeof(*timing));
+
+        int status = launch_container(&config);
+        if (status != 0) {
+            failures++;
+            continue;
+        }
+        for (int p = 0; p < PHASE_MAX; p++) {
+            samples[p][ok] = timing->end[p] - timing->begin[p];
+        }
+        // 合計 (resources 開始から free_resources 終了まで)
+        samples[PHASE_MAX][ok] = timing->end[PHASE_FREE] - timing->begin[PHASE_RESOURCES];
+        ok++;
+    }
+    uint64_t elapsed = timing_now_ns() - bench_start;
+
+    printf("{\n");
+    printf("  \"iterations\": %ld,\n", iterations);
+    printf("  \"failures\": %ld,\n", failures);
+    printf("  \"elapsed_ns\": %lu,\n", (unsigned long)elapsed);
+    printf("  \"launches_per_sec\": %.2f,\n", elapsed ? (double)ok * 1e9 / (double)elapsed : 0.0);
+    printf("  \"phases\": {\n");
+    for (int p = 0; p < PHASE_MAX; p++) {
+        print_phase(phase_names[p], samples[p], ok, 0);
+    }
+    print_phase("total", samples[PHASE_MAX], ok, 1);
+    printf("  }\n");
+    printf("}\n");
+
+    for (int p = 0; p <= PHASE_MAX; p++) {
+        free(samples[p]);
+    }
+    munmap(timing, sizeof(*timing));
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,211 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "container.h"
+#include "launch.h"
+#include "loopdev.h"
+#include "profile.h"
+#include "resources.h"
+#include "timing.h"
+
+/*
+ * rootfs の形式ごとのコールドスタート (rootfs_bench):
+ *  - ディレクトリ (-d, open_tree による bind) とイメージファイル (-i, EROFS/squashfs のループデバイス) で
+ *    同じコマンドを交互に -n 回ずつ起動する
+ *  - cold は毎回 page cache/dentry/inode cache を捨ててから (drop_caches), warm は捨てずに測る
+ *  - 起動から終了までの p50/p99/max と, 1 回あたりにディスクから読んだ量 (/proc/vmstat の pgpgin) を JSON で出す
+ */
+
+enum rootfs_mode { MODE_DIRECTORY, MODE_IMAGE, MODE_MAX };
+enum cache_state { CACHE_COLD, CACHE_WARM, CACHE_MAX };
+
+static const char *mode_names[MODE_MAX] = { "directory", "image" };
+static const char *cache_names[CACHE_MAX] = { "cold", "warm" };
+
+struct run_samples {
+    uint64_t *ns;
+    uint64_t  read_kib;      // 合計
+    size_t    count;
+    long      failures;
+};
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// bench/main.c と同じ nearest-rank
+static uint64_t percentile(const uint64_t *sorted, size_t n, double p) {
+    if (n == 0) {
+        return 0;
+    }
+    size_t rank = (size_t)(p / 100.0 * (double)n + 0.999999);
+    if (rank == 0) {
+        rank = 1;
+    }
+    if (rank > n) {
+        rank = n;
+    }
+    return sorted[rank - 1];
+}
+
+// ページインした量 (KiB)
+static uint64_t read_pgpgin(void) {
+    FILE *f = fopen("/proc/vmstat", "r");
+    if (!f) {
+        return 0;
+    }
+    char key[64];
+    unsigned long long value;
+    uint64_t pgpgin = 0;
+    while (fscanf(f, "%63s %llu", key, &value) == 2) {
+        if (!strcmp(key, "pgpgin")) {
+            pgpgin = value;
+            break;
+        }
+    }
+    fclose(f);
+    return pgpgin;
+}
+
+static int drop_caches(void) {
+    sync();
+    int fd = open("/proc/sys/vm/drop_caches", O_WRONLY | O_CLOEXEC);
+    if (fd < 0 || write(fd, "3", 1) != 1) {
+        perror("drop_caches failed");
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+static int run_once(struct child_config *config, const char *rootfs, int cold, struct run_samples *samples) {
+    if (cold && drop_caches() != 0) {
+        return -1;
+    }
+    config->mount_dir = (char *)rootfs;
+    uint64_t pgpgin = read_pgpgin();
+    uint64_t start = timing_now_ns();
+    int status = launch_container(config);
+    uint64_t elapsed = timing_now_ns() - start;
+    if (status != 0) {
+        samples->failures++;
+        return 0;
+    }
+    samples->ns[samples->count++] = elapsed;
+    samples->read_kib += read_pgpgin() - pgpgin;
+    return 0;
+}
+
+static void print_samples(struct run_samples *s, int last) {
+    qsort(s->ns, s->count, sizeof(s->ns[0]), compare_u64);
+    printf("{\"count\": %zu, \"failures\": %ld, \"p50_ns\": %lu, \"p99_ns\": %lu, \"max_ns\": %lu, \"read_kib_avg\": %.1f}%s",
+           s->count, s->failures,
+           (unsigned long)percentile(s->ns, s->count, 50.0),
+           (unsigned long)percentile(s->ns, s->count, 99.0),
+           (unsigned long)(s->count ? s->ns[s->count - 1] : 0),
+           s->count ? (double)s->read_kib / (double)s->count : 0.0,
+           last ? "" : ", ");
+}
+
+int main(int argc, char **argv) {
+    struct child_config config;
+    memset(&config, 0, sizeof(config));
+    config.uid = 1000;
+    config.cgroup_fd = -1;
+    config.exec_fd = -1;
+
+    const char *rootfs[MODE_MAX] = { NULL, NULL };
+    long iterations = 20;
+    int opt = 0;
+
+    while ((opt = getopt(argc, argv, "n:d:i:u:c:")) != -1) {
+        switch (opt) {
+        case 'n':
+            iterations = atol(optarg);
+            break;
+        case 'd':
+            rootfs[MODE_DIRECTORY] = optarg;
+            break;
+        case 'i':
+            rootfs[MODE_IMAGE] = optarg;
+            break;
+        case 'u':
+            config.uid = atoi(optarg);
+            break;
+        case 'c':
+            config.argc = argc - optind + 1;
+            config.argv = &argv[optind - 1];
+            optind = argc;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-n N] -d DIR -i IMAGE -u UID -c COMMAND [ARGS...]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (!config.argc || !rootfs[MODE_DIRECTORY] || !rootfs[MODE_IMAGE] || iterations <= 0) {
+        fprintf(stderr, "Usage: %s [-n N] -d DIR -i IMAGE -u UID -c /bin/true [args]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (rootfs_image_type(rootfs[MODE_IMAGE]) == ROOTFS_IMAGE_NONE) {
+        fprintf(stderr, "%s is not an EROFS/squashfs image\n", rootfs[MODE_IMAGE]);
+        return EXIT_FAILURE;
+    }
+    if (setup_cgroup_root() != 0 || prepare_security_profile() != 0) {
+        return EXIT_FAILURE;
+    }
+
+    struct run_samples samples[MODE_MAX][CACHE_MAX];
+    memset(samples, 0, sizeof(samples));
+    for (int m = 0; m < MODE_MAX; m++) {
+        for (int c = 0; c < CACHE_MAX; c++) {
+            samples[m][c].ns = calloc((size_t)iterations, sizeof(uint64_t));
+            if (!samples[m][c].ns) {
+                perror("calloc failed");
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    char hostname[64];
+    config.hostname = hostname;
+    long seq = 0;
+    // 形式ごとの偏り (ディスクの温度やほかの負荷) が出ないよう交互に測る
+    for (int c = 0; c < CACHE_MAX; c++) {
+        for (long i = 0; i < iterations; i++) {
+            for (int m = 0; m < MODE_MAX; m++) {
+                // 前回の cgroup は片付け用のプロセスが非同期に消すので, 毎回別の名前にする
+                snprintf(hostname, sizeof(hostname), "mycontainer-rootfs-%d-%ld", getpid(), seq++);
+                if (run_once(&config, rootfs[m], c == CACHE_COLD, &samples[m][c]) != 0) {
+                    return EXIT_FAILURE;
+                }
+            }
+        }
+    }
+
+    long failures = 0;
+    printf("{\n");
+    printf("  \"iterations\": %ld,\n", iterations);
+    printf("  \"image_type\": \"%s\",\n", rootfs_image_fstype(rootfs_image_type(rootfs[MODE_IMAGE])));
+    for (int m = 0; m < MODE_MAX; m++) {
+        printf("  \"%s\": {", mode_names[m]);
+        for (int c = 0; c < CACHE_MAX; c++) {
+            printf("\"%s\": ", cache_names[c]);
+            print_samples(&samples[m][c], c == CACHE_MAX - 1);
+            failures += samples[m][c].failures;
+            free(samples[m][c].ns);
+        }
+        printf("}%s\n", m == MODE_MAX - 1 ? "" : ",");
+    }
+    printf("}\n");
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,467 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "container.h"
+#include "launch.h"
+#include "profile.h"
+#include "resources.h"
+#include "timing.h"
+
+/*
+ * 耐久試験 (soak_bench):
+ *  - -j 個のワーカープロセスが launch_container を合計 -n 回 (-d 秒で打ち切り) 繰り返す
+ *  - -i 秒ごとにホスト側のカウンタを取り, 1 行の JSON で標準出力に出す
+ *      マウント数 (ホスト / ランチャーの mount namespace), cgroup 数 (dying を含む),
+ *      /tmp の tmp.* の数, ランチャーの RSS と fd 数, launches/sec
+ *  - 最後に判定して 1 行の JSON を出す. 失敗の条件:
+ *      起動の失敗, 増え続けるカウンタ (最初の 1/4 の最大から最後の 1/4 の最小までの増加が許容量を超える),
+ *      スループットの低下 (最後の 1/4 の中央値が最初の 1/4 の -r 倍未満),
+ *      終了後に開始時の値まで戻らないマウント/cgroup/一時ディレクトリ
+ */
+
+#define SOAK_DEFAULT_CYCLES   100000
+#define SOAK_DEFAULT_INTERVAL 5       // 秒
+#define SOAK_DEFAULT_RATIO    0.8
+#define SOAK_DEFAULT_WARMUP   2       // 判定に使わない最初のサンプル数
+#define SOAK_MIN_SAMPLES      8       // これ未満なら傾向は判定しない
+#define SOAK_SETTLE_SEC       15      // 終了後に戻るのを待つ上限 (片付け用プロセスの TEARDOWN_DRAIN_MS より長く)
+
+enum soak_counter {
+    SOAK_HOST_MOUNTS,
+    SOAK_LAUNCHER_MOUNTS,
+    SOAK_CGROUPS,
+    SOAK_DYING_CGROUPS,
+    SOAK_TMP_DIRS,
+    SOAK_RSS_KB,
+    SOAK_FDS,
+    SOAK_COUNTER_MAX
+};
+
+// 名前と, 増加を許す量 (起動中のコンテナの分の揺れを吸収する)
+static const struct {
+    const char *name;
+    uint64_t    slack;
+    int         settles;  // 終了後に開始時の値まで戻るべきか
+} counters[SOAK_COUNTER_MAX] = {
+    [SOAK_HOST_MOUNTS]     = { "host_mounts",     4,    1 },
+    [SOAK_LAUNCHER_MOUNTS] = { "launcher_mounts", 4,    0 },
+    [SOAK_CGROUPS]         = { "cgroups",         8,    1 },
+    [SOAK_DYING_CGROUPS]   = { "dying_cgroups",   64,   0 },
+    [SOAK_TMP_DIRS]        = { "tmp_dirs",        4,    1 },
+    [SOAK_RSS_KB]          = { "launcher_rss_kb", 4096, 0 },
+    [SOAK_FDS]             = { "launcher_fds",    4,    0 },
+};
+
+struct soak_sample {
+    double   t;                          // 開始からの秒
+    uint64_t launches;
+    uint64_t failures;
+    double   launches_per_sec;           // 前のサンプルからの平均
+    int      full;                       // 全ワーカーが動いている間のサンプルか (スループットの判定に使う)
+    uint64_t value[SOAK_COUNTER_MAX];
+};
+
+// ワーカー間で共有する (MAP_SHARED)
+struct soak_shared {
+    atomic_long next;        // 次の起動番号
+    atomic_long launches;    // 終わった起動
+    atomic_long failures;    // launch_container が 0 以外を返した回数
+    atomic_int  stop;        // -d を過ぎたら 1
+};
+
+static long count_lines(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return 0;
+    }
+    long n = 0;
+    int c;
+    while ((c = fgetc(f)) != EOF) {
+        n += c == '\n';
+    }
+    fclose(f);
+    return n;
+}
+
+// prefix が NULL ならすべて ("." と ".." は除く)
+static long count_entries(const char *path, const char *prefix) {
+    DIR *dir = opendir(path);
+    if (!dir) {
+        return 0;
+    }
+    long n = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (prefix ? !strncmp(entry->d_name, prefix, strlen(prefix)) : entry->d_name[0] != '.') {
+            n++;
+        }
+    }
+    closedir(dir);
+    return n;
+}
+
+// "key value" 形式のファイルから key の値を読む
+static uint64_t read_key(const char *path, const char *key) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return 0;
+    }
+    char line[256];
+    uint64_t value = 0;
+    size_t len = strlen(key);
+    while (fgets(line, sizeof(line), f)) {
+        if (!strncmp(line, key, len) && (line[len] == ' ' || line[len] == '\t')) {
+            value = strtoull(line + len + 1, NULL, 10);
+            break;
+        }
+    }
+    fclose(f);
+    return value;
+}
+
+static void sample_counters(const pid_t *workers, long nworkers, struct soak_sample *s) {
+    memset(s->value, 0, sizeof(s->value));
+    s->value[SOAK_HOST_MOUNTS] = (uint64_t)count_lines("/proc/self/mountinfo");
+    s->value[SOAK_CGROUPS] = read_key("/sys/fs/cgroup/cgroup.stat", "nr_descendants");
+    s->value[SOAK_DYING_CGROUPS] = read_key("/sys/fs/cgroup/cgroup.stat", "nr_dying_descendants");
+    // create_bind_mount() などの一時ディレクトリ
+    s->value[SOAK_TMP_DIRS] = (uint64_t)count_entries("/tmp", "tmp.");
+
+    // ランチャー (ワーカー) は自分の mount namespace を持つ (prepare_mount_namespace)
+    for (long w = 0; w < nworkers; w++) {
+        if (workers[w] <= 0) {
+            continue;
+        }
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/%d/mountinfo", workers[w]);
+        s->value[SOAK_LAUNCHER_MOUNTS] += (uint64_t)count_lines(path);
+        snprintf(path, sizeof(path), "/proc/%d/status", workers[w]);
+        s->value[SOAK_RSS_KB] += read_key(path, "VmRSS:");
+        snprintf(path, sizeof(path), "/proc/%d/fd", workers[w]);
+        s->value[SOAK_FDS] += (uint64_t)count_entries(path, NULL);
+    }
+}
+
+static void print_sample(const struct soak_sample *s) {
+    printf("{\"t\": %.1f, \"launches\": %lu, \"failures\": %lu, \"launches_per_sec\": %.2f",
+           s->t, (unsigned long)s->launches, (unsigned long)s->failures, s->launches_per_sec);
+    for (int c = 0; c < SOAK_COUNTER_MAX; c++) {
+        printf(", \"%s\": %lu", counters[c].name, (unsigned long)s->value[c]);
+    }
+    printf("}\n");
+    fflush(stdout);
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double median(double *values, size_t n) {
+    if (n == 0) {
+        return 0;
+    }
+    qsort(values, n, sizeof(values[0]), compare_double);
+    return values[n / 2];
+}
+
+// 判定の理由を JSON の文字列の並びとして足す
+static void add_reason(char *reasons, size_t size, const char *fmt, ...) {
+    size_t len = strlen(reasons);
+    if (len + 4 >= size) {
+        return;
+    }
+    len += (size_t)snprintf(reasons + len, size - len, "%s\"", len ? ", " : "");
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(reasons + len, size - len - 1, fmt, ap);
+    va_end(ap);
+    len = n < 0 ? len : (len + (size_t)n < size - 1 ? len + (size_t)n : size - 2);
+    snprintf(reasons + len, size - len, "\"");
+}
+
+static void soak_worker(struct child_config config, struct soak_shared *shared, long cycles) {
+    char hostname[64];
+    config.hostname = hostname;
+    while (!atomic_load(&shared->stop)) {
+        long i = atomic_fetch_add(&shared->next, 1);
+        if (i >= cycles) {
+            break;
+        }
+        snprintf(hostname, sizeof(hostname), "mycontainer-soak-%d-%ld", getpid(), i);
+        if (launch_container(&config) != 0) {
+            atomic_fetch_add(&shared->failures, 1);
+        }
+        atomic_fetch_add(&shared->launches, 1);
+    }
+}
+
+static void sleep_ms(long ms) {
+    struct timespec ts = { .tv_sec = ms / 1000, .tv_nsec = (ms % 1000) * 1000000 };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+int main(int argc, char **argv) {
+    struct child_config config;
+    memset(&config, 0, sizeof(config));
+    config.uid = 1000;
+    config.cgroup_fd = -1;
+    config.exec_fd = -1;
+
+    long cycles = SOAK_DEFAULT_CYCLES;
+    long jobs = 1;
+    long interval = SOAK_DEFAULT_INTERVAL;
+    long duration = 0;
+    long warmup = SOAK_DEFAULT_WARMUP;
+    double min_ratio = SOAK_DEFAULT_RATIO;
+    int opt = 0;
+
+    while ((opt = getopt(argc, argv, "n:j:i:d:r:w:u:m:o:c:")) != -1) {
+        switch (opt) {
+        case 'n':
+            cycles = atol(optarg);
+            break;
+        case 'j':
+            jobs = atol(optarg);
+            break;
+        case 'i':
+            interval = atol(optarg);
+            break;
+        case 'd':
+            duration = atol(optarg);
+            break;
+        case 'r':
+            min_ratio = atof(optarg);
+            break;
+        case 'w':
+            warmup = atol(optarg);
+            break;
+        case 'u':
+            config.uid = atoi(optarg);
+            break;
+        case 'm':
+            config.mount_dir = optarg;
+            break;
+        case 'o':
+            config.overlay_size = optarg;
+            break;
+        case 'c':
+            config.argc = argc - optind + 1;
+            config.argv = &argv[optind - 1];
+            optind = argc;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-n N] [-j JOBS] [-i SEC] [-d SEC] [-r RATIO] [-w SAMPLES] "
+                            "-u UID -m MOUNTDIR [-o SIZE] -c COMMAND [ARGS...]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (!config.argc || !config.mount_dir || cycles <= 0 || jobs <= 0 || interval <= 0
+        || duration < 0 || warmup < 0 || min_ratio < 0) {
+        fprintf(stderr, "Usage: %s [-n N] [-j JOBS] [-i SEC] [-d SEC] [-r RATIO] [-w SAMPLES] "
+                        "-u UID -m /path [-o SIZE] -c /bin/true [args]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // 全ワーカーで共有できる準備は fork 前に 1 回だけ行う (batch と同じ)
+    if (setup_cgroup_root() != 0 || prepare_security_profile() != 0) {
+        return EXIT_FAILURE;
+    }
+    struct soak_shared *shared = mmap(NULL, sizeof(*shared), PROT_READ | PROT_WRITE,
+                                      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    pid_t *workers = calloc((size_t)jobs, sizeof(pid_t));
+    if (shared == MAP_FAILED || !workers) {
+        perror("allocation failed");
+        return EXIT_FAILURE;
+    }
+    atomic_init(&shared->next, 0);
+    atomic_init(&shared->launches, 0);
+    atomic_init(&shared->failures, 0);
+    atomic_init(&shared->stop, 0);
+
+    size_t nsamples = 0, capacity = 64;
+    struct soak_sample *samples = malloc(capacity * sizeof(*samples));
+    if (!samples) {
+        perror("malloc failed");
+        return EXIT_FAILURE;
+    }
+    struct soak_sample start;
+    memset(&start, 0, sizeof(start));
+    sample_counters(NULL, 0, &start);
+
+    uint64_t start_ns = timing_now_ns();
+    long running = 0;
+    for (long w = 0; w < jobs; w++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork failed");
+            break;
+        }
+        if (pid == 0) {
+            soak_worker(config, shared, cycles);
+            _exit(EXIT_SUCCESS);
+        }
+        workers[w] = pid;
+        running++;
+    }
+    long started = running;
+
+    uint64_t last_ns = start_ns;
+    uint64_t last_launches = 0;
+    while (running > 0) {
+        // 100ms ごとに終わったワーカーを回収し, -i 秒ごとにサンプルを取る
+        int full = running == started;
+        for (long ms = 0; ms < interval * 1000 && running > 0; ms += 100) {
+            sleep_ms(100);
+            pid_t pid;
+            while ((pid = waitpid(-1, NULL, WNOHANG)) > 0) {
+                for (long w = 0; w < jobs; w++) {
+                    if (workers[w] == pid) {
+                        workers[w] = 0;
+                        running--;
+                    }
+                }
+            }
+        }
+        uint64_t now = timing_now_ns();
+        if (duration && now - start_ns >= (uint64_t)duration * 1000000000) {
+            atomic_store(&shared->stop, 1);
+        }
+
+        if (nsamples == capacity) {
+            capacity *= 2;
+            struct soak_sample *grown = realloc(samples, capacity * sizeof(*samples));
+            if (!grown) {
+                perror("realloc failed");
+                break;
+            }
+            samples = grown;
+        }
+        struct soak_sample *s = &samples[nsamples++];
+        s->t = (double)(now - start_ns) / 1e9;
+        s->launches = (uint64_t)atomic_load(&shared->launches);
+        s->failures = (uint64_t)atomic_load(&shared->failures);
+        s->launches_per_sec = now > last_ns ? (double)(s->launches - last_launches) * 1e9 / (double)(now - last_ns) : 0;
+        s->full = full && running == started;
+        sample_counters(workers, jobs, s);
+        print_sample(s);
+        last_ns = now;
+        last_launches = s->launches;
+    }
+    uint64_t elapsed = timing_now_ns() - start_ns;
+    // 残ったワーカー (realloc 失敗時) を止める
+    atomic_store(&shared->stop, 1);
+    while (wait(NULL) > 0 || errno == EINTR) {
+    }
+
+    // 判定
+    int fail = 0;
+    char reasons[1024] = "";
+
+    uint64_t launches = (uint64_t)atomic_load(&shared->launches);
+    uint64_t failures = (uint64_t)atomic_load(&shared->failures);
+    if (failures) {
+        fail = 1;
+        add_reason(reasons, sizeof(reasons), "%lu launches failed", (unsigned long)failures);
+    }
+
+    // 判定に使うのは慣らしの後, 全ワーカーが動いている間のサンプルだけ
+    // (ワーカーが減り始めるとランチャー側の合計もスループットも下がる)
+    const struct soak_sample **steady = calloc(nsamples ? nsamples : 1, sizeof(*steady));
+    double *rates = calloc(nsamples ? nsamples : 1, sizeof(double));
+    size_t n = 0;
+    for (size_t i = (size_t)warmup; steady && rates && i < nsamples; i++) {
+        if (samples[i].full) {
+            rates[n] = samples[i].launches_per_sec;
+            steady[n++] = &samples[i];
+        }
+    }
+
+    // 増え続けるカウンタ
+    int64_t growth[SOAK_COUNTER_MAX] = {0};
+    double baseline = 0, recent = 0;
+    if (n >= SOAK_MIN_SAMPLES) {
+        size_t quarter = n / 4;
+        for (int c = 0; c < SOAK_COUNTER_MAX; c++) {
+            uint64_t early_max = 0, late_min = UINT64_MAX;
+            for (size_t i = 0; i < quarter; i++) {
+                uint64_t early = steady[i]->value[c];
+                uint64_t late = steady[n - 1 - i]->value[c];
+                early_max = early > early_max ? early : early_max;
+                late_min = late < late_min ? late : late_min;
+            }
+            growth[c] = (int64_t)late_min - (int64_t)early_max;
+            if (growth[c] > (int64_t)counters[c].slack) {
+                fail = 1;
+                add_reason(reasons, sizeof(reasons), "%s grew by %ld", counters[c].name, (long)growth[c]);
+            }
+        }
+
+        // スループットの低下
+        recent = median(rates + n - quarter, quarter);
+        baseline = median(rates, quarter);
+        if (recent < baseline * min_ratio) {
+            fail = 1;
+            add_reason(reasons, sizeof(reasons), "launches/sec dropped from %.2f to %.2f", baseline, recent);
+        }
+    }
+    free(rates);
+    free(steady);
+
+    // 終了後, マウント/cgroup/一時ディレクトリが開始時の値まで戻るか (片付けは非同期なので待つ)
+    struct soak_sample end;
+    for (int waited = 0;; waited += 100) {
+        sample_counters(NULL, 0, &end);
+        int settled = 1;
+        for (int c = 0; c < SOAK_COUNTER_MAX; c++) {
+            if (counters[c].settles && end.value[c] > start.value[c] + counters[c].slack) {
+                settled = 0;
+            }
+        }
+        if (settled || waited >= SOAK_SETTLE_SEC * 1000) {
+            break;
+        }
+        sleep_ms(100);
+    }
+    for (int c = 0; c < SOAK_COUNTER_MAX; c++) {
+        if (counters[c].settles && end.value[c] > start.value[c] + counters[c].slack) {
+            fail = 1;
+            add_reason(reasons, sizeof(reasons), "%s left %lu behind", counters[c].name, (unsigned long)(end.value[c] - start.value[c]));
+        }
+    }
+
+    printf("{\"result\": \"%s\", \"workers\": %ld, \"launches\": %lu, \"failures\": %lu, \"elapsed_ns\": %lu, "
+           "\"launches_per_sec\": %.2f, \"baseline_launches_per_sec\": %.2f, \"recent_launches_per_sec\": %.2f, "
+           "\"growth\": {",
+           fail ? "fail" : "ok", started, (unsigned long)launches, (unsigned long)failures, (unsigned long)elapsed,
+           elapsed ? (double)launches * 1e9 / (double)elapsed : 0.0, baseline, recent);
+    for (int c = 0; c < SOAK_COUNTER_MAX; c++) {
+        printf("%s\"%s\": %ld", c ? ", " : "", counters[c].name, (long)growth[c]);
+    }
+    printf("}, \"residual\": {");
+    for (int c = 0, printed = 0; c < SOAK_COUNTER_MAX; c++) {
+        if (counters[c].settles) {
+            printf("%s\"%s\": %ld", printed++ ? ", " : "", counters[c].name,
+                   (long)end.value[c] - (long)start.value[c]);
+        }
+    }
+    printf("}, \"reasons\": [%s]}\n", reasons);
+
+    free(samples);
+    free(workers);
+    munmap(shared, sizeof(*shared));
+    return fail ? EXIT_FAILURE : EXIT_SUCCESS;
+}
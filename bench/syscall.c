@@ -0,0 +1,191 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <linux/seccomp.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include "profile.h"
+#include "timing.h"
+
+/*
+ * システムコールのオーバーヘッド計測:
+ *  - フィルタ無し (ホスト) / deny プロファイル / allow プロファイル の 3 通りで
+ *    同じ syscall を N 回ずつ呼び、1 回あたりの ns を JSON で標準出力に出す
+ *  - コンテナ内で syscall ごとに増えるのは seccomp の判定だけなので、
+ *    コンテナと同じ BPF を fork した子に読み込ませて測る
+ */
+
+enum bench_syscall {
+    BENCH_GETPPID,
+    BENCH_FUTEX,
+    BENCH_EPOLL_WAIT,
+    BENCH_READ_WRITE,
+    BENCH_CLOCK_GETTIME,
+    BENCH_MAX
+};
+
+static const char *syscall_names[BENCH_MAX] = {
+    [BENCH_GETPPID]       = "getppid",
+    [BENCH_FUTEX]         = "futex_wake",
+    [BENCH_EPOLL_WAIT]    = "epoll_wait",
+    [BENCH_READ_WRITE]    = "pipe_write_read",
+    [BENCH_CLOCK_GETTIME] = "clock_gettime",
+};
+
+// 子プロセスが結果を書き込む共有メモリ
+struct bench_result {
+    int      ok;
+    uint64_t ns[BENCH_MAX];  // 1 回あたり (read/write は 2 回分)
+};
+
+static uint64_t run_syscall(enum bench_syscall which, long iterations, int epfd, int pipefd[2]) {
+    uint32_t word = 0;
+    char byte = 0;
+    struct epoll_event event;
+    struct timespec ts;
+
+    uint64_t start = timing_now_ns();
+    for (long i = 0; i < iterations; i++) {
+        switch (which) {
+        case BENCH_GETPPID:
+            syscall(SYS_getppid);
+            break;
+        case BENCH_FUTEX:
+            // 待っているスレッドがいないので即座に戻る
+            syscall(SYS_futex, &word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+            break;
+        case BENCH_EPOLL_WAIT:
+            epoll_wait(epfd, &event, 1, 0);
+            break;
+        case BENCH_READ_WRITE:
+            if (write(pipefd[1], &byte, 1) != 1 || read(pipefd[0], &byte, 1) != 1) {
+                return 0;
+            }
+            break;
+        case BENCH_CLOCK_GETTIME:
+            // vDSO を通らないように syscall で呼ぶ
+            syscall(SYS_clock_gettime, CLOCK_MONOTONIC, &ts);
+            break;
+        default:
+            break;
+        }
+    }
+    return (timing_now_ns() - start) / (uint64_t)iterations;
+}
+
+/**
+ * @brief fork した子でフィルタを読み込み (NULL なら無し)、各 syscall を計測する
+ * @return 0 on success, -1 on failure
+ */
+static int measure(const struct security_profile *profile, long iterations, struct bench_result *result) {
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork failed");
+        return -1;
+    }
+    if (pid == 0) {
+        int epfd = epoll_create1(EPOLL_CLOEXEC);
+        int pipefd[2];
+        if (epfd < 0 || pipe2(pipefd, O_CLOEXEC) != 0) {
+            perror("epoll_create1/pipe2 failed");
+            _exit(EXIT_FAILURE);
+        }
+        if (profile) {
+            // 非特権でも読み込めるように no_new_privs を立てる (コンテナ内では CAP_SYS_ADMIN がある)
+            if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) != 0
+                || syscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER, 0, &profile->prog) != 0) {
+                perror("seccomp(SECCOMP_SET_MODE_FILTER) failed");
+                _exit(EXIT_FAILURE);
+            }
+        }
+        for (int s = 0; s < BENCH_MAX; s++) {
+            result->ns[s] = run_syscall((enum bench_syscall)s, iterations, epfd, pipefd);
+        }
+        result->ok = 1;
+        _exit(EXIT_SUCCESS);
+    }
+    int status = 0;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0 || !result->ok) {
+        fprintf(stderr, "measurement child failed\n");
+        return -1;
+    }
+    return 0;
+}
+
+static void print_result(const char *name, const struct security_profile *profile,
+                         const struct bench_result *result, const struct bench_result *host, int last) {
+    printf("    \"%s\": {\"bpf_insns\": %u", name, profile ? profile->prog.len : 0);
+    for (int s = 0; s < BENCH_MAX; s++) {
+        printf(", \"%s_ns\": %lu, \"%s_overhead_ns\": %ld",
+               syscall_names[s], (unsigned long)result->ns[s],
+               syscall_names[s], (long)result->ns[s] - (long)host->ns[s]);
+    }
+    printf("}%s\n", last ? "" : ",");
+}
+
+int main(int argc, char **argv) {
+    long iterations = 1000000;
+    int opt = 0;
+
+    while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+        switch (opt) {
+        case 'n':
+            iterations = atol(optarg);
+            break;
+        case 's':
+            set_profile_cache_dir(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-n N] [-s CACHEDIR]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (iterations <= 0) {
+        fprintf(stderr, "Usage: %s [-n N] [-s CACHEDIR]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    struct security_profile deny, allow;
+    if (build_security_profile(PROFILE_DENYLIST, &deny) != 0
+        || build_security_profile(PROFILE_ALLOWLIST, &allow) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    struct bench_result *results = mmap(NULL, 3 * sizeof(*results), PROT_READ | PROT_WRITE,
+                                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (results == MAP_FAILED) {
+        perror("mmap failed");
+        return EXIT_FAILURE;
+    }
+    memset(results, 0, 3 * sizeof(*results));
+
+    if (measure(NULL, iterations, &results[0]) != 0
+        || measure(&deny, iterations, &results[1]) != 0
+        || measure(&allow, iterations, &results[2]) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    printf("{\n");
+    printf("  \"iterations\": %ld,\n", iterations);
+    printf("  \"profiles\": {\n");
+    print_result("host", NULL, &results[0], &results[0], 0);
+    print_result("deny", &deny, &results[1], &results[0], 0);
+    print_result("allow", &allow, &results[2], &results[0], 1);
+    printf("  }\n");
+    printf("}\n");
+
+    free(deny.prog.filter);
+    free(allow.prog.filter);
+    munmap(results, 3 * sizeof(*results));
+    return EXIT_SUCCESS;
+}
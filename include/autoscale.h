@@ -0,0 +1,55 @@
+#ifndef AUTOSCALE_H
+#define AUTOSCALE_H
+
+#include <stdint.h>
+#include "metrics.h"
+
+/*
+ * cpu.max の自動調整:
+ *  - cpu.pressure (some) か cpu.stat の throttled_usec が閾値を超えたら quota を 1.5 倍 (上限まで)
+ *  - 圧力も throttle も無く, 使用率が低い状態が続いたら quota を下げる (下限まで)
+ *  上げるのは 1 回で, 下げるのは連続したときだけにして振動させない
+ */
+
+struct autoscale_config {
+    uint64_t period_usec;     // cpu.max の period
+    uint64_t floor_usec;      // quota の下限 (period あたり)
+    uint64_t ceiling_usec;    // quota の上限
+};
+
+struct autoscale_state {
+    uint64_t quota_usec;      // 現在の cpu.max の quota
+    int      have_last;       // 前回サンプルがあるか
+    uint64_t last_ns;
+    uint64_t last_usage_usec;
+    uint64_t last_throttled_usec;
+    uint64_t last_nr_throttled;
+    uint64_t last_some_usec;
+    unsigned int calm;        // 下げてよい状態が続いた回数
+};
+
+enum autoscale_action {
+    AUTOSCALE_KEEP,
+    AUTOSCALE_UP,
+    AUTOSCALE_DOWN,
+};
+
+// "FLOOR:CEIL" (ミリ CPU, 例: 500:4000 で 0.5〜4 CPU) を解釈する
+int parse_autoscale(const char *arg, struct autoscale_config *config);
+
+// quota を上限から始める (使っていなければ下げていく)
+void autoscale_init(const struct autoscale_config *config, struct autoscale_state *state);
+
+// 新しいサンプルから quota を決める (state->quota_usec を更新して, どちらに動かしたかを返す)
+enum autoscale_action autoscale_decide(const struct autoscale_config *config,
+                                       struct autoscale_state *state,
+                                       const struct metrics_sample *sample);
+
+// cpu.max と cpu.max.burst (quota の半分) に書き込む
+int autoscale_apply(int cgroup_fd, const struct autoscale_config *config,
+                    const struct autoscale_state *state);
+
+// cpu.max/cpu.max.burst を既定値 (max, 0) に戻す (cgroup をプールに返す前に)
+void autoscale_reset(int cgroup_fd);
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+/**
+ * バッチモード:
+ *  マニフェストの各行 ("-u UID -m DIR [-l NAME=VALUE]... -c CMD [ARGS...]") を
+ *  jobs 個 (0 なら CPU 数) のワーカーで並列に起動する
+ *  結果は "<index> <status> <ms> <command>" と集計行 ("# ...") を stdout に出す
+ * 戻り値: 全部成功なら 0, 失敗を含むなら 1, バッチ自体の失敗は -1
+ */
+int run_batch(const char *manifest, long jobs);
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef BLKIO_H
+#define BLKIO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define IO_MAX_PATHS   4
+#define IO_MAX_DEVICES 8
+
+// コンテナのブロック I/O の QoS (-q で指定)
+//  "[latency=USEC][,rbps=N][,wbps=N][,riops=N][,wiops=N][,dev=PATH]..."
+//  対象のデバイスは rootfs (-m の各層) と dev= のパス (scratch 領域など) から自動で求める
+struct io_config {
+    int      enabled;
+    uint64_t latency_us;      // io.latency の target (0 なら設定しない)
+    uint64_t rbps, wbps;      // io.max (0 なら制限しない)
+    uint64_t riops, wiops;
+    char     paths[IO_MAX_PATHS][64];
+    size_t   npaths;
+    dev_t    devices[IO_MAX_DEVICES]; // resources() が求めたディスク (返却時の復元にも使う)
+    size_t   ndevices;
+};
+
+int parse_io_config(const char *spec, struct io_config *io);
+
+/**
+ * @brief path を置いているブロックデバイスを求める (パーティションなら親のディスク)
+ *        btrfs などの匿名デバイスは /proc/self/mountinfo のマウント元から引く
+ * @param sysfs_root NULL なら "/sys" (テスト用に差し替えられる)
+ * @return MAJ:MIN, 求められなければ 0 (tmpfs など)
+ */
+dev_t io_backing_device(const char *sysfs_root, const char *path);
+
+// mount_dir (":" 区切りの各層) と io->paths のデバイスを重複なく io->devices に入れる
+void io_resolve_devices(struct io_config *io, const char *mount_dir);
+
+// io.max / io.latency に書く 1 行 ("MAJ:MIN ...", restore なら制限を外す値). 書くものが無ければ 0
+int io_format_max(const struct io_config *io, dev_t dev, int restore, char *buf, size_t len);
+int io_format_latency(const struct io_config *io, dev_t dev, int restore, char *buf, size_t len);
+
+#endif
@@ -2,6 +2,12 @@
 #define CONTAINER_H
 
 #include <sys/types.h>
+#include "blkio.h"
+#include "hugepage.h"
+#include "idmap.h"
+#include "loopdev.h"
+#include "net.h"
+#include "timing.h"
 
 // 子プロセス用のコンフィグ
 struct child_config {
@@ -10,12 +16,42 @@ struct child_config {
     int     fd;
     char   *hostname;
     char  **argv;
-    char   *mount_dir;
+    char  **envp;                  // execve に渡す環境変数 (NULL 可)
+    char   *mount_dir;             // rootfs (overlay 時は lower 層を ":" 区切りで複数指定可, EROFS/squashfs のイメージファイルも可)
+    int     readonly_rootfs;       // rootfs を読み取り専用にする (open_tree, bind mount, overlay のどれでも)
+    int     rootfs_fd;             // open_tree() で複製した rootfs (spawn_container が設定, -1 なら bind mount)
+    int    *lower_fds;             // overlay の lower 層を idmapped mount したツリー (spawn_container が設定し clone 後に閉じる)
+    int     lower_count;
+    struct id_range ids;           // userns の uid/gid 範囲 (spawn_container が割り当て, free_resources が返す)
+    char    scratch_dir[32];       // bind/overlay/イメージの一時ディレクトリ (spawn_container が作り, free_resources が消す)
+    char   *overlay_size;          // overlayfs の upper/work を置く tmpfs の上限 (NULL なら mount_dir を bind mount)
+    struct net_config net;         // veth の設定 (net.enabled が 0 なら lo だけ)
+    struct hugepage_config hugepages; // hugetlb の上限/hugetlbfs のマウント (-H) と THP の方針 (-t)
+    struct io_config io;           // ブロック I/O の io.latency/io.max (-q)
+    char  **cgroup_limits;         // 追加/上書きする cgroup 設定 "name=value" (NULL 終端, NULL 可)
+    char    cgroup[128];           // /sys/fs/cgroup からの相対パス (resources() が設定)
+    int     cgroup_fd;             // /sys/fs/cgroup/<cgroup> (CLONE_INTO_CGROUP 用)
+    int     cgroup_pooled;         // cgroup プールのスロットを使っているか
+    int     cgroup_entered;        // clone() フォールバックでランチャーが cgroup に入ったか
+    int     pooled;                // プールモード: execve 直前で argv/envp を待つ
+    struct launch_timing *timing;  // フェーズ計測用 (NULL なら計測しない)
+    uint32_t trace_track;          // トレースの track (resources() が割り当てる, 無効時は 0)
+    int     exec_fd;               // execve 完了通知用 (O_CLOEXEC, 計測時のみ)
+    int     log_fd;                // 子の stdout/stderr にするパイプ (-1 なら親の stdio を継承)
 };
 
 // 関数プロトタイプ
 int drop_capabilities(void);
 int restrict_syscalls(void);
 int mounts(struct child_config *config);
+// ランチャー側: rootfs を open_tree() で複製し属性を付けたツリーの fd (使えなければ -1)
+int open_rootfs_tree(struct child_config *config);
+// ランチャー側: overlay の各 lower 層を open_tree() で複製して idmapped mount にし lower_fds に入れる (使えなければ -1)
+int open_overlay_lowers(struct child_config *config);
+void close_overlay_lowers(struct child_config *config);
+// ランチャー側: idmapped mount を使えないとき, rootfs (overlay なら各層) の所有者が ids の範囲内か確かめる (範囲外なら -1)
+int check_rootfs_owner(const struct child_config *config);
+// ランチャー側: イメージファイルをループデバイスにつなぎ fsmount() した読み取り専用のツリーの fd (-1 なら失敗)
+int open_rootfs_image(struct child_config *config, enum rootfs_image_type type);
 
 #endif
@@ -0,0 +1,33 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include "autoscale.h"
+#include "reclaim.h"
+
+struct daemon_config {
+    const char  *socket_path;
+    const char  *metrics_path;       // NULL ならメトリクスを集めない
+    unsigned int metrics_interval;   // 秒 (0 なら既定値)
+    const struct autoscale_config *autoscale;  // NULL なら cpu.max を調整しない
+    const struct reclaim_config *reclaim;      // NULL なら memory.high/memory.reclaim を使わない
+    int          placement;          // cpuset で L3/NUMA ノードに配置する
+};
+
+/**
+ * デーモンモード:
+ *  Unix ソケットで "RUN -u UID -m DIR [-l NAME=VALUE]... -c CMD [ARGS...]" / "PS" を受け付け、
+ *  多数のコンテナを 1 つの epoll ループ (pidfd, ハンドシェイク用ソケット, cgroup.events) で管理する
+ *  応答: "STARTED <id> <pid>", "EXITED <id> <status>", "ERROR ..."
+ *  "FREEZE <id> [RECLAIM_BYTES]" / "THAW <id>" は cgroup.freeze で止める/再開する
+ *  (完了すると "FROZEN <id> <usec> <reclaimed>" / "THAWED <id> <usec>")
+ *  metrics_path を渡すと cgroup メトリクスを metrics_interval 秒ごとに集め、
+ *  Prometheus テキスト形式で書き出す ("-" なら "METRICS" コマンドで返すだけ)
+ *  autoscale を渡すと、そのサンプルから各コンテナの cpu.max を調整する (メトリクスも有効になる)
+ *  reclaim を渡すと、memory.pressure が低い間は冷えたページを memory.reclaim で押し出し
+ *  memory.high を下げていく ("RECLAIM" コマンドで memory.high, 回収量, refault の速さを返す)
+ *  placement を有効にすると、各コンテナを cpuset.cpus/cpuset.mems で空いている L3 ドメイン/ノードに置き、
+ *  終了のたびに偏りを直す ("PLACEMENT" コマンドで配置を返す)
+ */
+int run_daemon(const struct daemon_config *config);
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef HUGEPAGE_H
+#define HUGEPAGE_H
+
+#include <stdint.h>
+
+// THP (transparent huge pages) の方針 (-t で指定, prctl(PR_SET_THP_DISABLE) で子に設定する)
+enum thp_policy {
+    THP_POLICY_SYSTEM,    // ホストの設定に従う
+    THP_POLICY_NEVER,     // 使わない
+    THP_POLICY_MADVISE,   // madvise(MADV_HUGEPAGE) した範囲だけ (6.18 以降)
+};
+
+// コンテナの huge page 設定 (-H で指定)
+//  "SIZE[,max=BYTES][,mount=PATH]" (SIZE: 2MB, 1GB など)
+struct hugepage_config {
+    int      enabled;
+    char     size[16];        // hugetlb.<size>.max のファイル名に使う表記 (例: "2MB")
+    uint64_t page_size;       // bytes
+    uint64_t max;             // hugetlb.<size>.max と .rsvd.max (0 なら制限しない)
+    char     mount[64];       // rootfs 内の hugetlbfs のマウント先 (空ならマウントしない)
+    enum thp_policy thp;
+};
+
+int parse_hugepage_config(const char *spec, struct hugepage_config *config);
+int parse_thp_policy(const char *name, enum thp_policy *policy);
+
+// 子プロセス側 (pivot_root 後, userns に入る前): rootfs 内に hugetlbfs をマウントする
+int mount_hugetlbfs(const struct hugepage_config *config);
+
+// 子プロセス側: THP の方針を設定する (execve 後も引き継がれる)
+int set_thp_policy(enum thp_policy policy);
+
+#endif
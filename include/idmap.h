@@ -0,0 +1,42 @@
+#ifndef IDMAP_H
+#define IDMAP_H
+
+#include <sys/types.h>
+
+// コンテナに割り当てるホスト側の uid/gid 範囲 (-U FIRST:SIZE[:COUNT])
+//  FIRST から SIZE ずつ COUNT 個の範囲を用意し, 起動のたびに空いている 1 つを使う
+#define ID_RANGE_DEFAULT_FIRST 10000
+#define ID_RANGE_DEFAULT_SIZE  2000
+#define ID_RANGE_DEFAULT_COUNT 32
+#define ID_RANGE_MAX_COUNT     256
+
+// 使用中の範囲は <dir>/<FIRST> の flock で排他する (複数のランチャーで共有できる)
+#define ID_RANGE_LOCK_DIR "/run/mycontainer-ids"
+
+struct id_range {
+    uid_t start;        // コンテナ内の 0 に対応するホスト側の uid/gid
+    uid_t size;
+    int   lock_fd;      // 割り当て中は flock したまま持つ (-1 なら未割り当て)
+};
+
+int parse_id_ranges(const char *spec);
+
+/**
+ * @brief 空いている範囲を 1 つ取る (spawn_container が呼び, free_resources が返す)
+ *        COUNT 個すべて使用中なら失敗する (範囲を共有するとコンテナどうしで uid/gid が重なる)
+ * @return 0 on success, -1 if no range is free or the lock directory cannot be created
+ */
+int id_range_acquire(struct id_range *range);
+void id_range_release(struct id_range *range);
+
+// /proc/<pid>/uid_map, gid_map に "0 start size" を書く
+int id_range_write_maps(pid_t pid, const struct id_range *range);
+
+/**
+ * @brief ホストの owner_uid/owner_gid を range の先頭 (コンテナ内の 0) に写す user namespace の fd (idmapped mount 用)
+ *        範囲ごとに作ってランチャー内で使い回す (所有者が前回と違えば作り直す. プロセスは残らない)
+ * @return fd (閉じないこと), 作れなければ -1
+ */
+int id_range_userns_fd(const struct id_range *range, uid_t owner_uid, gid_t owner_gid);
+
+#endif
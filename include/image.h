@@ -0,0 +1,23 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * ローカルのレイヤーストア (STORE 以下):
+ *  - objects/xx/<sha256>  内容と属性 (mode/uid/gid) で重複を除いたファイル
+ *  - layers/<sha256>/     展開済みレイヤー (ファイルは objects へのハードリンク)
+ *  - tmp/                 展開中の一時ファイル
+ */
+
+// tar (gzip/zstd 圧縮も可) を 1 パスで展開し, layers/<sha256> のパスを layer_dir に返す
+int image_unpack_layer(const char *store, const char *archive, char *layer_dir, size_t len);
+
+// レイヤーを順に (下から) 展開し, -m に渡せる rootfs ("上:...:下") を stdout に出す
+int run_unpack(const char *store, char **archives, int count);
+
+// path がストアの layers/<sha256> か (ファイルがオブジェクトとリンクを共有しているので書き込ませてはいけない)
+bool image_store_layer(const char *path);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef LAUNCH_H
+#define LAUNCH_H
+
+#include <sys/types.h>
+#include "container.h"
+
+#define LAUNCH_MAX_ARGS   256
+#define LAUNCH_MAX_LIMITS 32
+
+// parse_launch_line() が config に設定するポインタの格納先
+struct launch_args {
+    char *argv[LAUNCH_MAX_ARGS + 1];
+    char *limits[LAUNCH_MAX_LIMITS + 1];
+};
+
+// "-u UID -m DIR [-l NAME=VALUE]... -c CMD [ARGS...]" を config に展開する
+// line は書き換えられ, config/args はその中を指す. 成功時 0
+int parse_launch_line(char *line, struct child_config *config, struct launch_args *args);
+
+// clone3(CLONE_INTO_CGROUP | CLONE_PIDFD) で子を起動する (resources() 済みであること)
+// 使えない環境では clone() にフォールバックし、*pidfd は -1 になる
+pid_t spawn_container(struct child_config *config, int *pidfd);
+
+// resources() → clone() → uid_map → waitpid() → free_resources() の一連の起動処理
+// 戻り値: コンテナの終了ステータス, 起動自体に失敗したら -1
+int launch_container(struct child_config *config);
+
+#endif
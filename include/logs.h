@@ -0,0 +1,75 @@
+#ifndef LOGS_H
+#define LOGS_H
+
+#include <stdint.h>
+#include <limits.h>
+
+/*
+ * コンテナの stdout/stderr の転送:
+ *  - 子の 1/2 をパイプ (書き込み側) にし、親が読み出し側から splice() でログファイルへ移す
+ *    (データはユーザー空間にコピーされない)
+ *  - ファイルはサイズで切り替える (NAME.log → NAME.log.1 → ... → NAME.log.KEEP)
+ *  - コンテナごとのレート (トークンバケット) を超えたら、方針に従って止める/捨てる
+ */
+
+enum log_policy {
+    LOG_POLICY_BLOCK,   // 読むのを止める (パイプが埋まるとコンテナの write が待たされる)
+    LOG_POLICY_DROP,    // /dev/null に splice して捨てる (コンテナは止まらない)
+};
+
+struct log_config {
+    char     dir[PATH_MAX];
+    uint64_t max_size;        // 1 ファイルの上限 (bytes)
+    unsigned int keep;        // 残す世代数
+    uint64_t rate;            // bytes/s (0 なら無制限)
+    enum log_policy policy;
+};
+
+// "DIR[,size=BYTES][,keep=N][,rate=BYTES][,policy=block|drop]" を解釈する
+int parse_log_config(const char *spec, struct log_config *config);
+
+// -L で有効にする (NULL なら親の stdio をそのまま継承する)
+void set_log_config(const struct log_config *config);
+const struct log_config *log_config(void);
+
+enum log_pump_result {
+    LOG_PUMP_IDLE,        // パイプが空になった
+    LOG_PUMP_MORE,        // 1 回分の上限まで移した (まだ残っている)
+    LOG_PUMP_THROTTLED,   // block 方針でレートを超えた (log_resume_ns まで読まない)
+    LOG_PUMP_EOF,         // 書き込み側がすべて閉じた
+    LOG_PUMP_ERROR,
+};
+
+struct log_sink {
+    const struct log_config *config;   // NULL なら未使用
+    int      pipe_r;
+    int      pipe_w;                   // 子に渡す側 (spawn 後に log_close_writer で閉じる)
+    int      file_fd;
+    char     path[PATH_MAX];
+    uint64_t size;                     // 現在のファイルの大きさ
+    uint64_t tokens;
+    uint64_t last_ns;
+    uint64_t dropped;                  // まだ記録していない破棄量
+    uint64_t dropped_total;
+    int      throttled;
+};
+
+/**
+ * @brief パイプとログファイル (DIR/NAME.log) を用意する
+ * @return 0 on success, -1 on failure
+ */
+int log_open(struct log_sink *sink, const struct log_config *config, const char *name);
+void log_close_writer(struct log_sink *sink);
+
+// 読めるだけ (1 回あたり上限付き) ファイルへ移す
+enum log_pump_result log_pump(struct log_sink *sink, uint64_t now_ns);
+// block 方針で止めたとき、次に読んでよい時刻
+uint64_t log_resume_ns(const struct log_sink *sink);
+
+// 残りを (レートに関係なく) 書き出してから閉じる
+void log_close(struct log_sink *sink);
+
+// 単発の起動用: 書き込み側がすべて閉じるまで転送し続ける
+int log_forward_until_eof(struct log_sink *sink);
+
+#endif
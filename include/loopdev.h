@@ -0,0 +1,32 @@
+#ifndef LOOPDEV_H
+#define LOOPDEV_H
+
+#include <stddef.h>
+
+// -m に指定できる圧縮済みの読み取り専用イメージ (ディレクトリなら NONE)
+enum rootfs_image_type {
+    ROOTFS_IMAGE_NONE,
+    ROOTFS_IMAGE_EROFS,
+    ROOTFS_IMAGE_SQUASHFS,
+};
+
+// LOOP_CONFIGURE で固定するブロックサイズ (direct I/O のアラインメント. mkfs.erofs/mksquashfs の既定と同じ)
+#define LOOP_BLOCK_SIZE 4096
+
+// 通常ファイルの先頭の magic で種類を判定する (読めない/知らない形式は NONE)
+enum rootfs_image_type rootfs_image_type(const char *path);
+
+// fsopen() に渡すファイルシステム名
+const char *rootfs_image_fstype(enum rootfs_image_type type);
+
+/**
+ * @brief image を読み取り専用 (direct I/O, LOOP_BLOCK_SIZE, AUTOCLEAR) のループデバイスにつなぐ
+ *        同じ image につながっているループデバイスがあればそれを使う (superblock と page cache も共有される)
+ * @param dev_path /dev/loopN を返す (マウントの source に使う)
+ * @param reused 既存のループデバイスを使ったら 1
+ * @return ループデバイスの fd (マウントし終わるまで閉じないこと: 開いている間は AUTOCLEAR で外れない),
+ *         -1 on failure
+ */
+int loop_attach(const char *image, char *dev_path, size_t len, int *reused);
+
+#endif
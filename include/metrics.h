@@ -0,0 +1,113 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+// 1 コンテナ分のサンプルで読む cgroup ファイル (開いたまま pread で読み直す)
+enum metrics_file {
+    METRICS_MEMORY_CURRENT,
+    METRICS_MEMORY_STAT,
+    METRICS_MEMORY_EVENTS,     // EPOLLPRI で oom/oom_kill を通知
+    METRICS_CPU_STAT,
+    METRICS_IO_STAT,
+    METRICS_PIDS_CURRENT,
+    METRICS_CPU_PRESSURE,      // PSI トリガーを登録して EPOLLPRI で通知
+    METRICS_MEMORY_PRESSURE,
+    METRICS_IO_PRESSURE,
+    METRICS_FILE_MAX
+};
+
+enum psi_resource { PSI_CPU, PSI_MEMORY, PSI_IO, PSI_MAX };
+
+struct psi_sample {
+    uint64_t some_total_usec;
+    uint64_t full_total_usec;
+    uint32_t some_avg10;       // x100 (例: 1.25% => 125)
+    uint32_t full_avg10;
+};
+
+struct metrics_sample {
+    uint64_t timestamp_ns;
+    unsigned long id;
+    uint64_t memory_current;
+    uint64_t memory_anon;
+    uint64_t memory_file;
+    uint64_t memory_active_anon;
+    uint64_t memory_inactive_anon;
+    uint64_t memory_active_file;
+    uint64_t memory_inactive_file;
+    uint64_t memory_refault;       // workingset_refault_anon + workingset_refault_file (pages)
+    uint64_t memory_high_events;
+    uint64_t memory_max_events;
+    uint64_t memory_oom;
+    uint64_t memory_oom_kill;
+    uint64_t cpu_usage_usec;
+    uint64_t cpu_user_usec;
+    uint64_t cpu_system_usec;
+    uint64_t cpu_nr_throttled;
+    uint64_t cpu_throttled_usec;
+    uint64_t io_rbytes;
+    uint64_t io_wbytes;
+    uint64_t io_rios;
+    uint64_t io_wios;
+    uint64_t pids_current;
+    struct psi_sample psi[PSI_MAX];
+};
+
+// 事前に確保する単一書き込み・複数読み出しのリングバッファ
+// 各スロットはシーケンス番号 (奇数: 書き込み中) で守り、読み手はロックを取らない
+struct metrics_slot {
+    atomic_uint_fast64_t seq;
+    struct metrics_sample sample;
+};
+
+struct metrics_ring {
+    size_t capacity;              // 2 のべき乗
+    atomic_uint_fast64_t head;    // 次に書く位置 (単調増加)
+    struct metrics_slot slots[];
+};
+
+struct metrics_ring *metrics_ring_create(size_t capacity);
+void metrics_ring_destroy(struct metrics_ring *ring);
+// 書き込み (書き手は 1 つだけ). 書いた位置を返す
+uint64_t metrics_ring_push(struct metrics_ring *ring, const struct metrics_sample *sample);
+// 位置 pos のサンプルを読む (上書き済み/書き込み中なら -1)
+int metrics_ring_read(const struct metrics_ring *ring, uint64_t pos, struct metrics_sample *out);
+
+// 監視対象のコンテナ (daemon の container に埋め込む)
+struct metrics_target {
+    unsigned long id;
+    const char *name;
+    int      fds[METRICS_FILE_MAX];   // 開けなかったものは -1
+    unsigned int notify_mask;         // EPOLLPRI で監視すべき fds の添字 (1 << enum metrics_file)
+    uint64_t last_pos;                // 最新サンプルのリング位置 + 1 (0: まだ無い)
+    struct metrics_target *prev;
+    struct metrics_target *next;
+};
+
+struct metrics;
+
+// export_path: Prometheus テキスト形式の出力先 (NULL なら METRICS コマンドのみ)
+struct metrics *metrics_create(const char *export_path, unsigned int interval_sec);
+void metrics_destroy(struct metrics *m);
+
+// 定期サンプル用の timerfd (epoll に EPOLLIN で登録する)
+int metrics_timer_fd(const struct metrics *m);
+// timerfd が鳴ったら: 全コンテナをサンプルし, export_path に書き出す
+void metrics_tick(struct metrics *m);
+
+// cgroup_fd から各ファイルを開き, PSI トリガーを登録する
+void metrics_target_open(struct metrics *m, struct metrics_target *t, int cgroup_fd,
+                         unsigned long id, const char *name);
+void metrics_target_close(struct metrics *m, struct metrics_target *t);
+// 1 コンテナ分をサンプルしてリングに入れる (PSI/memory.events の通知時にも呼ぶ)
+int metrics_sample(struct metrics *m, struct metrics_target *t);
+// 最新サンプルを読む (まだ無い/上書き済みなら -1)
+int metrics_latest(const struct metrics *m, const struct metrics_target *t, struct metrics_sample *out);
+
+// 各コンテナの最新サンプルを Prometheus テキスト形式で返す (呼び出し側で free)
+char *metrics_render(struct metrics *m, size_t *len);
+
+#endif
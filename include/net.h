@@ -0,0 +1,32 @@
+#ifndef NET_H
+#define NET_H
+
+#include <sys/types.h>
+#include <net/if.h>
+#include <netinet/in.h>
+
+// コンテナのネットワーク設定 (-n で指定)
+//  "ADDR/PREFIX[,gw=GW][,bridge=BR][,mtu=N][,queues=N][,gro=on|off]"
+struct net_config {
+    int      enabled;
+    struct in_addr addr;
+    unsigned int   prefix;
+    struct in_addr gateway;
+    int      has_gateway;
+    char     bridge[IFNAMSIZ];  // 空ならブリッジに繋がず, ホスト側に経路を張る
+    unsigned int mtu;           // 0 ならカーネルの既定値
+    unsigned int queues;        // TX/RX キューの数 (0 なら既定値)
+    int      gro;               // -1: 既定値, 0: off, 1: on
+};
+
+int parse_net_config(const char *spec, struct net_config *net);
+
+/**
+ * @brief 親側: veth ペアを作り, 片方 (eth0) を子の netns に入れてアドレスと経路を設定する
+ *        ハンドシェイク中 (子が親の応答を待っている間) に呼ぶ
+ *        ホスト側の veth は子の netns が消えると一緒に消える
+ * @return 0 on success, -1 on failure (errno に原因を残す)
+ */
+int setup_container_net(pid_t child_pid, const struct net_config *net);
+
+#endif
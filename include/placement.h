@@ -0,0 +1,61 @@
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * cpuset によるコンテナの配置:
+ *  - sysfs から CPU ごとの最終レベルキャッシュ (通常 L3) の共有範囲と NUMA ノードを読み、
+ *    キャッシュを共有する CPU の集まりを 1 つのドメインとする
+ *  - コンテナの幅 (CPU 数) がドメインに収まれば最も空いているドメイン 1 つ、
+ *    収まらなければ最も空いているノード全体、それでも収まらなければ全 CPU に置く
+ *  - cpuset.mems は置いた CPU のノードだけにする (リモートメモリへのアクセスを避ける)
+ *  - コンテナが去ったら、混んだドメインから空いたドメインへ移し直す
+ */
+
+#define PLACEMENT_MAX_CPUS    1024
+#define PLACEMENT_MAX_DOMAINS 64
+#define PLACEMENT_MAX_NODES   64
+
+// 配置したコンテナ (daemon の container に埋め込む)
+struct placement_slot {
+    unsigned long id;
+    unsigned int width;       // 要求する CPU 数
+    uint64_t domains;         // 置いたドメイン (bit i: ドメイン i, 0 なら未配置)
+    int      cgroup_fd;       // cpuset.* を書く cgroup (-1 なら書かない)
+    struct placement_slot *prev;
+    struct placement_slot *next;
+};
+
+struct placement;
+
+// sysfs_root: 通常は NULL (/sys/devices/system)
+struct placement *placement_create(const char *sysfs_root);
+void placement_destroy(struct placement *p);
+
+// cpu.max の値 ("QUOTA PERIOD" / "max") から幅を決める (max や NULL は 1)
+unsigned int placement_width(const char *cpu_max);
+
+/**
+ * @brief 最も空いている場所に置いて cpuset.cpus/cpuset.mems を書く
+ * @return 0 on success, -1 on failure (未配置のまま)
+ */
+int placement_assign(struct placement *p, struct placement_slot *slot, unsigned long id,
+                     unsigned int width, int cgroup_fd);
+void placement_release(struct placement *p, struct placement_slot *slot);
+
+// 偏りを直す (ドメイン 1 つに置いたものだけを動かす). 動かした数を返す
+unsigned int placement_rebalance(struct placement *p);
+
+// 置いた CPU/ノードを "0-3,8-11" の形式で書く
+void placement_cpus(const struct placement *p, const struct placement_slot *slot, char *buf, size_t len);
+void placement_mems(const struct placement *p, const struct placement_slot *slot, char *buf, size_t len);
+
+// cpuset.cpus/cpuset.mems を空 (親と同じ) に戻す (cgroup をプールに返す前に)
+void placement_reset(int cgroup_fd);
+
+// ドメインごとの負荷とコンテナごとの配置 (呼び出し側で free)
+char *placement_render(struct placement *p, size_t *len);
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "container.h"
+
+// 起動リクエスト (argv/envp) の最大サイズ
+#define POOL_REQUEST_MAX 65536
+
+/**
+ * プールモード:
+ *  execve 直前で待機する子プロセスを low〜high 個保持し、
+ *  stdin から 1 行 1 リクエスト ("[NAME=VALUE ...] /path/to/cmd [args...]") を受けて実行する
+ *  終了したコンテナは "<pid> <status>" として stdout に出力する
+ */
+int run_pool(struct child_config *config, size_t low, size_t high);
+
+// argv/envp を config.fd 経由で送るためのエンコード/デコード
+ssize_t pool_encode_request(char *buf, size_t len, char *const argv[], char *const envp[]);
+int pool_decode_request(char *buf, size_t len, char ***argv, char ***envp);
+
+#endif
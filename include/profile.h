@@ -0,0 +1,37 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include <linux/filter.h>
+
+// seccomp フィルタの種類
+enum profile_kind {
+    PROFILE_DENYLIST,   // デフォルト許可 + 危険な syscall だけ拒否 (既定)
+    PROFILE_ALLOWLIST,  // デフォルト拒否 + よく使う syscall だけ許可 (二分木で生成)
+};
+
+// コンパイル済みのセキュリティプロファイル (ランチャーで 1 回だけ作る)
+struct security_profile {
+    uint64_t hash;           // プロファイル定義 + アーキテクチャ + libseccomp のハッシュ
+    uint32_t arch;           // AUDIT_ARCH_*
+    uint64_t cap_drop_mask;  // bounding/inheritable から落とす capability
+    struct sock_fprog prog;  // seccomp(SECCOMP_SET_MODE_FILTER) にそのまま渡す BPF
+};
+
+// コンパイル結果を保存するディレクトリ (NULL ならキャッシュしない)
+void set_profile_cache_dir(const char *dir);
+
+// フィルタの種類 ("deny" / "allow")
+int parse_profile_kind(const char *name, enum profile_kind *kind);
+void set_profile_kind(enum profile_kind kind);
+
+// 指定した種類のプロファイルを作る (キャッシュがあれば読むだけ)
+int build_security_profile(enum profile_kind kind, struct security_profile *profile);
+
+// set_profile_kind() の種類でプロセス内に 1 つだけプロファイルを用意する (キャッシュがあれば読むだけ, なければコンパイルして保存)
+int prepare_security_profile(void);
+
+// 用意済みのプロファイル (未準備なら NULL)
+const struct security_profile *security_profile(void);
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef RECLAIM_H
+#define RECLAIM_H
+
+#include <stdint.h>
+#include "metrics.h"
+
+/*
+ * memory.high/memory.reclaim による先回りの回収:
+ *  - memory.pressure (some) が閾値未満の状態が続いたら, 冷えたページ (inactive の file/anon) の
+ *    一部を memory.reclaim で押し出し, memory.high を回収後の使用量 + 余裕まで下げる
+ *  - 圧力が閾値を超えるか, 押し出した分がすぐ refault してきたら memory.high を緩める (memory.max まで)
+ *  押し出すのは落ち着いた状態が続いたときだけ, 緩めるのは 1 回で行う
+ *  memory.reclaim は書いた量を回収し終えるまで戻らないので, 押し出しは reclaim_step で小分けに進める
+ *  memory.high は使用量より下には書かない (書き込んだ側で同期的に回収が走るため)
+ */
+
+struct reclaim_config {
+    uint32_t pressure_permyriad;  // memory の some の閾値 (経過時間の 1/10000, 例: 0.5% => 50)
+    uint32_t step_percent;        // 1 回に押し出す冷えたページの割合
+};
+
+struct reclaim_state {
+    uint64_t limit;               // memory.max (0 なら無制限)
+    uint64_t high;                // 現在の memory.high (0 なら max)
+    uint64_t request;             // reclaim_decide が決めた押し出す量
+    uint64_t pending;             // request のうち, まだ memory.reclaim に書いていない量
+    uint64_t progress;            // request のうち, これまでに押し出せた量
+    int      have_last;           // 前回サンプルがあるか
+    uint64_t last_ns;
+    uint64_t last_some_usec;
+    uint64_t last_refault;
+    unsigned int calm;            // 押し出してよい状態が続いた回数
+    uint64_t last_reclaimed;      // 直前に押し出せた量 (refault と比べる)
+    uint64_t reclaimed_total;
+    uint64_t refault_per_sec;     // 直近の refault (pages/sec)
+};
+
+enum reclaim_action {
+    RECLAIM_KEEP,
+    RECLAIM_SHRINK,               // memory.reclaim に request を書き, memory.high を下げる
+    RECLAIM_RELAX,                // memory.high を上げる
+};
+
+// "PRESSURE[:STEP]" (PRESSURE は %, 小数可. STEP は % で既定 10) を解釈する
+int parse_reclaim(const char *arg, struct reclaim_config *config);
+
+// cgroup の memory.max を読み, memory.high は max から始める
+void reclaim_init(int cgroup_fd, struct reclaim_state *state);
+
+// 新しいサンプルから次の動作を決める (state->high/request を更新する)
+enum reclaim_action reclaim_decide(const struct reclaim_config *config,
+                                   struct reclaim_state *state,
+                                   const struct metrics_sample *sample);
+
+// decide の結果を適用する: RELAX は memory.high をすぐ書き, SHRINK は pending に積む (reclaim_step で進める)
+int reclaim_apply(int cgroup_fd, struct reclaim_state *state, enum reclaim_action action);
+
+/**
+ * @brief pending から chunk まで memory.reclaim に書く. 押し出し終えたら (押し出しきれなくなったときも)
+ *        押し出せた量を state に足し, memory.high を書く
+ * @return 1 if more is pending, 0 when finished, -1 on failure (pending は捨てる)
+ */
+int reclaim_step(int cgroup_fd, struct reclaim_state *state, uint64_t chunk);
+
+// memory.high を max に戻す (cgroup をプールに返す前に)
+void reclaim_reset(int cgroup_fd);
+
+#endif
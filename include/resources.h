@@ -1,12 +1,51 @@
 #ifndef RESOURCES_H
 #define RESOURCES_H
 
+#include <stddef.h>
+#include <stdint.h>
 #include "container.h"
 
-// cgroupsとrlimitの設定
+// /sys/fs/cgroup を開いてコントローラを有効化する (プロセス内で 1 回だけ実際に行う)
+int setup_cgroup_root(void);
+
+// cgroup プールの大きさ (0 ならコンテナごとに mkdir/rmdir する)
+void set_cgroup_pool(size_t size);
+
+// cpuset コントローラも有効にする (setup_cgroup_root() より前に呼ぶ)
+void set_cgroup_cpuset(int enabled);
+
+// cgroup.events の populated (1: プロセスが残っている, 0: 空, -1: 読めない)
+int cgroup_populated(int cgroup_fd);
+
+// cgroup.kill に書いて cgroup 内のプロセスを 1 回で止める (無いカーネルでは cgroup.procs に SIGKILL)
+int cgroup_kill(int cgroup_fd);
+
+// cgroup.freeze に書く (完了は cgroup.events の frozen で分かる)
+int cgroup_freeze(int cgroup_fd, int frozen);
+
+// memory.current (読めなければ -1)
+int64_t cgroup_memory_current(int cgroup_fd);
+
+// memory.reclaim に bytes を書いて押し出させる (回収し終えるまで戻らないので, 大きな量は小分けにする)
+// 戻り値: memory.current の減少量 (要求量に届かなくても成功扱い), 失敗時 -1
+int64_t cgroup_reclaim(int cgroup_fd, uint64_t bytes);
+
+// -l の "NAME=VALUE" か, NAME が "<controller>.<knob>" の形か ("/" や "." / ".." を含まないか)
+int cgroup_limit_valid(const char *limit);
+
+// cgroupsの設定
 int resources(struct child_config *config);
 
-// 終了時に cgroup を片付ける
+// 終了時に cgroup を片付ける (残ったプロセスを止め, 削除は片付け用のプロセスに任せてすぐ戻る)
 int free_resources(struct child_config *config);
 
+// clone() フォールバック用: ランチャー自身を cgroup に入れる
+int enter_cgroup(struct child_config *config);
+
+// ランチャー自身を root cgroup に戻す (clone 後, cgroup は残す)
+int leave_cgroup(void);
+
+// rlimit の設定 (子プロセス側で呼ぶ)
+int set_rlimits(void);
+
 #endif
@@ -0,0 +1,25 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_DIGEST_SIZE 32
+#define SHA256_HEX_SIZE    (SHA256_DIGEST_SIZE * 2 + 1)
+
+// ストリーム入力用の SHA-256 (FIPS 180-4)
+struct sha256_ctx {
+    uint32_t state[8];
+    uint64_t length;        // これまでの入力バイト数
+    uint8_t  block[64];
+    size_t   used;          // block に溜まっているバイト数
+};
+
+void sha256_init(struct sha256_ctx *ctx);
+void sha256_update(struct sha256_ctx *ctx, const void *data, size_t len);
+void sha256_final(struct sha256_ctx *ctx, uint8_t digest[SHA256_DIGEST_SIZE]);
+
+// 16 進文字列 (小文字, NUL 終端)
+void sha256_hex(const uint8_t digest[SHA256_DIGEST_SIZE], char hex[SHA256_HEX_SIZE]);
+
+#endif
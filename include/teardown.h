@@ -0,0 +1,33 @@
+#ifndef TEARDOWN_H
+#define TEARDOWN_H
+
+/*
+ * コンテナの後片付けを起動/終了の経路から外す:
+ *  - free_resources() は cgroup.kill で残ったプロセスを止めたら, cgroup と一時ディレクトリの
+ *    削除を片付け用のプロセスに渡してすぐ戻る (終了ステータスも次の起動も待たせない)
+ *  - 片付け用のプロセスは cgroup.events を poll し, populated 0 になってから rmdir する
+ *  - 片付け用のプロセスを作れなければ, その場で待って削除する
+ */
+
+#define TEARDOWN_SYNC_TIMEOUT_MS  5000   // その場で待つときの上限
+#define TEARDOWN_RETRY_MS         1000   // 通知が来なくても populated を読み直す間隔
+#define TEARDOWN_DRAIN_MS         10000  // ランチャーの終了後, 残りを片付ける上限
+#define TEARDOWN_MAX_PENDING      256    // 同時に待つ cgroup の数 (超えたらその場で待つ)
+
+/**
+ * @brief cgroup.events の populated が 0 になるまで poll で待つ
+ * @param cgroup_dir cgroup のディレクトリ (絶対パス)
+ * @return 0 when empty (cgroup.events が無いときも), -1 on timeout
+ */
+int teardown_wait_empty(const char *cgroup_dir, int timeout_ms);
+
+/**
+ * @brief 空になったら消す cgroup と一時ディレクトリを渡す (どちらも NULL 可)
+ * @return 0 on success (片付け用プロセスに渡したか, その場で削除した), -1 on failure
+ */
+int teardown_submit(const char *cgroup_dir, const char *scratch_dir);
+
+// 渡した片付けがすべて終わるまで待ち, 片付け用プロセスを終わらせる
+void teardown_finish(void);
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdint.h>
+#include <time.h>
+
+// 起動処理のフェーズ (bench_app で個別に計測する)
+enum launch_phase {
+    PHASE_RESOURCES,
+    PHASE_CLONE,
+    PHASE_USERNS,
+    PHASE_MOUNTS,
+    PHASE_CAPS,
+    PHASE_SECCOMP,
+    PHASE_EXECVE,
+    PHASE_WAITPID,
+    PHASE_FREE,
+    PHASE_MAX
+};
+
+// 各フェーズの開始/終了時刻 (CLOCK_MONOTONIC, ns)
+// 子プロセスも書き込むので MAP_SHARED な領域に置くこと
+struct launch_timing {
+    uint64_t begin[PHASE_MAX];
+    uint64_t end[PHASE_MAX];
+};
+
+static inline uint64_t timing_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// timing が NULL のとき (通常の container_app) は何もしない
+static inline void timing_begin(struct launch_timing *timing, enum launch_phase phase) {
+    if (timing) {
+        timing->begin[phase] = timing_now_ns();
+    }
+}
+
+static inline void timing_end(struct launch_timing *timing, enum launch_phase phase) {
+    if (timing) {
+        timing->end[phase] = timing_now_ns();
+    }
+}
+
+#endif
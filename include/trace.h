@@ -0,0 +1,89 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+/*
+ * 起動処理のトレース:
+ *  - イベントは事前確保した MAP_SHARED なリングに記録する (親・子・バッチのワーカーで共有)
+ *  - 無効時 (既定) は trace_ring が NULL で、記録は何もしない
+ *  - 終了時に Chrome trace 形式 (chrome://tracing, Perfetto) の JSON に書き出す
+ *  各コンテナは 1 つの track (JSON の pid) を持ち、ランチャー側と子側を別スレッドとして表示する
+ */
+
+enum trace_event {
+    TRACE_CGROUPS,    // resources()
+    TRACE_LOOP_REUSE, // 親: 同じイメージにつながったループデバイスを使った (瞬間イベント)
+    TRACE_CLONE,      // spawn_container()
+    TRACE_UID_MAP,    // 親: uid_map/gid_map の書き込み
+    TRACE_NET,        // 親: veth の設定
+    TRACE_RLIMITS,
+    TRACE_MOUNTS,
+    TRACE_USERNS,     // 子: unshare(CLONE_NEWUSER) と親の応答待ち
+    TRACE_SETUID,
+    TRACE_CAPS,
+    TRACE_SECCOMP,
+    TRACE_EXECVE,     // 子: execve 直前 (瞬間イベント)
+    TRACE_WAIT,       // 親: 子の終了待ち
+    TRACE_CLEANUP,    // free_resources()
+    TRACE_EVENT_MAX
+};
+
+enum trace_side { TRACE_LAUNCHER, TRACE_CHILD };
+
+struct trace_record {
+    uint64_t ts_ns;
+    atomic_uint seq;        // 書き込み完了時に (位置 + 1) の下位 32 bit
+    uint32_t track;
+    uint16_t event;
+    uint8_t  phase;         // 'B', 'E', 'i'
+    uint8_t  side;
+};
+
+struct trace_ring {
+    size_t   capacity;                  // 2 のべき乗 (一周したら古いものから上書き)
+    uint64_t start_ns;
+    atomic_uint_fast64_t head;
+    atomic_uint next_track;
+    struct trace_record records[];
+};
+
+extern struct trace_ring *trace_ring;
+
+/**
+ * @brief トレースを有効にし、プロセス終了時に dump_path へ書き出す (NULL なら記録だけ)
+ *        fork/clone より前に呼ぶこと (子はリングを共有する)
+ * @return 0 on success, -1 on failure
+ */
+int trace_start(const char *dump_path);
+
+// 新しいコンテナ用の track を割り当てて、このプロセスの現在の track にする
+uint32_t trace_new_track(void);
+// 以降の記録をどの track/側に付けるか (デーモンは複数のコンテナを切り替える)
+void trace_attach(uint32_t track, enum trace_side side);
+
+void trace_record(enum trace_event event, char phase);
+
+// Chrome trace 形式の JSON を書き出す
+int trace_dump(const char *path);
+
+static inline void trace_begin(enum trace_event event) {
+    if (trace_ring) {
+        trace_record(event, 'B');
+    }
+}
+
+static inline void trace_end(enum trace_event event) {
+    if (trace_ring) {
+        trace_record(event, 'E');
+    }
+}
+
+static inline void trace_instant(enum trace_event event) {
+    if (trace_ring) {
+        trace_record(event, 'i');
+    }
+}
+
+#endif
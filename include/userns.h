@@ -4,7 +4,8 @@
 #include <sys/types.h>
 #include "container.h"
 
-int handle_child_uid_map(pid_t child_pid, int fd);
+// 親側のハンドシェイク: ids の範囲で uid_map/gid_map を書き, net があれば veth も設定してから子を再開させる
+int handle_child_uid_map(pid_t child_pid, int fd, const struct id_range *ids, const struct net_config *net);
 int userns(struct child_config *config);
 
 #endif
@@ -0,0 +1,144 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "autoscale.h"
+
+#define AUTOSCALE_PERIOD_USEC    100000
+#define AUTOSCALE_MIN_QUOTA_USEC 1000     // カーネルが受け付ける最小値 (1ms)
+#define AUTOSCALE_MIN_DT_USEC    1000000  // これより短い間隔の比率はノイズが大きいので使わない
+
+// 閾値 (経過時間に対する千分率)
+#define AUTOSCALE_UP_PRESSURE    100      // some が 10% 以上
+#define AUTOSCALE_UP_THROTTLED   50       // throttle が 5% 以上
+#define AUTOSCALE_DOWN_PRESSURE  10       // some が 1% 以下
+#define AUTOSCALE_DOWN_USAGE     500      // quota の使用率が 50% 未満
+#define AUTOSCALE_CALM_SAMPLES   3        // 下げるまでに必要な連続回数
+
+int parse_autoscale(const char *arg, struct autoscale_config *config) {
+    char *end;
+    unsigned long floor = strtoul(arg, &end, 10);
+    if (*end != ':') {
+        return -1;
+    }
+    unsigned long ceiling = strtoul(end + 1, &end, 10);
+    if (*end != '\0' || floor == 0 || ceiling < floor) {
+        return -1;
+    }
+    config->period_usec = AUTOSCALE_PERIOD_USEC;
+    config->floor_usec = floor * AUTOSCALE_PERIOD_USEC / 1000;
+    config->ceiling_usec = ceiling * AUTOSCALE_PERIOD_USEC / 1000;
+    if (config->floor_usec < AUTOSCALE_MIN_QUOTA_USEC) {
+        config->floor_usec = AUTOSCALE_MIN_QUOTA_USEC;
+    }
+    if (config->ceiling_usec < config->floor_usec) {
+        config->ceiling_usec = config->floor_usec;
+    }
+    return 0;
+}
+
+void autoscale_init(const struct autoscale_config *config, struct autoscale_state *state) {
+    memset(state, 0, sizeof(*state));
+    // 起動直後がいちばん CPU を使うので, 下限から始めると最初の数サンプルは throttle されっぱなしになる
+    state->quota_usec = config->ceiling_usec;
+}
+
+static uint64_t delta(uint64_t now, uint64_t last) {
+    return now > last ? now - last : 0;
+}
+
+enum autoscale_action autoscale_decide(const struct autoscale_config *config,
+                                       struct autoscale_state *state,
+                                       const struct metrics_sample *sample) {
+    const struct psi_sample *psi = &sample->psi[PSI_CPU];
+    uint64_t dt = delta(sample->timestamp_ns, state->last_ns) / 1000;
+    if (state->have_last && dt < AUTOSCALE_MIN_DT_USEC) {
+        // 基準は前のサンプルのまま (次で十分な間隔になる)
+        return AUTOSCALE_KEEP;
+    }
+    uint64_t pressure = delta(psi->some_total_usec, state->last_some_usec);
+    uint64_t throttled = delta(sample->cpu_throttled_usec, state->last_throttled_usec);
+    uint64_t nr_throttled = delta(sample->cpu_nr_throttled, state->last_nr_throttled);
+    uint64_t usage = delta(sample->cpu_usage_usec, state->last_usage_usec);
+    int first = !state->have_last;
+
+    state->have_last = 1;
+    state->last_ns = sample->timestamp_ns;
+    state->last_some_usec = psi->some_total_usec;
+    state->last_throttled_usec = sample->cpu_throttled_usec;
+    state->last_nr_throttled = sample->cpu_nr_throttled;
+    state->last_usage_usec = sample->cpu_usage_usec;
+    if (first) {
+        return AUTOSCALE_KEEP;
+    }
+
+    // 期間あたりに必要だった CPU 時間 (usec/period)
+    uint64_t needed = usage * config->period_usec / dt;
+
+    if (pressure * 1000 / dt >= AUTOSCALE_UP_PRESSURE
+        || (nr_throttled > 0 && throttled * 1000 / dt >= AUTOSCALE_UP_THROTTLED)) {
+        state->calm = 0;
+        if (state->quota_usec >= config->ceiling_usec) {
+            return AUTOSCALE_KEEP;
+        }
+        uint64_t quota = state->quota_usec + state->quota_usec / 2;
+        state->quota_usec = quota < config->ceiling_usec ? quota : config->ceiling_usec;
+        return AUTOSCALE_UP;
+    }
+
+    if (pressure * 1000 / dt > AUTOSCALE_DOWN_PRESSURE || nr_throttled > 0
+        || needed * 1000 / state->quota_usec >= AUTOSCALE_DOWN_USAGE) {
+        state->calm = 0;
+        return AUTOSCALE_KEEP;
+    }
+    if (++state->calm < AUTOSCALE_CALM_SAMPLES || state->quota_usec <= config->floor_usec) {
+        return AUTOSCALE_KEEP;
+    }
+    state->calm = 0;
+    // 0.8 倍まで下げるが, 実際の使用量の 1.25 倍は残す
+    uint64_t quota = state->quota_usec * 4 / 5;
+    if (quota < needed + needed / 4) {
+        quota = needed + needed / 4;
+    }
+    if (quota < config->floor_usec) {
+        quota = config->floor_usec;
+    }
+    if (quota >= state->quota_usec) {
+        return AUTOSCALE_KEEP;
+    }
+    state->quota_usec = quota;
+    return AUTOSCALE_DOWN;
+}
+
+static int write_cpu_file(int cgroup_fd, const char *name, const char *value) {
+    int fd = openat(cgroup_fd, name, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    int ret = write(fd, value, strlen(value)) < 0 ? -1 : 0;
+    close(fd);
+    return ret;
+}
+
+int autoscale_apply(int cgroup_fd, const struct autoscale_config *config,
+                    const struct autoscale_state *state) {
+    char value[64];
+    snprintf(value, sizeof(value), "%" PRIu64 " %" PRIu64, state->quota_usec, config->period_usec);
+    if (write_cpu_file(cgroup_fd, "cpu.max", value) != 0) {
+        fprintf(stderr, "write cpu.max %s failed: %m\n", value);
+        return -1;
+    }
+    // 短いピークは貯めておいた分で吸収する (cpu.max.burst の無いカーネルでは無視)
+    snprintf(value, sizeof(value), "%" PRIu64, state->quota_usec / 2);
+    write_cpu_file(cgroup_fd, "cpu.max.burst", value);
+    return 0;
+}
+
+void autoscale_reset(int cgroup_fd) {
+    write_cpu_file(cgroup_fd, "cpu.max.burst", "0");
+    write_cpu_file(cgroup_fd, "cpu.max", "max");
+}
@@ -0,0 +1,222 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "batch.h"
+#include "container.h"
+#include "launch.h"
+#include "profile.h"
+#include "resources.h"
+#include "timing.h"
+
+// マニフェストの 1 行 = 1 コンテナ
+struct batch_entry {
+    struct child_config config;
+    struct launch_args args;
+    char   hostname[64];
+    char  *command;          // 結果表示用 (argv[0])
+};
+
+// ワーカー間で共有する結果 (MAP_SHARED)
+struct batch_result {
+    int      status;         // 終了ステータス, 起動失敗は -1
+    uint64_t start_ns;
+    uint64_t end_ns;
+};
+
+struct batch_shared {
+    atomic_size_t next;      // 次に起動するエントリ
+    struct batch_result results[];
+};
+
+/**
+ * @brief マニフェストを読み込む (空行と '#' 行は無視)
+ * @return エントリ数, 失敗時 -1. *buf は呼び出し側で free する
+ */
+static ssize_t read_manifest(const char *path, char **buf, struct batch_entry **entries) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "open %s failed: %m\n", path);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        fprintf(stderr, "stat %s failed: %m\n", path);
+        close(fd);
+        return -1;
+    }
+    *buf = malloc((size_t)st.st_size + 1);
+    if (!*buf) {
+        perror("malloc failed");
+        close(fd);
+        return -1;
+    }
+    size_t len = 0;
+    while (len < (size_t)st.st_size) {
+        ssize_t n = read(fd, *buf + len, (size_t)st.st_size - len);
+        if (n <= 0) {
+            break;
+        }
+        len += (size_t)n;
+    }
+    close(fd);
+    (*buf)[len] = '\0';
+
+    size_t cap = 16, count = 0;
+    *entries = calloc(cap, sizeof(struct batch_entry));
+    if (!*entries) {
+        perror("calloc failed");
+        return -1;
+    }
+
+    char *save = NULL;
+    size_t lineno = 0;
+    for (char *line = strtok_r(*buf, "\n", &save); line; line = strtok_r(NULL, "\n", &save)) {
+        lineno++;
+        line += strspn(line, " \t");
+        if (*line == '\0' || *line == '#') {
+            continue;
+        }
+        if (count == cap) {
+            struct batch_entry *grown = realloc(*entries, cap * 2 * sizeof(struct batch_entry));
+            if (!grown) {
+                perror("realloc failed");
+                return -1;
+            }
+            memset(grown + cap, 0, cap * sizeof(struct batch_entry));
+            *entries = grown;
+            cap *= 2;
+        }
+        struct batch_entry *entry = &(*entries)[count];
+        if (parse_launch_line(line, &entry->config, &entry->args) != 0) {
+            fprintf(stderr, "%s:%zu: invalid entry\n", path, lineno);
+            return -1;
+        }
+        count++;
+    }
+    return (ssize_t)count;
+}
+
+/**
+ * @brief ワーカープロセス: 共有カウンタから次のエントリを取って順に起動する
+ *        (スレッドではなくプロセスにするのは、clone した子が他スレッドの
+ *         malloc/stdio のロックを握ったまま複製されるのを避けるため)
+ */
+static void batch_worker(struct batch_entry *entries, size_t count, struct batch_shared *shared) {
+    for (;;) {
+        size_t i = atomic_fetch_add(&shared->next, 1);
+        if (i >= count) {
+            break;
+        }
+        struct batch_entry *entry = &entries[i];
+        shared->results[i].start_ns = timing_now_ns();
+        shared->results[i].status = launch_container(&entry->config);
+        shared->results[i].end_ns = timing_now_ns();
+    }
+}
+
+int run_batch(const char *manifest, long jobs) {
+    char *buf = NULL;
+    struct batch_entry *entries = NULL;
+    ssize_t count = read_manifest(manifest, &buf, &entries);
+    if (count <= 0) {
+        if (count == 0) {
+            fprintf(stderr, "%s: no entries\n", manifest);
+        }
+        free(entries);
+        free(buf);
+        return -1;
+    }
+
+    if (jobs <= 0) {
+        jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (jobs <= 0) {
+        jobs = 1;
+    }
+    if (jobs > count) {
+        jobs = count;
+    }
+
+    for (ssize_t i = 0; i < count; i++) {
+        snprintf(entries[i].hostname, sizeof(entries[i].hostname), "mycontainer-%d-%zd", getpid(), i);
+        entries[i].config.hostname = entries[i].hostname;
+        // realloc で配列が動いているので args を指し直す
+        entries[i].config.argv = entries[i].args.argv;
+        entries[i].config.cgroup_limits = entries[i].args.limits;
+        entries[i].config.exec_fd = -1;
+        entries[i].config.cgroup_fd = -1;
+        entries[i].command = entries[i].config.argv[0];
+    }
+
+    // バッチ全体で共有できる準備は fork 前に 1 回だけ行う (ワーカーはコピーを使う)
+    if (setup_cgroup_root() != 0 || prepare_security_profile() != 0) {
+        free(entries);
+        free(buf);
+        return -1;
+    }
+
+    size_t shared_size = sizeof(struct batch_shared) + (size_t)count * sizeof(struct batch_result);
+    struct batch_shared *shared = mmap(NULL, shared_size, PROT_READ | PROT_WRITE,
+                                       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+        perror("mmap failed");
+        free(entries);
+        free(buf);
+        return -1;
+    }
+    atomic_init(&shared->next, 0);
+    for (ssize_t i = 0; i < count; i++) {
+        shared->results[i].status = -1;
+    }
+
+    fprintf(stderr, "=> batch: %zd containers, %ld workers\n", count, jobs);
+    uint64_t batch_start = timing_now_ns();
+
+    long started = 0;
+    for (long w = 0; w < jobs; w++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork failed");
+            break;
+        }
+        if (pid == 0) {
+            batch_worker(entries, (size_t)count, shared);
+            _exit(EXIT_SUCCESS);
+        }
+        started++;
+    }
+    for (long w = 0; w < started; w++) {
+        while (wait(NULL) < 0 && errno == EINTR) {
+        }
+    }
+    uint64_t elapsed = timing_now_ns() - batch_start;
+
+    // 結果: "<index> <status> <ms> <command>" と集計
+    long failed = 0;
+    for (ssize_t i = 0; i < count; i++) {
+        struct batch_result *r = &shared->results[i];
+        double ms = r->end_ns > r->start_ns ? (double)(r->end_ns - r->start_ns) / 1e6 : 0.0;
+        printf("%zd %d %.3f %s\n", i, r->status, ms, entries[i].command);
+        if (r->status != 0) {
+            failed++;
+        }
+    }
+    printf("# containers=%zd failed=%ld workers=%ld elapsed_ms=%.3f containers_per_sec=%.2f\n",
+           count, failed, started, (double)elapsed / 1e6,
+           elapsed ? (double)count * 1e9 / (double)elapsed : 0.0);
+
+    munmap(shared, shared_size);
+    free(entries);
+    free(buf);
+    return failed ? 1 : 0;
+}
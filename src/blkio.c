@@ -0,0 +1,191 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#include "blkio.h"
+
+static int parse_u64(const char *text, uint64_t *value) {
+    char *end;
+    *value = strtoull(text, &end, 10);
+    return end != text && *end == '\0' && *value > 0 ? 0 : -1;
+}
+
+int parse_io_config(const char *spec, struct io_config *io) {
+    char copy[512];
+    if (strlen(spec) >= sizeof(copy)) {
+        return -1;
+    }
+    strcpy(copy, spec);
+    memset(io, 0, sizeof(*io));
+
+    char *save = NULL;
+    for (char *tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        char *value = strchr(tok, '=');
+        if (!value) {
+            return -1;
+        }
+        *value++ = '\0';
+        int ret = 0;
+        if (!strcmp(tok, "latency")) {
+            ret = parse_u64(value, &io->latency_us);
+        } else if (!strcmp(tok, "rbps")) {
+            ret = parse_u64(value, &io->rbps);
+        } else if (!strcmp(tok, "wbps")) {
+            ret = parse_u64(value, &io->wbps);
+        } else if (!strcmp(tok, "riops")) {
+            ret = parse_u64(value, &io->riops);
+        } else if (!strcmp(tok, "wiops")) {
+            ret = parse_u64(value, &io->wiops);
+        } else if (!strcmp(tok, "dev") && value[0] == '/' && io->npaths < IO_MAX_PATHS
+                   && strlen(value) < sizeof(io->paths[0])) {
+            strcpy(io->paths[io->npaths++], value);
+        } else {
+            ret = -1;
+        }
+        if (ret != 0) {
+            return -1;
+        }
+    }
+    // dev= だけでは何も設定しない
+    if (!io->latency_us && !io->rbps && !io->wbps && !io->riops && !io->wiops) {
+        return -1;
+    }
+    io->enabled = 1;
+    return 0;
+}
+
+/**
+ * @brief 匿名デバイス (major 0: btrfs, overlay など) のマウント元をたどる
+ * @return マウント元がブロックデバイスならその MAJ:MIN, でなければ 0
+ */
+static dev_t mount_source_device(dev_t anon) {
+    FILE *f = fopen("/proc/self/mountinfo", "r");
+    if (!f) {
+        return 0;
+    }
+    char line[1024];
+    dev_t dev = 0;
+    while (fgets(line, sizeof(line), f)) {
+        unsigned int maj, min;
+        char source[PATH_MAX];
+        const char *sep = strstr(line, " - ");
+        if (sscanf(line, "%*d %*d %u:%u", &maj, &min) != 2 || makedev(maj, min) != anon || !sep) {
+            continue;
+        }
+        struct stat st;
+        // " - fstype source options"
+        if (sscanf(sep + 3, "%*s %4095s", source) == 1 && source[0] == '/'
+            && stat(source, &st) == 0 && S_ISBLK(st.st_mode)) {
+            dev = st.st_rdev;
+        }
+        break;
+    }
+    fclose(f);
+    return dev;
+}
+
+dev_t io_backing_device(const char *sysfs_root, const char *path) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        fprintf(stderr, "stat %s failed: %m\n", path);
+        return 0;
+    }
+    dev_t dev = major(st.st_dev) == 0 ? mount_source_device(st.st_dev) : st.st_dev;
+    if (dev == 0) {
+        return 0;
+    }
+
+    // io.max/io.latency はディスク単位なので, パーティションは親のディスクにする
+    //  /sys/dev/block/MAJ:MIN -> .../block/sda/sda1 (partition がある) の親 .../sda/dev
+    char link[PATH_MAX], disk[PATH_MAX];
+    snprintf(link, sizeof(link), "%s/dev/block/%u:%u", sysfs_root ? sysfs_root : "/sys", major(dev), minor(dev));
+    if (!realpath(link, disk)) {
+        return dev;
+    }
+    size_t len = strlen(disk);
+    if (len + sizeof("/partition") > sizeof(disk)) {
+        return dev;
+    }
+    strcpy(disk + len, "/partition");
+    if (access(disk, F_OK) != 0) {
+        return dev;
+    }
+    disk[len] = '\0';
+    char *slash = strrchr(disk, '/');
+    if (!slash) {
+        return dev;
+    }
+    strcpy(slash, "/dev");
+    FILE *f = fopen(disk, "r");
+    unsigned int maj, min;
+    if (f && fscanf(f, "%u:%u", &maj, &min) == 2) {
+        dev = makedev(maj, min);
+    }
+    if (f) {
+        fclose(f);
+    }
+    return dev;
+}
+
+static void add_device(struct io_config *io, const char *path) {
+    dev_t dev = io_backing_device(NULL, path);
+    if (dev == 0) {
+        // tmpfs などブロックデバイスの無い所は対象外
+        return;
+    }
+    for (size_t i = 0; i < io->ndevices; i++) {
+        if (io->devices[i] == dev) {
+            return;
+        }
+    }
+    if (io->ndevices < IO_MAX_DEVICES) {
+        io->devices[io->ndevices++] = dev;
+    }
+}
+
+void io_resolve_devices(struct io_config *io, const char *mount_dir) {
+    io->ndevices = 0;
+    if (mount_dir) {
+        char layers[PATH_MAX];
+        snprintf(layers, sizeof(layers), "%s", mount_dir);
+        char *save = NULL;
+        for (char *layer = strtok_r(layers, ":", &save); layer; layer = strtok_r(NULL, ":", &save)) {
+            add_device(io, layer);
+        }
+    }
+    for (size_t i = 0; i < io->npaths; i++) {
+        add_device(io, io->paths[i]);
+    }
+}
+
+int io_format_max(const struct io_config *io, dev_t dev, int restore, char *buf, size_t len) {
+    const struct { const char *key; uint64_t value; } limits[] = {
+        { "rbps", io->rbps }, { "wbps", io->wbps }, { "riops", io->riops }, { "wiops", io->wiops },
+    };
+    int n = snprintf(buf, len, "%u:%u", major(dev), minor(dev));
+    int any = 0;
+    for (size_t i = 0; i < sizeof(limits) / sizeof(limits[0]); i++) {
+        if (!limits[i].value || n < 0 || (size_t)n >= len) {
+            continue;
+        }
+        any = 1;
+        n += restore ? snprintf(buf + n, len - (size_t)n, " %s=max", limits[i].key)
+                     : snprintf(buf + n, len - (size_t)n, " %s=%llu", limits[i].key,
+                                (unsigned long long)limits[i].value);
+    }
+    return any && n > 0 && (size_t)n < len ? n : 0;
+}
+
+int io_format_latency(const struct io_config *io, dev_t dev, int restore, char *buf, size_t len) {
+    if (!io->latency_us) {
+        return 0;
+    }
+    int n = snprintf(buf, len, "%u:%u target=%llu", major(dev), minor(dev),
+                     restore ? 0ULL : (unsigned long long)io->latency_us);
+    return n > 0 && (size_t)n < len ? n : 0;
+}
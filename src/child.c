@@ -2,55 +2,123 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <sched.h>
+#include <signal.h>
 #include <sys/types.h>
 #include <grp.h>
 #include <errno.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/syscall.h>
 
 #include "child.h"
 #include "container.h"
+#include "pool.h"
+#include "resources.h"
+#include "timing.h"
+#include "trace.h"
 #include "userns.h"
 
 
 bool set_config(struct child_config *config) {
+    trace_begin(TRACE_RLIMITS);
+    if (set_rlimits() < 0) {
+        fprintf(stderr, "set_rlimits failed\n");
+        return false;
+    }
+    trace_end(TRACE_RLIMITS);
+
+    // THP の方針は fork/execve をまたいで引き継がれる
+    if (set_thp_policy(config->hugepages.thp) != 0) {
+        return false;
+    }
+
     if (sethostname(config->hostname, strlen(config->hostname)) < 0) {
         perror("sethostname failed");
         return false;
     }
 
+    timing_begin(config->timing, PHASE_MOUNTS);
+    trace_begin(TRACE_MOUNTS);
     if (mounts(config) < 0) {
         fprintf(stderr, "mounts failed\n");
         return false;
     }
+    trace_end(TRACE_MOUNTS);
+    timing_end(config->timing, PHASE_MOUNTS);
 
+    timing_begin(config->timing, PHASE_USERNS);
+    trace_begin(TRACE_USERNS);
     if (userns(config) < 0) {
         fprintf(stderr, "userns failed\n");
         return false;
     }
+    trace_end(TRACE_USERNS);
+    timing_end(config->timing, PHASE_USERNS);
     return true;
 }
 
-bool switch_uid_gid(int uid, int gid, int fd) {
+bool switch_uid_gid(int uid, int gid, struct launch_timing *timing) {
+    trace_begin(TRACE_SETUID);
     if (setgroups(1, (gid_t[]){uid}) ||
         setresgid(uid, uid, uid) ||
         setresuid(uid, uid, uid)) {
         perror("failed setresuid/setresgid");
         return false;
     }
+    trace_end(TRACE_SETUID);
 
+    timing_begin(timing, PHASE_CAPS);
+    trace_begin(TRACE_CAPS);
     if (drop_capabilities() < 0) {
         fprintf(stderr, "drop_capabilities() failed\n");
         return false;
     }
+    trace_end(TRACE_CAPS);
+    timing_end(timing, PHASE_CAPS);
+
+    timing_begin(timing, PHASE_SECCOMP);
+    trace_begin(TRACE_SECCOMP);
     if (restrict_syscalls() < 0) {
         fprintf(stderr, "restrict_syscalls() failed\n");
         return false;
     }
+    trace_end(TRACE_SECCOMP);
+    timing_end(timing, PHASE_SECCOMP);
+    return true;
+}
 
-    if (close(fd) < 0) {
-        perror("close fd");
+/**
+ * @brief プールモード: 待機に入る前に config->fd 以外の fd (3 以上) を閉じる
+ *        先に作られて待機している子のソケットの親側 (CLOEXEC だが execve まで閉じない) や
+ *        uid/gid 範囲・cgroup プールの flock を持ったままだと, 親が閉じても EOF やロックの解放が届かない
+ */
+static void close_inherited_fds(const struct child_config *config) {
+    unsigned int fd = (unsigned int)config->fd;
+    if ((fd > 3 && syscall(SYS_close_range, 3U, fd - 1, 0) != 0)
+        || syscall(SYS_close_range, fd + 1, ~0U, 0) != 0) {
+        for (long i = 3; i < sysconf(_SC_OPEN_MAX); i++) {
+            if (i != config->fd) {
+                close((int)i);
+            }
+        }
+    }
+}
+
+/**
+ * @brief プールモード: execve 直前で待機し、親から argv/envp を受け取る
+ *        (名前空間・cgroup・pivot_root・seccomp/caps はすべて設定済みの状態)
+ */
+static bool receive_launch_request(struct child_config *config) {
+    static char request[POOL_REQUEST_MAX];
+
+    ssize_t len = read(config->fd, request, sizeof(request));
+    if (len <= 0) {
+        // 親がソケットを閉じた => プール縮小 or 終了
+        return false;
+    }
+    if (pool_decode_request(request, (size_t)len, &config->argv, &config->envp) != 0) {
+        fprintf(stderr, "invalid launch request\n");
         return false;
     }
     return true;
@@ -58,21 +126,47 @@ bool switch_uid_gid(int uid, int gid, int fd) {
 
 int child(void *arg) {
     struct child_config *config = (struct child_config*) arg;
+    trace_attach(config->trace_track, TRACE_CHILD);
+
+    // stdout/stderr をログ用パイプに付け替える (dup2 した fd は CLOEXEC ではないので execve 後も残る)
+    if (config->log_fd >= 0) {
+        if (dup2(config->log_fd, STDOUT_FILENO) < 0 || dup2(config->log_fd, STDERR_FILENO) < 0) {
+            perror("dup2 log pipe failed");
+            return -1;
+        }
+    }
+
+    // 親 (プールのイベントループ) がブロックしたシグナルを引き継がない
+    sigset_t empty;
+    sigemptyset(&empty);
+    sigprocmask(SIG_SETMASK, &empty, NULL);
 
     // ホスト名設定
     if (!set_config(config)) {
         return -1;
     }
+    // マウントと uid_map が済めば config->fd 以外は要らない (seccomp を入れる前に閉じる)
+    if (config->pooled) {
+        close_inherited_fds(config);
+    }
 
     // userns 内で uid/gidを切り替え
-    fprintf(stderr, "=> switching to uid %d / gid %d...\n", config->uid, config->uid);
-    if (!switch_uid_gid(config->uid, config->uid, config->fd)) {
+    if (!switch_uid_gid(config->uid, config->uid, config->timing)) {
+        return -1;
+    }
+
+    if (config->pooled && !receive_launch_request(config)) {
+        return -1;
+    }
+    if (close(config->fd) < 0) {
+        perror("close fd");
         return -1;
     }
 
     // 実行
-    fprintf(stderr, "=> execve(%s)...\n", config->argv[0]);
-    if (execve(config->argv[0], config->argv, NULL) < 0) {
+    trace_instant(TRACE_EXECVE);
+    timing_begin(config->timing, PHASE_EXECVE);
+    if (execve(config->argv[0], config->argv, config->envp) < 0) {
         perror("execve failed");
         return -1;
     }
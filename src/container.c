@@ -10,95 +10,61 @@
 #include <sys/prctl.h>
 #include <sys/syscall.h>
 #include <sys/stat.h>
+#include <sys/sysmacros.h>
 #include <sys/mount.h>
-#include <seccomp.h>
+#include <stdint.h>
 #include <linux/seccomp.h>
 #include <fcntl.h>
 #include <libgen.h>   // basename()
+#include <linux/limits.h>
 
 #include "container.h"
-
-#ifndef SCMP_FAIL
-#define SCMP_FAIL SCMP_ACT_ERRNO(EPERM)
-#endif
+#include "hugepage.h"
+#include "idmap.h"
+#include "loopdev.h"
+#include "profile.h"
+#include "trace.h"
 
 //------------------------------------------------------
 // 1. drop_capabilities
 //------------------------------------------------------
 
-/**
- * @brief Drop the inheritable drop_capabilities from the current process.
- *        On success => true, failure => false.
- */
-static bool drop_inheritable_caps(size_t num_capabilities, const int *capabilities_to_drop) {
-    cap_t capabilities = cap_get_proc();
-    if (!capabilities) {
-        perror("cap_get_proc failed");
-        return false;
-    }
-    // drop from inheritable set (アンビエントセットもクリアされる)
-    if (cap_set_flag(capabilities, CAP_INHERITABLE, (int)num_capabilities, capabilities_to_drop, CAP_CLEAR)) {
-        perror("cap_set_flag failed");
-        cap_free(capabilities);
-        return false;
-    }
-    if (cap_set_proc(capabilities)) {
-        perror("cap_set_proc failed");
-        cap_free(capabilities);
-        return false;
-    }
-    cap_free(capabilities);
-    return true;
-}
-
 /**
  * @brief Remove bounding set and inheritable capabilities.
+ *        落とす集合はプロファイルで事前計算済み (cap_drop_mask)
  * @return 0 on success, -1 on failure
  */
 int drop_capabilities(void) {
-    fprintf(stderr, "=> dropping drop_capabilities...\n");
-
-    int capabilities_to_drop[] = {
-        CAP_AUDIT_CONTROL,
-        CAP_AUDIT_READ,
-        CAP_AUDIT_WRITE,
-        CAP_BLOCK_SUSPEND,
-        CAP_DAC_READ_SEARCH,
-        CAP_FSETID,
-        CAP_IPC_LOCK,
-        CAP_MAC_ADMIN,
-        CAP_MAC_OVERRIDE,
-        CAP_MKNOD,
-        CAP_SETFCAP,
-        CAP_SYSLOG,
-        CAP_SYS_ADMIN,
-        CAP_SYS_BOOT,
-        CAP_SYS_MODULE,
-        CAP_SYS_NICE,
-        CAP_SYS_RAWIO,
-        CAP_SYS_RESOURCE,
-        CAP_SYS_TIME,
-        CAP_WAKE_ALARM
-    };
-    size_t num_capabilities = sizeof(capabilities_to_drop) / sizeof(capabilities_to_drop[0]);
+    const struct security_profile *profile = security_profile();
+    if (!profile && (prepare_security_profile() != 0 || !(profile = security_profile()))) {
+        return -1;
+    }
+    uint64_t mask = profile->cap_drop_mask;
 
-    fprintf(stderr, "   bounding...");
-    // bounding set から drop
-    for (size_t i = 0; i < num_capabilities; i++) {
-        if (prctl(PR_CAPBSET_DROP, capabilities_to_drop[i], 0, 0, 0)) {
+    // bounding set から drop (一括で落とす syscall はないので 1 つずつ)
+    for (int cap = 0; cap < 64; cap++) {
+        if ((mask & (1ULL << cap)) && prctl(PR_CAPBSET_DROP, cap, 0, 0, 0)) {
             perror("prctl(PR_CAPBSET_DROP) failed");
             return -1;
         }
     }
 
-    fprintf(stderr, "   inheritable...");
-    // inheritable set を削除
-    if (!drop_inheritable_caps(num_capabilities, capabilities_to_drop)) {
-        fprintf(stderr, "Failed to drop inheritable caps\n");
+    // inheritable set を削除 (capget/capset の 2 回で済ませる, アンビエントセットもクリアされる)
+    struct __user_cap_header_struct header = {
+        .version = _LINUX_CAPABILITY_VERSION_3,
+        .pid = 0,
+    };
+    struct __user_cap_data_struct data[_LINUX_CAPABILITY_U32S_3];
+    if (capget(&header, data) != 0) {
+        perror("capget failed");
+        return -1;
+    }
+    data[0].inheritable &= ~(uint32_t)mask;
+    data[1].inheritable &= ~(uint32_t)(mask >> 32);
+    if (capset(&header, data) != 0) {
+        perror("capset failed");
         return -1;
     }
-
-    fprintf(stderr, "done.\n");
     return 0;
 }
 
@@ -107,114 +73,321 @@ int drop_capabilities(void) {
 //------------------------------------------------------
 
 /**
- * @brief Create seccomp filter context with restricted syscalls.
- * @return scmp_filter_ctx, or NULL if something fails
+ * @brief Apply seccomp filter to restrict syscalls.
+ *        ランチャーでコンパイル済みの BPF をそのまま読み込む
+ * @return 0 on success, -1 on failure
  */
-static scmp_filter_ctx create_secure_context(void) {
-    // seccomp_init(SCMP_ACT_ALLOW) => デフォルト許可, 特定のsyscallのみ拒否
-    scmp_filter_ctx context = seccomp_init(SCMP_ACT_ALLOW);
-    if (!context) {
-        perror("seccomp_init failed");
-        return NULL;
+int restrict_syscalls(void) {
+    const struct security_profile *profile = security_profile();
+    if (!profile && (prepare_security_profile() != 0 || !(profile = security_profile()))) {
+        return -1;
     }
-
-    // Helperマクロ: エラー時に context を解放して NULL return
-#define RULE_FAIL_CHECK(expr) \
-    do { \
-        if ((expr) != 0) { \
-            perror("seccomp_rule_add/set failed"); \
-            seccomp_release(context); \
-            return NULL; \
-        } \
-    } while(0)
-
-    // setuid/setgidビットを立てる chmod 系禁止
-    RULE_FAIL_CHECK(seccomp_rule_add(context, SCMP_FAIL, SCMP_SYS(chmod), 1,
-                SCMP_A1(SCMP_CMP_MASKED_EQ, S_ISUID, S_ISUID)));
-    RULE_FAIL_CHECK(seccomp_rule_add(context, SCMP_FAIL, SCMP_SYS(chmod), 1,
-                SCMP_A1(SCMP_CMP_MASKED_EQ, S_ISGID, S_ISGID)));
-    RULE_FAIL_CHECK(seccomp_rule_add(context, SCMP_FAIL, SCMP_SYS(fchmod), 1,
-                SCMP_A1(SCMP_CMP_MASKED_EQ, S_ISUID, S_ISUID)));
-    RULE_FAIL_CHECK(seccomp_rule_add(context, SCMP_FAIL, SCMP_SYS(fchmod), 1,
-                SCMP_A1(SCMP_CMP_MASKED_EQ, S_ISGID, S_ISGID)));
-    RULE_FAIL_CHECK(seccomp_rule_add(context, SCMP_FAIL, SCMP_SYS(fchmodat), 1,
-                SCMP_A2(SCMP_CMP_MASKED_EQ, S_ISUID, S_ISUID)));
-    RULE_FAIL_CHECK(seccomp_rule_add(context, SCMP_FAIL, SCMP_SYS(fchmodat), 1,
-                SCMP_A2(SCMP_CMP_MASKED_EQ, S_ISGID, S_ISGID)));
-
-    // user namespace
-    RULE_FAIL_CHECK(seccomp_rule_add(context, SCMP_FAIL, SCMP_SYS(unshare), 1,
-                SCMP_A0(SCMP_CMP_MASKED_EQ, CLONE_NEWUSER, CLONE_NEWUSER)));
-    RULE_FAIL_CHECK(seccomp_rule_add(context, SCMP_FAIL, SCMP_SYS(clone), 1,
-                SCMP_A0(SCMP_CMP_MASKED_EQ, CLONE_NEWUSER, CLONE_NEWUSER)));
-
-    // ioctl(TIOCSTI)
-    RULE_FAIL_CHECK(seccomp_rule_add(context, SCMP_FAIL, SCMP_SYS(ioctl), 1,
-                SCMP_A1(SCMP_CMP_MASKED_EQ, TIOCSTI, TIOCSTI)));
-
-    // keyring 系
-    RULE_FAIL_CHECK(seccomp_rule_add(context, SCMP_FAIL, SCMP_SYS(keyctl), 0));
-    RULE_FAIL_CHECK(seccomp_rule_add(context, SCMP_FAIL, SCMP_SYS(add_key), 0));
-    RULE_FAIL_CHECK(seccomp_rule_add(context, SCMP_FAIL, SCMP_SYS(request_key), 0));
-
-    // ptrace
-    RULE_FAIL_CHECK(seccomp_rule_add(context, SCMP_FAIL, SCMP_SYS(ptrace), 0));
-
-    // NUMA系
-    RULE_FAIL_CHECK(seccomp_rule_add(context, SCMP_FAIL, SCMP_SYS(mbind), 0));
-    RULE_FAIL_CHECK(seccomp_rule_add(context, SCMP_FAIL, SCMP_SYS(migrate_pages), 0));
-    RULE_FAIL_CHECK(seccomp_rule_add(context, SCMP_FAIL, SCMP_SYS(move_pages), 0));
-    RULE_FAIL_CHECK(seccomp_rule_add(context, SCMP_FAIL, SCMP_SYS(set_mempolicy), 0));
-
-    // userfaultfd
-    RULE_FAIL_CHECK(seccomp_rule_add(context, SCMP_FAIL, SCMP_SYS(userfaultfd), 0));
-
-    // perf_event_open
-    RULE_FAIL_CHECK(seccomp_rule_add(context, SCMP_FAIL, SCMP_SYS(perf_event_open), 0));
-
-    // PR_SET_NO_NEW_PRIVS → 0
-    if (seccomp_attr_set(context, SCMP_FLTATR_CTL_NNP, 0) != 0) {
-        perror("seccomp_attr_set(CTL_NNP)");
-        seccomp_release(context);
-        return NULL;
+    // CTL_NNP = 0 と同じく no_new_privs は立てない (CAP_SYS_ADMIN を持っている前提)
+    if (syscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER, 0, &profile->prog) != 0) {
+        perror("seccomp(SECCOMP_SET_MODE_FILTER) failed");
+        return -1;
     }
+    return 0;
+}
 
-#undef RULE_FAIL_CHECK
+//------------------------------------------------------
+// 3. Mounts
+//------------------------------------------------------
 
-    return context;
+/**
+ * @brief pivot_root をシステムコールで呼ぶラッパ
+ */
+static int pivot_root_syscall(const char *new_root, const char *put_old) {
+    return syscall(SYS_pivot_root, new_root, put_old);
 }
 
+// 新しいマウント API (古いヘッダ向けの定義)
+#ifndef OPEN_TREE_CLONE
+#define OPEN_TREE_CLONE 1
+#endif
+#ifndef OPEN_TREE_CLOEXEC
+#define OPEN_TREE_CLOEXEC O_CLOEXEC
+#endif
+#ifndef AT_RECURSIVE
+#define AT_RECURSIVE 0x8000
+#endif
+#ifndef MOVE_MOUNT_F_EMPTY_PATH
+#define MOVE_MOUNT_F_EMPTY_PATH 0x00000004
+#endif
+#ifndef MOUNT_ATTR_RDONLY
+#define MOUNT_ATTR_RDONLY 0x00000001
+#define MOUNT_ATTR_NOSUID 0x00000002
+#define MOUNT_ATTR_NODEV  0x00000004
+#endif
+#ifndef MOUNT_ATTR_IDMAP
+#define MOUNT_ATTR_IDMAP 0x00100000
+#endif
+#ifndef FSOPEN_CLOEXEC
+#define FSOPEN_CLOEXEC      0x00000001
+#define FSMOUNT_CLOEXEC     0x00000001
+#define FSCONFIG_SET_FLAG   0
+#define FSCONFIG_SET_STRING 1
+#define FSCONFIG_CMD_CREATE 6
+#endif
+#ifndef MOUNT_ATTR_SIZE_VER0
+struct mount_attr {
+    uint64_t attr_set;
+    uint64_t attr_clr;
+    uint64_t propagation;
+    uint64_t userns_fd;
+};
+#define MOUNT_ATTR_SIZE_VER0 32
+#endif
+
+static int mount_namespace_ready = 0;  // 1: 準備済み, -1: 使えない
+
 /**
- * @brief Apply seccomp filter to restrict syscalls.
+ * @brief ランチャー自身を専用のマウント名前空間に移し、全体を slave にする (1 回だけ)
+ *        以降 CLONE_NEWNS でコピーされるマウントも slave になるので、子は
+ *        "/" を再帰的に private にし直さなくても pivot_root/umount がホストに伝播しない
  * @return 0 on success, -1 on failure
  */
-int restrict_syscalls(void) {
-    fprintf(stderr, "=> restricting syscalls...\n");
+static int prepare_mount_namespace(void) {
+    if (mount_namespace_ready) {
+        return mount_namespace_ready > 0 ? 0 : -1;
+    }
+    mount_namespace_ready = -1;
+    if (unshare(CLONE_NEWNS) != 0) {
+        perror("unshare(CLONE_NEWNS) failed");
+        return -1;
+    }
+    if (mount(NULL, "/", NULL, MS_REC | MS_SLAVE, NULL) != 0) {
+        perror("mount MS_SLAVE failed");
+        return -1;
+    }
+    mount_namespace_ready = 1;
+    return 0;
+}
 
-    scmp_filter_ctx secure_context = create_secure_context();
-    if (!secure_context) {
+/**
+ * @brief 未マウントのツリーを config->ids の範囲で idmapped mount にする
+ *        ツリーの "/" の所有者 (ホストの 0 でも, 別の範囲へ chown 済みでも) をコンテナ内の 0 にずらして見せる
+ *        すでにこの範囲の先頭の所有ならそのまま使う
+ * @return 0 on success, -1 if the tree needs an idmap that cannot be applied
+ */
+static int apply_rootfs_idmap(struct child_config *config, const char *path, int tree_fd) {
+    struct stat st;
+    if (fstat(tree_fd, &st) != 0) {
+        fprintf(stderr, "stat %s failed: %m\n", path);
+        return -1;
+    }
+    if (st.st_uid == config->ids.start && st.st_gid == config->ids.start) {
+        return 0;
+    }
+    int userns_fd = id_range_userns_fd(&config->ids, st.st_uid, st.st_gid);
+    if (userns_fd < 0) {
+        fprintf(stderr, "=> no user namespace mapping %u:%u to %u for %s\n",
+                (unsigned int)st.st_uid, (unsigned int)st.st_gid, (unsigned int)config->ids.start, path);
         return -1;
     }
-    if (seccomp_load(secure_context) < 0) {
-        perror("seccomp_load failed");
-        seccomp_release(secure_context);
+    struct mount_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.attr_set = MOUNT_ATTR_IDMAP;
+    attr.userns_fd = (uint64_t)userns_fd;
+    if (syscall(SYS_mount_setattr, tree_fd, "", AT_EMPTY_PATH | AT_RECURSIVE, &attr, MOUNT_ATTR_SIZE_VER0) != 0) {
+        fprintf(stderr, "=> idmapped mount on %s failed: %m\n", path);
         return -1;
     }
-    seccomp_release(secure_context);
+    return 0;
+}
 
-    fprintf(stderr, "=> syscalls restricted.\n");
+int check_rootfs_owner(const struct child_config *config) {
+    const char *layer = config->mount_dir;
+    uid_t first = config->ids.start, last = config->ids.start + (config->ids.size - 1);
+    // overlay なら各 lower 層, そうでなければ mount_dir そのもの
+    while (*layer) {
+        size_t len = config->overlay_size ? strcspn(layer, ":") : strlen(layer);
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%.*s", (int)len, layer);
+        struct stat st;
+        if (stat(path, &st) != 0) {
+            fprintf(stderr, "stat %s failed: %m\n", path);
+            return -1;
+        }
+        if (st.st_uid < first || st.st_uid > last || st.st_gid < first || st.st_gid > last) {
+            fprintf(stderr, "rootfs %s is owned by %u:%u, outside the container's uid/gid range %u-%u, "
+                    "and cannot be idmapped here (chown it into the range)\n", path,
+                    (unsigned int)st.st_uid, (unsigned int)st.st_gid, (unsigned int)first, (unsigned int)last);
+            return -1;
+        }
+        layer += len;
+        if (*layer == ':') {
+            layer++;
+        }
+    }
     return 0;
 }
 
-//------------------------------------------------------
-// 3. Mounts
-//------------------------------------------------------
+int open_rootfs_tree(struct child_config *config) {
+    // overlayfs は子の中で組み立てる
+    if (config->overlay_size || prepare_mount_namespace() != 0) {
+        return -1;
+    }
+
+    // rootfs を再帰的に複製した、どこにもマウントされていないツリー
+    int tree_fd = (int)syscall(SYS_open_tree, AT_FDCWD, config->mount_dir,
+                               OPEN_TREE_CLONE | OPEN_TREE_CLOEXEC | AT_RECURSIVE);
+    if (tree_fd < 0) {
+        if (errno != ENOSYS) {
+            fprintf(stderr, "open_tree %s failed: %m\n", config->mount_dir);
+        }
+        return -1;
+    }
+
+    struct mount_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    // rootfs (ストアのレイヤーを含む) のデバイスノードは使わせない. /dev は mount_dev() が別に作る
+    attr.attr_set = MOUNT_ATTR_NOSUID | MOUNT_ATTR_NODEV | (config->readonly_rootfs ? MOUNT_ATTR_RDONLY : 0);
+    if (syscall(SYS_mount_setattr, tree_fd, "", AT_EMPTY_PATH | AT_RECURSIVE, &attr, MOUNT_ATTR_SIZE_VER0) != 0) {
+        perror("mount_setattr failed");
+        close(tree_fd);
+        return -1;
+    }
+    if (apply_rootfs_idmap(config, config->mount_dir, tree_fd) != 0) {
+        close(tree_fd);
+        return -1;
+    }
+    return tree_fd;
+}
+
+int open_overlay_lowers(struct child_config *config) {
+    config->lower_fds = NULL;
+    config->lower_count = 0;
+    size_t layers = 1;
+    for (const char *p = config->mount_dir; *p; p++) {
+        layers += *p == ':';
+    }
+    config->lower_fds = calloc(layers, sizeof(int));
+    if (!config->lower_fds) {
+        perror("calloc failed");
+        return -1;
+    }
+    const char *layer = config->mount_dir;
+    while (config->lower_count < (int)layers) {
+        size_t len = strcspn(layer, ":");
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%.*s", (int)len, layer);
+        // 層ごとに所有者が違ってもよい (それぞれをコンテナ内の 0 にずらす)
+        int tree_fd = (int)syscall(SYS_open_tree, AT_FDCWD, path, OPEN_TREE_CLONE | OPEN_TREE_CLOEXEC | AT_RECURSIVE);
+        if (tree_fd < 0) {
+            if (errno != ENOSYS) {
+                fprintf(stderr, "open_tree %s failed: %m\n", path);
+            }
+            close_overlay_lowers(config);
+            return -1;
+        }
+        config->lower_fds[config->lower_count++] = tree_fd;
+        if (apply_rootfs_idmap(config, path, tree_fd) != 0) {
+            close_overlay_lowers(config);
+            return -1;
+        }
+        layer += len + (layer[len] == ':');
+    }
+    return 0;
+}
+
+void close_overlay_lowers(struct child_config *config) {
+    for (int i = 0; i < config->lower_count; i++) {
+        close(config->lower_fds[i]);
+    }
+    free(config->lower_fds);
+    config->lower_fds = NULL;
+    config->lower_count = 0;
+}
+
+int open_rootfs_image(struct child_config *config, enum rootfs_image_type type) {
+    // overlay の lower 層はディレクトリでないといけない
+    if (config->overlay_size) {
+        fprintf(stderr, "overlay on an image rootfs (%s) is not supported\n", config->mount_dir);
+        return -1;
+    }
+    if (prepare_mount_namespace() != 0) {
+        return -1;
+    }
+
+    char dev_path[32];
+    int reused = 0;
+    int loop_fd = loop_attach(config->mount_dir, dev_path, sizeof(dev_path), &reused);
+    if (loop_fd < 0) {
+        return -1;
+    }
+
+    // 同じループデバイスのマウントは superblock (と page cache) を共有する
+    int tree_fd = -1;
+    const char *fstype = rootfs_image_fstype(type);
+    int fs_fd = (int)syscall(SYS_fsopen, fstype, FSOPEN_CLOEXEC);
+    if (fs_fd < 0) {
+        fprintf(stderr, "fsopen %s failed: %m\n", fstype);
+        close(loop_fd);
+        return -1;
+    }
+    if (syscall(SYS_fsconfig, fs_fd, FSCONFIG_SET_STRING, "source", dev_path, 0) != 0
+        || syscall(SYS_fsconfig, fs_fd, FSCONFIG_SET_FLAG, "ro", NULL, 0) != 0
+        || syscall(SYS_fsconfig, fs_fd, FSCONFIG_CMD_CREATE, NULL, NULL, 0) != 0) {
+        fprintf(stderr, "mount %s (%s on %s) failed: %m\n", config->mount_dir, fstype, dev_path);
+    } else {
+        // イメージの中のデバイスノードも使わせない (ディレクトリの rootfs と同じ)
+        tree_fd = (int)syscall(SYS_fsmount, fs_fd, FSMOUNT_CLOEXEC,
+                               MOUNT_ATTR_RDONLY | MOUNT_ATTR_NOSUID | MOUNT_ATTR_NODEV);
+        if (tree_fd < 0) {
+            perror("fsmount failed");
+        }
+    }
+    close(fs_fd);
+    // マウントがループデバイスを掴んだので閉じてよい (最後のマウントが外れたら AUTOCLEAR で外れる)
+    close(loop_fd);
+    if (tree_fd < 0) {
+        return -1;
+    }
+    // 起動のたびに stderr へは出さない (-T のトレースでだけ分かる)
+    if (reused) {
+        trace_instant(TRACE_LOOP_REUSE);
+    }
+    if (apply_rootfs_idmap(config, config->mount_dir, tree_fd) != 0) {
+        close(tree_fd);
+        return -1;
+    }
+    return tree_fd;
+}
 
 /**
- * @brief pivot_root をシステムコールで呼ぶラッパ
+ * @brief ランチャーが用意したツリーを mount_dir (イメージなら一時ディレクトリ) の上に付けて pivot_root する
+ *        oldroot 用の一時ディレクトリは作らず pivot_root(".", ".") で重ねてから外す
  */
-static int pivot_root_syscall(const char *new_root, const char *put_old) {
-    return syscall(SYS_pivot_root, new_root, put_old);
+static bool attach_rootfs_tree(struct child_config *config) {
+    // イメージファイルの上には付けられないので, そのときはランチャーが作った一時ディレクトリに付ける
+    const char *target = config->scratch_dir[0] ? config->scratch_dir : config->mount_dir;
+    if (syscall(SYS_move_mount, config->rootfs_fd, "", AT_FDCWD, target,
+                MOVE_MOUNT_F_EMPTY_PATH) != 0) {
+        perror("move_mount failed");
+        return false;
+    }
+    close(config->rootfs_fd);
+    config->rootfs_fd = -1;
+
+    if (chdir(target) != 0) {
+        perror("chdir rootfs failed");
+        return false;
+    }
+    if (pivot_root_syscall(".", ".") != 0) {
+        perror("pivot_root failed");
+        return false;
+    }
+    // old root は新しいルートの下に重なっているので、それを外す
+    if (umount2(".", MNT_DETACH) != 0) {
+        perror("umount2 old_root failed");
+        return false;
+    }
+    if (chdir("/") != 0) {
+        perror("chdir / failed");
+        return false;
+    }
+    return true;
 }
 
 /**
@@ -229,32 +402,96 @@ static bool make_all_mounts_private(void) {
 }
 
 /**
- * @brief 一時ディレクトリを作成し、そこに bind mount を行う
+ * @brief ランチャーが作った一時ディレクトリに bind mount を行う
+ *        (ディレクトリの削除はランチャー側の free_resources が行う)
+ * @param readonly 1 なら読み取り専用にする (open_tree のときと同じく nosuid と nodev は常に付ける)
  * @return bind先のディレクトリパス(ヒープ上)を返す。失敗時はNULL
  */
-static char* create_bind_mount(const char *src_dir) {
-    // 1) 一時ディレクトリ作成
-    char *bind_dir = strdup("/tmp/tmp.XXXXXX");
+static char* create_bind_mount(const char *src_dir, const char *scratch, int readonly) {
+    char *bind_dir = strdup(scratch);
     if (!bind_dir) {
         perror("strdup failed");
         return NULL;
     }
-    if (!mkdtemp(bind_dir)) {
-        perror("mkdtemp failed");
-        free(bind_dir);
-        return NULL;
-    }
 
-    // 2) bind mount
     if (mount(src_dir, bind_dir, NULL, MS_BIND | MS_PRIVATE, NULL) != 0) {
         perror("bind mount failed");
-        rmdir(bind_dir);
+        free(bind_dir);
+        return NULL;
+    }
+    // bind mount の時点ではフラグは効かないので付け直す
+    unsigned long flags = MS_REMOUNT | MS_BIND | MS_NOSUID | MS_NODEV | (readonly ? MS_RDONLY : 0);
+    if (mount(NULL, bind_dir, NULL, flags, NULL) != 0) {
+        perror("remount nosuid/nodev failed");
+        umount2(bind_dir, MNT_DETACH);
         free(bind_dir);
         return NULL;
     }
     return bind_dir;
 }
 
+/**
+ * @brief overlayfs でルートを作る
+ *        lower 層 (":" 区切り, 左が上) は全コンテナで共有し、upper/work は
+ *        サイズ上限付きの tmpfs に置く (書き込みはコンテナ終了時に tmpfs ごと消える)
+ * @param readonly 1 なら overlay 自体を読み取り専用でマウントする (upper には何も書かれない)
+ * @return マージ先のディレクトリパス(ヒープ上)を返す。失敗時はNULL
+ */
+static char* create_overlay_mount(const char *lower_dirs, const char *size, const char *scratch, int readonly) {
+    // 1) upper/work 用の tmpfs (一時ディレクトリはランチャーが作ってある)
+    char options[64];
+    snprintf(options, sizeof(options), "size=%s,mode=0755", size);
+    if (mount("tmpfs", scratch, "tmpfs", MS_NOSUID | MS_NODEV, options) != 0) {
+        perror("mount tmpfs failed");
+        return NULL;
+    }
+
+    char upper[64], work[64], *merged = NULL, *overlay_options = NULL;
+    snprintf(upper, sizeof(upper), "%s/upper", scratch);
+    snprintf(work, sizeof(work), "%s/work", scratch);
+    if (asprintf(&merged, "%s/root", scratch) < 0) {
+        merged = NULL;
+        perror("asprintf failed");
+        goto fail;
+    }
+    if (mkdir(upper, 0755) != 0 || mkdir(work, 0700) != 0 || mkdir(merged, 0755) != 0) {
+        perror("mkdir overlay dirs failed");
+        goto fail;
+    }
+
+    // マージ後の "/" は upper の属性になるので、一番上の lower 層に合わせる
+    char top[PATH_MAX];
+    snprintf(top, sizeof(top), "%.*s", (int)strcspn(lower_dirs, ":"), lower_dirs);
+    struct stat st;
+    if (stat(top, &st) != 0) {
+        fprintf(stderr, "stat %s failed: %m\n", top);
+        goto fail;
+    }
+    if (chown(upper, st.st_uid, st.st_gid) != 0 || chmod(upper, st.st_mode & 07777) != 0) {
+        perror("chown/chmod upper failed");
+        goto fail;
+    }
+
+    // 2) overlay mount
+    if (asprintf(&overlay_options, "lowerdir=%s,upperdir=%s,workdir=%s", lower_dirs, upper, work) < 0) {
+        overlay_options = NULL;
+        perror("asprintf failed");
+        goto fail;
+    }
+    if (mount("overlay", merged, "overlay", MS_NOSUID | MS_NODEV | (readonly ? MS_RDONLY : 0), overlay_options) != 0) {
+        perror("overlay mount failed");
+        goto fail;
+    }
+    free(overlay_options);
+    return merged;
+
+fail:
+    free(overlay_options);
+    free(merged);
+    umount2(scratch, MNT_DETACH);
+    return NULL;
+}
+
 /**
  * @brief bindマウント先ディレクトリに oldroot 用ディレクトリを作成
  * @return 作成したサブディレクトリパス(ヒープ上) or NULL
@@ -310,21 +547,89 @@ static bool pivot_and_cleanup(const char *bind_dir, const char *inner_dir) {
     return true;
 }
 
+// コンテナの /dev に作るデバイス (rootfs のものは nodev で使えない)
+static const struct {
+    const char  *name;
+    unsigned int major, minor;
+} dev_nodes[] = {
+    { "null", 1, 3 }, { "zero", 1, 5 }, { "full", 1, 7 },
+    { "random", 1, 8 }, { "urandom", 1, 9 }, { "tty", 5, 0 },
+};
+
+/**
+ * @brief pivot_root 後の /dev に小さな tmpfs を置き, 決まったデバイスノードだけを作る
+ *        (userns に入る前なので mknod できる. rootfs が読み取り専用なら /dev が必要)
+ * @return 0 on success, -1 on failure
+ */
+static int mount_dev(void) {
+    if (mkdir("/dev", 0755) != 0 && errno != EEXIST) {
+        perror("mkdir /dev failed");
+        return -1;
+    }
+    if (mount("tmpfs", "/dev", "tmpfs", MS_NOSUID | MS_NOEXEC, "size=64k,mode=0755") != 0) {
+        perror("mount /dev failed");
+        return -1;
+    }
+    mode_t old_umask = umask(0);
+    int ret = 0;
+    for (size_t i = 0; i < sizeof(dev_nodes) / sizeof(dev_nodes[0]) && ret == 0; i++) {
+        char path[32];
+        snprintf(path, sizeof(path), "/dev/%s", dev_nodes[i].name);
+        if (mknod(path, S_IFCHR | 0666, makedev(dev_nodes[i].major, dev_nodes[i].minor)) != 0) {
+            fprintf(stderr, "mknod %s failed: %m\n", path);
+            ret = -1;
+        }
+    }
+    umask(old_umask);
+    if (ret == 0 && (symlink("/proc/self/fd", "/dev/fd") != 0
+                     || symlink("/proc/self/fd/0", "/dev/stdin") != 0
+                     || symlink("/proc/self/fd/1", "/dev/stdout") != 0
+                     || symlink("/proc/self/fd/2", "/dev/stderr") != 0)) {
+        perror("symlink in /dev failed");
+        ret = -1;
+    }
+    return ret;
+}
+
 /**
  * @brief 全体のマウント処理
- * @param config child_config 構造体: mount_dir が使用される
+ * @param config child_config 構造体: mount_dir, overlay_size が使用される
  * @return 0 on success, -1 on failure
  */
 int mounts(struct child_config *config) {
-    fprintf(stderr, "=> setting up mounts...\n");
+    // ランチャーが open_tree() で用意したツリーがあればそれを使う
+    if (config->rootfs_fd >= 0) {
+        if (!attach_rootfs_tree(config) || mount_dev() != 0) {
+            return -1;
+        }
+        return mount_hugetlbfs(&config->hugepages);
+    }
 
     // 1. すべてを private に
     if (!make_all_mounts_private()) {
         return -1;
     }
 
-    // 2. bind mount
-    char *bind_dir = create_bind_mount(config->mount_dir);
+    // 2. bind mount (overlay_size があれば mount_dir を lower 層にした overlayfs)
+    //    ランチャーが idmapped mount にした lower 層があれば, その fd を /proc/self/fd/N で渡す
+    char *lower_dirs = config->mount_dir, *lower_fd_dirs = NULL;
+    if (config->overlay_size && config->lower_count > 0) {
+        size_t len = (size_t)config->lower_count * sizeof("/proc/self/fd/2147483647:");
+        lower_fd_dirs = calloc(1, len);
+        if (!lower_fd_dirs) {
+            perror("calloc failed");
+            return -1;
+        }
+        for (int i = 0; i < config->lower_count; i++) {
+            size_t used = strlen(lower_fd_dirs);
+            snprintf(lower_fd_dirs + used, len - used, "%s/proc/self/fd/%d", i ? ":" : "", config->lower_fds[i]);
+        }
+        lower_dirs = lower_fd_dirs;
+    }
+    char *bind_dir = config->overlay_size
+        ? create_overlay_mount(lower_dirs, config->overlay_size, config->scratch_dir, config->readonly_rootfs)
+        : create_bind_mount(config->mount_dir, config->scratch_dir, config->readonly_rootfs);
+    free(lower_fd_dirs);
     if (!bind_dir) {
         return -1;
     }
@@ -332,7 +637,6 @@ int mounts(struct child_config *config) {
     // 3. inner mount dir
     char *inner_dir = create_inner_mount_dir(bind_dir);
     if (!inner_dir) {
-        rmdir(bind_dir);
         free(bind_dir);
         return -1;
     }
@@ -351,6 +655,11 @@ int mounts(struct child_config *config) {
     // いまやパスとしては使わないのでメモリだけ解放する
     free(bind_dir);
 
-    fprintf(stderr, "=> mounts done.\n");
-    return 0;
+    // 5. /dev (rootfs は nodev なので別に作る)
+    if (mount_dev() != 0) {
+        return -1;
+    }
+
+    // 6. hugetlbfs (-H ...,mount=PATH). userns に入る前なのでここでマウントできる
+    return mount_hugetlbfs(&config->hugepages);
 }
@@ -0,0 +1,1170 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "autoscale.h"
+#include "daemon.h"
+#include "container.h"
+#include "launch.h"
+#include "logs.h"
+#include "metrics.h"
+#include "placement.h"
+#include "profile.h"
+#include "resources.h"
+#include "timing.h"
+#include "trace.h"
+#include "userns.h"
+
+#define DAEMON_MAX_EVENTS  64
+#define DAEMON_LINE_MAX    4096
+#define DAEMON_OUTPUT_MAX  (16 << 20)  // 送り切れていない応答をクライアントごとに溜めておける量
+#define DAEMON_METRICS_INTERVAL 10   // 秒 (コンテナ 1000 個でも CPU 1% 未満に収まる間隔)
+#define DAEMON_LOG_TICK_NS 50000000  // 止めたログを見直す間隔 (50ms)
+// memory.reclaim は書いた量を回収し終えるまで戻らないので, イベントループでは小分けにして書く
+#define DAEMON_RECLAIM_CHUNK     (4ULL << 20)  // 1 回の memory.reclaim に書く量
+#define DAEMON_RECLAIM_TICK_NS   10000000      // 続きを書く間隔 (10ms)
+#define DAEMON_RECLAIM_BUDGET_NS 2000000       // 1 回の起床で reclaim に使ってよい時間 (2ms)
+
+// epoll に登録する fd の種類
+enum watch_kind {
+    WATCH_LISTEN,
+    WATCH_SIGNAL,
+    WATCH_CLIENT,
+    WATCH_PIDFD,      // 子プロセスの終了
+    WATCH_HANDSHAKE,  // uid_map ハンドシェイク用ソケット
+    WATCH_EVENTS,     // cgroup.events (populated)
+    WATCH_METRICS,    // メトリクスの timerfd
+    WATCH_PRESSURE,   // PSI トリガー / memory.events (即時サンプル)
+    WATCH_LOG,        // stdout/stderr のパイプ
+    WATCH_LOG_TIMER,  // レート超過で止めたログの再開
+    WATCH_RECLAIM_TIMER, // memory.reclaim の続き
+};
+
+struct watch {
+    enum watch_kind kind;
+    void *owner;
+};
+
+struct daemon;
+
+struct client {
+    int    fd;
+    char   buf[DAEMON_LINE_MAX];
+    size_t len;
+    char  *out;              // 送り切れなかった応答 (EPOLLOUT で続きを送る)
+    size_t out_len;
+    size_t out_cap;
+    int    closing;          // 読み側は閉じた. 溜めた応答を送り終えたら片付ける
+    int    dead;
+    struct daemon *daemon;   // EPOLLOUT の登録に使う
+    struct watch watch;
+    struct client *next;
+};
+
+struct container {
+    struct child_config config;
+    char   hostname[64];
+    char  *request;          // argv/mount_dir が指すリクエスト行のコピー
+    struct launch_args args;
+    unsigned long id;
+    pid_t  pid;
+    int    pidfd;
+    int    sock;             // 親側ハンドシェイクソケット (完了後 -1)
+    int    events_fd;        // cgroup.events (開けなければ -1)
+    int    exited;
+    int    status;
+    int    populated;
+    int    frozen;           // cgroup.events の frozen
+    int    freeze_target;    // FREEZE/THAW で要求した状態
+    int    freeze_pending;   // 要求が cgroup.events に反映されるのを待っている
+    uint64_t freeze_start_ns;
+    uint64_t freeze_us;      // frozen 1 になるまでにかかった時間
+    uint64_t reclaim_bytes;  // 凍結後に memory.reclaim で押し出す残りの量 (0 なら何もしない)
+    uint64_t freeze_reclaimed;
+    int    freeze_reclaiming; // 凍結済みで, FROZEN を返す前に押し出している
+    uint64_t reclaim_round;  // 最後に reclaim を進めた周 (daemon.reclaim_round)
+    struct client *freeze_client;  // FROZEN/THAWED の通知先
+    int    dead;
+    struct client *client;   // 結果の通知先 (切断済みなら NULL)
+    struct watch pid_watch;
+    struct watch sock_watch;
+    struct watch events_watch;
+    struct watch pressure_watch;
+    struct log_sink log;     // -L 指定時 (log.config が NULL なら未使用)
+    struct watch log_watch;
+    struct metrics_target metrics;
+    int    autoscaled;
+    struct autoscale_state autoscale;
+    int    reclaiming;
+    struct reclaim_state reclaim;
+    struct placement_slot placement;   // placement.domains が 0 なら未配置
+    struct container *next;
+};
+
+struct daemon {
+    int epoll_fd;
+    int listen_fd;
+    int signal_fd;
+    int running;
+    unsigned long seq;
+    struct client *clients;
+    struct container *containers;
+    // 同じ epoll バッチ内の後続イベントが参照しうるので、解放はバッチの後で行う
+    struct client *dead_clients;
+    struct container *dead_containers;
+    struct watch listen_watch;
+    struct watch signal_watch;
+    struct metrics *metrics;  // -M/-A 指定時のみ
+    const struct autoscale_config *autoscale;
+    const struct reclaim_config *reclaim;
+    struct placement *placement;  // -N 指定時のみ
+    struct watch metrics_watch;
+    int log_timer_fd;         // 止めているログがある間だけ動かす
+    unsigned int log_throttled;
+    struct watch log_timer_watch;
+    int reclaim_timer_fd;     // 押し出し途中のコンテナがある間だけ動かす
+    unsigned int reclaim_pending;
+    uint64_t reclaim_round;   // 全員を 1 回ずつ進めたら 1 増やす (予算切れで後回しにしたものを先にする)
+    struct watch reclaim_timer_watch;
+};
+
+//------------------------------------------------------
+// 1. 補助関数
+//------------------------------------------------------
+
+static int watch_fd(struct daemon *d, int fd, uint32_t events, struct watch *watch) {
+    struct epoll_event ev = { .events = events, .data.ptr = watch };
+    if (epoll_ctl(d->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        perror("epoll_ctl failed");
+        return -1;
+    }
+    return 0;
+}
+
+static void unwatch_fd(struct daemon *d, int fd) {
+    epoll_ctl(d->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+static void rewatch_fd(struct daemon *d, int fd, uint32_t events, struct watch *watch) {
+    struct epoll_event ev = { .events = events, .data.ptr = watch };
+    if (epoll_ctl(d->epoll_fd, EPOLL_CTL_MOD, fd, &ev) != 0) {
+        perror("epoll_ctl failed");
+    }
+}
+
+/**
+ * @brief 応答を送る. 送り切れない分は溜めて EPOLLOUT で続きを送る (デーモンは待たない)
+ *        溜まっている間の応答は後ろに足すので順序は変わらない
+ */
+static void client_send(struct client *client, const char *buf, size_t len) {
+    if (!client || len == 0) {
+        return;
+    }
+    if (client->out_len == 0) {
+        ssize_t n = send(client->fd, buf, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0 && errno != EAGAIN) {
+            // 切断済み: 読み側の EOF で片付く
+            fprintf(stderr, "reply to client failed: %m\n");
+            return;
+        }
+        if (n > 0) {
+            buf += n;
+            len -= (size_t)n;
+        }
+        if (len == 0) {
+            return;
+        }
+    }
+    // 読まないクライアントのためにメモリを使い続けない
+    if (client->out_len + len > DAEMON_OUTPUT_MAX) {
+        fprintf(stderr, "client output over %d bytes, dropping reply\n", DAEMON_OUTPUT_MAX);
+        return;
+    }
+    if (client->out_len + len > client->out_cap) {
+        size_t cap = client->out_cap ? client->out_cap : DAEMON_LINE_MAX;
+        while (cap < client->out_len + len) {
+            cap *= 2;
+        }
+        char *out = realloc(client->out, cap);
+        if (!out) {
+            perror("realloc failed");
+            return;
+        }
+        client->out = out;
+        client->out_cap = cap;
+    }
+    if (client->out_len == 0) {
+        rewatch_fd(client->daemon, client->fd, EPOLLIN | EPOLLOUT, &client->watch);
+    }
+    memcpy(client->out + client->out_len, buf, len);
+    client->out_len += len;
+}
+
+// EPOLLOUT: 溜めた応答の続きを送る. 空になったら EPOLLIN だけに戻す
+static void client_flush(struct client *client) {
+    size_t sent = 0;
+    while (sent < client->out_len) {
+        ssize_t n = send(client->fd, client->out + sent, client->out_len - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == EAGAIN) {
+                break;
+            }
+            fprintf(stderr, "reply to client failed: %m\n");
+            sent = client->out_len;
+            break;
+        }
+        sent += (size_t)n;
+    }
+    memmove(client->out, client->out + sent, client->out_len - sent);
+    client->out_len -= sent;
+    if (client->out_len == 0 && !client->closing) {
+        rewatch_fd(client->daemon, client->fd, EPOLLIN, &client->watch);
+    }
+}
+
+static void reply(struct client *client, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void reply(struct client *client, const char *fmt, ...) {
+    if (!client) {
+        return;
+    }
+    char line[DAEMON_LINE_MAX];
+    va_list ap;
+    va_start(ap, fmt);
+    int len = vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    if (len < 0) {
+        return;
+    }
+    if ((size_t)len >= sizeof(line)) {
+        len = sizeof(line) - 1;
+    }
+    client_send(client, line, (size_t)len);
+}
+
+// cgroup.events の "populated N" と "frozen N" を読む
+static void read_events(struct container *c) {
+    char buf[256];
+    ssize_t n = pread(c->events_fd, buf, sizeof(buf) - 1, 0);
+    if (n <= 0) {
+        c->populated = 0;
+        return;
+    }
+    buf[n] = '\0';
+    char *p = strstr(buf, "populated ");
+    c->populated = p ? atoi(p + strlen("populated ")) : 0;
+    p = strstr(buf, "frozen ");
+    c->frozen = p ? atoi(p + strlen("frozen ")) : 0;
+}
+
+//------------------------------------------------------
+// 2. コンテナの起動と後片付け
+//------------------------------------------------------
+
+static void container_metrics_close(struct daemon *d, struct container *c) {
+    for (int f = 0; f < METRICS_FILE_MAX; f++) {
+        if (c->metrics.notify_mask & (1u << f)) {
+            unwatch_fd(d, c->metrics.fds[f]);
+        }
+    }
+    metrics_target_close(d->metrics, &c->metrics);
+}
+
+// -l cpu.max=... を指定したコンテナは固定値のまま
+static int wants_autoscale(struct daemon *d, struct container *c) {
+    if (!d->autoscale) {
+        return 0;
+    }
+    for (char **limit = c->config.cgroup_limits; limit && *limit; limit++) {
+        if (!strncmp(*limit, "cpu.max", 7)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// 配置の幅 (CPU 数): -l cpu.max=... の quota, 自動調整ならその上限, どちらも無ければ 1
+static unsigned int container_width(struct daemon *d, struct container *c) {
+    for (char **limit = c->config.cgroup_limits; limit && *limit; limit++) {
+        if (!strncmp(*limit, "cpu.max=", 8)) {
+            return placement_width(*limit + 8);
+        }
+    }
+    if (d->autoscale) {
+        return (unsigned int)((d->autoscale->ceiling_usec + d->autoscale->period_usec - 1) / d->autoscale->period_usec);
+    }
+    return 1;
+}
+
+static void container_autoscale(struct daemon *d, struct container *c) {
+    struct metrics_sample sample;
+    // 凍結中は使用量が 0 になるだけなので quota を下げない
+    if (!c->autoscaled || c->freeze_target || metrics_latest(d->metrics, &c->metrics, &sample) != 0) {
+        return;
+    }
+    if (autoscale_decide(d->autoscale, &c->autoscale, &sample) != AUTOSCALE_KEEP) {
+        autoscale_apply(c->config.cgroup_fd, d->autoscale, &c->autoscale);
+    }
+}
+
+// 押し出し途中のコンテナができたら, 続きを書くタイマーを動かす
+static void reclaim_work_add(struct daemon *d) {
+    if (d->reclaim_pending++ > 0) {
+        return;
+    }
+    if (d->reclaim_timer_fd < 0) {
+        d->reclaim_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+        if (d->reclaim_timer_fd < 0) {
+            perror("timerfd_create failed");
+            return;
+        }
+        d->reclaim_timer_watch = (struct watch){ WATCH_RECLAIM_TIMER, NULL };
+        watch_fd(d, d->reclaim_timer_fd, EPOLLIN, &d->reclaim_timer_watch);
+    }
+    struct itimerspec its = {
+        .it_interval = { 0, DAEMON_RECLAIM_TICK_NS },
+        .it_value = { 0, 1 },
+    };
+    timerfd_settime(d->reclaim_timer_fd, 0, &its, NULL);
+}
+
+// -l memory.high=... を指定したコンテナは固定値のまま
+static int wants_reclaim(struct daemon *d, struct container *c) {
+    if (!d->reclaim) {
+        return 0;
+    }
+    for (char **limit = c->config.cgroup_limits; limit && *limit; limit++) {
+        if (!strncmp(*limit, "memory.high=", 12)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void container_reclaim(struct daemon *d, struct container *c) {
+    struct metrics_sample sample;
+    // 凍結中は FREEZE の reclaim に任せる (圧力も 0 になるので押し出しすぎる)
+    if (!c->reclaiming || c->freeze_target || metrics_latest(d->metrics, &c->metrics, &sample) != 0) {
+        return;
+    }
+    // 前回の押し出しがまだ途中なら, 終わるまで次を決めない
+    if (c->reclaim.pending) {
+        return;
+    }
+    enum reclaim_action action = reclaim_decide(d->reclaim, &c->reclaim, &sample);
+    if (action == RECLAIM_KEEP) {
+        return;
+    }
+    reclaim_apply(c->config.cgroup_fd, &c->reclaim, action);
+    // SHRINK の memory.reclaim はタイマーで小分けに書く
+    if (c->reclaim.pending) {
+        reclaim_work_add(d);
+    }
+}
+
+static void container_destroy(struct daemon *d, struct container *c) {
+    trace_attach(c->config.trace_track, TRACE_LAUNCHER);
+    if (c->sock >= 0) {
+        unwatch_fd(d, c->sock);
+        close(c->sock);
+    }
+    if (c->pidfd >= 0) {
+        unwatch_fd(d, c->pidfd);
+        close(c->pidfd);
+    }
+    if (c->events_fd >= 0) {
+        unwatch_fd(d, c->events_fd);
+        close(c->events_fd);
+    }
+    if (c->autoscaled) {
+        autoscale_reset(c->config.cgroup_fd);
+    }
+    if (c->reclaiming) {
+        reclaim_reset(c->config.cgroup_fd);
+    }
+    // 凍結したまま SIGKILL されたものは解凍してから返す (プールの次の利用者が止まらないように)
+    if (c->freeze_target) {
+        cgroup_freeze(c->config.cgroup_fd, 0);
+    }
+    // FROZEN/THAWED を待っているクライアントには応答が来なくなるので失敗を返す
+    if (c->freeze_pending) {
+        reply(c->freeze_client, "ERROR %s failed\n", c->freeze_target ? "freeze" : "thaw");
+        c->freeze_client = NULL;
+        if (c->freeze_reclaiming) {
+            d->reclaim_pending--;
+        }
+    }
+    if (c->reclaiming && c->reclaim.pending) {
+        d->reclaim_pending--;
+    }
+    if (c->log.config) {
+        if (c->log.throttled) {
+            d->log_throttled--;
+        }
+        if (c->log.pipe_r >= 0) {
+            unwatch_fd(d, c->log.pipe_r);
+        }
+        log_close(&c->log);
+    }
+    if (d->metrics) {
+        container_metrics_close(d, c);
+    }
+    if (c->placement.domains) {
+        placement_release(d->placement, &c->placement);
+        placement_reset(c->config.cgroup_fd);
+        // 空いたドメインへ残りを寄せる (終了処理中は動かさない)
+        if (d->running) {
+            placement_rebalance(d->placement);
+        }
+    }
+    free_resources(&c->config);
+
+    for (struct container **pp = &d->containers; *pp; pp = &(*pp)->next) {
+        if (*pp == c) {
+            *pp = c->next;
+            break;
+        }
+    }
+    c->dead = 1;
+    c->next = d->dead_containers;
+    d->dead_containers = c;
+}
+
+// 子が終了し、cgroup 内のプロセス (孫も含む) がいなくなったら片付ける
+static void container_maybe_cleanup(struct daemon *d, struct container *c) {
+    if (c->exited && !c->populated) {
+        container_destroy(d, c);
+    }
+}
+
+static void container_exited(struct daemon *d, struct container *c, int status) {
+    c->exited = 1;
+    c->status = status;
+    reply(c->client, "EXITED %lu %d\n", c->id, status);
+    if (c->pidfd >= 0) {
+        unwatch_fd(d, c->pidfd);
+        close(c->pidfd);
+        c->pidfd = -1;
+    }
+    if (c->events_fd < 0) {
+        c->populated = 0;
+    } else if (c->populated && c->config.cgroup_fd >= 0) {
+        // 残ったプロセスをまとめて止める. populated 0 は cgroup.events の通知で分かる
+        cgroup_kill(c->config.cgroup_fd);
+    }
+    container_maybe_cleanup(d, c);
+}
+
+static int container_start(struct daemon *d, struct client *client, const char *args) {
+    struct container *c = calloc(1, sizeof(*c));
+    if (!c) {
+        perror("calloc failed");
+        return -1;
+    }
+    c->id = d->seq++;
+    c->pidfd = -1;
+    c->sock = -1;
+    c->events_fd = -1;
+    c->populated = 1;
+    c->client = client;
+    c->config.cgroup_fd = -1;
+    c->config.exec_fd = -1;
+    c->config.log_fd = -1;
+    c->request = strdup(args);
+    if (!c->request || parse_launch_line(c->request, &c->config, &c->args) != 0) {
+        free(c->request);
+        free(c);
+        return -1;
+    }
+    snprintf(c->hostname, sizeof(c->hostname), "mycontainer-%d-%lu", getpid(), c->id);
+    c->config.hostname = c->hostname;
+
+    int sockets[2];
+    if (socketpair(AF_LOCAL, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sockets) != 0) {
+        perror("socketpair failed");
+        free(c->request);
+        free(c);
+        return -1;
+    }
+    c->config.fd = sockets[1];
+
+    if (log_config()) {
+        if (log_open(&c->log, log_config(), c->hostname) != 0) {
+            close(sockets[0]);
+            close(sockets[1]);
+            free(c->request);
+            free(c);
+            return -1;
+        }
+        c->config.log_fd = c->log.pipe_w;
+    }
+
+    if (resources(&c->config) != 0) {
+        close(sockets[0]);
+        close(sockets[1]);
+        log_close(&c->log);
+        free(c->request);
+        free(c);
+        return -1;
+    }
+
+    // 子が最初からその CPU/ノードで動き、メモリもそこから取るように clone の前に置く
+    if (d->placement && placement_assign(d->placement, &c->placement, c->id,
+                                         container_width(d, c), c->config.cgroup_fd) != 0) {
+        fprintf(stderr, "placement failed for %lu, leaving it unpinned\n", c->id);
+    }
+
+    c->pid = spawn_container(&c->config, &c->pidfd);
+    close(sockets[1]);
+    log_close_writer(&c->log);
+    if (c->pid < 0) {
+        perror("clone failed");
+        close(sockets[0]);
+        log_close(&c->log);
+        if (c->placement.domains) {
+            placement_release(d->placement, &c->placement);
+            placement_reset(c->config.cgroup_fd);
+        }
+        free_resources(&c->config);
+        free(c->request);
+        free(c);
+        return -1;
+    }
+    c->sock = sockets[0];
+    c->next = d->containers;
+    d->containers = c;
+
+    c->sock_watch = (struct watch){ WATCH_HANDSHAKE, c };
+    watch_fd(d, c->sock, EPOLLIN, &c->sock_watch);
+    if (c->pidfd >= 0) {
+        c->pid_watch = (struct watch){ WATCH_PIDFD, c };
+        watch_fd(d, c->pidfd, EPOLLIN, &c->pid_watch);
+    }
+    c->events_fd = openat(c->config.cgroup_fd, "cgroup.events", O_RDONLY | O_CLOEXEC);
+    if (c->events_fd >= 0) {
+        c->events_watch = (struct watch){ WATCH_EVENTS, c };
+        watch_fd(d, c->events_fd, EPOLLPRI, &c->events_watch);
+        // 登録する前に空になっていたら通知は来ないので, 登録してから読み直す
+        read_events(c);
+    }
+    if (c->log.config) {
+        c->log_watch = (struct watch){ WATCH_LOG, c };
+        watch_fd(d, c->log.pipe_r, EPOLLIN, &c->log_watch);
+    }
+    if (d->metrics) {
+        metrics_target_open(d->metrics, &c->metrics, c->config.cgroup_fd, c->id, c->hostname);
+        c->pressure_watch = (struct watch){ WATCH_PRESSURE, c };
+        for (int f = 0; f < METRICS_FILE_MAX; f++) {
+            if (c->metrics.notify_mask & (1u << f)) {
+                watch_fd(d, c->metrics.fds[f], EPOLLPRI, &c->pressure_watch);
+            }
+        }
+        metrics_sample(d->metrics, &c->metrics);
+    }
+    if (wants_autoscale(d, c)) {
+        autoscale_init(d->autoscale, &c->autoscale);
+        c->autoscaled = autoscale_apply(c->config.cgroup_fd, d->autoscale, &c->autoscale) == 0;
+        container_autoscale(d, c);
+    }
+    if (wants_reclaim(d, c)) {
+        reclaim_init(c->config.cgroup_fd, &c->reclaim);
+        c->reclaiming = 1;
+        container_reclaim(d, c);
+    }
+
+    reply(client, "STARTED %lu %d\n", c->id, c->pid);
+    return 0;
+}
+
+//------------------------------------------------------
+// 凍結/解凍
+//   cgroup.freeze に書いてすぐ戻り, cgroup.events の frozen が変わったら応答する
+//   名前空間・マウント・seccomp はそのまま残るので, 解凍は書き込み 1 回で済む
+//------------------------------------------------------
+
+static struct container *find_container(struct daemon *d, unsigned long id) {
+    for (struct container *c = d->containers; c; c = c->next) {
+        if (c->id == id) {
+            return c;
+        }
+    }
+    return NULL;
+}
+
+static void freeze_reply(struct container *c) {
+    c->freeze_pending = 0;
+    if (!c->freeze_target) {
+        reply(c->freeze_client, "THAWED %lu %llu\n", c->id, (unsigned long long)c->freeze_us);
+    } else {
+        reply(c->freeze_client, "FROZEN %lu %llu %llu\n", c->id, (unsigned long long)c->freeze_us,
+              (unsigned long long)c->freeze_reclaimed);
+    }
+    c->freeze_client = NULL;
+}
+
+static void container_freeze_progress(struct daemon *d, struct container *c) {
+    if (!c->freeze_pending || c->freeze_reclaiming || c->frozen != c->freeze_target) {
+        return;
+    }
+    c->freeze_us = (timing_now_ns() - c->freeze_start_ns) / 1000;
+    // 止まっている間は触られないので, 押し出したページは解凍まで戻ってこない
+    //  押し出しはタイマーで小分けに進め, 終わってから FROZEN を返す
+    if (c->freeze_target && c->reclaim_bytes) {
+        c->freeze_reclaiming = 1;
+        reclaim_work_add(d);
+        return;
+    }
+    freeze_reply(c);
+}
+
+// 凍結後の押し出しを 1 回分 (DAEMON_RECLAIM_CHUNK まで) 進める
+static void container_freeze_reclaim_step(struct daemon *d, struct container *c) {
+    uint64_t chunk = c->reclaim_bytes < DAEMON_RECLAIM_CHUNK ? c->reclaim_bytes : DAEMON_RECLAIM_CHUNK;
+    int64_t n = cgroup_reclaim(c->config.cgroup_fd, chunk);
+    c->freeze_reclaimed += n > 0 ? (uint64_t)n : 0;
+    c->reclaim_bytes -= chunk;
+    // 1 回分を押し出しきれなければ, 残りを書いても回収できるものはもう無い
+    if (n < (int64_t)chunk) {
+        c->reclaim_bytes = 0;
+    }
+    if (c->reclaim_bytes == 0) {
+        c->freeze_reclaiming = 0;
+        d->reclaim_pending--;
+        freeze_reply(c);
+    }
+}
+
+static void handle_reclaim_timer(struct daemon *d) {
+    uint64_t ticks;
+    if (read(d->reclaim_timer_fd, &ticks, sizeof(ticks)) != sizeof(ticks)) {
+        return;
+    }
+    // 予算を使い切ったら残りは次の起床へ (この周でまだ進めていないものから)
+    uint64_t start = timing_now_ns();
+    int finished_round = 1;
+    for (struct container *c = d->containers; c; c = c->next) {
+        int proactive = c->reclaiming && c->reclaim.pending;
+        if ((!c->freeze_reclaiming && !proactive) || c->reclaim_round == d->reclaim_round) {
+            continue;
+        }
+        if (timing_now_ns() - start >= DAEMON_RECLAIM_BUDGET_NS) {
+            finished_round = 0;
+            break;
+        }
+        c->reclaim_round = d->reclaim_round;
+        // FROZEN を待たせている方を先に進める
+        if (c->freeze_reclaiming) {
+            container_freeze_reclaim_step(d, c);
+        } else if (reclaim_step(c->config.cgroup_fd, &c->reclaim, DAEMON_RECLAIM_CHUNK) <= 0) {
+            d->reclaim_pending--;
+        }
+    }
+    if (finished_round) {
+        d->reclaim_round++;
+    }
+    if (d->reclaim_pending == 0) {
+        struct itimerspec its = { 0 };
+        timerfd_settime(d->reclaim_timer_fd, 0, &its, NULL);
+    }
+}
+
+static int container_freeze(struct daemon *d, struct client *client, struct container *c, int frozen,
+                            uint64_t reclaim) {
+    if (c->exited || c->freeze_pending || c->freeze_target == frozen) {
+        return -1;
+    }
+    if (cgroup_freeze(c->config.cgroup_fd, frozen) != 0) {
+        return -1;
+    }
+    c->freeze_target = frozen;
+    c->freeze_pending = 1;
+    c->freeze_start_ns = timing_now_ns();
+    c->freeze_client = client;
+    c->reclaim_bytes = reclaim;
+    c->freeze_reclaimed = 0;
+    // 止まっているプロセスが少なければ書き込みの時点で終わっていることが多い
+    if (c->events_fd >= 0) {
+        read_events(c);
+    } else {
+        c->frozen = frozen;
+    }
+    container_freeze_progress(d, c);
+    return 0;
+}
+
+static void handle_handshake(struct daemon *d, struct container *c) {
+    trace_attach(c->config.trace_track, TRACE_LAUNCHER);
+    // 子は userns() で書き込み済みなので read はブロックしない
+    if (handle_child_uid_map(c->pid, c->sock, &c->config.ids, &c->config.net) != 0) {
+        fprintf(stderr, "handle_child_uid_map failed for %lu\n", c->id);
+        kill(c->pid, SIGKILL);
+    }
+    unwatch_fd(d, c->sock);
+    close(c->sock);
+    c->sock = -1;
+}
+
+static void handle_pidfd(struct daemon *d, struct container *c) {
+    siginfo_t info;
+    memset(&info, 0, sizeof(info));
+    if (waitid(P_PIDFD, c->pidfd, &info, WEXITED | WNOHANG) < 0 || info.si_pid == 0) {
+        return;
+    }
+    container_exited(d, c, info.si_code == CLD_EXITED ? info.si_status : 1);
+}
+
+// pidfd が使えない (clone() フォールバック) 場合は SIGCHLD で回収する
+//  waitpid(-1) だと pidfd で待っている子まで回収してしまうので, pidfd の無いものだけ個別に待つ
+static void handle_sigchld(struct daemon *d) {
+    struct container *next;
+    for (struct container *c = d->containers; c; c = next) {
+        // container_exited で片付くと c->next は dead_containers 側につながる
+        next = c->next;
+        int status = 0;
+        if (c->pidfd >= 0 || c->exited || waitpid(c->pid, &status, WNOHANG) != c->pid) {
+            continue;
+        }
+        container_exited(d, c, WIFEXITED(status) ? WEXITSTATUS(status) : 1);
+    }
+}
+
+// 1 回の起床で移すのは上限まで (残りは level-triggered の次の通知で続ける)
+// block 方針でレートを超えたら epoll から外し、タイマーで再開する
+static void handle_log(struct daemon *d, struct container *c) {
+    switch (log_pump(&c->log, timing_now_ns())) {
+    case LOG_PUMP_IDLE:
+    case LOG_PUMP_MORE:
+        break;
+    case LOG_PUMP_THROTTLED:
+        rewatch_fd(d, c->log.pipe_r, 0, &c->log_watch);
+        if (d->log_throttled++ == 0) {
+            if (d->log_timer_fd < 0) {
+                d->log_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+                if (d->log_timer_fd < 0) {
+                    perror("timerfd_create failed");
+                    break;
+                }
+                d->log_timer_watch = (struct watch){ WATCH_LOG_TIMER, NULL };
+                watch_fd(d, d->log_timer_fd, EPOLLIN, &d->log_timer_watch);
+            }
+            struct itimerspec its = {
+                .it_interval = { 0, DAEMON_LOG_TICK_NS },
+                .it_value = { 0, DAEMON_LOG_TICK_NS },
+            };
+            timerfd_settime(d->log_timer_fd, 0, &its, NULL);
+        }
+        break;
+    case LOG_PUMP_EOF:
+    case LOG_PUMP_ERROR:
+        // 残りは container_destroy の log_close で書き出す
+        unwatch_fd(d, c->log.pipe_r);
+        break;
+    }
+}
+
+static void handle_log_timer(struct daemon *d) {
+    uint64_t ticks;
+    if (read(d->log_timer_fd, &ticks, sizeof(ticks)) != sizeof(ticks)) {
+        return;
+    }
+    uint64_t now = timing_now_ns();
+    for (struct container *c = d->containers; c; c = c->next) {
+        if (!c->log.config || !c->log.throttled || now < log_resume_ns(&c->log)) {
+            continue;
+        }
+        d->log_throttled--;
+        rewatch_fd(d, c->log.pipe_r, EPOLLIN, &c->log_watch);
+        handle_log(d, c);
+    }
+    if (d->log_throttled == 0) {
+        struct itimerspec its = { 0 };
+        timerfd_settime(d->log_timer_fd, 0, &its, NULL);
+    }
+}
+
+//------------------------------------------------------
+// 3. クライアント
+//------------------------------------------------------
+
+static void client_close(struct daemon *d, struct client *client) {
+    for (struct container *c = d->containers; c; c = c->next) {
+        if (c->client == client) {
+            c->client = NULL;
+        }
+        if (c->freeze_client == client) {
+            c->freeze_client = NULL;
+        }
+    }
+    for (struct client **pp = &d->clients; *pp; pp = &(*pp)->next) {
+        if (*pp == client) {
+            *pp = client->next;
+            break;
+        }
+    }
+    unwatch_fd(d, client->fd);
+    close(client->fd);
+    client->dead = 1;
+    client->next = d->dead_clients;
+    d->dead_clients = client;
+}
+
+static void free_dead(struct daemon *d) {
+    while (d->dead_containers) {
+        struct container *c = d->dead_containers;
+        d->dead_containers = c->next;
+        free(c->request);
+        free(c);
+    }
+    while (d->dead_clients) {
+        struct client *client = d->dead_clients;
+        d->dead_clients = client->next;
+        free(client->out);
+        free(client);
+    }
+}
+
+static int watch_is_dead(struct watch *w) {
+    switch (w->kind) {
+    case WATCH_CLIENT:
+        return ((struct client *)w->owner)->dead;
+    case WATCH_PIDFD:
+    case WATCH_HANDSHAKE:
+    case WATCH_EVENTS:
+    case WATCH_PRESSURE:
+    case WATCH_LOG:
+        return ((struct container *)w->owner)->dead;
+    default:
+        return 0;
+    }
+}
+
+static void handle_command(struct daemon *d, struct client *client, char *line) {
+    if (!strncmp(line, "RUN ", 4)) {
+        if (container_start(d, client, line + 4) != 0) {
+            reply(client, "ERROR run failed\n");
+        }
+    } else if (!strcmp(line, "PS")) {
+        for (struct container *c = d->containers; c; c = c->next) {
+            reply(client, "%lu %d %s %s\n", c->id, c->pid, c->hostname,
+                  c->exited ? "exited" : c->frozen ? "frozen" : "running");
+        }
+        reply(client, "END\n");
+    } else if (!strcmp(line, "METRICS")) {
+        size_t len = 0;
+        char *text = d->metrics ? metrics_render(d->metrics, &len) : NULL;
+        if (text) {
+            client_send(client, text, len);
+            free(text);
+        }
+        reply(client, "END\n");
+    } else if (!strncmp(line, "FREEZE ", 7) || !strncmp(line, "THAW ", 5)) {
+        int frozen = line[0] == 'F';
+        char *end;
+        unsigned long id = strtoul(line + (frozen ? 7 : 5), &end, 10);
+        uint64_t reclaim = frozen ? strtoull(end, NULL, 10) : 0;
+        struct container *c = find_container(d, id);
+        if (!c || container_freeze(d, client, c, frozen, reclaim) != 0) {
+            reply(client, "ERROR %s failed\n", frozen ? "freeze" : "thaw");
+        }
+    } else if (!strcmp(line, "RECLAIM")) {
+        for (struct container *c = d->containers; c; c = c->next) {
+            if (!c->reclaiming) {
+                continue;
+            }
+            char high[32];
+            if (c->reclaim.high) {
+                snprintf(high, sizeof(high), "%llu", (unsigned long long)c->reclaim.high);
+            } else {
+                strcpy(high, "max");
+            }
+            reply(client, "%lu %s high=%s reclaimed=%llu refaults_per_sec=%llu\n", c->id, c->hostname, high,
+                  (unsigned long long)c->reclaim.reclaimed_total, (unsigned long long)c->reclaim.refault_per_sec);
+        }
+        reply(client, "END\n");
+    } else if (!strcmp(line, "PLACEMENT")) {
+        size_t len = 0;
+        char *text = d->placement ? placement_render(d->placement, &len) : NULL;
+        if (text) {
+            client_send(client, text, len);
+            free(text);
+        }
+        reply(client, "END\n");
+    } else if (line[0] != '\0') {
+        reply(client, "ERROR unknown command\n");
+    }
+}
+
+static void handle_client(struct daemon *d, struct client *client, uint32_t events) {
+    if (events & EPOLLOUT) {
+        client_flush(client);
+    }
+    // 送り終えた, または相手が完全に切れた
+    if (client->closing && (client->out_len == 0 || (events & (EPOLLHUP | EPOLLERR)))) {
+        client_close(d, client);
+        return;
+    }
+    if (client->closing || !(events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+        return;
+    }
+    ssize_t n = read(client->fd, client->buf + client->len, sizeof(client->buf) - 1 - client->len);
+    if (n <= 0) {
+        if (n < 0 && errno == EAGAIN) {
+            return;
+        }
+        // 書き込み側だけ閉じた (echo ... | socat など) ときは, 溜めた応答を送り終えてから閉じる
+        if (n == 0 && client->out_len > 0) {
+            client->closing = 1;
+            rewatch_fd(d, client->fd, EPOLLOUT, &client->watch);
+            return;
+        }
+        client_close(d, client);
+        return;
+    }
+    client->len += (size_t)n;
+
+    char *newline;
+    while ((newline = memchr(client->buf, '\n', client->len)) != NULL) {
+        *newline = '\0';
+        if (newline > client->buf && newline[-1] == '\r') {
+            newline[-1] = '\0';
+        }
+        size_t consumed = (size_t)(newline - client->buf) + 1;
+        handle_command(d, client, client->buf);
+        memmove(client->buf, client->buf + consumed, client->len - consumed);
+        client->len -= consumed;
+    }
+    if (client->len == sizeof(client->buf) - 1) {
+        reply(client, "ERROR line too long\n");
+        client->len = 0;
+    }
+}
+
+static void handle_accept(struct daemon *d) {
+    int fd;
+    while ((fd = accept4(d->listen_fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK)) >= 0) {
+        struct client *client = calloc(1, sizeof(*client));
+        if (!client) {
+            close(fd);
+            continue;
+        }
+        client->fd = fd;
+        client->daemon = d;
+        client->watch = (struct watch){ WATCH_CLIENT, client };
+        if (watch_fd(d, fd, EPOLLIN, &client->watch) != 0) {
+            close(fd);
+            free(client);
+            continue;
+        }
+        client->next = d->clients;
+        d->clients = client;
+    }
+}
+
+//------------------------------------------------------
+// 4. 初期化とイベントループ
+//------------------------------------------------------
+
+static int open_listen_socket(const char *path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd < 0) {
+        perror("socket failed");
+        return -1;
+    }
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 128) != 0) {
+        fprintf(stderr, "bind/listen %s failed: %m\n", path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// 多数のコンテナ分の fd を持つので soft limit を hard limit まで上げる
+static void raise_nofile_limit(void) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+int run_daemon(const struct daemon_config *config) {
+    struct daemon d;
+    memset(&d, 0, sizeof(d));
+    d.running = 1;
+    d.log_timer_fd = -1;
+    d.reclaim_timer_fd = -1;
+    d.reclaim_round = 1;
+    d.autoscale = config->autoscale;
+    d.reclaim = config->reclaim;
+    const char *socket_path = config->socket_path;
+    const char *metrics_path = config->metrics_path;
+    if (!metrics_path && (d.autoscale || d.reclaim)) {
+        metrics_path = "-";
+    }
+
+    raise_nofile_limit();
+
+    if (config->placement) {
+        d.placement = placement_create(NULL);
+        if (!d.placement) {
+            return -1;
+        }
+        set_cgroup_cpuset(1);
+    }
+
+    // コンテナ間で共有できる準備はここで 1 回だけ行う
+    if (setup_cgroup_root() != 0 || prepare_security_profile() != 0) {
+        return -1;
+    }
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+
+    d.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    d.signal_fd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+    d.listen_fd = open_listen_socket(socket_path);
+    if (d.epoll_fd < 0 || d.signal_fd < 0 || d.listen_fd < 0) {
+        perror("daemon setup failed");
+        return -1;
+    }
+    d.listen_watch = (struct watch){ WATCH_LISTEN, NULL };
+    d.signal_watch = (struct watch){ WATCH_SIGNAL, NULL };
+    watch_fd(&d, d.listen_fd, EPOLLIN, &d.listen_watch);
+    watch_fd(&d, d.signal_fd, EPOLLIN, &d.signal_watch);
+    if (metrics_path) {
+        d.metrics = metrics_create(strcmp(metrics_path, "-") ? metrics_path : NULL,
+                                   config->metrics_interval ? config->metrics_interval : DAEMON_METRICS_INTERVAL);
+        if (!d.metrics) {
+            return -1;
+        }
+        d.metrics_watch = (struct watch){ WATCH_METRICS, NULL };
+        watch_fd(&d, metrics_timer_fd(d.metrics), EPOLLIN, &d.metrics_watch);
+    }
+    fprintf(stderr, "=> daemon listening on %s\n", socket_path);
+
+    struct epoll_event events[DAEMON_MAX_EVENTS];
+    while (d.running) {
+        int n = epoll_wait(d.epoll_fd, events, DAEMON_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait failed");
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            struct watch *w = events[i].data.ptr;
+            if (watch_is_dead(w)) {
+                continue;
+            }
+            switch (w->kind) {
+            case WATCH_LISTEN:
+                handle_accept(&d);
+                break;
+            case WATCH_SIGNAL: {
+                struct signalfd_siginfo info;
+                while (read(d.signal_fd, &info, sizeof(info)) == sizeof(info)) {
+                    if (info.ssi_signo == SIGCHLD) {
+                        handle_sigchld(&d);
+                    } else {
+                        d.running = 0;
+                    }
+                }
+                break;
+            }
+            case WATCH_CLIENT:
+                handle_client(&d, w->owner, events[i].events);
+                break;
+            case WATCH_PIDFD:
+                handle_pidfd(&d, w->owner);
+                break;
+            case WATCH_HANDSHAKE:
+                handle_handshake(&d, w->owner);
+                break;
+            case WATCH_EVENTS: {
+                struct container *c = w->owner;
+                read_events(c);
+                container_freeze_progress(&d, c);
+                container_maybe_cleanup(&d, c);
+                break;
+            }
+            case WATCH_METRICS:
+                metrics_tick(d.metrics);
+                for (struct container *c = d.containers; c; c = c->next) {
+                    container_autoscale(&d, c);
+                    container_reclaim(&d, c);
+                }
+                break;
+            case WATCH_PRESSURE: {
+                struct container *c = w->owner;
+                metrics_sample(d.metrics, &c->metrics);
+                container_autoscale(&d, c);
+                container_reclaim(&d, c);
+                break;
+            }
+            case WATCH_LOG:
+                handle_log(&d, w->owner);
+                break;
+            case WATCH_LOG_TIMER:
+                handle_log_timer(&d);
+                break;
+            case WATCH_RECLAIM_TIMER:
+                handle_reclaim_timer(&d);
+                break;
+            }
+        }
+        free_dead(&d);
+    }
+
+    fprintf(stderr, "=> daemon shutting down...\n");
+    while (d.containers) {
+        struct container *c = d.containers;
+        if (!c->exited) {
+            kill(c->pid, SIGKILL);
+            waitpid(c->pid, NULL, 0);
+        }
+        container_destroy(&d, c);
+    }
+    while (d.clients) {
+        client_close(&d, d.clients);
+    }
+    free_dead(&d);
+    metrics_destroy(d.metrics);
+    placement_destroy(d.placement);
+    if (d.log_timer_fd >= 0) {
+        close(d.log_timer_fd);
+    }
+    if (d.reclaim_timer_fd >= 0) {
+        close(d.reclaim_timer_fd);
+    }
+    close(d.listen_fd);
+    unlink(socket_path);
+    close(d.signal_fd);
+    close(d.epoll_fd);
+    return 0;
+}
@@ -0,0 +1,133 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mount.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+
+#include "hugepage.h"
+
+// 6.18 で追加: madvise(MADV_HUGEPAGE) した範囲だけ THP を使う
+#ifndef PR_THP_DISABLE_EXCEPT_ADVISED
+#define PR_THP_DISABLE_EXCEPT_ADVISED (1 << 1)
+#endif
+
+// "2MB" / "2M" / "1GB" / "2048kB" などをバイト数にする
+static uint64_t parse_page_size(const char *text) {
+    char *end;
+    uint64_t value = strtoull(text, &end, 10);
+    if (end == text || value == 0) {
+        return 0;
+    }
+    switch (*end) {
+    case 'k': case 'K': value <<= 10; end++; break;
+    case 'm': case 'M': value <<= 20; end++; break;
+    case 'g': case 'G': value <<= 30; end++; break;
+    default: return 0;
+    }
+    if (*end == 'B' || *end == 'b') {
+        end++;
+    }
+    // huge page の大きさは 2 のべき乗
+    return *end == '\0' && (value & (value - 1)) == 0 ? value : 0;
+}
+
+int parse_hugepage_config(const char *spec, struct hugepage_config *config) {
+    char copy[128];
+    if (strlen(spec) >= sizeof(copy)) {
+        return -1;
+    }
+    strcpy(copy, spec);
+    enum thp_policy thp = config->thp;   // -t とは独立
+    memset(config, 0, sizeof(*config));
+    config->thp = thp;
+
+    char *save = NULL;
+    char *size = strtok_r(copy, ",", &save);
+    if (!size || !(config->page_size = parse_page_size(size))) {
+        return -1;
+    }
+    // カーネルの hugetlb.<size>.* と同じ表記にする
+    if (config->page_size >= (1ULL << 30)) {
+        snprintf(config->size, sizeof(config->size), "%lluGB", (unsigned long long)(config->page_size >> 30));
+    } else if (config->page_size >= (1ULL << 20)) {
+        snprintf(config->size, sizeof(config->size), "%lluMB", (unsigned long long)(config->page_size >> 20));
+    } else {
+        snprintf(config->size, sizeof(config->size), "%lluKB", (unsigned long long)(config->page_size >> 10));
+    }
+
+    for (char *tok = strtok_r(NULL, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        char *value = strchr(tok, '=');
+        if (!value) {
+            return -1;
+        }
+        *value++ = '\0';
+        if (!strcmp(tok, "max")) {
+            config->max = strtoull(value, NULL, 10);
+        } else if (!strcmp(tok, "mount") && value[0] == '/' && strlen(value) < sizeof(config->mount)) {
+            strcpy(config->mount, value);
+        } else {
+            return -1;
+        }
+    }
+    config->enabled = 1;
+    return 0;
+}
+
+int parse_thp_policy(const char *name, enum thp_policy *policy) {
+    if (!strcmp(name, "system")) {
+        *policy = THP_POLICY_SYSTEM;
+    } else if (!strcmp(name, "never")) {
+        *policy = THP_POLICY_NEVER;
+    } else if (!strcmp(name, "madvise")) {
+        *policy = THP_POLICY_MADVISE;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+int mount_hugetlbfs(const struct hugepage_config *config) {
+    if (!config->enabled || config->mount[0] == '\0') {
+        return 0;
+    }
+    if (mkdir(config->mount, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "mkdir %s failed: %m\n", config->mount);
+        return -1;
+    }
+    // コンテナ内のどのユーザーでもファイルを作れるように sticky + 1777 にする
+    // size はマウント単位の上限 (cgroup の hugetlb.<size>.max とは別に効く)
+    char options[128];
+    int len = snprintf(options, sizeof(options), "pagesize=%llu,mode=01777",
+                       (unsigned long long)config->page_size);
+    if (config->max) {
+        snprintf(options + len, sizeof(options) - (size_t)len, ",size=%llu", (unsigned long long)config->max);
+    }
+    if (mount("hugetlbfs", config->mount, "hugetlbfs", MS_NOSUID | MS_NODEV | MS_NOEXEC, options) != 0) {
+        fprintf(stderr, "mount hugetlbfs (%s) on %s failed: %m\n", options, config->mount);
+        return -1;
+    }
+    return 0;
+}
+
+int set_thp_policy(enum thp_policy policy) {
+    switch (policy) {
+    case THP_POLICY_SYSTEM:
+        return 0;
+    case THP_POLICY_NEVER:
+        if (prctl(PR_SET_THP_DISABLE, 1, 0, 0, 0) != 0) {
+            perror("prctl(PR_SET_THP_DISABLE) failed");
+            return -1;
+        }
+        return 0;
+    case THP_POLICY_MADVISE:
+        if (prctl(PR_SET_THP_DISABLE, 1, PR_THP_DISABLE_EXCEPT_ADVISED, 0, 0) != 0) {
+            perror("prctl(PR_SET_THP_DISABLE, EXCEPT_ADVISED) failed");
+            return -1;
+        }
+        return 0;
+    }
+    return -1;
+}
@@ -0,0 +1,203 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "idmap.h"
+
+static uid_t range_first = ID_RANGE_DEFAULT_FIRST;
+static uid_t range_size  = ID_RANGE_DEFAULT_SIZE;
+static unsigned int range_count = ID_RANGE_DEFAULT_COUNT;
+
+// 範囲ごとの user namespace (idmapped mount 用, 最初に要ったときに作る)
+//  rootfs の所有者 (uid/gid の起点) が前回と違えば作り直す
+struct range_userns {
+    int   fd;
+    uid_t owner_uid;
+    gid_t owner_gid;
+};
+static struct range_userns userns_fds[ID_RANGE_MAX_COUNT];
+static int userns_fds_ready = 0;
+
+int parse_id_ranges(const char *spec) {
+    char *end;
+    unsigned long long first = strtoull(spec, &end, 10);
+    if (end == spec || *end != ':') {
+        return -1;
+    }
+    const char *size_text = end + 1;
+    unsigned long long size = strtoull(size_text, &end, 10);
+    if (end == size_text || size == 0) {
+        return -1;
+    }
+    unsigned long long count = range_count;
+    if (*end == ':') {
+        const char *count_text = end + 1;
+        count = strtoull(count_text, &end, 10);
+        if (end == count_text) {
+            return -1;
+        }
+    }
+    // uid 0 (ホストの root) を含む範囲や 32bit を超える範囲は使わない
+    if (*end != '\0' || first == 0 || size > (uid_t)-1 || count == 0 || count > ID_RANGE_MAX_COUNT
+        || first + size * count > (uid_t)-1) {
+        return -1;
+    }
+    range_first = (uid_t)first;
+    range_size = (uid_t)size;
+    range_count = (unsigned int)count;
+    return 0;
+}
+
+int id_range_acquire(struct id_range *range) {
+    range->lock_fd = -1;
+    if (mkdir(ID_RANGE_LOCK_DIR, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "mkdir %s failed: %m\n", ID_RANGE_LOCK_DIR);
+        return -1;
+    }
+    for (unsigned int i = 0; i < range_count; i++) {
+        uid_t start = range_first + range_size * i;
+        char path[64];
+        snprintf(path, sizeof(path), "%s/%u", ID_RANGE_LOCK_DIR, (unsigned int)start);
+        int fd = open(path, O_RDONLY | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            fprintf(stderr, "open %s failed: %m\n", path);
+            return -1;
+        }
+        // 他のコンテナ (別のランチャーを含む) が使用中
+        if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+            close(fd);
+            continue;
+        }
+        range->start = start;
+        range->size = range_size;
+        range->lock_fd = fd;
+        return 0;
+    }
+    // 共有すると同時に動くコンテナどうしで uid/gid が重なるので, 起動のほうを失敗させる
+    fprintf(stderr, "no free uid/gid range (%u x %u from %u), raise COUNT in -U\n",
+            range_count, (unsigned int)range_size, (unsigned int)range_first);
+    return -1;
+}
+
+void id_range_release(struct id_range *range) {
+    // close で flock も外れる
+    if (range->lock_fd >= 0) {
+        close(range->lock_fd);
+        range->lock_fd = -1;
+    }
+}
+
+// "<起点> start size" を uid_map/gid_map に書く
+static int write_maps(pid_t pid, const struct id_range *range, uid_t owner_uid, gid_t owner_gid) {
+    char path[64];
+    const char *files[] = { "uid_map", "gid_map" };
+    unsigned int owners[] = { (unsigned int)owner_uid, (unsigned int)owner_gid };
+    for (int i = 0; i < 2; i++) {
+        snprintf(path, sizeof(path), "/proc/%d/%s", pid, files[i]);
+        int fd = open(path, O_WRONLY | O_CLOEXEC);
+        if (fd < 0) {
+            fprintf(stderr, "open %s failed: %m\n", path);
+            return -1;
+        }
+        if (dprintf(fd, "%u %u %u\n", owners[i], (unsigned int)range->start, (unsigned int)range->size) < 0) {
+            fprintf(stderr, "write %s failed: %m\n", path);
+            close(fd);
+            return -1;
+        }
+        close(fd);
+    }
+    return 0;
+}
+
+int id_range_write_maps(pid_t pid, const struct id_range *range) {
+    return write_maps(pid, range, 0, 0);
+}
+
+/**
+ * @brief 使い捨ての子に user namespace を作らせ, マップを書いてから ns の fd だけ残す
+ */
+static int create_userns(const struct id_range *range, uid_t owner_uid, gid_t owner_gid) {
+    int ready[2], hold[2];
+    if (pipe2(ready, O_CLOEXEC) != 0) {
+        perror("pipe2 failed");
+        return -1;
+    }
+    if (pipe2(hold, O_CLOEXEC) != 0) {
+        perror("pipe2 failed");
+        close(ready[0]);
+        close(ready[1]);
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork failed");
+        close(ready[0]);
+        close(ready[1]);
+        close(hold[0]);
+        close(hold[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        // 親が ns を開き終えて hold を閉じるまで待つ
+        char c = unshare(CLONE_NEWUSER) == 0;
+        close(hold[1]);
+        if (write(ready[1], &c, 1) != 1 || !c) {
+            _exit(EXIT_FAILURE);
+        }
+        while (read(hold[0], &c, 1) < 0 && errno == EINTR) {
+        }
+        _exit(EXIT_SUCCESS);
+    }
+
+    close(ready[1]);
+    close(hold[0]);
+    int fd = -1;
+    char ok = 0;
+    if (read(ready[0], &ok, 1) == 1 && ok && write_maps(pid, range, owner_uid, owner_gid) == 0) {
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/%d/ns/user", pid);
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            fprintf(stderr, "open %s failed: %m\n", path);
+        }
+    }
+    close(ready[0]);
+    close(hold[1]);
+    waitpid(pid, NULL, 0);
+    return fd;
+}
+
+int id_range_userns_fd(const struct id_range *range, uid_t owner_uid, gid_t owner_gid) {
+    if (range->lock_fd < 0 || range->start < range_first || range->size != range_size) {
+        return -1;
+    }
+    unsigned int slot = (range->start - range_first) / range_size;
+    if (slot >= range_count) {
+        return -1;
+    }
+    if (!userns_fds_ready) {
+        for (int i = 0; i < ID_RANGE_MAX_COUNT; i++) {
+            userns_fds[i].fd = -1;
+        }
+        userns_fds_ready = 1;
+    }
+    struct range_userns *ns = &userns_fds[slot];
+    if (ns->fd >= 0 && (ns->owner_uid != owner_uid || ns->owner_gid != owner_gid)) {
+        close(ns->fd);
+        ns->fd = -1;
+    }
+    if (ns->fd < 0) {
+        ns->fd = create_userns(range, owner_uid, owner_gid);
+        ns->owner_uid = owner_uid;
+        ns->owner_gid = owner_gid;
+    }
+    return ns->fd;
+}
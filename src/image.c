@@ -0,0 +1,872 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <ftw.h>
+#include <linux/limits.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/wait.h>
+#include <sys/xattr.h>
+
+#include "image.h"
+#include "sha256.h"
+
+#define TAR_BLOCK    512
+#define READ_BUFSIZE (64 * 1024)
+
+// 伸長済みの tar ストリーム (tar 全体の sha256 も同時に計算する)
+struct tar_reader {
+    int      fd;
+    pid_t    decompressor;   // gzip/zstd の子プロセス (-1 なら非圧縮)
+    struct sha256_ctx hash;
+    uint8_t  buf[READ_BUFSIZE];
+    size_t   pos;
+    size_t   len;
+};
+
+// tar のエントリ (pax/GNU 拡張で上書きされた値を含む)
+struct tar_entry {
+    char     type;
+    char     path[PATH_MAX];
+    char     link[PATH_MAX];
+    uint64_t size;
+    mode_t   mode;
+    uid_t    uid;
+    gid_t    gid;
+    time_t   mtime;
+    dev_t    dev;
+};
+
+// pax/GNU 拡張ヘッダで指定された値 (次のエントリに適用する)
+struct tar_override {
+    char     path[PATH_MAX];
+    char     link[PATH_MAX];
+    uint64_t size;
+    uid_t    uid;
+    gid_t    gid;
+    time_t   mtime;
+    bool     has_path, has_link, has_size, has_uid, has_gid, has_mtime;
+};
+
+//------------------------------------------------------
+// 1. 読み込み (圧縮形式の判定と伸長プロセス)
+//------------------------------------------------------
+
+/**
+ * @brief 先頭のマジックで圧縮形式を判定し, 必要なら伸長プロセスにつなぐ
+ * @return 0 on success, -1 on failure
+ */
+static int open_reader(struct tar_reader *r, const char *archive) {
+    memset(r, 0, sizeof(*r));
+    r->decompressor = -1;
+    sha256_init(&r->hash);
+
+    int fd = open(archive, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "open %s failed: %m\n", archive);
+        return -1;
+    }
+    uint8_t magic[4] = {0};
+    if (pread(fd, magic, sizeof(magic), 0) < 0) {
+        fprintf(stderr, "read %s failed: %m\n", archive);
+        close(fd);
+        return -1;
+    }
+
+    const char *program = NULL;
+    if (magic[0] == 0x1f && magic[1] == 0x8b) {
+        program = "gzip";
+    } else if (magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) {
+        program = "zstd";
+    }
+    if (!program) {
+        r->fd = fd;
+        return 0;
+    }
+
+    // ファイルを stdin に, パイプを stdout につないで "-dc" で伸長させる
+    int pipefd[2];
+    if (pipe2(pipefd, O_CLOEXEC) != 0) {
+        perror("pipe2 failed");
+        close(fd);
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork failed");
+        close(fd);
+        close(pipefd[0]);
+        close(pipefd[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        if (dup2(fd, STDIN_FILENO) < 0 || dup2(pipefd[1], STDOUT_FILENO) < 0) {
+            _exit(127);
+        }
+        execlp(program, program, "-dc", (char *)NULL);
+        fprintf(stderr, "exec %s failed: %m\n", program);
+        _exit(127);
+    }
+    close(fd);
+    close(pipefd[1]);
+    r->fd = pipefd[0];
+    r->decompressor = pid;
+    return 0;
+}
+
+/**
+ * @brief 読み込みを終える (伸長プロセスの終了ステータスも確認する)
+ * @return 0 on success, -1 on failure
+ */
+static int close_reader(struct tar_reader *r) {
+    close(r->fd);
+    if (r->decompressor < 0) {
+        return 0;
+    }
+    int status = 0;
+    while (waitpid(r->decompressor, &status, 0) < 0) {
+        if (errno != EINTR) {
+            perror("waitpid failed");
+            return -1;
+        }
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "decompressor failed (status %d)\n", status);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief ストリームから最大 len バイト読む (通ったバイトはすべてハッシュに入る)
+ * @return 読んだバイト数, EOF で 0, 失敗時 -1
+ */
+static ssize_t reader_read(struct tar_reader *r, void *dst, size_t len) {
+    if (r->pos == r->len) {
+        ssize_t n;
+        do {
+            n = read(r->fd, r->buf, sizeof(r->buf));
+        } while (n < 0 && errno == EINTR);
+        if (n < 0) {
+            perror("read archive failed");
+            return -1;
+        }
+        r->pos = 0;
+        r->len = (size_t)n;
+        if (n == 0) {
+            return 0;
+        }
+        sha256_update(&r->hash, r->buf, (size_t)n);
+    }
+    size_t n = r->len - r->pos;
+    if (n > len) {
+        n = len;
+    }
+    if (dst) {
+        memcpy(dst, r->buf + r->pos, n);
+    }
+    r->pos += n;
+    return (ssize_t)n;
+}
+
+// ちょうど len バイト読む (dst が NULL なら読み飛ばす)
+static int reader_full(struct tar_reader *r, void *dst, uint64_t len) {
+    uint8_t *p = dst;
+    while (len > 0) {
+        ssize_t n = reader_read(r, p, len > SIZE_MAX ? SIZE_MAX : (size_t)len);
+        if (n <= 0) {
+            if (n == 0) {
+                fprintf(stderr, "unexpected end of archive\n");
+            }
+            return -1;
+        }
+        if (p) {
+            p += n;
+        }
+        len -= (uint64_t)n;
+    }
+    return 0;
+}
+
+// データの後ろの 512 バイト境界までのパディング
+static uint64_t tar_padding(uint64_t size) {
+    return (TAR_BLOCK - size % TAR_BLOCK) % TAR_BLOCK;
+}
+
+//------------------------------------------------------
+// 2. ヘッダ解析 (ustar + pax/GNU の長い名前)
+//------------------------------------------------------
+
+// 8 進数 (GNU の base-256 表記も受け付ける)
+static uint64_t parse_number(const char *field, size_t len) {
+    const unsigned char *p = (const unsigned char *)field;
+    uint64_t value = 0;
+    if (p[0] & 0x80) {
+        value = p[0] & 0x7f;
+        for (size_t i = 1; i < len; i++) {
+            value = (value << 8) | p[i];
+        }
+        return value;
+    }
+    for (size_t i = 0; i < len && p[i]; i++) {
+        if (p[i] >= '0' && p[i] <= '7') {
+            value = (value << 3) | (uint64_t)(p[i] - '0');
+        } else if (p[i] != ' ') {
+            break;
+        }
+    }
+    return value;
+}
+
+static bool header_is_zero(const uint8_t *block) {
+    for (size_t i = 0; i < TAR_BLOCK; i++) {
+        if (block[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool header_checksum_ok(const uint8_t *block) {
+    uint64_t expected = parse_number((const char *)block + 148, 8);
+    uint64_t sum = 0;
+    for (size_t i = 0; i < TAR_BLOCK; i++) {
+        sum += (i >= 148 && i < 156) ? ' ' : block[i];
+    }
+    return sum == expected;
+}
+
+// NUL 終端されていないかもしれないフィールドをコピー
+static void copy_field(char *dst, size_t dstlen, const char *field, size_t len) {
+    size_t n = strnlen(field, len);
+    if (n >= dstlen) {
+        n = dstlen - 1;
+    }
+    memcpy(dst, field, n);
+    dst[n] = '\0';
+}
+
+/**
+ * @brief pax 拡張ヘッダ ("<len> key=value\n" の並び) を読む
+ */
+static void parse_pax(struct tar_override *ov, char *data, size_t len) {
+    char *p = data, *end = data + len;
+    while (p < end) {
+        char *space = memchr(p, ' ', (size_t)(end - p));
+        if (!space) {
+            break;
+        }
+        size_t reclen = strtoul(p, NULL, 10);
+        if (reclen == 0 || reclen > (size_t)(end - p)) {
+            break;
+        }
+        char *record_end = p + reclen;
+        char *key = space + 1;
+        char *eq = memchr(key, '=', (size_t)(record_end - key));
+        if (eq && record_end[-1] == '\n') {
+            *eq = '\0';
+            record_end[-1] = '\0';
+            char *value = eq + 1;
+            if (!strcmp(key, "path")) {
+                snprintf(ov->path, sizeof(ov->path), "%s", value);
+                ov->has_path = true;
+            } else if (!strcmp(key, "linkpath")) {
+                snprintf(ov->link, sizeof(ov->link), "%s", value);
+                ov->has_link = true;
+            } else if (!strcmp(key, "size")) {
+                ov->size = strtoull(value, NULL, 10);
+                ov->has_size = true;
+            } else if (!strcmp(key, "uid")) {
+                ov->uid = (uid_t)strtoul(value, NULL, 10);
+                ov->has_uid = true;
+            } else if (!strcmp(key, "gid")) {
+                ov->gid = (gid_t)strtoul(value, NULL, 10);
+                ov->has_gid = true;
+            } else if (!strcmp(key, "mtime")) {
+                ov->mtime = (time_t)strtoll(value, NULL, 10);
+                ov->has_mtime = true;
+            }
+        }
+        p = record_end;
+    }
+}
+
+/**
+ * @brief 次のエントリを読む (pax 'x' と GNU 'L'/'K' は次のエントリに畳み込む)
+ * @return 1: エントリあり, 0: アーカイブの終わり, -1: 失敗
+ */
+static int read_entry(struct tar_reader *r, struct tar_entry *entry, struct tar_override *ov) {
+    memset(ov, 0, sizeof(*ov));
+
+    for (;;) {
+        uint8_t block[TAR_BLOCK];
+        if (reader_full(r, block, TAR_BLOCK) != 0) {
+            return -1;
+        }
+        if (header_is_zero(block)) {
+            return 0;
+        }
+        if (!header_checksum_ok(block)) {
+            fprintf(stderr, "bad tar header checksum\n");
+            return -1;
+        }
+
+        char type = (char)block[156];
+        uint64_t size = parse_number((const char *)block + 124, 12);
+
+        if (type == 'x' || type == 'g' || type == 'L' || type == 'K') {
+            if (size >= 1024 * 1024) {
+                fprintf(stderr, "tar extension header too large\n");
+                return -1;
+            }
+            char *data = malloc((size_t)size + 1);
+            if (!data) {
+                perror("malloc failed");
+                return -1;
+            }
+            if (reader_full(r, data, size) != 0 || reader_full(r, NULL, tar_padding(size)) != 0) {
+                free(data);
+                return -1;
+            }
+            data[size] = '\0';
+            if (type == 'x') {
+                parse_pax(ov, data, (size_t)size);
+            } else if (type == 'L') {
+                snprintf(ov->path, sizeof(ov->path), "%s", data);
+                ov->has_path = true;
+            } else if (type == 'K') {
+                snprintf(ov->link, sizeof(ov->link), "%s", data);
+                ov->has_link = true;
+            }
+            // 'g' (グローバル pax) は無視する
+            free(data);
+            continue;
+        }
+
+        memset(entry, 0, sizeof(*entry));
+        entry->type = type ? type : '0';
+        entry->size = ov->has_size ? ov->size : size;
+        entry->mode = (mode_t)parse_number((const char *)block + 100, 8) & 07777;
+        entry->uid = ov->has_uid ? ov->uid : (uid_t)parse_number((const char *)block + 108, 8);
+        entry->gid = ov->has_gid ? ov->gid : (gid_t)parse_number((const char *)block + 116, 8);
+        entry->mtime = ov->has_mtime ? ov->mtime : (time_t)parse_number((const char *)block + 136, 12);
+        entry->dev = makedev((unsigned int)parse_number((const char *)block + 329, 8),
+                             (unsigned int)parse_number((const char *)block + 337, 8));
+
+        // ustar: prefix + "/" + name
+        char name[101], prefix[156];
+        copy_field(name, sizeof(name), (const char *)block, 100);
+        copy_field(prefix, sizeof(prefix), (const char *)block + 345, 155);
+        if (ov->has_path) {
+            memcpy(entry->path, ov->path, sizeof(entry->path));
+        } else if (memcmp(block + 257, "ustar", 5) == 0 && prefix[0]) {
+            snprintf(entry->path, sizeof(entry->path), "%s/%s", prefix, name);
+        } else {
+            snprintf(entry->path, sizeof(entry->path), "%s", name);
+        }
+        if (ov->has_link) {
+            memcpy(entry->link, ov->link, sizeof(entry->link));
+        } else {
+            copy_field(entry->link, sizeof(entry->link), (const char *)block + 157, 100);
+        }
+        return 1;
+    }
+}
+
+//------------------------------------------------------
+// 3. 展開先の操作 (シンボリックリンクをたどらない)
+//------------------------------------------------------
+
+/**
+ * @brief パスを正規化する (先頭の "/" や "./" を取り, ".." は拒否)
+ * @return 0 on success, -1 if the path escapes the layer
+ */
+static int clean_path(const char *in, char *out, size_t len) {
+    size_t used = 0;
+    out[0] = '\0';
+    while (*in) {
+        while (*in == '/') {
+            in++;
+        }
+        size_t n = strcspn(in, "/");
+        if (n == 0) {
+            break;
+        }
+        if (n == 2 && in[0] == '.' && in[1] == '.') {
+            return -1;
+        }
+        if (!(n == 1 && in[0] == '.')) {
+            if (used + n + 2 > len) {
+                return -1;
+            }
+            if (used) {
+                out[used++] = '/';
+            }
+            memcpy(out + used, in, n);
+            used += n;
+            out[used] = '\0';
+        }
+        in += n;
+    }
+    return 0;
+}
+
+/**
+ * @brief 親ディレクトリを 1 段ずつ O_NOFOLLOW で開く (無ければ作る)
+ *        レイヤー内のシンボリックリンクで展開先の外に書き込まないようにするため
+ * @return 親ディレクトリの fd (呼び出し側で close), 失敗時 -1. *base に最後の要素
+ */
+static int open_parent(int root_fd, char *path, char **base) {
+    int dir_fd = dup(root_fd);
+    if (dir_fd < 0) {
+        perror("dup failed");
+        return -1;
+    }
+    char *p = path;
+    char *slash;
+    while ((slash = strchr(p, '/'))) {
+        *slash = '\0';
+        if (mkdirat(dir_fd, p, 0755) != 0 && errno != EEXIST) {
+            fprintf(stderr, "mkdir %s failed: %m\n", path);
+            close(dir_fd);
+            return -1;
+        }
+        int next = openat(dir_fd, p, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (next < 0) {
+            fprintf(stderr, "open %s failed: %m\n", path);
+            close(dir_fd);
+            return -1;
+        }
+        *slash = '/';
+        close(dir_fd);
+        dir_fd = next;
+        p = slash + 1;
+    }
+    *base = p;
+    return dir_fd;
+}
+
+// dir_fd の下の name を中身ごと消す (シンボリックリンクはたどらない. ファイルはオブジェクトへのリンクを外すだけ)
+static void remove_tree_at(int dir_fd, const char *name) {
+    int fd = openat(dir_fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    DIR *dir = fd >= 0 ? fdopendir(fd) : NULL;
+    if (!dir) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        unlinkat(dir_fd, name, 0);
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) {
+            continue;
+        }
+        if (entry->d_type == DT_DIR || entry->d_type == DT_UNKNOWN) {
+            remove_tree_at(fd, entry->d_name);
+        } else {
+            unlinkat(fd, entry->d_name, 0);
+        }
+    }
+    closedir(dir);
+    if (unlinkat(dir_fd, name, AT_REMOVEDIR) != 0) {
+        fprintf(stderr, "rmdir %s failed: %m\n", name);
+    }
+}
+
+// 既存のエントリを置き換える (ディレクトリ同士は置き換えない. ディレクトリを別の種類で置き換えるなら中身ごと消す)
+static void remove_existing(int dir_fd, const char *name, char type) {
+    struct stat st;
+    if (fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+        return;
+    }
+    if (S_ISDIR(st.st_mode)) {
+        if (type != '5') {
+            remove_tree_at(dir_fd, name);
+        }
+        return;
+    }
+    unlinkat(dir_fd, name, 0);
+}
+
+//------------------------------------------------------
+// 4. 内容アドレスのオブジェクト
+//------------------------------------------------------
+
+/**
+ * @brief ファイルの内容をストリームから読みつつオブジェクトとして保存する
+ *        キーは sha256(mode uid gid + 内容). 既にあれば一時ファイルを捨てるだけ
+ * @return 0 on success, -1 on failure. object に objects/xx/<hash> のパス
+ */
+static int store_object(const char *store, struct tar_reader *r, const struct tar_entry *entry,
+                        char *object, size_t len) {
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s/tmp/object.XXXXXX", store);
+    int fd = mkostemp(tmp, O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "mkostemp %s failed: %m\n", tmp);
+        return -1;
+    }
+
+    // ハードリンクは inode の属性も共有するので, 属性もキーに含める
+    struct sha256_ctx hash;
+    sha256_init(&hash);
+    char meta[64];
+    int metalen = snprintf(meta, sizeof(meta), "%o %u %u\n", entry->mode, entry->uid, entry->gid);
+    sha256_update(&hash, meta, (size_t)metalen);
+
+    uint8_t buf[READ_BUFSIZE];
+    uint64_t remaining = entry->size;
+    while (remaining > 0) {
+        ssize_t n = reader_read(r, buf, remaining < sizeof(buf) ? (size_t)remaining : sizeof(buf));
+        if (n <= 0) {
+            if (n == 0) {
+                fprintf(stderr, "unexpected end of archive\n");
+            }
+            goto fail;
+        }
+        sha256_update(&hash, buf, (size_t)n);
+        for (ssize_t off = 0; off < n;) {
+            ssize_t w = write(fd, buf + off, (size_t)(n - off));
+            if (w < 0) {
+                fprintf(stderr, "write %s failed: %m\n", tmp);
+                goto fail;
+            }
+            off += w;
+        }
+        remaining -= (uint64_t)n;
+    }
+    if (reader_full(r, NULL, tar_padding(entry->size)) != 0) {
+        goto fail;
+    }
+
+    // 最初に書いた時の属性がそのまま共有される (mtime はキーに含めない)
+    struct timespec times[2] = {
+        { .tv_sec = entry->mtime, .tv_nsec = 0 },
+        { .tv_sec = entry->mtime, .tv_nsec = 0 },
+    };
+    if (fchown(fd, entry->uid, entry->gid) != 0 || fchmod(fd, entry->mode) != 0
+        || futimens(fd, times) != 0) {
+        fprintf(stderr, "setting attributes on %s failed: %m\n", tmp);
+        goto fail;
+    }
+    close(fd);
+    fd = -1;
+
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    char hex[SHA256_HEX_SIZE];
+    sha256_final(&hash, digest);
+    sha256_hex(digest, hex);
+
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s/objects/%.2s", store, hex);
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "mkdir %s failed: %m\n", dir);
+        goto fail;
+    }
+    if ((size_t)snprintf(object, len, "%s/%s", dir, hex) >= len) {
+        fprintf(stderr, "object path too long\n");
+        goto fail;
+    }
+    // link は既存のオブジェクトを上書きしないので, 並行して展開しても安全
+    if (link(tmp, object) != 0 && errno != EEXIST) {
+        fprintf(stderr, "link %s failed: %m\n", object);
+        goto fail;
+    }
+    unlink(tmp);
+    return 0;
+
+fail:
+    if (fd >= 0) {
+        close(fd);
+    }
+    unlink(tmp);
+    return -1;
+}
+
+//------------------------------------------------------
+// 5. エントリの展開
+//------------------------------------------------------
+
+/**
+ * @brief OCI のホワイトアウトを overlayfs の表現に変換する
+ *        ".wh..wh..opq" => 親ディレクトリに trusted.overlay.opaque=y
+ *        ".wh.NAME"     => NAME を 0/0 のキャラクタデバイスにする
+ * @return 1: ホワイトアウトだった, 0: 通常のエントリ, -1: 失敗
+ */
+static int apply_whiteout(int parent_fd, const char *base) {
+    if (strncmp(base, ".wh.", 4) != 0) {
+        return 0;
+    }
+    if (!strcmp(base, ".wh..wh..opq")) {
+        if (fsetxattr(parent_fd, "trusted.overlay.opaque", "y", 1, 0) != 0) {
+            perror("setxattr trusted.overlay.opaque failed");
+            return -1;
+        }
+        return 1;
+    }
+    const char *name = base + 4;
+    remove_existing(parent_fd, name, '0');
+    if (mknodat(parent_fd, name, S_IFCHR | 0, makedev(0, 0)) != 0) {
+        fprintf(stderr, "mknod whiteout %s failed: %m\n", name);
+        return -1;
+    }
+    return 1;
+}
+
+static int extract_entry(const char *store, struct tar_reader *r, int root_fd, struct tar_entry *entry) {
+    char path[PATH_MAX];
+    if (clean_path(entry->path, path, sizeof(path)) != 0) {
+        fprintf(stderr, "refusing path outside layer: %s\n", entry->path);
+        return -1;
+    }
+    uint64_t data = (entry->type == '0' || entry->type == '7') ? 0 : entry->size;
+
+    // レイヤーのルート自身 ("./")
+    if (path[0] == '\0') {
+        if (entry->type == '5' && (fchown(root_fd, entry->uid, entry->gid) != 0 || fchmod(root_fd, entry->mode) != 0)) {
+            perror("chown/chmod layer root failed");
+            return -1;
+        }
+        return reader_full(r, NULL, data + tar_padding(data));
+    }
+
+    char *base = NULL;
+    int dir_fd = open_parent(root_fd, path, &base);
+    if (dir_fd < 0) {
+        return -1;
+    }
+    int ret = apply_whiteout(dir_fd, base);
+    if (ret != 0) {
+        close(dir_fd);
+        return ret < 0 ? -1 : reader_full(r, NULL, data + tar_padding(data));
+    }
+    remove_existing(dir_fd, base, entry->type);
+
+    ret = 0;
+    switch (entry->type) {
+    case '0':
+    case '7': {
+        char object[PATH_MAX];
+        if (store_object(store, r, entry, object, sizeof(object)) != 0
+            || linkat(AT_FDCWD, object, dir_fd, base, 0) != 0) {
+            fprintf(stderr, "extract %s failed: %m\n", path);
+            ret = -1;
+        }
+        break;
+    }
+    case '1': {
+        // レイヤー内の既存ファイルへのハードリンク
+        char target[PATH_MAX];
+        char *target_base = NULL;
+        if (clean_path(entry->link, target, sizeof(target)) != 0 || target[0] == '\0') {
+            fprintf(stderr, "bad hardlink target: %s\n", entry->link);
+            ret = -1;
+            break;
+        }
+        int target_fd = open_parent(root_fd, target, &target_base);
+        if (target_fd < 0) {
+            ret = -1;
+            break;
+        }
+        if (linkat(target_fd, target_base, dir_fd, base, 0) != 0) {
+            fprintf(stderr, "link %s => %s failed: %m\n", path, entry->link);
+            ret = -1;
+        }
+        close(target_fd);
+        break;
+    }
+    case '2':
+        if (symlinkat(entry->link, dir_fd, base) != 0
+            || fchownat(dir_fd, base, entry->uid, entry->gid, AT_SYMLINK_NOFOLLOW) != 0) {
+            fprintf(stderr, "symlink %s failed: %m\n", path);
+            ret = -1;
+        }
+        break;
+    case '3':
+    case '4':
+    case '6': {
+        mode_t kind = entry->type == '3' ? S_IFCHR : entry->type == '4' ? S_IFBLK : S_IFIFO;
+        if (mknodat(dir_fd, base, kind | entry->mode, entry->dev) != 0
+            || fchownat(dir_fd, base, entry->uid, entry->gid, AT_SYMLINK_NOFOLLOW) != 0
+            || fchmodat(dir_fd, base, entry->mode, 0) != 0) {
+            fprintf(stderr, "mknod %s failed: %m\n", path);
+            ret = -1;
+        }
+        break;
+    }
+    case '5':
+        if ((mkdirat(dir_fd, base, 0755) != 0 && errno != EEXIST)
+            || fchownat(dir_fd, base, entry->uid, entry->gid, AT_SYMLINK_NOFOLLOW) != 0
+            || fchmodat(dir_fd, base, entry->mode, 0) != 0) {
+            fprintf(stderr, "mkdir %s failed: %m\n", path);
+            ret = -1;
+        }
+        break;
+    default:
+        fprintf(stderr, "skipping %s (unsupported type '%c')\n", path, entry->type);
+        break;
+    }
+    close(dir_fd);
+
+    // 通常ファイルのデータは store_object が読んでいる
+    if (ret == 0 && data) {
+        ret = reader_full(r, NULL, data + tar_padding(data));
+    }
+    return ret;
+}
+
+//------------------------------------------------------
+// 6. レイヤー単位の展開
+//------------------------------------------------------
+
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+    (void)st;
+    (void)flag;
+    (void)ftw;
+    return remove(path);
+}
+
+static int make_store_dirs(const char *store) {
+    static const char *subdirs[] = { "", "/objects", "/layers", "/tmp" };
+    char path[PATH_MAX];
+    for (size_t i = 0; i < sizeof(subdirs) / sizeof(subdirs[0]); i++) {
+        snprintf(path, sizeof(path), "%s%s", store, subdirs[i]);
+        if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+            fprintf(stderr, "mkdir %s failed: %m\n", path);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int image_unpack_layer(const char *store, const char *archive, char *layer_dir, size_t len) {
+    if (make_store_dirs(store) != 0) {
+        return -1;
+    }
+    char tmpdir[PATH_MAX];
+    snprintf(tmpdir, sizeof(tmpdir), "%s/tmp/layer.XXXXXX", store);
+    if (!mkdtemp(tmpdir)) {
+        fprintf(stderr, "mkdtemp %s failed: %m\n", tmpdir);
+        return -1;
+    }
+    int root_fd = open(tmpdir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (root_fd < 0) {
+        fprintf(stderr, "open %s failed: %m\n", tmpdir);
+        rmdir(tmpdir);
+        return -1;
+    }
+
+    struct tar_reader *r = malloc(sizeof(*r));
+    if (!r) {
+        perror("malloc failed");
+        close(root_fd);
+        rmdir(tmpdir);
+        return -1;
+    }
+    int ret = open_reader(r, archive);
+    if (ret == 0) {
+        // PATH_MAX のバッファを複数持つのでスタックではなくヒープに置く
+        struct tar_entry *entry = malloc(sizeof(*entry));
+        struct tar_override *ov = malloc(sizeof(*ov));
+        int more = -1;
+        size_t entries = 0;
+        while (entry && ov && (more = read_entry(r, entry, ov)) > 0) {
+            if (extract_entry(store, r, root_fd, entry) != 0) {
+                break;
+            }
+            entries++;
+        }
+        ret = more == 0 ? 0 : -1;
+        free(entry);
+        free(ov);
+        // 終端ブロック以降も読み切って, ストリーム全体のハッシュにする
+        if (ret == 0) {
+            uint8_t drain[TAR_BLOCK];
+            ssize_t n;
+            while ((n = reader_read(r, drain, sizeof(drain))) > 0) {
+            }
+            ret = n < 0 ? -1 : 0;
+        }
+        if (close_reader(r) != 0) {
+            ret = -1;
+        }
+        fprintf(stderr, "=> %s: %zu entries\n", archive, entries);
+    }
+    close(root_fd);
+
+    if (ret == 0) {
+        uint8_t digest[SHA256_DIGEST_SIZE];
+        char hex[SHA256_HEX_SIZE];
+        sha256_final(&r->hash, digest);
+        sha256_hex(digest, hex);
+        snprintf(layer_dir, len, "%s/layers/%s", store, hex);
+
+        // 同じレイヤーが既にあれば展開し直した分は捨てる (オブジェクトは共有のまま)
+        if (rename(tmpdir, layer_dir) != 0) {
+            if (errno != EEXIST && errno != ENOTEMPTY) {
+                fprintf(stderr, "rename %s failed: %m\n", layer_dir);
+                ret = -1;
+            }
+            nftw(tmpdir, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+        }
+    } else {
+        nftw(tmpdir, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    }
+    free(r);
+    return ret;
+}
+
+int run_unpack(const char *store, char **archives, int count) {
+    if (count <= 0) {
+        fprintf(stderr, "no layers given\n");
+        return -1;
+    }
+    char (*dirs)[PATH_MAX] = calloc((size_t)count, PATH_MAX);
+    if (!dirs) {
+        perror("calloc failed");
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        if (image_unpack_layer(store, archives[i], dirs[i], PATH_MAX) != 0) {
+            fprintf(stderr, "unpacking %s failed\n", archives[i]);
+            free(dirs);
+            return -1;
+        }
+    }
+    // overlayfs の lowerdir と同じく上の層から並べる
+    for (int i = count - 1; i >= 0; i--) {
+        printf("%s%s", dirs[i], i ? ":" : "\n");
+    }
+    free(dirs);
+    return 0;
+}
+
+bool image_store_layer(const char *path) {
+    // 末尾の '/' やシンボリックリンクを解決して layers/<sha256> の形か見る
+    char real[PATH_MAX];
+    if (!realpath(path, real)) {
+        return false;
+    }
+    char *base = strrchr(real, '/');
+    if (!base || base == real) {
+        return false;
+    }
+    *base = '\0';
+    char *parent = strrchr(real, '/');
+    if (!parent || strcmp(parent + 1, "layers") != 0) {
+        return false;
+    }
+    // 同じストアの objects/ が隣にあること
+    char objects[PATH_MAX];
+    struct stat st;
+    snprintf(objects, sizeof(objects), "%.*s/objects", (int)(parent - real), real);
+    return stat(objects, &st) == 0 && S_ISDIR(st.st_mode);
+}
@@ -0,0 +1,377 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <linux/sched.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+
+#include "launch.h"
+#include "child.h"
+#include "container.h"
+#include "image.h"
+#include "logs.h"
+#include "profile.h"
+#include "resources.h"
+#include "timing.h"
+#include "trace.h"
+#include "userns.h"
+
+/**
+ * @brief execve 完了を待つ
+ *        子が持つ O_CLOEXEC な書き込み端は execve 成功時に閉じるので EOF が来る
+ */
+static void wait_exec(int exec_fd) {
+    char c;
+    while (read(exec_fd, &c, sizeof(c)) < 0 && errno == EINTR) {
+    }
+}
+
+int parse_launch_line(char *line, struct child_config *config, struct launch_args *args) {
+    size_t argc = 0;
+    size_t nlimits = 0;
+    char *save = NULL;
+
+    config->uid = 1000;
+    for (char *tok = strtok_r(line, " \t\n", &save); tok; tok = strtok_r(NULL, " \t\n", &save)) {
+        if (argc > 0) {
+            if (argc >= LAUNCH_MAX_ARGS) {
+                return -1;
+            }
+            args->argv[argc++] = tok;
+            continue;
+        }
+        if (!strcmp(tok, "-r")) {
+            config->readonly_rootfs = 1;
+            continue;
+        }
+        // 以降のオプションはすべて値を 1 つ取る
+        char *val = strtok_r(NULL, " \t\n", &save);
+        if (!val) {
+            return -1;
+        }
+        if (!strcmp(tok, "-u")) {
+            config->uid = atoi(val);
+        } else if (!strcmp(tok, "-m")) {
+            config->mount_dir = val;
+        } else if (!strcmp(tok, "-o")) {
+            config->overlay_size = val;
+        } else if (!strcmp(tok, "-n")) {
+            if (parse_net_config(val, &config->net) != 0) {
+                return -1;
+            }
+        } else if (!strcmp(tok, "-H")) {
+            if (parse_hugepage_config(val, &config->hugepages) != 0) {
+                return -1;
+            }
+        } else if (!strcmp(tok, "-t")) {
+            if (parse_thp_policy(val, &config->hugepages.thp) != 0) {
+                return -1;
+            }
+        } else if (!strcmp(tok, "-q")) {
+            if (parse_io_config(val, &config->io) != 0) {
+                return -1;
+            }
+        } else if (!strcmp(tok, "-l") && nlimits < LAUNCH_MAX_LIMITS && cgroup_limit_valid(val)) {
+            args->limits[nlimits++] = val;
+        } else if (!strcmp(tok, "-c")) {
+            args->argv[argc++] = val;
+        } else {
+            return -1;
+        }
+    }
+    args->argv[argc] = NULL;
+    args->limits[nlimits] = NULL;
+    config->argc = (int)argc;
+    config->argv = args->argv;
+    config->cgroup_limits = args->limits;
+    return (argc && config->mount_dir) ? 0 : -1;
+}
+
+#define CONTAINER_CLONE_FLAGS (CLONE_NEWNS \
+                             | CLONE_NEWCGROUP \
+                             | CLONE_NEWPID \
+                             | CLONE_NEWIPC \
+                             | CLONE_NEWNET \
+                             | CLONE_NEWUTS)
+
+/**
+ * @brief clone3() で子を cgroup に直接入れて起動する
+ *        スタックは不要 (fork と同様に親のスタックのコピーで動く)
+ * @return 子の pid, 失敗時 -1 (errno を保持)
+ */
+static pid_t clone3_child(struct child_config *config, int *pidfd) {
+    struct clone_args args;
+    memset(&args, 0, sizeof(args));
+    args.flags = CONTAINER_CLONE_FLAGS | CLONE_PIDFD | CLONE_INTO_CGROUP;
+    args.pidfd = (uint64_t)(uintptr_t)pidfd;
+    args.exit_signal = SIGCHLD;
+    args.cgroup = (uint64_t)config->cgroup_fd;
+
+    pid_t pid = (pid_t)syscall(SYS_clone3, &args, sizeof(args));
+    if (pid == 0) {
+        _exit(child(config) & 0xff);
+    }
+    return pid;
+}
+
+/**
+ * @brief 旧来の clone(): ランチャーが一旦 cgroup に入り、子に継承させる
+ */
+static pid_t clone_child(struct child_config *config) {
+    static const size_t STACK_SIZE = 1024 * 1024;
+
+    if (enter_cgroup(config) != 0) {
+        return -1;
+    }
+    void *stack = malloc(STACK_SIZE);
+    if (!stack) {
+        fprintf(stderr, "malloc stack failed\n");
+        leave_cgroup();
+        config->cgroup_entered = 0;
+        return -1;
+    }
+    pid_t pid = clone(child, (char*)stack + STACK_SIZE, CONTAINER_CLONE_FLAGS | SIGCHLD, config);
+    int saved_errno = errno;
+    // CLONE_VM なしなので子はスタックのコピーを持つ => 親側はすぐ解放してよい
+    free(stack);
+    // ランチャーは root cgroup に戻る (cgroup は子が使い続ける)
+    if (leave_cgroup() == 0) {
+        config->cgroup_entered = 0;
+    }
+    errno = saved_errno;
+    return pid;
+}
+
+pid_t spawn_container(struct child_config *config, int *pidfd) {
+    *pidfd = -1;
+    config->lower_fds = NULL;
+    config->lower_count = 0;
+    // seccomp/capability のプロファイルは子ではなくランチャーで用意する (2 回目以降は何もしない)
+    if (prepare_security_profile() != 0) {
+        return -1;
+    }
+    // 同時に動くコンテナどうしで重ならない uid/gid 範囲 (idmapped mount にも使う)
+    if (id_range_acquire(&config->ids) != 0) {
+        return -1;
+    }
+    // ストアのレイヤーはファイルがオブジェクト (他のレイヤー/イメージと共有) へのハードリンクなので,
+    // overlay を組まないなら書き込めないようにする
+    if (!config->overlay_size && !config->readonly_rootfs && image_store_layer(config->mount_dir)) {
+        fprintf(stderr, "%s is a layer in the image store, mounting it read-only (use -o for a writable rootfs)\n",
+                config->mount_dir);
+        config->readonly_rootfs = 1;
+    }
+    // rootfs はランチャーで複製しておき、子は付け替えるだけにする (-1 なら子が bind mount する)
+    // EROFS/squashfs のイメージファイルはループデバイスにつないで fsmount() する (bind mount には戻れない)
+    enum rootfs_image_type image = rootfs_image_type(config->mount_dir);
+    if (image != ROOTFS_IMAGE_NONE) {
+        config->rootfs_fd = open_rootfs_image(config, image);
+        if (config->rootfs_fd < 0) {
+            return -1;
+        }
+    } else if (config->overlay_size) {
+        if (open_overlay_lowers(config) != 0 && check_rootfs_owner(config) != 0) {
+            return -1;
+        }
+    } else {
+        config->rootfs_fd = open_rootfs_tree(config);
+        // bind mount に戻ると idmap できないので, 範囲外の所有者はコンテナ内で nobody になる前に止める
+        if (config->rootfs_fd < 0 && check_rootfs_owner(config) != 0) {
+            return -1;
+        }
+    }
+    // bind/overlay のマウント先 (イメージなら付け替え先) はランチャーで作る (子の中で作るとホストに残り続ける)
+    if (config->rootfs_fd < 0 || image != ROOTFS_IMAGE_NONE) {
+        strcpy(config->scratch_dir, "/tmp/tmp.XXXXXX");
+        if (!mkdtemp(config->scratch_dir)) {
+            perror("mkdtemp failed");
+            config->scratch_dir[0] = '\0';
+            if (config->rootfs_fd >= 0) {
+                close(config->rootfs_fd);
+                config->rootfs_fd = -1;
+            }
+            close_overlay_lowers(config);
+            return -1;
+        }
+    }
+
+    trace_begin(TRACE_CLONE);
+    pid_t pid = clone3_child(config, pidfd);
+    // clone3 未対応 (ENOSYS/E2BIG) や CLONE_INTO_CGROUP が使えない環境は clone() に戻る
+    if (pid < 0 && (errno == ENOSYS || errno == E2BIG || errno == EINVAL || errno == EOPNOTSUPP)) {
+        *pidfd = -1;
+        pid = clone_child(config);
+    }
+    trace_end(TRACE_CLONE);
+
+    // 子はコピーを持っているので閉じてよい
+    int saved_errno = errno;
+    if (config->rootfs_fd >= 0) {
+        close(config->rootfs_fd);
+        config->rootfs_fd = -1;
+    }
+    close_overlay_lowers(config);
+    errno = saved_errno;
+    return pid;
+}
+
+/**
+ * @brief 子プロセスの終了を待って終了ステータスを返す
+ */
+static int wait_child(pid_t child_pid, int pidfd) {
+    int status = 0;
+    if (pidfd >= 0) {
+        siginfo_t info;
+        memset(&info, 0, sizeof(info));
+        if (waitid(P_PIDFD, pidfd, &info, WEXITED) < 0) {
+            perror("waitid failed");
+            return 1;
+        }
+        return info.si_code == CLD_EXITED ? info.si_status : 1;
+    }
+    if (waitpid(child_pid, &status, 0) < 0) {
+        perror("waitpid failed");
+        return 1;
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
+
+int launch_container(struct child_config *config) {
+    int sockets[2] = {0};
+    int exec_pipe[2] = {-1, -1};
+    pid_t child_pid = 0;
+    int pidfd = -1;
+    struct launch_timing *timing = config->timing;
+    struct log_sink log = { .config = NULL };
+
+    // ソケットペア作成
+    if (socketpair(AF_LOCAL, SOCK_SEQPACKET, 0, sockets) != 0) {
+        perror("socketpair failed");
+        return -1;
+    }
+    // FD_CLOEXEC
+    if (fcntl(sockets[0], F_SETFD, FD_CLOEXEC) != 0) {
+        perror("fcntl failed");
+        close(sockets[0]);
+        close(sockets[1]);
+        return -1;
+    }
+    config->fd = sockets[1];
+
+    // 計測時のみ: execve の完了を検出するパイプ
+    config->exec_fd = -1;
+    if (timing) {
+        if (pipe2(exec_pipe, O_CLOEXEC) != 0) {
+            perror("pipe2 failed");
+            close(sockets[0]);
+            close(sockets[1]);
+            return -1;
+        }
+        config->exec_fd = exec_pipe[1];
+    }
+
+    // cgroupなどリソース設定
+    timing_begin(timing, PHASE_RESOURCES);
+    if (resources(config) != 0) {
+        fprintf(stderr, "resources failed\n");
+        close(sockets[0]);
+        close(sockets[1]);
+        if (timing) {
+            close(exec_pipe[0]);
+            close(exec_pipe[1]);
+        }
+        return -1;
+    }
+    timing_end(timing, PHASE_RESOURCES);
+
+    // -L 指定時: 子の stdout/stderr をパイプにし、終了まで splice でログファイルへ移す
+    config->log_fd = -1;
+    if (log_config()) {
+        if (log_open(&log, log_config(), config->hostname) != 0) {
+            close(sockets[0]);
+            close(sockets[1]);
+            if (timing) {
+                close(exec_pipe[0]);
+                close(exec_pipe[1]);
+            }
+            free_resources(config);
+            return -1;
+        }
+        config->log_fd = log.pipe_w;
+    }
+
+    timing_begin(timing, PHASE_CLONE);
+    child_pid = spawn_container(config, &pidfd);
+    if (child_pid < 0) {
+        perror("clone failed");
+        close(sockets[0]);
+        close(sockets[1]);
+        if (timing) {
+            close(exec_pipe[0]);
+            close(exec_pipe[1]);
+        }
+        log_close(&log);
+        free_resources(config);
+        return -1;
+    }
+    timing_end(timing, PHASE_CLONE);
+    close(sockets[1]); // 子側の fd を閉じる
+    if (timing) {
+        close(exec_pipe[1]);
+    }
+    log_close_writer(&log);
+
+    // ユーザー名前空間の UID/GID マップ設定
+    if (handle_child_uid_map(child_pid, sockets[0], &config->ids, &config->net) != 0) {
+        fprintf(stderr, "handle_child_uid_map failed\n");
+        // 子プロセス終了待ち
+        wait_child(child_pid, pidfd);
+        if (pidfd >= 0) {
+            close(pidfd);
+        }
+        close(sockets[0]);
+        if (timing) {
+            close(exec_pipe[0]);
+        }
+        log_close(&log);
+        free_resources(config);
+        return -1;
+    }
+
+    if (timing) {
+        wait_exec(exec_pipe[0]);
+        timing_end(timing, PHASE_EXECVE);
+        close(exec_pipe[0]);
+    }
+
+    // 子プロセス終了待ち
+    timing_begin(timing, PHASE_WAITPID);
+    trace_begin(TRACE_WAIT);
+    if (log.config && log_forward_until_eof(&log) != 0) {
+        // 読み手を閉じて、子が埋まったパイプで止まらないようにする
+        fprintf(stderr, "log forwarding failed, output may be lost\n");
+        log_close(&log);
+    }
+    int status = wait_child(child_pid, pidfd);
+    trace_end(TRACE_WAIT);
+    timing_end(timing, PHASE_WAITPID);
+    log_close(&log);
+
+    // 後片付け
+    if (pidfd >= 0) {
+        close(pidfd);
+    }
+    close(sockets[0]);
+    timing_begin(timing, PHASE_FREE);
+    free_resources(config);
+    timing_end(timing, PHASE_FREE);
+    return status;
+}
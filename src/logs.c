@@ -0,0 +1,285 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+
+#include "logs.h"
+#include "timing.h"
+
+#define LOG_DEFAULT_SIZE  (16ULL * 1024 * 1024)
+#define LOG_DEFAULT_KEEP  3
+#define LOG_PIPE_SIZE     (1024 * 1024)     // バーストはパイプで吸収する
+#define LOG_PUMP_BUDGET   (256 * 1024)      // 1 回の呼び出しで移す上限 (他のコンテナを待たせない)
+
+static const struct log_config *current_config;
+static int devnull_fd = -1;
+
+int parse_log_config(const char *spec, struct log_config *config) {
+    char copy[PATH_MAX + 128];
+    if (strlen(spec) >= sizeof(copy)) {
+        return -1;
+    }
+    strcpy(copy, spec);
+    memset(config, 0, sizeof(*config));
+    config->max_size = LOG_DEFAULT_SIZE;
+    config->keep = LOG_DEFAULT_KEEP;
+    config->policy = LOG_POLICY_BLOCK;
+
+    char *save = NULL;
+    char *dir = strtok_r(copy, ",", &save);
+    if (!dir || strlen(dir) >= sizeof(config->dir)) {
+        return -1;
+    }
+    strcpy(config->dir, dir);
+    for (char *tok = strtok_r(NULL, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        char *value = strchr(tok, '=');
+        if (!value) {
+            return -1;
+        }
+        *value++ = '\0';
+        if (!strcmp(tok, "size")) {
+            config->max_size = strtoull(value, NULL, 10);
+        } else if (!strcmp(tok, "keep")) {
+            config->keep = strtoul(value, NULL, 10);
+        } else if (!strcmp(tok, "rate")) {
+            config->rate = strtoull(value, NULL, 10);
+        } else if (!strcmp(tok, "policy") && !strcmp(value, "block")) {
+            config->policy = LOG_POLICY_BLOCK;
+        } else if (!strcmp(tok, "policy") && !strcmp(value, "drop")) {
+            config->policy = LOG_POLICY_DROP;
+        } else {
+            return -1;
+        }
+    }
+    return config->max_size > 0 ? 0 : -1;
+}
+
+void set_log_config(const struct log_config *config) {
+    current_config = config;
+}
+
+const struct log_config *log_config(void) {
+    return current_config;
+}
+
+//------------------------------------------------------
+// 1. ファイル
+//------------------------------------------------------
+
+static int open_log_file(struct log_sink *sink) {
+    // splice() は O_APPEND の出力先を受け付けないので, 末尾に移動して書き足す (書き手は自分だけ)
+    sink->file_fd = open(sink->path, O_WRONLY | O_CREAT | O_CLOEXEC, 0640);
+    if (sink->file_fd < 0) {
+        fprintf(stderr, "open %s failed: %m\n", sink->path);
+        return -1;
+    }
+    off_t end = lseek(sink->file_fd, 0, SEEK_END);
+    sink->size = end > 0 ? (uint64_t)end : 0;
+    return 0;
+}
+
+// NAME.log.(keep-1) → NAME.log.keep, ..., NAME.log → NAME.log.1
+static int rotate(struct log_sink *sink) {
+    char from[PATH_MAX + 16], to[PATH_MAX + 16];
+    close(sink->file_fd);
+    sink->file_fd = -1;
+    for (unsigned int i = sink->config->keep; i > 0; i--) {
+        snprintf(to, sizeof(to), "%s.%u", sink->path, i);
+        if (i > 1) {
+            snprintf(from, sizeof(from), "%s.%u", sink->path, i - 1);
+        } else {
+            snprintf(from, sizeof(from), "%s", sink->path);
+        }
+        if (rename(from, to) != 0 && errno != ENOENT) {
+            fprintf(stderr, "rename %s failed: %m\n", from);
+        }
+    }
+    if (sink->config->keep == 0) {
+        unlink(sink->path);
+    }
+    return open_log_file(sink);
+}
+
+int log_open(struct log_sink *sink, const struct log_config *config, const char *name) {
+    memset(sink, 0, sizeof(*sink));
+    sink->pipe_r = sink->pipe_w = sink->file_fd = -1;
+    if ((size_t)snprintf(sink->path, sizeof(sink->path), "%s/%s.log", config->dir, name) >= sizeof(sink->path)) {
+        fprintf(stderr, "log path too long\n");
+        return -1;
+    }
+    if (devnull_fd < 0) {
+        devnull_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    }
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC | O_NONBLOCK) != 0) {
+        perror("pipe2 failed");
+        return -1;
+    }
+    // 子側 (書き込み) は通常のブロッキング I/O にする (block 方針で待たせるため)
+    fcntl(fds[1], F_SETFL, 0);
+    fcntl(fds[0], F_SETPIPE_SZ, LOG_PIPE_SIZE);
+    sink->pipe_r = fds[0];
+    sink->pipe_w = fds[1];
+    sink->config = config;
+    if (open_log_file(sink) != 0) {
+        close(fds[0]);
+        close(fds[1]);
+        sink->config = NULL;
+        return -1;
+    }
+    sink->tokens = config->rate;
+    sink->last_ns = timing_now_ns();
+    return 0;
+}
+
+void log_close_writer(struct log_sink *sink) {
+    if (sink->config && sink->pipe_w >= 0) {
+        close(sink->pipe_w);
+        sink->pipe_w = -1;
+    }
+}
+
+//------------------------------------------------------
+// 2. 転送
+//------------------------------------------------------
+
+static void refill(struct log_sink *sink, uint64_t now_ns) {
+    uint64_t rate = sink->config->rate;
+    if (!rate || now_ns <= sink->last_ns) {
+        return;
+    }
+    // バースト上限は 1 秒分
+    uint64_t add = (now_ns - sink->last_ns) * rate / 1000000000ULL;
+    if (add == 0) {
+        return;
+    }
+    sink->tokens = sink->tokens + add > rate ? rate : sink->tokens + add;
+    sink->last_ns = now_ns;
+}
+
+// 破棄した量を 1 行だけ残す (これは write で十分)
+static void note_dropped(struct log_sink *sink) {
+    char line[96];
+    int len = snprintf(line, sizeof(line), "[mycontainer: dropped %llu bytes]\n",
+                       (unsigned long long)sink->dropped);
+    if (write(sink->file_fd, line, (size_t)len) == len) {
+        sink->size += (uint64_t)len;
+    }
+    sink->dropped = 0;
+}
+
+static enum log_pump_result pump(struct log_sink *sink, uint64_t now_ns, int limited) {
+    size_t budget = LOG_PUMP_BUDGET;
+    while (budget > 0) {
+        refill(sink, now_ns);
+        if (limited && sink->config->rate && sink->tokens == 0) {
+            if (sink->config->policy == LOG_POLICY_BLOCK) {
+                sink->throttled = 1;
+                return LOG_PUMP_THROTTLED;
+            }
+            ssize_t n = splice(sink->pipe_r, NULL, devnull_fd, NULL, budget, SPLICE_F_NONBLOCK);
+            if (n <= 0) {
+                return n == 0 ? LOG_PUMP_EOF : errno == EAGAIN ? LOG_PUMP_IDLE : LOG_PUMP_ERROR;
+            }
+            sink->dropped += (uint64_t)n;
+            sink->dropped_total += (uint64_t)n;
+            budget -= (size_t)n;
+            continue;
+        }
+        if (sink->dropped) {
+            note_dropped(sink);
+        }
+        if (sink->size >= sink->config->max_size && rotate(sink) != 0) {
+            return LOG_PUMP_ERROR;
+        }
+
+        size_t len = budget;
+        if (sink->config->max_size - sink->size < len) {
+            len = (size_t)(sink->config->max_size - sink->size);
+        }
+        if (limited && sink->config->rate && sink->tokens < len) {
+            len = (size_t)sink->tokens;
+        }
+        ssize_t n = splice(sink->pipe_r, NULL, sink->file_fd, NULL, len, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n == 0) {
+            return LOG_PUMP_EOF;
+        }
+        if (n < 0) {
+            if (errno == EAGAIN) {
+                return LOG_PUMP_IDLE;
+            }
+            fprintf(stderr, "splice to %s failed: %m\n", sink->path);
+            return LOG_PUMP_ERROR;
+        }
+        sink->size += (uint64_t)n;
+        if (sink->config->rate) {
+            sink->tokens = sink->tokens > (uint64_t)n ? sink->tokens - (uint64_t)n : 0;
+        }
+        budget -= (size_t)n;
+    }
+    return LOG_PUMP_MORE;
+}
+
+enum log_pump_result log_pump(struct log_sink *sink, uint64_t now_ns) {
+    sink->throttled = 0;
+    return pump(sink, now_ns, 1);
+}
+
+uint64_t log_resume_ns(const struct log_sink *sink) {
+    // 1 回分 (最低 1 ページ) のトークンが貯まる時刻
+    uint64_t want = sink->config->rate < 4096 ? sink->config->rate : 4096;
+    return sink->last_ns + (want * 1000000000ULL + sink->config->rate - 1) / sink->config->rate;
+}
+
+void log_close(struct log_sink *sink) {
+    if (!sink->config) {
+        return;
+    }
+    log_close_writer(sink);
+    if (sink->pipe_r >= 0) {
+        // パイプに残っている分は (子はもう居ないので) レートに関係なく書き出す
+        while (pump(sink, timing_now_ns(), 0) == LOG_PUMP_MORE) {
+        }
+        close(sink->pipe_r);
+        sink->pipe_r = -1;
+    }
+    if (sink->dropped && sink->file_fd >= 0) {
+        note_dropped(sink);
+    }
+    if (sink->file_fd >= 0) {
+        close(sink->file_fd);
+        sink->file_fd = -1;
+    }
+    sink->config = NULL;
+}
+
+int log_forward_until_eof(struct log_sink *sink) {
+    struct pollfd pfd = { .fd = sink->pipe_r, .events = POLLIN };
+    for (;;) {
+        int ready;
+        if (sink->throttled) {
+            // 次のトークンまで眠る (fd を見ると書き込み側が閉じた後に POLLHUP で回り続ける)
+            uint64_t now = timing_now_ns();
+            uint64_t resume = log_resume_ns(sink);
+            ready = poll(NULL, 0, resume > now ? (int)((resume - now) / 1000000) + 1 : 0);
+        } else {
+            ready = poll(&pfd, 1, -1);
+        }
+        if (ready < 0 && errno != EINTR) {
+            perror("poll failed");
+            return -1;
+        }
+        switch (log_pump(sink, timing_now_ns())) {
+        case LOG_PUMP_EOF:
+            return 0;
+        case LOG_PUMP_ERROR:
+            return -1;
+        default:
+            break;
+        }
+    }
+}
@@ -0,0 +1,184 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/loop.h>
+
+#include "loopdev.h"
+
+#define EROFS_SUPER_OFFSET  1024
+#define EROFS_SUPER_MAGIC   0xE0F5E1E2U
+#define SQUASHFS_MAGIC      0x73717368U  // "hsqs"
+#define LOOP_CONFIGURE_TRIES 8           // 空きを取り合って EBUSY になったら取り直す回数
+
+// 直前に使ったループデバイス (同じ image なら /sys/block を走査しない)
+static dev_t cached_image_dev;
+static ino_t cached_image_ino;
+static int   cached_loop = -1;
+
+static uint32_t read_le32(const unsigned char *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+enum rootfs_image_type rootfs_image_type(const char *path) {
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return ROOTFS_IMAGE_NONE;
+    }
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return ROOTFS_IMAGE_NONE;
+    }
+    unsigned char head[EROFS_SUPER_OFFSET + 4];
+    ssize_t n = pread(fd, head, sizeof(head), 0);
+    close(fd);
+
+    if (n >= 4 && read_le32(head) == SQUASHFS_MAGIC) {
+        return ROOTFS_IMAGE_SQUASHFS;
+    }
+    if (n == (ssize_t)sizeof(head) && read_le32(head + EROFS_SUPER_OFFSET) == EROFS_SUPER_MAGIC) {
+        return ROOTFS_IMAGE_EROFS;
+    }
+    return ROOTFS_IMAGE_NONE;
+}
+
+const char *rootfs_image_fstype(enum rootfs_image_type type) {
+    switch (type) {
+    case ROOTFS_IMAGE_EROFS:
+        return "erofs";
+    case ROOTFS_IMAGE_SQUASHFS:
+        return "squashfs";
+    default:
+        return NULL;
+    }
+}
+
+/**
+ * @brief /dev/loopN が st の image に読み取り専用でつながっていれば開いたまま返す
+ *        (開いている間は AUTOCLEAR で外れないので, 確かめてから使うまでに別のファイルに変わらない)
+ */
+static int open_if_backed_by(int index, const struct stat *st, char *dev_path, size_t len) {
+    snprintf(dev_path, len, "/dev/loop%d", index);
+    int fd = open(dev_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    struct loop_info64 info;
+    if (ioctl(fd, LOOP_GET_STATUS64, &info) == 0
+        && info.lo_device == (uint64_t)st->st_dev && info.lo_inode == (uint64_t)st->st_ino
+        && info.lo_offset == 0 && info.lo_sizelimit == 0
+        && (info.lo_flags & LO_FLAGS_READ_ONLY)) {
+        return fd;
+    }
+    close(fd);
+    return -1;
+}
+
+// 他のコンテナ (他のランチャーも含む) が同じ image につないだループデバイスを探す
+static int find_attached(const struct stat *st, char *dev_path, size_t len) {
+    if (cached_loop >= 0 && cached_image_dev == st->st_dev && cached_image_ino == st->st_ino) {
+        int fd = open_if_backed_by(cached_loop, st, dev_path, len);
+        if (fd >= 0) {
+            return fd;
+        }
+    }
+    DIR *dir = opendir("/sys/block");
+    if (!dir) {
+        return -1;
+    }
+    int fd = -1;
+    struct dirent *entry;
+    while (fd < 0 && (entry = readdir(dir)) != NULL) {
+        int index;
+        char path[300];
+        // 何かにつながっているループデバイスだけ loop/ がある
+        if (sscanf(entry->d_name, "loop%d", &index) != 1) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "/sys/block/%s/loop", entry->d_name);
+        if (access(path, F_OK) != 0) {
+            continue;
+        }
+        fd = open_if_backed_by(index, st, dev_path, len);
+        if (fd >= 0) {
+            cached_loop = index;
+        }
+    }
+    closedir(dir);
+    return fd;
+}
+
+int loop_attach(const char *image, char *dev_path, size_t len, int *reused) {
+    *reused = 0;
+    int backing_fd = open(image, O_RDONLY | O_CLOEXEC);
+    if (backing_fd < 0) {
+        fprintf(stderr, "open %s failed: %m\n", image);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(backing_fd, &st) != 0) {
+        fprintf(stderr, "stat %s failed: %m\n", image);
+        close(backing_fd);
+        return -1;
+    }
+    cached_image_dev = st.st_dev;
+    cached_image_ino = st.st_ino;
+
+    int loop_fd = find_attached(&st, dev_path, len);
+    if (loop_fd >= 0) {
+        *reused = 1;
+        close(backing_fd);
+        return loop_fd;
+    }
+
+    int control_fd = open("/dev/loop-control", O_RDWR | O_CLOEXEC);
+    if (control_fd < 0) {
+        perror("open /dev/loop-control failed");
+        close(backing_fd);
+        return -1;
+    }
+    // 最後のマウントが外れたら自動で外れる. 読み取り専用, page cache を二重に持たない direct I/O
+    struct loop_config config;
+    memset(&config, 0, sizeof(config));
+    config.fd = (uint32_t)backing_fd;
+    config.block_size = LOOP_BLOCK_SIZE;
+    config.info.lo_flags = LO_FLAGS_READ_ONLY | LO_FLAGS_AUTOCLEAR | LO_FLAGS_DIRECT_IO;
+    snprintf((char *)config.info.lo_file_name, sizeof(config.info.lo_file_name), "%s", image);
+
+    for (int tries = 0; loop_fd < 0 && tries < LOOP_CONFIGURE_TRIES; tries++) {
+        int index = ioctl(control_fd, LOOP_CTL_GET_FREE);
+        if (index < 0) {
+            perror("LOOP_CTL_GET_FREE failed");
+            break;
+        }
+        snprintf(dev_path, len, "/dev/loop%d", index);
+        loop_fd = open(dev_path, O_RDONLY | O_CLOEXEC);
+        if (loop_fd < 0) {
+            fprintf(stderr, "open %s failed: %m\n", dev_path);
+            break;
+        }
+        if (ioctl(loop_fd, LOOP_CONFIGURE, &config) != 0) {
+            int saved_errno = errno;
+            close(loop_fd);
+            loop_fd = -1;
+            // 同時に起動した別のランチャーが同じ空きを先に使った
+            if (saved_errno == EBUSY) {
+                continue;
+            }
+            errno = saved_errno;
+            fprintf(stderr, "LOOP_CONFIGURE %s on %s failed: %m\n", image, dev_path);
+            break;
+        }
+        cached_loop = index;
+    }
+    close(control_fd);
+    close(backing_fd);
+    return loop_fd;
+}
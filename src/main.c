@@ -3,17 +3,22 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <sched.h>
-#include <sys/socket.h>
-#include <sys/wait.h>
 #include <sys/utsname.h>
+#include <sys/stat.h>
 #include <errno.h>
 #include <string.h>
-#include <fcntl.h>
 
-#include "child.h"
+#include "batch.h"
 #include "container.h"
+#include "daemon.h"
+#include "idmap.h"
+#include "image.h"
+#include "launch.h"
+#include "logs.h"
+#include "pool.h"
+#include "profile.h"
 #include "resources.h"
-#include "userns.h"
+#include "trace.h"
 
 // 適当なホスト名を決める
 static int choose_hostname(char *buff, size_t len) {
@@ -29,37 +34,208 @@ int main(int argc, char **argv) {
     struct child_config config;
     memset(&config, 0, sizeof(config));
 
-    int sockets[2] = {0};
-    pid_t child_pid = 0;
     int opt = 0;
+    size_t pool_high = 0;
+    size_t pool_low = 0;
+    struct daemon_config daemon = {0};
+    struct autoscale_config autoscale;
+    struct reclaim_config reclaim;
+    static struct log_config logs;
+    const char *batch_manifest = NULL;
+    long batch_jobs = 0;
+    const char *image_store = NULL;
+    char *limits[LAUNCH_MAX_LIMITS + 1] = {NULL};
+    size_t nlimits = 0;
 
     // デフォルト値
     config.uid = 1000;  // 例: 非特権ユーザID
     config.mount_dir = NULL;
 
-    // オプション解析 (例: -u 1000, -m /some/dir, -c /bin/sh)
-    while ((opt = getopt(argc, argv, "u:m:c:")) != -1) {
+    // オプション解析 (例: -u 1000, -m /some/dir, -l memory.max=512M, -c /bin/sh, -P 8:2)
+    while ((opt = getopt(argc, argv, "u:m:l:c:g:P:D:M:A:B:j:s:p:o:n:rNI:T:L:H:t:U:q:R:")) != -1) {
         switch (opt) {
         case 'u':
             config.uid = atoi(optarg);
             break;
+        case 'U':
+            // uid/gid 範囲: -U FIRST:SIZE[:COUNT] (同時に動くコンテナは別々の範囲を使う)
+            if (parse_id_ranges(optarg) != 0) {
+                fprintf(stderr, "invalid uid range spec: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
         case 'm':
             config.mount_dir = optarg;
             break;
+        case 'o':
+            // overlayfs: -o SIZE (-m を lower 層にし, upper/work を SIZE の tmpfs に置く)
+            config.overlay_size = optarg;
+            break;
+        case 'n':
+            // ネットワーク: -n ADDR/PREFIX[,gw=GW][,bridge=BR][,mtu=N][,queues=N][,gro=on|off]
+            if (parse_net_config(optarg, &config.net) != 0) {
+                fprintf(stderr, "invalid network spec: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'H':
+            // huge page: -H SIZE[,max=BYTES][,mount=PATH] (hugetlb の上限と rootfs 内の hugetlbfs)
+            if (parse_hugepage_config(optarg, &config.hugepages) != 0) {
+                fprintf(stderr, "invalid hugepage spec: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'q':
+            // ブロック I/O: -q [latency=USEC][,rbps=N][,wbps=N][,riops=N][,wiops=N][,dev=PATH]...
+            if (parse_io_config(optarg, &config.io) != 0) {
+                fprintf(stderr, "invalid io spec: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 't':
+            // THP の方針: -t system (既定) | never | madvise
+            if (parse_thp_policy(optarg, &config.hugepages.thp) != 0) {
+                fprintf(stderr, "unknown THP policy: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'T':
+            // 起動処理のトレース: -T PATH (終了時に Chrome trace 形式の JSON を書き出す)
+            if (trace_start(optarg) != 0) {
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'r':
+            // rootfs を読み取り専用にする
+            config.readonly_rootfs = 1;
+            break;
+        case 'l':
+            // cgroup 設定の追加/上書き: -l NAME=VALUE (複数可)
+            if (nlimits >= LAUNCH_MAX_LIMITS || !cgroup_limit_valid(optarg)) {
+                fprintf(stderr, "invalid cgroup limit: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            limits[nlimits++] = optarg;
+            config.cgroup_limits = limits;
+            break;
         case 'c':
             // 残りをコマンドとして扱う
             config.argc = argc - optind + 1;
             config.argv = &argv[optind - 1];
             optind = argc; // ループ終了
             break;
+        case 'g':
+            // cgroup プール: -g SIZE (作り置きの cgroup を使い回す)
+            set_cgroup_pool(strtoul(optarg, NULL, 10));
+            break;
+        case 'P': {
+            // プールモード: -P HIGH[:LOW] (LOW 省略時は HIGH/2)
+            char *low = strchr(optarg, ':');
+            pool_high = strtoul(optarg, NULL, 10);
+            pool_low = low ? strtoul(low + 1, NULL, 10) : pool_high / 2;
+            break;
+        }
+        case 'D':
+            // デーモンモード: -D SOCKET_PATH
+            daemon.socket_path = optarg;
+            break;
+        case 'M': {
+            // デーモンのメトリクス: -M PATH[:SECONDS] (PATH が "-" なら METRICS コマンドのみ)
+            char *interval = strchr(optarg, ':');
+            if (interval) {
+                *interval = '\0';
+                daemon.metrics_interval = strtoul(interval + 1, NULL, 10);
+            }
+            daemon.metrics_path = optarg;
+            break;
+        }
+        case 'A':
+            // デーモンの cpu.max 自動調整: -A FLOOR:CEIL (ミリ CPU)
+            if (parse_autoscale(optarg, &autoscale) != 0) {
+                fprintf(stderr, "invalid autoscale range: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            daemon.autoscale = &autoscale;
+            break;
+        case 'R':
+            // デーモンの先回りのメモリ回収: -R PRESSURE[:STEP] (memory の some が PRESSURE% 未満なら STEP% ずつ)
+            if (parse_reclaim(optarg, &reclaim) != 0) {
+                fprintf(stderr, "invalid reclaim spec: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            daemon.reclaim = &reclaim;
+            break;
+        case 'N':
+            // デーモンのコンテナを cpuset で L3 ドメイン/NUMA ノードに配置する
+            daemon.placement = 1;
+            break;
+        case 'B':
+            // バッチモード: -B MANIFEST [-j JOBS]
+            batch_manifest = optarg;
+            break;
+        case 'L':
+            // stdout/stderr をログファイルへ: -L DIR[,size=BYTES][,keep=N][,rate=BYTES][,policy=block|drop]
+            if (parse_log_config(optarg, &logs) != 0) {
+                fprintf(stderr, "invalid log spec: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            if (mkdir(logs.dir, 0755) != 0 && errno != EEXIST) {
+                fprintf(stderr, "mkdir %s failed: %m\n", logs.dir);
+                return EXIT_FAILURE;
+            }
+            set_log_config(&logs);
+            break;
+        case 'I':
+            // イメージ展開: -I STORE LAYER.tar[.gz|.zst]... (下の層から順に)
+            image_store = optarg;
+            break;
+        case 'j':
+            batch_jobs = atol(optarg);
+            break;
+        case 's':
+            // コンパイル済み seccomp/capability プロファイルのキャッシュ: -s CACHEDIR
+            set_profile_cache_dir(optarg);
+            break;
+        case 'p': {
+            // seccomp フィルタの種類: -p deny (既定) | allow
+            enum profile_kind kind;
+            if (parse_profile_kind(optarg, &kind) != 0) {
+                fprintf(stderr, "unknown profile: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            set_profile_kind(kind);
+            break;
+        }
         default:
-            fprintf(stderr, "Usage: %s -u UID -m MOUNTDIR -c COMMAND [ARGS...]\n", argv[0]);
+            fprintf(stderr, "Usage: %s -u UID [-U FIRST:SIZE[:COUNT]] -m MOUNTDIR[:LOWER...] [-o SIZE] [-r] [-n ADDR/PREFIX[,OPTS]] [-H SIZE[,OPTS]] [-t system|never|madvise] [-q IO[,OPTS]] [-l NAME=VALUE]... [-g POOLSIZE] [-P HIGH[:LOW]] [-s CACHEDIR] [-p deny|allow] [-L LOGDIR[,OPTS]] [-T TRACE.json] -c COMMAND [ARGS...]\n", argv[0]);
             return EXIT_FAILURE;
         }
     }
 
-    if (!config.argc || !config.mount_dir) {
+    if (daemon.socket_path) {
+        return run_daemon(&daemon) < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    if (image_store) {
+        return run_unpack(image_store, &argv[optind], argc - optind) < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    if (batch_manifest) {
+        int failed = run_batch(batch_manifest, batch_jobs);
+        return failed < 0 ? EXIT_FAILURE : failed;
+    }
+
+    if (pool_high > 0 && config.mount_dir) {
+        if (pool_low > pool_high) {
+            fprintf(stderr, "pool low watermark must be <= high\n");
+            return EXIT_FAILURE;
+        }
+    } else if (!config.argc || !config.mount_dir) {
         fprintf(stderr, "Usage: %s -u UID -m /path -c /bin/sh [args]\n", argv[0]);
+        fprintf(stderr, "       %s -u UID -m /path -P HIGH[:LOW] < requests\n", argv[0]);
+        fprintf(stderr, "       %s -D /path/to/socket [-M PATH[:SEC]] [-A FLOOR:CEIL] [-R PRESSURE[:STEP]] [-N]\n", argv[0]);
+        fprintf(stderr, "       %s -B manifest [-j JOBS]\n", argv[0]);
+        fprintf(stderr, "       %s -I STORE layer.tar[.gz|.zst]...\n", argv[0]);
         return EXIT_FAILURE;
     }
 
@@ -71,86 +247,17 @@ int main(int argc, char **argv) {
     }
     fprintf(stderr, "Running on %s %s\n", host.sysname, host.release);
 
+    if (pool_high > 0) {
+        return run_pool(&config, pool_low, pool_high) < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
     char hostname[256] = {0};
     choose_hostname(hostname, sizeof(hostname));
     config.hostname = hostname;
 
-    // ソケットペア作成
-    if (socketpair(AF_LOCAL, SOCK_SEQPACKET, 0, sockets) != 0) {
-        perror("socketpair failed");
-        return EXIT_FAILURE;
-    }
-    // FD_CLOEXEC
-    if (fcntl(sockets[0], F_SETFD, FD_CLOEXEC) != 0) {
-        perror("fcntl failed");
+    int status = launch_container(&config);
+    if (status < 0) {
         return EXIT_FAILURE;
     }
-    config.fd = sockets[1];
-
-    // cgroupなどリソース設定
-    if (resources(&config) != 0) {
-        fprintf(stderr, "resources failed\n");
-        close(sockets[0]);
-        close(sockets[1]);
-        return EXIT_FAILURE;
-    }
-
-    size_t STACK_SIZE = 1024 * 1024;
-    void *stack = malloc(STACK_SIZE);
-    if (!stack) {
-        fprintf(stderr, "malloc stack failed\n");
-        close(sockets[0]);
-        close(sockets[1]);
-        free_resources(&config);
-        return EXIT_FAILURE;
-    }
-
-    int clone_flags = CLONE_NEWNS
-                    | CLONE_NEWCGROUP
-                    | CLONE_NEWPID
-                    | CLONE_NEWIPC
-                    | CLONE_NEWNET
-                    | CLONE_NEWUTS
-                    | SIGCHLD;
-
-    child_pid = clone(child, (char*)stack + STACK_SIZE, clone_flags, &config);
-    if (child_pid < 0) {
-        perror("clone failed");
-        free(stack);
-        close(sockets[0]);
-        close(sockets[1]);
-        free_resources(&config);
-        return EXIT_FAILURE;
-    }
-    close(sockets[1]); // 子側の fd を閉じる
-
-    // ユーザー名前空間の UID/GID マップ設定
-    if (handle_child_uid_map(child_pid, sockets[0]) != 0) {
-        fprintf(stderr, "handle_child_uid_map failed\n");
-        // 子プロセス終了待ち
-        waitpid(child_pid, NULL, 0);
-        free(stack);
-        close(sockets[0]);
-        free_resources(&config);
-        return EXIT_FAILURE;
-    }
-
-    // 子プロセス終了待ち
-    int status = 0;
-    if (waitpid(child_pid, &status, 0) < 0) {
-        perror("waitpid failed");
-        status = 1;
-    } else {
-        if (WIFEXITED(status)) {
-            status = WEXITSTATUS(status);
-        } else {
-            status = 1;
-        }
-    }
-
-    // 後片付け
-    free(stack);
-    close(sockets[0]);
-    free_resources(&config);
     return status;
 }
@@ -0,0 +1,477 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/timerfd.h>
+
+#include "metrics.h"
+#include "timing.h"
+
+/*
+ * cgroup メトリクスの収集:
+ *  - ファイルはコンテナ起動時に 1 回だけ開き, サンプルごとに pread で読み直す
+ *  - 定期サンプルは timerfd, PSI トリガーと memory.events の変化は EPOLLPRI で即時サンプル
+ *  - サンプルは事前確保したリングに入れ, 出力時は各コンテナの最新位置だけを読む
+ */
+
+#define METRICS_RING_SIZE 4096
+#define METRICS_BUFSIZE   8192
+
+// PSI トリガー: 1 秒の窓で 150ms 以上ストールしたら通知
+#define PSI_TRIGGER "some 150000 1000000"
+
+static const char *metrics_files[METRICS_FILE_MAX] = {
+    [METRICS_MEMORY_CURRENT]  = "memory.current",
+    [METRICS_MEMORY_STAT]     = "memory.stat",
+    [METRICS_MEMORY_EVENTS]   = "memory.events",
+    [METRICS_CPU_STAT]        = "cpu.stat",
+    [METRICS_IO_STAT]         = "io.stat",
+    [METRICS_PIDS_CURRENT]    = "pids.current",
+    [METRICS_CPU_PRESSURE]    = "cpu.pressure",
+    [METRICS_MEMORY_PRESSURE] = "memory.pressure",
+    [METRICS_IO_PRESSURE]     = "io.pressure",
+};
+
+static const char *psi_names[PSI_MAX] = {
+    [PSI_CPU]    = "cpu",
+    [PSI_MEMORY] = "memory",
+    [PSI_IO]     = "io",
+};
+
+struct metrics {
+    struct metrics_ring  *ring;
+    struct metrics_target *targets;
+    const char *export_path;
+    int      timer_fd;
+    uint64_t samples;          // 自身のコスト (サンプル数と所要時間)
+    uint64_t sample_ns;
+};
+
+//------------------------------------------------------
+// 1. リングバッファ
+//------------------------------------------------------
+
+struct metrics_ring *metrics_ring_create(size_t capacity) {
+    size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    size_t bytes = sizeof(struct metrics_ring) + size * sizeof(struct metrics_slot);
+    // 別プロセスの読み手とも共有できるように MAP_SHARED で確保する
+    struct metrics_ring *ring = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) {
+        perror("mmap failed");
+        return NULL;
+    }
+    ring->capacity = size;
+    atomic_init(&ring->head, 0);
+    for (size_t i = 0; i < size; i++) {
+        atomic_init(&ring->slots[i].seq, 0);
+    }
+    return ring;
+}
+
+void metrics_ring_destroy(struct metrics_ring *ring) {
+    if (ring) {
+        munmap(ring, sizeof(struct metrics_ring) + ring->capacity * sizeof(struct metrics_slot));
+    }
+}
+
+uint64_t metrics_ring_push(struct metrics_ring *ring, const struct metrics_sample *sample) {
+    uint64_t pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    struct metrics_slot *slot = &ring->slots[pos & (ring->capacity - 1)];
+
+    // 奇数 = 書き込み中, 偶数 = pos の書き込み完了
+    atomic_store_explicit(&slot->seq, pos * 2 + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot->sample = *sample;
+    atomic_store_explicit(&slot->seq, pos * 2 + 2, memory_order_release);
+    atomic_store_explicit(&ring->head, pos + 1, memory_order_release);
+    return pos;
+}
+
+int metrics_ring_read(const struct metrics_ring *ring, uint64_t pos, struct metrics_sample *out) {
+    const struct metrics_slot *slot = &ring->slots[pos & (ring->capacity - 1)];
+    uint64_t before = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    if (before != pos * 2 + 2) {
+        return -1;
+    }
+    *out = slot->sample;
+    atomic_thread_fence(memory_order_acquire);
+    uint64_t after = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+    return after == before ? 0 : -1;
+}
+
+//------------------------------------------------------
+// 2. cgroup ファイルの解析
+//------------------------------------------------------
+
+static ssize_t read_file(int fd, char *buf, size_t len) {
+    if (fd < 0) {
+        return -1;
+    }
+    ssize_t n = pread(fd, buf, len - 1, 0);
+    if (n < 0) {
+        return -1;
+    }
+    buf[n] = '\0';
+    return n;
+}
+
+// "key value" 形式の行から value を探す
+static uint64_t find_value(const char *buf, const char *key) {
+    size_t keylen = strlen(key);
+    for (const char *line = buf; line && *line; line = strchr(line, '\n'), line = line ? line + 1 : NULL) {
+        if (!strncmp(line, key, keylen) && line[keylen] == ' ') {
+            return strtoull(line + keylen + 1, NULL, 10);
+        }
+    }
+    return 0;
+}
+
+// io.stat: "MAJ:MIN rbytes=.. wbytes=.. rios=.. wios=.. ..." をデバイス全体で合計
+static void parse_io_stat(const char *buf, struct metrics_sample *s) {
+    static const char *keys[] = { "rbytes=", "wbytes=", "rios=", "wios=" };
+    uint64_t *fields[] = { &s->io_rbytes, &s->io_wbytes, &s->io_rios, &s->io_wios };
+    for (size_t i = 0; i < 4; i++) {
+        for (const char *p = buf; (p = strstr(p, keys[i])) != NULL; p += strlen(keys[i])) {
+            *fields[i] += strtoull(p + strlen(keys[i]), NULL, 10);
+        }
+    }
+}
+
+// *.pressure: "some avg10=0.12 avg60=... avg300=... total=N" と "full ..." の 2 行
+static void parse_pressure(const char *buf, struct psi_sample *psi) {
+    for (const char *line = buf; line && *line; line = strchr(line, '\n'), line = line ? line + 1 : NULL) {
+        double avg10 = 0;
+        uint64_t total = 0;
+        int full = !strncmp(line, "full ", 5);
+        if (!full && strncmp(line, "some ", 5) != 0) {
+            continue;
+        }
+        if (sscanf(line + 5, "avg10=%lf avg60=%*f avg300=%*f total=%" SCNu64, &avg10, &total) != 2) {
+            continue;
+        }
+        if (full) {
+            psi->full_avg10 = (uint32_t)(avg10 * 100 + 0.5);
+            psi->full_total_usec = total;
+        } else {
+            psi->some_avg10 = (uint32_t)(avg10 * 100 + 0.5);
+            psi->some_total_usec = total;
+        }
+    }
+}
+
+//------------------------------------------------------
+// 3. 監視対象
+//------------------------------------------------------
+
+void metrics_target_open(struct metrics *m, struct metrics_target *t, int cgroup_fd,
+                         unsigned long id, const char *name) {
+    t->id = id;
+    t->name = name;
+    t->last_pos = 0;
+    t->notify_mask = 0;
+    for (int f = 0; f < METRICS_FILE_MAX; f++) {
+        int pressure = f >= METRICS_CPU_PRESSURE;
+        // PSI トリガーの登録には書き込みが要る
+        t->fds[f] = openat(cgroup_fd, metrics_files[f], (pressure ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+        if (t->fds[f] >= 0 && pressure
+            && write(t->fds[f], PSI_TRIGGER, sizeof(PSI_TRIGGER)) != (ssize_t)sizeof(PSI_TRIGGER)) {
+            // トリガーが使えなくても定期サンプルでは読む
+            close(t->fds[f]);
+            t->fds[f] = openat(cgroup_fd, metrics_files[f], O_RDONLY | O_CLOEXEC);
+        } else if (t->fds[f] >= 0 && (pressure || f == METRICS_MEMORY_EVENTS)) {
+            t->notify_mask |= 1u << f;
+        }
+    }
+
+    t->prev = NULL;
+    t->next = m->targets;
+    if (m->targets) {
+        m->targets->prev = t;
+    }
+    m->targets = t;
+}
+
+void metrics_target_close(struct metrics *m, struct metrics_target *t) {
+    for (int f = 0; f < METRICS_FILE_MAX; f++) {
+        if (t->fds[f] >= 0) {
+            close(t->fds[f]);
+            t->fds[f] = -1;
+        }
+    }
+    t->notify_mask = 0;
+    if (t->prev) {
+        t->prev->next = t->next;
+    } else if (m->targets == t) {
+        m->targets = t->next;
+    }
+    if (t->next) {
+        t->next->prev = t->prev;
+    }
+    t->prev = t->next = NULL;
+}
+
+int metrics_sample(struct metrics *m, struct metrics_target *t) {
+    char buf[METRICS_BUFSIZE];
+    struct metrics_sample s;
+    memset(&s, 0, sizeof(s));
+    uint64_t start = timing_now_ns();
+    s.timestamp_ns = start;
+    s.id = t->id;
+
+    if (read_file(t->fds[METRICS_MEMORY_CURRENT], buf, sizeof(buf)) > 0) {
+        s.memory_current = strtoull(buf, NULL, 10);
+    }
+    if (read_file(t->fds[METRICS_MEMORY_STAT], buf, sizeof(buf)) > 0) {
+        s.memory_anon = find_value(buf, "anon");
+        s.memory_file = find_value(buf, "file");
+        s.memory_active_anon = find_value(buf, "active_anon");
+        s.memory_inactive_anon = find_value(buf, "inactive_anon");
+        s.memory_active_file = find_value(buf, "active_file");
+        s.memory_inactive_file = find_value(buf, "inactive_file");
+        s.memory_refault = find_value(buf, "workingset_refault_anon") + find_value(buf, "workingset_refault_file");
+    }
+    if (read_file(t->fds[METRICS_MEMORY_EVENTS], buf, sizeof(buf)) > 0) {
+        s.memory_high_events = find_value(buf, "high");
+        s.memory_max_events = find_value(buf, "max");
+        s.memory_oom = find_value(buf, "oom");
+        s.memory_oom_kill = find_value(buf, "oom_kill");
+    }
+    if (read_file(t->fds[METRICS_CPU_STAT], buf, sizeof(buf)) > 0) {
+        s.cpu_usage_usec = find_value(buf, "usage_usec");
+        s.cpu_user_usec = find_value(buf, "user_usec");
+        s.cpu_system_usec = find_value(buf, "system_usec");
+        s.cpu_nr_throttled = find_value(buf, "nr_throttled");
+        s.cpu_throttled_usec = find_value(buf, "throttled_usec");
+    }
+    if (read_file(t->fds[METRICS_IO_STAT], buf, sizeof(buf)) > 0) {
+        parse_io_stat(buf, &s);
+    }
+    if (read_file(t->fds[METRICS_PIDS_CURRENT], buf, sizeof(buf)) > 0) {
+        s.pids_current = strtoull(buf, NULL, 10);
+    }
+    for (int r = 0; r < PSI_MAX; r++) {
+        if (read_file(t->fds[METRICS_CPU_PRESSURE + r], buf, sizeof(buf)) > 0) {
+            parse_pressure(buf, &s.psi[r]);
+        }
+    }
+
+    t->last_pos = metrics_ring_push(m->ring, &s) + 1;
+    m->samples++;
+    m->sample_ns += timing_now_ns() - start;
+    return 0;
+}
+
+int metrics_latest(const struct metrics *m, const struct metrics_target *t, struct metrics_sample *out) {
+    if (!t->last_pos) {
+        return -1;
+    }
+    return metrics_ring_read(m->ring, t->last_pos - 1, out);
+}
+
+//------------------------------------------------------
+// 4. 出力 (Prometheus テキスト形式)
+//------------------------------------------------------
+
+#define METRIC(name, type, help) \
+    fprintf(out, "# HELP mycontainer_" name " " help "\n# TYPE mycontainer_" name " " type "\n")
+
+char *metrics_render(struct metrics *m, size_t *len) {
+    char *text = NULL;
+    FILE *out = open_memstream(&text, len);
+    if (!out) {
+        perror("open_memstream failed");
+        return NULL;
+    }
+
+    // 最新サンプルを先に集める (リングが一周して読めないものは飛ばす)
+    size_t count = 0;
+    for (struct metrics_target *t = m->targets; t; t = t->next) {
+        count++;
+    }
+    struct metrics_sample *samples = calloc(count ? count : 1, sizeof(*samples));
+    const char **names = calloc(count ? count : 1, sizeof(*names));
+    size_t n = 0;
+    for (struct metrics_target *t = m->targets; t && samples && names; t = t->next) {
+        if (metrics_latest(m, t, &samples[n]) == 0) {
+            names[n++] = t->name;
+        }
+    }
+
+#define EACH(name, field) \
+    for (size_t i = 0; i < n; i++) \
+        fprintf(out, "mycontainer_" name "{container=\"%s\",id=\"%lu\"} %" PRIu64 "\n", \
+                names[i], samples[i].id, (uint64_t)(field))
+
+    METRIC("memory_current_bytes", "gauge", "memory.current");
+    EACH("memory_current_bytes", samples[i].memory_current);
+    METRIC("memory_anon_bytes", "gauge", "anon in memory.stat");
+    EACH("memory_anon_bytes", samples[i].memory_anon);
+    METRIC("memory_file_bytes", "gauge", "file in memory.stat");
+    EACH("memory_file_bytes", samples[i].memory_file);
+    METRIC("memory_lru_bytes", "gauge", "active/inactive anon/file in memory.stat");
+    for (size_t i = 0; i < n; i++) {
+        const char *lrus[] = { "active_anon", "inactive_anon", "active_file", "inactive_file" };
+        uint64_t values[] = { samples[i].memory_active_anon, samples[i].memory_inactive_anon,
+                              samples[i].memory_active_file, samples[i].memory_inactive_file };
+        for (size_t l = 0; l < 4; l++) {
+            fprintf(out, "mycontainer_memory_lru_bytes{container=\"%s\",id=\"%lu\",lru=\"%s\"} %" PRIu64 "\n",
+                    names[i], samples[i].id, lrus[l], values[l]);
+        }
+    }
+    METRIC("memory_workingset_refault_total", "counter", "workingset_refault_anon + workingset_refault_file in memory.stat");
+    EACH("memory_workingset_refault_total", samples[i].memory_refault);
+    METRIC("memory_events_total", "counter", "memory.events");
+    for (size_t i = 0; i < n; i++) {
+        const char *events[] = { "high", "max", "oom", "oom_kill" };
+        uint64_t values[] = { samples[i].memory_high_events, samples[i].memory_max_events,
+                              samples[i].memory_oom, samples[i].memory_oom_kill };
+        for (size_t e = 0; e < 4; e++) {
+            fprintf(out, "mycontainer_memory_events_total{container=\"%s\",id=\"%lu\",event=\"%s\"} %" PRIu64 "\n",
+                    names[i], samples[i].id, events[e], values[e]);
+        }
+    }
+    METRIC("cpu_usage_usec_total", "counter", "usage_usec in cpu.stat");
+    EACH("cpu_usage_usec_total", samples[i].cpu_usage_usec);
+    METRIC("cpu_user_usec_total", "counter", "user_usec in cpu.stat");
+    EACH("cpu_user_usec_total", samples[i].cpu_user_usec);
+    METRIC("cpu_system_usec_total", "counter", "system_usec in cpu.stat");
+    EACH("cpu_system_usec_total", samples[i].cpu_system_usec);
+    METRIC("cpu_throttled_total", "counter", "nr_throttled in cpu.stat");
+    EACH("cpu_throttled_total", samples[i].cpu_nr_throttled);
+    METRIC("cpu_throttled_usec_total", "counter", "throttled_usec in cpu.stat");
+    EACH("cpu_throttled_usec_total", samples[i].cpu_throttled_usec);
+    METRIC("io_read_bytes_total", "counter", "rbytes in io.stat (all devices)");
+    EACH("io_read_bytes_total", samples[i].io_rbytes);
+    METRIC("io_write_bytes_total", "counter", "wbytes in io.stat (all devices)");
+    EACH("io_write_bytes_total", samples[i].io_wbytes);
+    METRIC("io_read_ios_total", "counter", "rios in io.stat (all devices)");
+    EACH("io_read_ios_total", samples[i].io_rios);
+    METRIC("io_write_ios_total", "counter", "wios in io.stat (all devices)");
+    EACH("io_write_ios_total", samples[i].io_wios);
+    METRIC("pids_current", "gauge", "pids.current");
+    EACH("pids_current", samples[i].pids_current);
+#undef EACH
+
+    // ファミリごとに HELP/TYPE の直後へサンプルを並べる (Prometheus のテキスト形式はファミリが連続している前提)
+#define EACH_PSI(name, format, ...) \
+    for (size_t i = 0; i < n; i++) \
+        for (int r = 0; r < PSI_MAX; r++) \
+            fprintf(out, "mycontainer_" name "{container=\"%s\",id=\"%lu\",resource=\"%s\"} " format "\n", \
+                    names[i], samples[i].id, psi_names[r], __VA_ARGS__)
+
+    METRIC("pressure_some_usec_total", "counter", "some total in *.pressure");
+    EACH_PSI("pressure_some_usec_total", "%" PRIu64, samples[i].psi[r].some_total_usec);
+    METRIC("pressure_full_usec_total", "counter", "full total in *.pressure");
+    EACH_PSI("pressure_full_usec_total", "%" PRIu64, samples[i].psi[r].full_total_usec);
+    METRIC("pressure_some_avg10_ratio", "gauge", "some avg10 in *.pressure");
+    EACH_PSI("pressure_some_avg10_ratio", "%u.%04u",
+             samples[i].psi[r].some_avg10 / 10000, samples[i].psi[r].some_avg10 % 10000);
+#undef EACH_PSI
+
+    // コレクタ自身のコスト
+    METRIC("metrics_samples_total", "counter", "samples taken by the collector");
+    fprintf(out, "mycontainer_metrics_samples_total %" PRIu64 "\n", m->samples);
+    METRIC("metrics_sample_seconds_total", "counter", "time spent sampling cgroup files");
+    fprintf(out, "mycontainer_metrics_sample_seconds_total %" PRIu64 ".%09" PRIu64 "\n",
+            m->sample_ns / 1000000000, m->sample_ns % 1000000000);
+
+    free(samples);
+    free(names);
+    if (fclose(out) != 0) {
+        free(text);
+        return NULL;
+    }
+    return text;
+}
+#undef METRIC
+
+// 一時ファイルに書いて rename する (node_exporter の textfile collector が途中の状態を読まないように)
+static void metrics_export(struct metrics *m) {
+    size_t len = 0;
+    char *text = metrics_render(m, &len);
+    if (!text) {
+        return;
+    }
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", m->export_path);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "open %s failed: %m\n", tmp);
+        free(text);
+        return;
+    }
+    if (write(fd, text, len) != (ssize_t)len || rename(tmp, m->export_path) != 0) {
+        fprintf(stderr, "writing %s failed: %m\n", m->export_path);
+        unlink(tmp);
+    }
+    close(fd);
+    free(text);
+}
+
+//------------------------------------------------------
+// 5. 初期化と定期サンプル
+//------------------------------------------------------
+
+struct metrics *metrics_create(const char *export_path, unsigned int interval_sec) {
+    struct metrics *m = calloc(1, sizeof(*m));
+    if (!m) {
+        perror("calloc failed");
+        return NULL;
+    }
+    m->export_path = export_path;
+    m->ring = metrics_ring_create(METRICS_RING_SIZE);
+    m->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (!m->ring || m->timer_fd < 0) {
+        perror("metrics setup failed");
+        metrics_destroy(m);
+        return NULL;
+    }
+    struct itimerspec spec = {
+        .it_interval = { .tv_sec = interval_sec ? interval_sec : 1 },
+        .it_value    = { .tv_sec = interval_sec ? interval_sec : 1 },
+    };
+    if (timerfd_settime(m->timer_fd, 0, &spec, NULL) != 0) {
+        perror("timerfd_settime failed");
+        metrics_destroy(m);
+        return NULL;
+    }
+    return m;
+}
+
+void metrics_destroy(struct metrics *m) {
+    if (!m) {
+        return;
+    }
+    if (m->timer_fd >= 0) {
+        close(m->timer_fd);
+    }
+    metrics_ring_destroy(m->ring);
+    free(m);
+}
+
+int metrics_timer_fd(const struct metrics *m) {
+    return m->timer_fd;
+}
+
+void metrics_tick(struct metrics *m) {
+    uint64_t expirations;
+    if (read(m->timer_fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+        return;
+    }
+    for (struct metrics_target *t = m->targets; t; t = t->next) {
+        metrics_sample(m, t);
+    }
+    if (m->export_path) {
+        metrics_export(m);
+    }
+}
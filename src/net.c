@@ -0,0 +1,462 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <arpa/inet.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/ethtool.h>
+#include <linux/if_link.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/sockios.h>
+#include <linux/veth.h>
+
+#include "net.h"
+
+/*
+ * rtnetlink で veth を設定する:
+ *  - ホスト側: veth の作成 (ピアは IFLA_NET_NS_FD で子の netns に直接作る) とブリッジへの接続を 1 メッセージで
+ *  - 子側: lo/eth0 の up, アドレス, デフォルト経路をまとめて 1 回の sendmsg で
+ *  ip コマンドは使わない
+ */
+
+#define NET_BUFSIZE      4096
+#define NET_PEER_NAME    "eth0"
+
+// ランチャーが子の netns から戻れなくなったら, 以降の veth の設定はすべて断る
+static int net_stranded = 0;
+
+//------------------------------------------------------
+// 1. 設定の解析
+//------------------------------------------------------
+
+int parse_net_config(const char *spec, struct net_config *net) {
+    char copy[256];
+    if (strlen(spec) >= sizeof(copy)) {
+        return -1;
+    }
+    strcpy(copy, spec);
+    memset(net, 0, sizeof(*net));
+    net->gro = -1;
+
+    char *save = NULL;
+    for (char *tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        char *value = strchr(tok, '=');
+        if (!value) {
+            // 先頭の ADDR/PREFIX
+            char *slash = strchr(tok, '/');
+            if (net->enabled || !slash) {
+                return -1;
+            }
+            *slash = '\0';
+            net->prefix = strtoul(slash + 1, NULL, 10);
+            if (inet_pton(AF_INET, tok, &net->addr) != 1 || net->prefix == 0 || net->prefix > 32) {
+                return -1;
+            }
+            net->enabled = 1;
+            continue;
+        }
+        *value++ = '\0';
+        if (!strcmp(tok, "gw")) {
+            if (inet_pton(AF_INET, value, &net->gateway) != 1) {
+                return -1;
+            }
+            net->has_gateway = 1;
+        } else if (!strcmp(tok, "bridge") && strlen(value) < sizeof(net->bridge)) {
+            strcpy(net->bridge, value);
+        } else if (!strcmp(tok, "mtu")) {
+            net->mtu = strtoul(value, NULL, 10);
+        } else if (!strcmp(tok, "queues")) {
+            net->queues = strtoul(value, NULL, 10);
+        } else if (!strcmp(tok, "gro") && (!strcmp(value, "on") || !strcmp(value, "off"))) {
+            net->gro = !strcmp(value, "on");
+        } else {
+            return -1;
+        }
+    }
+    return net->enabled ? 0 : -1;
+}
+
+//------------------------------------------------------
+// 2. netlink メッセージの組み立て
+//------------------------------------------------------
+
+struct nl_batch {
+    char     buf[NET_BUFSIZE] __attribute__((aligned(NLMSG_ALIGNTO)));
+    size_t   len;
+    unsigned int count;   // ACK を待つメッセージ数
+    int      overflow;
+};
+
+static struct nlmsghdr *nl_begin(struct nl_batch *b, uint16_t type, uint16_t flags,
+                                 const void *body, size_t body_len) {
+    size_t len = NLMSG_LENGTH(body_len);
+    if (b->len + NLMSG_ALIGN(len) > sizeof(b->buf)) {
+        b->overflow = 1;
+        return NULL;
+    }
+    struct nlmsghdr *h = (struct nlmsghdr *)(b->buf + b->len);
+    memset(h, 0, NLMSG_ALIGN(len));
+    h->nlmsg_len = (uint32_t)len;
+    h->nlmsg_type = type;
+    h->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | flags;
+    h->nlmsg_seq = ++b->count;
+    memcpy(NLMSG_DATA(h), body, body_len);
+    return h;
+}
+
+static void nl_end(struct nl_batch *b, struct nlmsghdr *h) {
+    if (h) {
+        b->len += NLMSG_ALIGN(h->nlmsg_len);
+    }
+}
+
+static struct rtattr *nl_attr(struct nl_batch *b, struct nlmsghdr *h, uint16_t type,
+                              const void *data, size_t len) {
+    if (!h) {
+        return NULL;
+    }
+    size_t offset = b->len + NLMSG_ALIGN(h->nlmsg_len);
+    if (offset + RTA_SPACE(len) > sizeof(b->buf)) {
+        b->overflow = 1;
+        return NULL;
+    }
+    struct rtattr *rta = (struct rtattr *)(b->buf + offset);
+    rta->rta_type = type;
+    rta->rta_len = (unsigned short)RTA_LENGTH(len);
+    if (len) {
+        memcpy(RTA_DATA(rta), data, len);
+    }
+    h->nlmsg_len = (uint32_t)(NLMSG_ALIGN(h->nlmsg_len) + RTA_ALIGN(rta->rta_len));
+    return rta;
+}
+
+static void nl_attr_u32(struct nl_batch *b, struct nlmsghdr *h, uint16_t type, uint32_t value) {
+    nl_attr(b, h, type, &value, sizeof(value));
+}
+
+// ネストした属性: 開始位置を返し, nl_nest_end で長さを確定する
+static struct rtattr *nl_nest_begin(struct nl_batch *b, struct nlmsghdr *h, uint16_t type) {
+    return nl_attr(b, h, type, NULL, 0);
+}
+
+static void nl_nest_end(struct nlmsghdr *h, struct rtattr *nest) {
+    if (nest) {
+        nest->rta_len = (unsigned short)((char *)h + h->nlmsg_len - (char *)nest);
+    }
+}
+
+// まとめて送り, 全メッセージの ACK を待つ (最初のエラーを返す)
+static int nl_send(int fd, struct nl_batch *b) {
+    if (b->overflow) {
+        fprintf(stderr, "netlink batch too large\n");
+        return -1;
+    }
+    struct sockaddr_nl addr = { .nl_family = AF_NETLINK };
+    if (sendto(fd, b->buf, b->len, 0, (struct sockaddr *)&addr, sizeof(addr)) != (ssize_t)b->len) {
+        perror("netlink send failed");
+        return -1;
+    }
+    int error = 0;
+    unsigned int acked = 0;
+    char buf[NET_BUFSIZE] __attribute__((aligned(NLMSG_ALIGNTO)));
+    while (acked < b->count) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("netlink recv failed");
+            return -1;
+        }
+        for (struct nlmsghdr *h = (struct nlmsghdr *)buf; NLMSG_OK(h, (size_t)n); h = NLMSG_NEXT(h, n)) {
+            if (h->nlmsg_type != NLMSG_ERROR) {
+                continue;
+            }
+            const struct nlmsgerr *err = NLMSG_DATA(h);
+            if (err->error && !error) {
+                error = -err->error;
+            }
+            acked++;
+        }
+    }
+    b->len = 0;
+    b->count = 0;
+    if (error) {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+//------------------------------------------------------
+// 3. veth の設定
+//------------------------------------------------------
+
+static int set_gro(int sock, const char *ifname, int on) {
+    struct ethtool_value value = { .cmd = ETHTOOL_SGRO, .data = (uint32_t)on };
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "%s", ifname);
+    ifr.ifr_data = (char *)&value;
+    if (ioctl(sock, SIOCETHTOOL, &ifr) != 0) {
+        fprintf(stderr, "set gro on %s failed: %m\n", ifname);
+        return -1;
+    }
+    return 0;
+}
+
+// veth の MTU/キュー数 (ホスト側とピアで共通)
+static void add_link_params(struct nl_batch *b, struct nlmsghdr *h, const struct net_config *net) {
+    if (net->mtu) {
+        nl_attr_u32(b, h, IFLA_MTU, net->mtu);
+    }
+    if (net->queues) {
+        nl_attr_u32(b, h, IFLA_NUM_TX_QUEUES, net->queues);
+        nl_attr_u32(b, h, IFLA_NUM_RX_QUEUES, net->queues);
+    }
+}
+
+// ホスト側: veth ペアを作り, ピアを子の netns に置く (ブリッジ指定時はそのまま接続する)
+static int create_veth(int nl, struct nl_batch *b, const char *host_name, int netns_fd,
+                       const struct net_config *net) {
+    struct ifinfomsg ifi = { .ifi_family = AF_UNSPEC, .ifi_flags = IFF_UP, .ifi_change = IFF_UP };
+    struct nlmsghdr *h = nl_begin(b, RTM_NEWLINK, NLM_F_CREATE | NLM_F_EXCL, &ifi, sizeof(ifi));
+    nl_attr(b, h, IFLA_IFNAME, host_name, strlen(host_name) + 1);
+    add_link_params(b, h, net);
+    if (net->bridge[0]) {
+        unsigned int master = if_nametoindex(net->bridge);
+        if (!master) {
+            fprintf(stderr, "bridge %s not found: %m\n", net->bridge);
+            return -1;
+        }
+        nl_attr_u32(b, h, IFLA_MASTER, master);
+    }
+
+    struct rtattr *linkinfo = nl_nest_begin(b, h, IFLA_LINKINFO);
+    nl_attr(b, h, IFLA_INFO_KIND, "veth", strlen("veth"));
+    struct rtattr *data = nl_nest_begin(b, h, IFLA_INFO_DATA);
+    struct rtattr *peer = nl_nest_begin(b, h, VETH_INFO_PEER);
+    // ifindex はカーネルに任せる (子の netns で何番になるかは名前で引き直す)
+    struct ifinfomsg peer_ifi = { .ifi_family = AF_UNSPEC };
+    // ピアの ifinfomsg は属性ではなく VETH_INFO_PEER の先頭に直接置く
+    if (h && !b->overflow) {
+        size_t offset = b->len + h->nlmsg_len;
+        if (offset + NLMSG_ALIGN(sizeof(peer_ifi)) > sizeof(b->buf)) {
+            b->overflow = 1;
+        } else {
+            memset(b->buf + offset, 0, NLMSG_ALIGN(sizeof(peer_ifi)));
+            memcpy(b->buf + offset, &peer_ifi, sizeof(peer_ifi));
+            h->nlmsg_len += NLMSG_ALIGN(sizeof(peer_ifi));
+        }
+    }
+    nl_attr(b, h, IFLA_IFNAME, NET_PEER_NAME, strlen(NET_PEER_NAME) + 1);
+    nl_attr_u32(b, h, IFLA_NET_NS_FD, (uint32_t)netns_fd);
+    add_link_params(b, h, net);
+    nl_nest_end(h, peer);
+    nl_nest_end(h, data);
+    nl_nest_end(h, linkinfo);
+    nl_end(b, h);
+    if (nl_send(nl, b) != 0) {
+        fprintf(stderr, "create veth %s failed: %m\n", host_name);
+        return -1;
+    }
+    return 0;
+}
+
+static void add_address(struct nl_batch *b, int ifindex, struct in_addr addr, unsigned int prefix) {
+    struct ifaddrmsg ifa = {
+        .ifa_family = AF_INET,
+        .ifa_prefixlen = (unsigned char)prefix,
+        .ifa_index = (unsigned int)ifindex,
+    };
+    struct nlmsghdr *h = nl_begin(b, RTM_NEWADDR, NLM_F_CREATE | NLM_F_REPLACE, &ifa, sizeof(ifa));
+    nl_attr(b, h, IFA_LOCAL, &addr, sizeof(addr));
+    nl_attr(b, h, IFA_ADDRESS, &addr, sizeof(addr));
+    nl_end(b, h);
+}
+
+// dst/dst_len への経路 (gateway が NULL なら直結)
+static void add_route(struct nl_batch *b, int ifindex, const struct in_addr *dst, unsigned int dst_len,
+                      const struct in_addr *gateway) {
+    struct rtmsg rtm = {
+        .rtm_family = AF_INET,
+        .rtm_dst_len = (unsigned char)dst_len,
+        .rtm_table = RT_TABLE_MAIN,
+        .rtm_protocol = RTPROT_BOOT,
+        .rtm_scope = gateway ? RT_SCOPE_UNIVERSE : RT_SCOPE_LINK,
+        .rtm_type = RTN_UNICAST,
+        // ゲートウェイがサブネット外 (ホスト経路モード) でも使えるように
+        .rtm_flags = gateway ? RTNH_F_ONLINK : 0,
+    };
+    struct nlmsghdr *h = nl_begin(b, RTM_NEWROUTE, NLM_F_CREATE | NLM_F_REPLACE, &rtm, sizeof(rtm));
+    if (dst_len) {
+        nl_attr(b, h, RTA_DST, dst, sizeof(*dst));
+    }
+    if (gateway) {
+        nl_attr(b, h, RTA_GATEWAY, gateway, sizeof(*gateway));
+    }
+    nl_attr_u32(b, h, RTA_OIF, (uint32_t)ifindex);
+    nl_end(b, h);
+}
+
+// inet は子の netns で作ったソケット (if_nametoindex はランチャーの netns を引いてしまう)
+static int ifindex_in_netns(int inet, const char *ifname) {
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "%s", ifname);
+    if (ioctl(inet, SIOCGIFINDEX, &ifr) != 0) {
+        fprintf(stderr, "%s not found in child netns: %m\n", ifname);
+        return -1;
+    }
+    return ifr.ifr_ifindex;
+}
+
+// 子側: lo/eth0 を up, アドレスとデフォルト経路を 1 回で送る
+static int configure_peer(int nl, int inet, struct nl_batch *b, const struct net_config *net) {
+    int lo = ifindex_in_netns(inet, "lo");
+    int peer = ifindex_in_netns(inet, NET_PEER_NAME);
+    if (lo < 0 || peer < 0) {
+        return -1;
+    }
+    for (int *ifindex = (int[]){ lo, peer, 0 }; *ifindex; ifindex++) {
+        struct ifinfomsg ifi = {
+            .ifi_family = AF_UNSPEC,
+            .ifi_index = *ifindex,
+            .ifi_flags = IFF_UP,
+            .ifi_change = IFF_UP,
+        };
+        nl_end(b, nl_begin(b, RTM_NEWLINK, 0, &ifi, sizeof(ifi)));
+    }
+    add_address(b, peer, net->addr, net->prefix);
+    if (net->has_gateway) {
+        add_route(b, peer, NULL, 0, &net->gateway);
+    }
+    if (nl_send(nl, b) != 0) {
+        fprintf(stderr, "configure " NET_PEER_NAME " failed: %m\n");
+        return -1;
+    }
+    return 0;
+}
+
+// ブリッジ無し: ホスト側 veth にゲートウェイのアドレス (/32) とコンテナへの経路を張る
+static int configure_host_route(int nl, struct nl_batch *b, const char *host_name,
+                                const struct net_config *net) {
+    int ifindex = (int)if_nametoindex(host_name);
+    if (!ifindex) {
+        fprintf(stderr, "if_nametoindex %s failed: %m\n", host_name);
+        return -1;
+    }
+    add_address(b, ifindex, net->gateway, 32);
+    add_route(b, ifindex, &net->addr, 32, NULL);
+    if (nl_send(nl, b) != 0) {
+        fprintf(stderr, "configure %s failed: %m\n", host_name);
+        return -1;
+    }
+    return 0;
+}
+
+static int open_netlink(void) {
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (fd < 0) {
+        perror("netlink socket failed");
+    }
+    return fd;
+}
+
+/**
+ * @brief 子の netns に一時的に入り, そこに属するソケットを作って戻る
+ *        (ソケットは作った時点の netns に紐づくので, 以降の操作に setns は要らない)
+ */
+static int open_in_netns(int netns_fd, int *nl, int *inet) {
+    int self = open("/proc/self/ns/net", O_RDONLY | O_CLOEXEC);
+    if (self < 0) {
+        perror("open /proc/self/ns/net failed");
+        return -1;
+    }
+    if (setns(netns_fd, CLONE_NEWNET) != 0) {
+        perror("setns to child netns failed");
+        close(self);
+        return -1;
+    }
+    *nl = open_netlink();
+    *inet = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (setns(self, CLONE_NEWNET) != 0) {
+        // ランチャーが別の netns に残ったまま veth を作り続けてはいけない (以降はすべて失敗させる)
+        perror("setns back to host netns failed");
+        net_stranded = 1;
+        close(self);
+        return -1;
+    }
+    close(self);
+    return (*nl >= 0 && *inet >= 0) ? 0 : -1;
+}
+
+int setup_container_net(pid_t child_pid, const struct net_config *net) {
+    char path[64];
+    char host_name[IFNAMSIZ];
+    snprintf(path, sizeof(path), "/proc/%d/ns/net", child_pid);
+    snprintf(host_name, sizeof(host_name), "mcv%d", child_pid);
+    if (net_stranded) {
+        fprintf(stderr, "launcher is stuck in a container netns, refusing to set up %s\n", host_name);
+        errno = EIO;
+        return -1;
+    }
+
+    int netns_fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (netns_fd < 0) {
+        fprintf(stderr, "open %s failed: %m\n", path);
+        return -1;
+    }
+    int ret = -1, saved_errno = 0;
+    int host_nl = open_netlink();
+    int child_nl = -1;
+    int child_inet = -1;
+    struct nl_batch *batch = calloc(1, sizeof(*batch));
+    if (host_nl < 0 || !batch || open_in_netns(netns_fd, &child_nl, &child_inet) != 0) {
+        goto out;
+    }
+
+    if (create_veth(host_nl, batch, host_name, netns_fd, net) != 0
+        || configure_peer(child_nl, child_inet, batch, net) != 0) {
+        goto out;
+    }
+    if (!net->bridge[0] && net->has_gateway && configure_host_route(host_nl, batch, host_name, net) != 0) {
+        goto out;
+    }
+    if (net->gro >= 0) {
+        int host_inet = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        int failed = host_inet < 0 || set_gro(host_inet, host_name, net->gro) != 0
+                  || set_gro(child_inet, NET_PEER_NAME, net->gro) != 0;
+        if (host_inet >= 0) {
+            close(host_inet);
+        }
+        if (failed) {
+            goto out;
+        }
+    }
+    ret = 0;
+
+out:
+    // 呼び出し側が errno で原因 (EPERM など) を見分けられるように残す
+    saved_errno = errno;
+    free(batch);
+    if (child_inet >= 0) {
+        close(child_inet);
+    }
+    if (child_nl >= 0) {
+        close(child_nl);
+    }
+    if (host_nl >= 0) {
+        close(host_nl);
+    }
+    close(netns_fd);
+    errno = saved_errno;
+    return ret;
+}
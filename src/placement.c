@@ -0,0 +1,503 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+
+#include "placement.h"
+
+/*
+ * 負荷はドメインに割り当てた幅の合計 (ミリ CPU) で数え、比較は負荷 / CPU 数で行う
+ * (割り算を避けて掛け算で比べる). 複数ドメインにまたがる配置は CPU 数で按分する
+ */
+
+#define PLACEMENT_SYSFS "/sys/devices/system"
+#define MASK_WORDS      (PLACEMENT_MAX_CPUS / 64)
+
+struct placement_domain {
+    uint64_t cpus[MASK_WORDS];
+    unsigned int ncpus;
+    int      node;
+    uint64_t load;             // ミリ CPU
+};
+
+struct placement {
+    struct placement_domain domains[PLACEMENT_MAX_DOMAINS];
+    unsigned int ndomains;
+    int      nnodes;
+    struct placement_slot *slots;
+    unsigned long moves;
+};
+
+//------------------------------------------------------
+// 1. CPU リスト ("0-3,8-11")
+//------------------------------------------------------
+
+static int parse_cpulist(const char *list, uint64_t *mask, unsigned int nbits) {
+    memset(mask, 0, (nbits / 64) * sizeof(uint64_t));
+    const char *p = list;
+    while (*p && *p != '\n') {
+        char *end;
+        unsigned long first = strtoul(p, &end, 10);
+        unsigned long last = first;
+        if (end == p) {
+            return -1;
+        }
+        if (*end == '-') {
+            p = end + 1;
+            last = strtoul(p, &end, 10);
+            if (end == p) {
+                return -1;
+            }
+        }
+        for (unsigned long i = first; i <= last && i < nbits; i++) {
+            mask[i / 64] |= 1ULL << (i % 64);
+        }
+        p = *end == ',' ? end + 1 : end;
+    }
+    return 0;
+}
+
+static int mask_test(const uint64_t *mask, unsigned int bit) {
+    return (mask[bit / 64] >> (bit % 64)) & 1;
+}
+
+static void format_cpulist(const uint64_t *mask, unsigned int nbits, char *buf, size_t len) {
+    size_t used = 0;
+    buf[0] = '\0';
+    for (unsigned int i = 0; i < nbits; i++) {
+        if (!mask_test(mask, i)) {
+            continue;
+        }
+        unsigned int last = i;
+        while (last + 1 < nbits && mask_test(mask, last + 1)) {
+            last++;
+        }
+        int n = last == i
+            ? snprintf(buf + used, len - used, "%s%u", used ? "," : "", i)
+            : snprintf(buf + used, len - used, "%s%u-%u", used ? "," : "", i, last);
+        if (n < 0 || (size_t)n >= len - used) {
+            return;
+        }
+        used += (size_t)n;
+        i = last;
+    }
+}
+
+//------------------------------------------------------
+// 2. トポロジー
+//------------------------------------------------------
+
+static int read_sysfs(const char *path, char *buf, size_t len) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    ssize_t n = read(fd, buf, len - 1);
+    close(fd);
+    if (n < 0) {
+        return -1;
+    }
+    buf[n] = '\0';
+    return 0;
+}
+
+// CPU が共有する最終レベルのキャッシュ (命令キャッシュは除く) の CPU リスト
+static int read_llc(const char *root, unsigned int cpu, char *list, size_t len) {
+    int best = -1;
+    for (int index = 0; index < 8; index++) {
+        char path[PATH_MAX], buf[64];
+        snprintf(path, sizeof(path), "%s/cpu/cpu%u/cache/index%d/level", root, cpu, index);
+        if (read_sysfs(path, buf, sizeof(buf)) != 0) {
+            break;
+        }
+        int level = atoi(buf);
+        snprintf(path, sizeof(path), "%s/cpu/cpu%u/cache/index%d/type", root, cpu, index);
+        if (read_sysfs(path, buf, sizeof(buf)) == 0 && !strncmp(buf, "Instruction", 11)) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/cpu/cpu%u/cache/index%d/shared_cpu_list", root, cpu, index);
+        if (level > best && read_sysfs(path, list, len) == 0) {
+            best = level;
+        }
+    }
+    return best < 0 ? -1 : 0;
+}
+
+static int add_domain(struct placement *p, const uint64_t *cpus, int node) {
+    for (unsigned int i = 0; i < p->ndomains; i++) {
+        if (!memcmp(p->domains[i].cpus, cpus, sizeof(p->domains[i].cpus))) {
+            return 0;
+        }
+    }
+    if (p->ndomains == PLACEMENT_MAX_DOMAINS) {
+        fprintf(stderr, "too many cache domains (max %d)\n", PLACEMENT_MAX_DOMAINS);
+        return -1;
+    }
+    struct placement_domain *d = &p->domains[p->ndomains++];
+    memcpy(d->cpus, cpus, sizeof(d->cpus));
+    d->ncpus = 0;
+    for (unsigned int i = 0; i < PLACEMENT_MAX_CPUS; i++) {
+        d->ncpus += mask_test(cpus, i);
+    }
+    d->node = node;
+    d->load = 0;
+    return 0;
+}
+
+struct placement *placement_create(const char *sysfs_root) {
+    const char *root = sysfs_root ? sysfs_root : PLACEMENT_SYSFS;
+    char path[PATH_MAX], buf[4096];
+    uint64_t online[MASK_WORDS];
+
+    snprintf(path, sizeof(path), "%s/cpu/online", root);
+    if (read_sysfs(path, buf, sizeof(buf)) != 0 || parse_cpulist(buf, online, PLACEMENT_MAX_CPUS) != 0) {
+        fprintf(stderr, "read %s failed: %m\n", path);
+        return NULL;
+    }
+
+    struct placement *p = calloc(1, sizeof(*p));
+    if (!p) {
+        perror("calloc failed");
+        return NULL;
+    }
+
+    // CPU → ノード (node/ が無いカーネルは全部ノード 0)
+    int cpu_node[PLACEMENT_MAX_CPUS] = {0};
+    p->nnodes = 1;
+    for (int node = 0; node < PLACEMENT_MAX_NODES; node++) {
+        uint64_t cpus[MASK_WORDS];
+        snprintf(path, sizeof(path), "%s/node/node%d/cpulist", root, node);
+        if (read_sysfs(path, buf, sizeof(buf)) != 0 || parse_cpulist(buf, cpus, PLACEMENT_MAX_CPUS) != 0) {
+            continue;
+        }
+        for (unsigned int cpu = 0; cpu < PLACEMENT_MAX_CPUS; cpu++) {
+            if (mask_test(cpus, cpu)) {
+                cpu_node[cpu] = node;
+            }
+        }
+        if (node + 1 > p->nnodes) {
+            p->nnodes = node + 1;
+        }
+    }
+
+    // キャッシュを共有する CPU の集まり (情報が無ければ CPU 単体) をドメインにする
+    for (unsigned int cpu = 0; cpu < PLACEMENT_MAX_CPUS; cpu++) {
+        if (!mask_test(online, cpu)) {
+            continue;
+        }
+        uint64_t cpus[MASK_WORDS];
+        if (read_llc(root, cpu, buf, sizeof(buf)) != 0 || parse_cpulist(buf, cpus, PLACEMENT_MAX_CPUS) != 0) {
+            memset(cpus, 0, sizeof(cpus));
+            cpus[cpu / 64] |= 1ULL << (cpu % 64);
+        }
+        // オフラインの CPU と他ノードの CPU は含めない (ノードをまたぐキャッシュは無い前提)
+        for (unsigned int i = 0; i < PLACEMENT_MAX_CPUS; i++) {
+            if (mask_test(cpus, i) && (!mask_test(online, i) || cpu_node[i] != cpu_node[cpu])) {
+                cpus[i / 64] &= ~(1ULL << (i % 64));
+            }
+        }
+        if (add_domain(p, cpus, cpu_node[cpu]) != 0) {
+            free(p);
+            return NULL;
+        }
+    }
+    if (p->ndomains == 0) {
+        fprintf(stderr, "no online cpus in %s/cpu/online\n", root);
+        free(p);
+        return NULL;
+    }
+    return p;
+}
+
+void placement_destroy(struct placement *p) {
+    free(p);
+}
+
+unsigned int placement_width(const char *cpu_max) {
+    if (!cpu_max || !strncmp(cpu_max, "max", 3)) {
+        return 1;
+    }
+    char *end;
+    unsigned long long quota = strtoull(cpu_max, &end, 10);
+    unsigned long long period = *end == ' ' ? strtoull(end + 1, NULL, 10) : 100000;
+    if (!quota || !period) {
+        return 1;
+    }
+    return (unsigned int)((quota + period - 1) / period);
+}
+
+//------------------------------------------------------
+// 3. 配置
+//------------------------------------------------------
+
+static unsigned int domains_ncpus(const struct placement *p, uint64_t domains) {
+    unsigned int ncpus = 0;
+    for (unsigned int i = 0; i < p->ndomains; i++) {
+        if (domains & (1ULL << i)) {
+            ncpus += p->domains[i].ncpus;
+        }
+    }
+    return ncpus;
+}
+
+static uint64_t domains_load(const struct placement *p, uint64_t domains) {
+    uint64_t load = 0;
+    for (unsigned int i = 0; i < p->ndomains; i++) {
+        if (domains & (1ULL << i)) {
+            load += p->domains[i].load;
+        }
+    }
+    return load;
+}
+
+// 幅をドメインの CPU 数で按分して足す/引く
+static void account(struct placement *p, const struct placement_slot *slot, int sign) {
+    unsigned int total = domains_ncpus(p, slot->domains);
+    for (unsigned int i = 0; i < p->ndomains && total; i++) {
+        if (!(slot->domains & (1ULL << i))) {
+            continue;
+        }
+        uint64_t share = (uint64_t)slot->width * 1000 * p->domains[i].ncpus / total;
+        p->domains[i].load = sign > 0 ? p->domains[i].load + share
+                                      : p->domains[i].load - (share < p->domains[i].load ? share : p->domains[i].load);
+    }
+}
+
+// (load_a + add) / ncpus_a < (load_b + add) / ncpus_b
+static int less_loaded(uint64_t load_a, unsigned int ncpus_a, uint64_t load_b, unsigned int ncpus_b, uint64_t add) {
+    return (load_a + add) * ncpus_b < (load_b + add) * ncpus_a;
+}
+
+// 候補: ドメイン 1 つ → ノード全体 → 全 CPU
+static uint64_t choose(const struct placement *p, unsigned int width) {
+    uint64_t add = (uint64_t)width * 1000;
+    int best = -1;
+    for (unsigned int i = 0; i < p->ndomains; i++) {
+        const struct placement_domain *d = &p->domains[i];
+        if (d->ncpus < width) {
+            continue;
+        }
+        if (best < 0 || less_loaded(d->load, d->ncpus, p->domains[best].load, p->domains[best].ncpus, add)) {
+            best = (int)i;
+        }
+    }
+    if (best >= 0) {
+        return 1ULL << best;
+    }
+
+    uint64_t best_node = 0, all = 0;
+    for (int node = 0; node < p->nnodes; node++) {
+        uint64_t domains = 0;
+        for (unsigned int i = 0; i < p->ndomains; i++) {
+            if (p->domains[i].node == node) {
+                domains |= 1ULL << i;
+            }
+        }
+        all |= domains;
+        unsigned int ncpus = domains_ncpus(p, domains);
+        if (!domains || ncpus < width) {
+            continue;
+        }
+        if (!best_node || less_loaded(domains_load(p, domains), ncpus,
+                                      domains_load(p, best_node), domains_ncpus(p, best_node), add)) {
+            best_node = domains;
+        }
+    }
+    return best_node ? best_node : all;
+}
+
+static int write_cpuset(int cgroup_fd, const char *name, const char *value) {
+    int fd = openat(cgroup_fd, name, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "open %s failed: %m\n", name);
+        return -1;
+    }
+    if (write(fd, value, strlen(value)) == -1) {
+        fprintf(stderr, "write %s to %s failed: %m\n", value, name);
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+// cpuset.mems を変えるとカーネルがページを新しいノードへ移す
+static int apply(const struct placement *p, const struct placement_slot *slot) {
+    if (slot->cgroup_fd < 0) {
+        return 0;
+    }
+    char cpus[1024], mems[256];
+    placement_cpus(p, slot, cpus, sizeof(cpus));
+    placement_mems(p, slot, mems, sizeof(mems));
+    if (write_cpuset(slot->cgroup_fd, "cpuset.cpus", cpus) != 0 ||
+        write_cpuset(slot->cgroup_fd, "cpuset.mems", mems) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+int placement_assign(struct placement *p, struct placement_slot *slot, unsigned long id,
+                     unsigned int width, int cgroup_fd) {
+    slot->id = id;
+    slot->width = width ? width : 1;
+    slot->cgroup_fd = cgroup_fd;
+    slot->domains = choose(p, slot->width);
+    if (apply(p, slot) != 0) {
+        slot->domains = 0;
+        return -1;
+    }
+    account(p, slot, 1);
+
+    slot->prev = NULL;
+    slot->next = p->slots;
+    if (p->slots) {
+        p->slots->prev = slot;
+    }
+    p->slots = slot;
+    return 0;
+}
+
+void placement_release(struct placement *p, struct placement_slot *slot) {
+    if (!slot->domains) {
+        return;
+    }
+    account(p, slot, -1);
+    slot->domains = 0;
+    if (slot->prev) {
+        slot->prev->next = slot->next;
+    } else {
+        p->slots = slot->next;
+    }
+    if (slot->next) {
+        slot->next->prev = slot->prev;
+    }
+    slot->prev = slot->next = NULL;
+}
+
+// 最も混んだドメインから, 最も空いたドメインへ 1 つ移す
+// 移した先が移す前の元より空いている場合だけ動かす (負荷の二乗和が減るので往復しない)
+static int rebalance_once(struct placement *p) {
+    int hi = -1, lo = -1;
+    for (unsigned int i = 0; i < p->ndomains; i++) {
+        const struct placement_domain *d = &p->domains[i];
+        if (hi < 0 || less_loaded(p->domains[hi].load, p->domains[hi].ncpus, d->load, d->ncpus, 0)) {
+            hi = (int)i;
+        }
+    }
+    for (unsigned int i = 0; i < p->ndomains; i++) {
+        const struct placement_domain *d = &p->domains[i];
+        // 同じ負荷ならメモリを移さずに済む同じノードを選ぶ
+        if (lo < 0 || less_loaded(d->load, d->ncpus, p->domains[lo].load, p->domains[lo].ncpus, 0) ||
+            (!less_loaded(p->domains[lo].load, p->domains[lo].ncpus, d->load, d->ncpus, 0) &&
+             p->domains[lo].node != p->domains[hi].node && d->node == p->domains[hi].node)) {
+            lo = (int)i;
+        }
+    }
+    if (hi == lo) {
+        return 0;
+    }
+    struct placement_domain *from = &p->domains[hi], *to = &p->domains[lo];
+
+    struct placement_slot *best = NULL;
+    for (struct placement_slot *s = p->slots; s; s = s->next) {
+        if (s->domains != (1ULL << hi) || s->width > to->ncpus) {
+            continue;
+        }
+        uint64_t add = (uint64_t)s->width * 1000;
+        if ((to->load + add) * from->ncpus >= from->load * to->ncpus) {
+            continue;
+        }
+        if (!best || s->width > best->width) {
+            best = s;
+        }
+    }
+    if (!best) {
+        return 0;
+    }
+
+    account(p, best, -1);
+    best->domains = 1ULL << lo;
+    account(p, best, 1);
+    if (apply(p, best) != 0) {
+        fprintf(stderr, "=> placement: failed to move container %lu\n", best->id);
+    } else {
+        char cpus[1024], mems[256];
+        placement_cpus(p, best, cpus, sizeof(cpus));
+        placement_mems(p, best, mems, sizeof(mems));
+        fprintf(stderr, "=> placement: moved container %lu to cpus %s mems %s\n", best->id, cpus, mems);
+    }
+    p->moves++;
+    return 1;
+}
+
+unsigned int placement_rebalance(struct placement *p) {
+    unsigned int moved = 0, limit = 0;
+    for (struct placement_slot *s = p->slots; s; s = s->next) {
+        limit++;
+    }
+    while (moved < limit && rebalance_once(p)) {
+        moved++;
+    }
+    return moved;
+}
+
+void placement_cpus(const struct placement *p, const struct placement_slot *slot, char *buf, size_t len) {
+    uint64_t cpus[MASK_WORDS] = {0};
+    for (unsigned int i = 0; i < p->ndomains; i++) {
+        if (slot->domains & (1ULL << i)) {
+            for (unsigned int w = 0; w < MASK_WORDS; w++) {
+                cpus[w] |= p->domains[i].cpus[w];
+            }
+        }
+    }
+    format_cpulist(cpus, PLACEMENT_MAX_CPUS, buf, len);
+}
+
+void placement_mems(const struct placement *p, const struct placement_slot *slot, char *buf, size_t len) {
+    uint64_t nodes[1] = {0};
+    for (unsigned int i = 0; i < p->ndomains; i++) {
+        if (slot->domains & (1ULL << i)) {
+            nodes[0] |= 1ULL << p->domains[i].node;
+        }
+    }
+    format_cpulist(nodes, PLACEMENT_MAX_NODES, buf, len);
+}
+
+void placement_reset(int cgroup_fd) {
+    // 空を書くと親の cpuset をそのまま使う
+    write_cpuset(cgroup_fd, "cpuset.cpus", "\n");
+    write_cpuset(cgroup_fd, "cpuset.mems", "\n");
+}
+
+char *placement_render(struct placement *p, size_t *len) {
+    char *text = NULL;
+    FILE *out = open_memstream(&text, len);
+    if (!out) {
+        perror("open_memstream failed");
+        return NULL;
+    }
+    char cpus[1024], mems[256];
+    for (unsigned int i = 0; i < p->ndomains; i++) {
+        const struct placement_domain *d = &p->domains[i];
+        format_cpulist(d->cpus, PLACEMENT_MAX_CPUS, cpus, sizeof(cpus));
+        fprintf(out, "DOMAIN %u node=%d cpus=%s load=%" PRIu64 ".%03" PRIu64 "/%u\n",
+                i, d->node, cpus, d->load / 1000, d->load % 1000, d->ncpus);
+    }
+    for (struct placement_slot *s = p->slots; s; s = s->next) {
+        placement_cpus(p, s, cpus, sizeof(cpus));
+        placement_mems(p, s, mems, sizeof(mems));
+        fprintf(out, "PLACED %lu width=%u cpus=%s mems=%s\n", s->id, s->width, cpus, mems);
+    }
+    fprintf(out, "MOVES %lu\n", p->moves);
+    if (fclose(out) != 0) {
+        free(text);
+        return NULL;
+    }
+    return text;
+}
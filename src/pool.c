@@ -0,0 +1,393 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+
+#include "pool.h"
+#include "container.h"
+#include "launch.h"
+#include "resources.h"
+#include "trace.h"
+#include "userns.h"
+
+#define POOL_MAX_ARGS 256
+#define POOL_RETRY_MS 1000   // 補充に失敗したら次に試すまでの間隔 (cgroup プールの枯渇などで失敗し続けても空回りしない)
+
+// プールの 1 スロット (= 1 コンテナ)
+struct pool_slot {
+    struct child_config config;
+    char   hostname[64];
+    pid_t  pid;
+    int    pidfd;   // clone3 で得た pidfd (フォールバック時は -1)
+    int    fd;      // 親側のソケット (parked のときのみ有効)
+};
+
+struct pool {
+    struct child_config *template;
+    size_t low;
+    size_t high;
+    struct pool_slot **parked;   // execve 直前で待機中
+    size_t nparked;
+    struct pool_slot **running;  // 実行中
+    size_t nrunning;
+    size_t cap;
+    unsigned long seq;
+    int backoff;                 // 補充に失敗した (POOL_RETRY_MS か, 次の回収/リクエストまで補充しない)
+};
+
+//------------------------------------------------------
+// 1. リクエストのエンコード/デコード
+//------------------------------------------------------
+
+/*
+ * フォーマット: [uint32 argc][uint32 envc] "argv0\0argv1\0...env0\0..."
+ */
+ssize_t pool_encode_request(char *buf, size_t len, char *const argv[], char *const envp[]) {
+    uint32_t counts[2] = {0, 0};
+    size_t off = sizeof(counts);
+    if (len < off) {
+        return -1;
+    }
+
+    char *const *lists[2] = {argv, envp};
+    for (int l = 0; l < 2; l++) {
+        for (size_t i = 0; lists[l] && lists[l][i]; i++) {
+            size_t n = strlen(lists[l][i]) + 1;
+            if (off + n > len) {
+                return -1;
+            }
+            memcpy(buf + off, lists[l][i], n);
+            off += n;
+            counts[l]++;
+        }
+    }
+    memcpy(buf, counts, sizeof(counts));
+    return (ssize_t)off;
+}
+
+int pool_decode_request(char *buf, size_t len, char ***argv, char ***envp) {
+    uint32_t counts[2];
+    if (len < sizeof(counts)) {
+        return -1;
+    }
+    memcpy(counts, buf, sizeof(counts));
+    if (counts[0] == 0 || counts[0] > POOL_MAX_ARGS || counts[1] > POOL_MAX_ARGS) {
+        return -1;
+    }
+
+    char **lists[2] = { NULL, NULL };
+    size_t off = sizeof(counts);
+    for (int l = 0; l < 2; l++) {
+        lists[l] = calloc(counts[l] + 1, sizeof(char *));
+        if (!lists[l]) {
+            free(lists[0]);
+            return -1;
+        }
+        for (uint32_t i = 0; i < counts[l]; i++) {
+            char *end = memchr(buf + off, '\0', len - off);
+            if (!end) {
+                free(lists[0]);
+                free(lists[1]);
+                return -1;
+            }
+            lists[l][i] = buf + off;
+            off = (size_t)(end - buf) + 1;
+        }
+    }
+    *argv = lists[0];
+    *envp = lists[1];
+    return 0;
+}
+
+//------------------------------------------------------
+// 2. 子プロセスの生成 (refill) と回収
+//------------------------------------------------------
+
+static void pool_release(struct pool_slot *slot) {
+    if (slot->pidfd >= 0) {
+        close(slot->pidfd);
+    }
+    trace_attach(slot->config.trace_track, TRACE_LAUNCHER);
+    free_resources(&slot->config);
+    free(slot);
+}
+
+/**
+ * @brief 子プロセスを 1 つ作り execve 直前まで進めて parked に積む
+ * @return 0 on success, -1 on failure
+ */
+static int pool_spawn(struct pool *pool) {
+    struct pool_slot *slot = calloc(1, sizeof(*slot));
+    if (!slot) {
+        perror("calloc failed");
+        return -1;
+    }
+    slot->config = *pool->template;
+    slot->config.pooled = 1;
+    slot->config.timing = NULL;
+    slot->config.exec_fd = -1;
+    slot->config.log_fd = -1;   // プールでは親の stdio をそのまま使う
+    snprintf(slot->hostname, sizeof(slot->hostname), "mycontainer-%d-%lu", getpid(), pool->seq++);
+    slot->config.hostname = slot->hostname;
+
+    int sockets[2];
+    if (socketpair(AF_LOCAL, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sockets) != 0) {
+        perror("socketpair failed");
+        free(slot);
+        return -1;
+    }
+    // 子側だけは execve 直前まで使うので CLOEXEC を外さない (execve で閉じる)
+    slot->config.fd = sockets[1];
+
+    if (resources(&slot->config) != 0) {
+        fprintf(stderr, "resources failed\n");
+        close(sockets[0]);
+        close(sockets[1]);
+        free(slot);
+        return -1;
+    }
+
+    slot->pid = spawn_container(&slot->config, &slot->pidfd);
+    close(sockets[1]);
+    if (slot->pid < 0) {
+        perror("clone failed");
+        close(sockets[0]);
+        free_resources(&slot->config);
+        free(slot);
+        return -1;
+    }
+    slot->fd = sockets[0];
+
+    if (handle_child_uid_map(slot->pid, slot->fd, &slot->config.ids, NULL) != 0) {
+        fprintf(stderr, "handle_child_uid_map failed\n");
+        close(slot->fd);
+        waitpid(slot->pid, NULL, 0);
+        pool_release(slot);
+        return -1;
+    }
+
+    pool->parked[pool->nparked++] = slot;
+    return 0;
+}
+
+// 起動前に high まで用意する (以降の補充はイベントループが 1 つずつ行う)
+static int pool_refill(struct pool *pool, size_t target) {
+    while (pool->nparked < target) {
+        if (pool_spawn(pool) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief 終了した子プロセスを回収する
+ *        running なら終了ステータスを出力し、parked なら (異常終了として) 取り除く
+ */
+static void pool_reap(struct pool *pool) {
+    int status = 0;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        int code = WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+
+        for (size_t i = 0; i < pool->nrunning; i++) {
+            if (pool->running[i]->pid == pid) {
+                printf("%d %d\n", pid, code);
+                fflush(stdout);
+                pool_release(pool->running[i]);
+                pool->running[i] = pool->running[--pool->nrunning];
+                pid = 0;
+                break;
+            }
+        }
+        for (size_t i = 0; pid && i < pool->nparked; i++) {
+            if (pool->parked[i]->pid == pid) {
+                fprintf(stderr, "parked child %d exited (%d)\n", pid, code);
+                close(pool->parked[i]->fd);
+                pool_release(pool->parked[i]);
+                pool->parked[i] = pool->parked[--pool->nparked];
+                break;
+            }
+        }
+    }
+}
+
+//------------------------------------------------------
+// 3. 起動リクエスト
+//------------------------------------------------------
+
+/**
+ * @brief 1 行を argv/envp に分割する ("NAME=VALUE" は先頭にある分だけ envp 扱い)
+ */
+static int parse_request_line(char *line, char **argv, char **envp) {
+    size_t argc = 0, envc = 0;
+    for (char *tok = strtok(line, " \t\n"); tok; tok = strtok(NULL, " \t\n")) {
+        if (argc == 0 && strchr(tok, '=') && envc < POOL_MAX_ARGS) {
+            envp[envc++] = tok;
+        } else if (argc < POOL_MAX_ARGS) {
+            argv[argc++] = tok;
+        } else {
+            return -1;
+        }
+    }
+    argv[argc] = NULL;
+    envp[envc] = NULL;
+    return argc ? 0 : -1;
+}
+
+static int pool_launch(struct pool *pool, char *line) {
+    static char request[POOL_REQUEST_MAX];
+    char *argv[POOL_MAX_ARGS + 1];
+    char *envp[POOL_MAX_ARGS + 1];
+
+    if (parse_request_line(line, argv, envp) != 0) {
+        fprintf(stderr, "invalid request\n");
+        return -1;
+    }
+    ssize_t len = pool_encode_request(request, sizeof(request), argv, envp);
+    if (len < 0) {
+        fprintf(stderr, "request too large\n");
+        return -1;
+    }
+
+    // プールが空ならその場で作る (コールドスタート)
+    if (pool->nparked == 0 && pool_spawn(pool) != 0) {
+        return -1;
+    }
+    struct pool_slot *slot = pool->parked[--pool->nparked];
+
+    if (send(slot->fd, request, (size_t)len, 0) != len) {
+        perror("send request failed");
+        close(slot->fd);
+        waitpid(slot->pid, NULL, 0);
+        pool_release(slot);
+        return -1;
+    }
+    close(slot->fd);
+    slot->fd = -1;
+    pool->running[pool->nrunning++] = slot;
+    return 0;
+}
+
+//------------------------------------------------------
+// 4. イベントループ
+//------------------------------------------------------
+
+int run_pool(struct child_config *config, size_t low, size_t high) {
+    struct pool pool = {
+        .template = config,
+        .low = low,
+        .high = high,
+        .cap = 1024,
+    };
+    pool.parked = calloc(pool.high + 1, sizeof(struct pool_slot *));
+    pool.running = calloc(pool.cap, sizeof(struct pool_slot *));
+    if (!pool.parked || !pool.running) {
+        perror("allocation failed");
+        free(pool.parked);
+        free(pool.running);
+        return -1;
+    }
+
+    // SIGCHLD は signalfd で受ける
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    int sfd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+    if (sfd < 0) {
+        perror("signalfd failed");
+        return -1;
+    }
+
+    pool_refill(&pool, pool.high);
+    fprintf(stderr, "=> pool ready (%zu parked)\n", pool.nparked);
+
+    // stdio のバッファと poll を混ぜないよう、行の切り出しは自前で行う
+    static char input[POOL_REQUEST_MAX];
+    size_t input_len = 0;
+    int input_open = 1;
+    while (input_open || pool.nrunning > 0) {
+        struct pollfd fds[2] = {
+            { .fd = sfd, .events = POLLIN },
+            { .fd = input_open ? STDIN_FILENO : -1, .events = POLLIN },
+        };
+        // high まで空きがあれば、入力待ちの合間に 1 つずつ補充する (失敗した後は間を空ける)
+        int timeout = (input_open && pool.nparked < pool.high) ? (pool.backoff ? POOL_RETRY_MS : 0) : -1;
+        int n = poll(fds, 2, timeout);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll failed");
+            break;
+        }
+        if (n == 0) {
+            pool.backoff = pool_spawn(&pool) != 0;
+            continue;
+        }
+        // 回収やリクエストで状況が変わったら補充をやり直す
+        pool.backoff = 0;
+        // low を下回っている間は, 入力が続いていてもリクエストの合間に 1 つずつ補充する
+        //  (high までまとめて作るとその間の起動リクエストが待たされる)
+        if (input_open && pool.nparked < pool.low) {
+            pool.backoff = pool_spawn(&pool) != 0;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            struct signalfd_siginfo info;
+            while (read(sfd, &info, sizeof(info)) == sizeof(info)) {
+            }
+            pool_reap(&pool);
+        }
+
+        if (fds[1].revents & (POLLIN | POLLHUP)) {
+            ssize_t r = read(STDIN_FILENO, input + input_len, sizeof(input) - 1 - input_len);
+            if (r <= 0) {
+                input_open = 0;
+                continue;
+            }
+            input_len += (size_t)r;
+
+            char *newline;
+            while ((newline = memchr(input, '\n', input_len)) != NULL) {
+                *newline = '\0';
+                size_t consumed = (size_t)(newline - input) + 1;
+                if (pool.nrunning == pool.cap) {
+                    fprintf(stderr, "too many running containers\n");
+                } else {
+                    pool_launch(&pool, input);
+                }
+                memmove(input, input + consumed, input_len - consumed);
+                input_len -= consumed;
+            }
+            if (input_len == sizeof(input) - 1) {
+                fprintf(stderr, "request line too long\n");
+                input_len = 0;
+            }
+        }
+    }
+
+    // 待機中の子はソケットを閉じると終了する (全部閉じてから待つ)
+    for (size_t i = 0; i < pool.nparked; i++) {
+        close(pool.parked[i]->fd);
+    }
+    for (size_t i = 0; i < pool.nparked; i++) {
+        waitpid(pool.parked[i]->pid, NULL, 0);
+        pool_release(pool.parked[i]);
+    }
+
+    close(sfd);
+    free(pool.parked);
+    free(pool.running);
+    return 0;
+}
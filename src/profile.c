@@ -0,0 +1,597 @@
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/capability.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <seccomp.h>
+#include <linux/filter.h>
+
+#include "profile.h"
+
+#ifndef SCMP_FAIL
+#define SCMP_FAIL SCMP_ACT_ERRNO(EPERM)
+#endif
+
+/*
+ * セキュリティプロファイル (seccomp BPF + capability マスク)
+ *  - ランチャーで 1 回だけ libseccomp でコンパイルし、生の BPF として保持する
+ *  - キャッシュディレクトリがあれば "<hash>.profile" として保存し、次回以降は読むだけ
+ *  - 子プロセスは seccomp(SECCOMP_SET_MODE_FILTER) と capset だけで適用できる
+ */
+
+//------------------------------------------------------
+// 1. プロファイルの定義 (ハッシュのキーになる)
+//------------------------------------------------------
+
+// bounding/inheritable から落とす capability
+static const int capabilities_to_drop[] = {
+    CAP_AUDIT_CONTROL,
+    CAP_AUDIT_READ,
+    CAP_AUDIT_WRITE,
+    CAP_BLOCK_SUSPEND,
+    CAP_DAC_READ_SEARCH,
+    CAP_FSETID,
+    CAP_IPC_LOCK,
+    CAP_MAC_ADMIN,
+    CAP_MAC_OVERRIDE,
+    CAP_MKNOD,
+    CAP_SETFCAP,
+    CAP_SYSLOG,
+    CAP_SYS_ADMIN,
+    CAP_SYS_BOOT,
+    CAP_SYS_MODULE,
+    CAP_SYS_NICE,
+    CAP_SYS_RAWIO,
+    CAP_SYS_RESOURCE,
+    CAP_SYS_TIME,
+    CAP_WAKE_ALARM
+};
+
+// システムコールのルール (argc == 0 なら無条件, 1 なら引数 arg を op で比較)
+struct syscall_rule {
+    int32_t  nr;
+    uint32_t action;
+    uint32_t argc;
+    uint32_t arg;
+    uint32_t op;
+    uint64_t datum_a;
+    uint64_t datum_b;
+};
+
+#define RULE(name, action)                  { SCMP_SYS(name), action, 0, 0, 0, 0, 0 }
+#define RULE_MASKED(name, action, a, m, v)  { SCMP_SYS(name), action, 1, a, SCMP_CMP_MASKED_EQ, m, v }
+#define RULE_NE(name, action, a, v)         { SCMP_SYS(name), action, 1, a, SCMP_CMP_NE, v, 0 }
+
+// deny: デフォルト許可, 以下のみ拒否
+static const struct syscall_rule deny_rules[] = {
+    // setuid/setgidビットを立てる chmod 系禁止
+    RULE_MASKED(chmod,    SCMP_FAIL, 1, S_ISUID, S_ISUID),
+    RULE_MASKED(chmod,    SCMP_FAIL, 1, S_ISGID, S_ISGID),
+    RULE_MASKED(fchmod,   SCMP_FAIL, 1, S_ISUID, S_ISUID),
+    RULE_MASKED(fchmod,   SCMP_FAIL, 1, S_ISGID, S_ISGID),
+    RULE_MASKED(fchmodat, SCMP_FAIL, 2, S_ISUID, S_ISUID),
+    RULE_MASKED(fchmodat, SCMP_FAIL, 2, S_ISGID, S_ISGID),
+
+    // user namespace
+    RULE_MASKED(unshare,  SCMP_FAIL, 0, CLONE_NEWUSER, CLONE_NEWUSER),
+    RULE_MASKED(clone,    SCMP_FAIL, 0, CLONE_NEWUSER, CLONE_NEWUSER),
+
+    // ioctl(TIOCSTI)
+    RULE_MASKED(ioctl,    SCMP_FAIL, 1, TIOCSTI, TIOCSTI),
+
+    // keyring 系
+    RULE(keyctl,      SCMP_FAIL),
+    RULE(add_key,     SCMP_FAIL),
+    RULE(request_key, SCMP_FAIL),
+
+    // ptrace
+    RULE(ptrace,      SCMP_FAIL),
+
+    // NUMA系
+    RULE(mbind,         SCMP_FAIL),
+    RULE(migrate_pages, SCMP_FAIL),
+    RULE(move_pages,    SCMP_FAIL),
+    RULE(set_mempolicy, SCMP_FAIL),
+
+    // userfaultfd
+    RULE(userfaultfd,     SCMP_FAIL),
+
+    // perf_event_open
+    RULE(perf_event_open, SCMP_FAIL),
+};
+
+// allow: デフォルト拒否, 以下のみ許可
+// 呼ばれる頻度の高い順に並べ、前にあるものほど優先度を高くする
+// (優先度が効くのは二分木を作れない libseccomp 2.5 未満の線形リストだけ. 二分木ではどれもほぼ同じ深さで判定される)
+static const struct syscall_rule allow_rules[] = {
+    // 待ち合わせ・イベントループ
+    RULE(futex,          SCMP_ACT_ALLOW),
+    RULE(epoll_wait,     SCMP_ACT_ALLOW),
+    RULE(epoll_pwait,    SCMP_ACT_ALLOW),
+    RULE(read,           SCMP_ACT_ALLOW),
+    RULE(write,          SCMP_ACT_ALLOW),
+    RULE(recvfrom,       SCMP_ACT_ALLOW),
+    RULE(sendto,         SCMP_ACT_ALLOW),
+    RULE(recvmsg,        SCMP_ACT_ALLOW),
+    RULE(sendmsg,        SCMP_ACT_ALLOW),
+    RULE(readv,          SCMP_ACT_ALLOW),
+    RULE(writev,         SCMP_ACT_ALLOW),
+    RULE(pread64,        SCMP_ACT_ALLOW),
+    RULE(pwrite64,       SCMP_ACT_ALLOW),
+    RULE(epoll_ctl,      SCMP_ACT_ALLOW),
+    RULE(poll,           SCMP_ACT_ALLOW),
+    RULE(ppoll,          SCMP_ACT_ALLOW),
+    RULE(clock_gettime,  SCMP_ACT_ALLOW),
+    RULE(clock_nanosleep, SCMP_ACT_ALLOW),
+    RULE(nanosleep,      SCMP_ACT_ALLOW),
+    RULE(sched_yield,    SCMP_ACT_ALLOW),
+    RULE(gettimeofday,   SCMP_ACT_ALLOW),
+
+    // メモリ
+    RULE(mmap,           SCMP_ACT_ALLOW),
+    RULE(munmap,         SCMP_ACT_ALLOW),
+    RULE(mprotect,       SCMP_ACT_ALLOW),
+    RULE(madvise,        SCMP_ACT_ALLOW),
+    RULE(brk,            SCMP_ACT_ALLOW),
+    RULE(mremap,         SCMP_ACT_ALLOW),
+
+    // ファイル
+    RULE(close,          SCMP_ACT_ALLOW),
+    RULE(openat,         SCMP_ACT_ALLOW),
+    RULE(open,           SCMP_ACT_ALLOW),
+    RULE(fstat,          SCMP_ACT_ALLOW),
+    RULE(newfstatat,     SCMP_ACT_ALLOW),
+    RULE(statx,          SCMP_ACT_ALLOW),
+    RULE(stat,           SCMP_ACT_ALLOW),
+    RULE(lstat,          SCMP_ACT_ALLOW),
+    RULE(lseek,          SCMP_ACT_ALLOW),
+    RULE(fcntl,          SCMP_ACT_ALLOW),
+    RULE(getdents64,     SCMP_ACT_ALLOW),
+    RULE(access,         SCMP_ACT_ALLOW),
+    RULE(faccessat,      SCMP_ACT_ALLOW),
+    RULE(faccessat2,     SCMP_ACT_ALLOW),
+    RULE(readlink,       SCMP_ACT_ALLOW),
+    RULE(readlinkat,     SCMP_ACT_ALLOW),
+    RULE(getcwd,         SCMP_ACT_ALLOW),
+    RULE(chdir,          SCMP_ACT_ALLOW),
+    RULE(fchdir,         SCMP_ACT_ALLOW),
+    RULE(dup,            SCMP_ACT_ALLOW),
+    RULE(dup2,           SCMP_ACT_ALLOW),
+    RULE(dup3,           SCMP_ACT_ALLOW),
+    RULE(pipe,           SCMP_ACT_ALLOW),
+    RULE(pipe2,          SCMP_ACT_ALLOW),
+    RULE(mkdir,          SCMP_ACT_ALLOW),
+    RULE(mkdirat,        SCMP_ACT_ALLOW),
+    RULE(rmdir,          SCMP_ACT_ALLOW),
+    RULE(unlink,         SCMP_ACT_ALLOW),
+    RULE(unlinkat,       SCMP_ACT_ALLOW),
+    RULE(rename,         SCMP_ACT_ALLOW),
+    RULE(renameat,       SCMP_ACT_ALLOW),
+    RULE(renameat2,      SCMP_ACT_ALLOW),
+    RULE(link,           SCMP_ACT_ALLOW),
+    RULE(linkat,         SCMP_ACT_ALLOW),
+    RULE(symlink,        SCMP_ACT_ALLOW),
+    RULE(symlinkat,      SCMP_ACT_ALLOW),
+    RULE(ftruncate,      SCMP_ACT_ALLOW),
+    RULE(truncate,       SCMP_ACT_ALLOW),
+    RULE(fsync,          SCMP_ACT_ALLOW),
+    RULE(fdatasync,      SCMP_ACT_ALLOW),
+    RULE(flock,          SCMP_ACT_ALLOW),
+    RULE(fchown,         SCMP_ACT_ALLOW),
+    RULE(fchownat,       SCMP_ACT_ALLOW),
+    RULE(chown,          SCMP_ACT_ALLOW),
+    RULE(umask,          SCMP_ACT_ALLOW),
+    RULE(utimensat,      SCMP_ACT_ALLOW),
+    RULE(statfs,         SCMP_ACT_ALLOW),
+    RULE(fstatfs,        SCMP_ACT_ALLOW),
+    RULE(sendfile,       SCMP_ACT_ALLOW),
+    RULE(splice,         SCMP_ACT_ALLOW),
+    RULE(tee,            SCMP_ACT_ALLOW),
+    RULE(copy_file_range, SCMP_ACT_ALLOW),
+    RULE(memfd_create,   SCMP_ACT_ALLOW),
+    // setuid/setgid ビットを立てない chmod だけ許可
+    RULE_MASKED(chmod,    SCMP_ACT_ALLOW, 1, S_ISUID | S_ISGID, 0),
+    RULE_MASKED(fchmod,   SCMP_ACT_ALLOW, 1, S_ISUID | S_ISGID, 0),
+    RULE_MASKED(fchmodat, SCMP_ACT_ALLOW, 2, S_ISUID | S_ISGID, 0),
+    // ioctl(TIOCSTI) 以外は許可
+    RULE_NE(ioctl,        SCMP_ACT_ALLOW, 1, TIOCSTI),
+
+    // ソケット
+    RULE(socket,         SCMP_ACT_ALLOW),
+    RULE(socketpair,     SCMP_ACT_ALLOW),
+    RULE(connect,        SCMP_ACT_ALLOW),
+    RULE(accept,         SCMP_ACT_ALLOW),
+    RULE(accept4,        SCMP_ACT_ALLOW),
+    RULE(bind,           SCMP_ACT_ALLOW),
+    RULE(listen,         SCMP_ACT_ALLOW),
+    RULE(shutdown,       SCMP_ACT_ALLOW),
+    RULE(getsockname,    SCMP_ACT_ALLOW),
+    RULE(getpeername,    SCMP_ACT_ALLOW),
+    RULE(getsockopt,     SCMP_ACT_ALLOW),
+    RULE(setsockopt,     SCMP_ACT_ALLOW),
+    RULE(epoll_create1,  SCMP_ACT_ALLOW),
+    RULE(eventfd2,       SCMP_ACT_ALLOW),
+    RULE(timerfd_create, SCMP_ACT_ALLOW),
+    RULE(timerfd_settime, SCMP_ACT_ALLOW),
+    RULE(signalfd4,      SCMP_ACT_ALLOW),
+    RULE(select,         SCMP_ACT_ALLOW),
+    RULE(pselect6,       SCMP_ACT_ALLOW),
+
+    // シグナル・プロセス
+    RULE(rt_sigaction,   SCMP_ACT_ALLOW),
+    RULE(rt_sigprocmask, SCMP_ACT_ALLOW),
+    RULE(rt_sigreturn,   SCMP_ACT_ALLOW),
+    RULE(sigaltstack,    SCMP_ACT_ALLOW),
+    RULE(kill,           SCMP_ACT_ALLOW),
+    RULE(tgkill,         SCMP_ACT_ALLOW),
+    RULE(getpid,         SCMP_ACT_ALLOW),
+    RULE(gettid,         SCMP_ACT_ALLOW),
+    RULE(getppid,        SCMP_ACT_ALLOW),
+    RULE(getuid,         SCMP_ACT_ALLOW),
+    RULE(geteuid,        SCMP_ACT_ALLOW),
+    RULE(getgid,         SCMP_ACT_ALLOW),
+    RULE(getegid,        SCMP_ACT_ALLOW),
+    RULE(getgroups,      SCMP_ACT_ALLOW),
+    RULE(getresuid,      SCMP_ACT_ALLOW),
+    RULE(getresgid,      SCMP_ACT_ALLOW),
+    RULE(getpgrp,        SCMP_ACT_ALLOW),
+    RULE(getpgid,        SCMP_ACT_ALLOW),
+    RULE(setpgid,        SCMP_ACT_ALLOW),
+    RULE(getsid,         SCMP_ACT_ALLOW),
+    RULE(setsid,         SCMP_ACT_ALLOW),
+    RULE(wait4,          SCMP_ACT_ALLOW),
+    RULE(waitid,         SCMP_ACT_ALLOW),
+    RULE(execve,         SCMP_ACT_ALLOW),
+    RULE(execveat,       SCMP_ACT_ALLOW),
+    RULE(fork,           SCMP_ACT_ALLOW),
+    RULE(vfork,          SCMP_ACT_ALLOW),
+    // CLONE_NEWUSER を含まない clone だけ許可
+    RULE_MASKED(clone,   SCMP_ACT_ALLOW, 0, CLONE_NEWUSER, 0),
+    // clone3 の flags は構造体の中で検査できないので ENOSYS にして clone に戻させる
+    RULE(clone3,         SCMP_ACT_ERRNO(ENOSYS)),
+    RULE(exit,           SCMP_ACT_ALLOW),
+    RULE(exit_group,     SCMP_ACT_ALLOW),
+    RULE(set_tid_address, SCMP_ACT_ALLOW),
+    RULE(set_robust_list, SCMP_ACT_ALLOW),
+    RULE(get_robust_list, SCMP_ACT_ALLOW),
+    RULE(rseq,           SCMP_ACT_ALLOW),
+    RULE(arch_prctl,     SCMP_ACT_ALLOW),
+    RULE(prctl,          SCMP_ACT_ALLOW),
+    RULE(prlimit64,      SCMP_ACT_ALLOW),
+    RULE(getrlimit,      SCMP_ACT_ALLOW),
+    RULE(getrusage,      SCMP_ACT_ALLOW),
+    RULE(times,          SCMP_ACT_ALLOW),
+    RULE(sysinfo,        SCMP_ACT_ALLOW),
+    RULE(uname,          SCMP_ACT_ALLOW),
+    RULE(getrandom,      SCMP_ACT_ALLOW),
+    RULE(sched_getaffinity, SCMP_ACT_ALLOW),
+    RULE(membarrier,     SCMP_ACT_ALLOW),
+    RULE(mincore,        SCMP_ACT_ALLOW),
+};
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+struct profile_rules {
+    const char *name;
+    uint32_t default_action;
+    const struct syscall_rule *rules;
+    size_t count;
+};
+
+static const struct profile_rules profiles[] = {
+    [PROFILE_DENYLIST]  = { "deny",  SCMP_ACT_ALLOW, deny_rules,  ARRAY_SIZE(deny_rules) },
+    [PROFILE_ALLOWLIST] = { "allow", SCMP_FAIL,      allow_rules, ARRAY_SIZE(allow_rules) },
+};
+
+int parse_profile_kind(const char *name, enum profile_kind *kind) {
+    for (size_t i = 0; i < ARRAY_SIZE(profiles); i++) {
+        if (strcmp(name, profiles[i].name) == 0) {
+            *kind = (enum profile_kind)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+//------------------------------------------------------
+// 2. コンパイル (libseccomp)
+//------------------------------------------------------
+
+/**
+ * @brief Create seccomp filter context from the profile's rule table.
+ * @return scmp_filter_ctx, or NULL if something fails
+ */
+static scmp_filter_ctx create_secure_context(enum profile_kind kind) {
+    const struct profile_rules *profile = &profiles[kind];
+
+    scmp_filter_ctx context = seccomp_init(profile->default_action);
+    if (!context) {
+        perror("seccomp_init failed");
+        return NULL;
+    }
+
+    for (size_t i = 0; i < profile->count; i++) {
+        const struct syscall_rule *rule = &profile->rules[i];
+        // このアーキテクチャに無い syscall (open, fork など) は飛ばす
+        if (rule->nr < 0 && kind == PROFILE_ALLOWLIST) {
+            continue;
+        }
+        int ret;
+        if (rule->argc) {
+            struct scmp_arg_cmp cmp = {
+                .arg = rule->arg,
+                .op = (enum scmp_compare)rule->op,
+                .datum_a = rule->datum_a,
+                .datum_b = rule->datum_b,
+            };
+            ret = seccomp_rule_add(context, rule->action, rule->nr, 1, cmp);
+        } else {
+            ret = seccomp_rule_add(context, rule->action, rule->nr, 0);
+        }
+        if (ret != 0) {
+            perror("seccomp_rule_add/set failed");
+            seccomp_release(context);
+            return NULL;
+        }
+        // 線形リストになったときは表の前にあるものほど先に判定される
+        if (kind == PROFILE_ALLOWLIST) {
+            seccomp_syscall_priority(context, rule->nr, (uint8_t)(i < 254 ? 254 - i : 0));
+        }
+    }
+
+    // 許可リストは長いので二分木で生成させる. 二分木は syscall 番号で分けるので優先度は無視される
+    // (SCMP_FLTATR_CTL_OPTIMIZE は libseccomp 2.5 から. それより古いと優先度順の線形リストになる)
+#if SCMP_VER_MAJOR > 2 || (SCMP_VER_MAJOR == 2 && SCMP_VER_MINOR >= 5)
+    if (kind == PROFILE_ALLOWLIST && seccomp_attr_set(context, SCMP_FLTATR_CTL_OPTIMIZE, 2) != 0) {
+        // ヘッダより古い libseccomp.so と組み合わさったとき. 線形リストのまま続ける
+        fprintf(stderr, "seccomp binary tree not available, using a priority-ordered filter\n");
+    }
+#endif
+
+    // PR_SET_NO_NEW_PRIVS → 0
+    if (seccomp_attr_set(context, SCMP_FLTATR_CTL_NNP, 0) != 0) {
+        perror("seccomp_attr_set(CTL_NNP)");
+        seccomp_release(context);
+        return NULL;
+    }
+    return context;
+}
+
+/**
+ * @brief libseccomp でコンパイルし、生の BPF を取り出す (seccomp_export_bpf)
+ * @return 命令数, 失敗時 -1. *filter は呼び出し側で free する
+ */
+static ssize_t compile_filter(enum profile_kind kind, struct sock_filter **filter) {
+    scmp_filter_ctx context = create_secure_context(kind);
+    if (!context) {
+        return -1;
+    }
+
+    int fd = memfd_create("seccomp-bpf", MFD_CLOEXEC);
+    if (fd < 0) {
+        perror("memfd_create failed");
+        seccomp_release(context);
+        return -1;
+    }
+    if (seccomp_export_bpf(context, fd) != 0) {
+        fprintf(stderr, "seccomp_export_bpf failed\n");
+        seccomp_release(context);
+        close(fd);
+        return -1;
+    }
+    seccomp_release(context);
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0 || st.st_size % sizeof(struct sock_filter) != 0) {
+        fprintf(stderr, "unexpected BPF size\n");
+        close(fd);
+        return -1;
+    }
+    *filter = malloc((size_t)st.st_size);
+    if (!*filter) {
+        perror("malloc failed");
+        close(fd);
+        return -1;
+    }
+    if (pread(fd, *filter, (size_t)st.st_size, 0) != st.st_size) {
+        perror("read BPF failed");
+        free(*filter);
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    return st.st_size / (ssize_t)sizeof(struct sock_filter);
+}
+
+//------------------------------------------------------
+// 3. キャッシュ (ハッシュ = プロファイル定義 + アーキテクチャ + libseccomp)
+//------------------------------------------------------
+
+#define PROFILE_MAGIC   0x50524f46u  // "PROF"
+#define PROFILE_VERSION 1u
+
+// キャッシュファイルのヘッダ (この後に BPF 命令列が続く)
+struct profile_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t hash;
+    uint32_t arch;
+    uint32_t len;           // BPF 命令数
+    uint64_t cap_drop_mask;
+};
+
+static const char *profile_cache_dir = NULL;
+static enum profile_kind profile_kind = PROFILE_DENYLIST;
+static struct security_profile prepared_profile;
+static int profile_ready = 0;
+
+void set_profile_cache_dir(const char *dir) {
+    profile_cache_dir = dir;
+}
+
+void set_profile_kind(enum profile_kind kind) {
+    profile_kind = kind;
+}
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t len) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static uint64_t profile_hash(enum profile_kind kind, uint32_t arch) {
+    const struct scmp_version *version = seccomp_version();
+    uint32_t lib[3] = {0, 0, 0};
+    if (version) {
+        lib[0] = version->major;
+        lib[1] = version->minor;
+        lib[2] = version->micro;
+    }
+    uint32_t header[4] = { PROFILE_VERSION, arch, (uint32_t)kind, profiles[kind].default_action };
+
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    hash = fnv1a(hash, header, sizeof(header));
+    hash = fnv1a(hash, lib, sizeof(lib));
+    hash = fnv1a(hash, capabilities_to_drop, sizeof(capabilities_to_drop));
+    hash = fnv1a(hash, profiles[kind].rules, profiles[kind].count * sizeof(struct syscall_rule));
+    return hash;
+}
+
+static void cache_path(char *buf, size_t len, uint64_t hash) {
+    snprintf(buf, len, "%s/%016llx.profile", profile_cache_dir, (unsigned long long)hash);
+}
+
+/**
+ * @brief キャッシュから読み込む
+ * @return 0 on hit, -1 on miss
+ */
+static int load_cached_profile(struct security_profile *profile) {
+    char path[4096];
+    cache_path(path, sizeof(path), profile->hash);
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    struct profile_header header;
+    if (read(fd, &header, sizeof(header)) != sizeof(header)
+        || header.magic != PROFILE_MAGIC
+        || header.version != PROFILE_VERSION
+        || header.hash != profile->hash
+        || header.arch != profile->arch
+        || header.len == 0 || header.len > BPF_MAXINSNS) {
+        close(fd);
+        return -1;
+    }
+    size_t size = header.len * sizeof(struct sock_filter);
+    struct sock_filter *filter = malloc(size);
+    if (!filter) {
+        close(fd);
+        return -1;
+    }
+    if (read(fd, filter, size) != (ssize_t)size) {
+        free(filter);
+        close(fd);
+        return -1;
+    }
+    close(fd);
+
+    profile->cap_drop_mask = header.cap_drop_mask;
+    profile->prog.len = (unsigned short)header.len;
+    profile->prog.filter = filter;
+    return 0;
+}
+
+// 一時ファイルに書いてから rename する (並行する他のランチャーが壊れたファイルを読まないように)
+static void store_cached_profile(const struct security_profile *profile) {
+    char path[4096], tmp[4096 + 16];
+    cache_path(path, sizeof(path), profile->hash);
+    snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path);
+
+    if (mkdir(profile_cache_dir, 0700) != 0 && errno != EEXIST) {
+        fprintf(stderr, "mkdir %s failed: %m\n", profile_cache_dir);
+        return;
+    }
+    int fd = mkostemp(tmp, O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "mkostemp %s failed: %m\n", tmp);
+        return;
+    }
+    struct profile_header header = {
+        .magic = PROFILE_MAGIC,
+        .version = PROFILE_VERSION,
+        .hash = profile->hash,
+        .arch = profile->arch,
+        .len = profile->prog.len,
+        .cap_drop_mask = profile->cap_drop_mask,
+    };
+    size_t size = profile->prog.len * sizeof(struct sock_filter);
+    if (write(fd, &header, sizeof(header)) != sizeof(header)
+        || write(fd, profile->prog.filter, size) != (ssize_t)size
+        || rename(tmp, path) != 0) {
+        fprintf(stderr, "writing %s failed: %m\n", path);
+        unlink(tmp);
+    }
+    close(fd);
+}
+
+//------------------------------------------------------
+// 4. 準備
+//------------------------------------------------------
+
+int build_security_profile(enum profile_kind kind, struct security_profile *profile) {
+    memset(profile, 0, sizeof(*profile));
+    profile->arch = seccomp_arch_native();
+    profile->hash = profile_hash(kind, profile->arch);
+
+    if (profile_cache_dir && load_cached_profile(profile) == 0) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(capabilities_to_drop); i++) {
+        profile->cap_drop_mask |= 1ULL << capabilities_to_drop[i];
+    }
+    struct sock_filter *filter = NULL;
+    ssize_t len = compile_filter(kind, &filter);
+    if (len < 0) {
+        return -1;
+    }
+    if (len > BPF_MAXINSNS) {
+        fprintf(stderr, "seccomp filter too long (%zd)\n", len);
+        free(filter);
+        return -1;
+    }
+    profile->prog.len = (unsigned short)len;
+    profile->prog.filter = filter;
+
+    if (profile_cache_dir) {
+        store_cached_profile(profile);
+    }
+    return 0;
+}
+
+int prepare_security_profile(void) {
+    if (profile_ready) {
+        return 0;
+    }
+    if (build_security_profile(profile_kind, &prepared_profile) != 0) {
+        return -1;
+    }
+    profile_ready = 1;
+    return 0;
+}
+
+const struct security_profile *security_profile(void) {
+    return profile_ready ? &prepared_profile : NULL;
+}
@@ -0,0 +1,198 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "reclaim.h"
+#include "resources.h"
+
+#define RECLAIM_DEFAULT_STEP   10
+#define RECLAIM_MIN_DT_USEC    1000000     // autoscale と同じ: 短い間隔の比率は使わない
+#define RECLAIM_CALM_SAMPLES   3           // 押し出すまでに必要な連続回数
+#define RECLAIM_MIN_BYTES      (1ULL << 20) // 冷えたページがこれ未満なら何もしない
+#define RECLAIM_FLOOR_BYTES    (16ULL << 20) // memory.high をこれより下げない
+#define RECLAIM_HEADROOM_DIV   4           // memory.high = 回収後の使用量 + 1/4
+#define RECLAIM_REFAULT_PERCENT 20         // 押し出した量の 20% 以上が戻ってきたら緩める
+
+int parse_reclaim(const char *arg, struct reclaim_config *config) {
+    char *end;
+    double pressure = strtod(arg, &end);
+    if (end == arg || pressure <= 0 || pressure > 100) {
+        return -1;
+    }
+    unsigned long step = RECLAIM_DEFAULT_STEP;
+    if (*end == ':') {
+        const char *step_text = end + 1;
+        step = strtoul(step_text, &end, 10);
+        if (end == step_text) {
+            return -1;
+        }
+    }
+    if (*end != '\0' || step == 0 || step > 100) {
+        return -1;
+    }
+    config->pressure_permyriad = (uint32_t)(pressure * 100 + 0.5);
+    if (config->pressure_permyriad == 0) {
+        config->pressure_permyriad = 1;
+    }
+    config->step_percent = (uint32_t)step;
+    return 0;
+}
+
+void reclaim_init(int cgroup_fd, struct reclaim_state *state) {
+    memset(state, 0, sizeof(*state));
+    char buf[32];
+    int fd = openat(cgroup_fd, "memory.max", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n > 0) {
+        buf[n] = '\0';
+        // "max" は 0 (無制限) になる
+        state->limit = strtoull(buf, NULL, 10);
+    }
+}
+
+static uint64_t delta(uint64_t now, uint64_t last) {
+    return now > last ? now - last : 0;
+}
+
+enum reclaim_action reclaim_decide(const struct reclaim_config *config,
+                                   struct reclaim_state *state,
+                                   const struct metrics_sample *sample) {
+    const struct psi_sample *psi = &sample->psi[PSI_MEMORY];
+    uint64_t dt = delta(sample->timestamp_ns, state->last_ns) / 1000;
+    if (state->have_last && dt < RECLAIM_MIN_DT_USEC) {
+        return RECLAIM_KEEP;
+    }
+    uint64_t pressure = delta(psi->some_total_usec, state->last_some_usec);
+    uint64_t refault = delta(sample->memory_refault, state->last_refault);
+    int first = !state->have_last;
+
+    state->have_last = 1;
+    state->last_ns = sample->timestamp_ns;
+    state->last_some_usec = psi->some_total_usec;
+    state->last_refault = sample->memory_refault;
+    if (first) {
+        return RECLAIM_KEEP;
+    }
+    state->refault_per_sec = refault * 1000000 / dt;
+
+    // 直前に押し出したページがすぐ読み直されている => 冷えていなかった
+    uint64_t refault_bytes = refault * (uint64_t)sysconf(_SC_PAGESIZE);
+    int thrashing = state->last_reclaimed > 0
+                 && refault_bytes * 100 >= state->last_reclaimed * RECLAIM_REFAULT_PERCENT;
+    state->last_reclaimed = 0;
+
+    if (pressure * 10000 / dt >= config->pressure_permyriad || thrashing) {
+        state->calm = 0;
+        if (state->high == 0) {
+            return RECLAIM_KEEP;
+        }
+        uint64_t high = state->high + state->high / 2;
+        state->high = state->limit && high >= state->limit ? 0 : high;
+        return RECLAIM_RELAX;
+    }
+    if (++state->calm < RECLAIM_CALM_SAMPLES) {
+        return RECLAIM_KEEP;
+    }
+    uint64_t request = (sample->memory_inactive_file + sample->memory_inactive_anon) * config->step_percent / 100;
+    if (request < RECLAIM_MIN_BYTES) {
+        return RECLAIM_KEEP;
+    }
+    state->calm = 0;
+    state->request = request;
+
+    // 回収後の使用量に余裕を足したところを soft limit にする (上げる向きには動かさない)
+    uint64_t used = delta(sample->memory_current, request);
+    uint64_t high = used + used / RECLAIM_HEADROOM_DIV;
+    if (high < RECLAIM_FLOOR_BYTES) {
+        high = RECLAIM_FLOOR_BYTES;
+    }
+    if ((state->high == 0 || high < state->high) && !(state->limit && high >= state->limit)) {
+        state->high = high;
+    }
+    return RECLAIM_SHRINK;
+}
+
+// high が使用量より低いと書き込みの中で回収し終えるまで戻らないので, 使用量で止める
+//  (実際に書いた値を返す. 押し出しが進めば次の SHRINK でさらに下がる)
+static int write_memory_high(int cgroup_fd, uint64_t *high) {
+    int64_t current = cgroup_memory_current(cgroup_fd);
+    if (*high && current > 0 && *high < (uint64_t)current) {
+        *high = (uint64_t)current;
+    }
+    char value[32];
+    if (*high) {
+        snprintf(value, sizeof(value), "%" PRIu64, *high);
+    } else {
+        strcpy(value, "max");
+    }
+    int fd = openat(cgroup_fd, "memory.high", O_WRONLY | O_CLOEXEC);
+    if (fd < 0 || write(fd, value, strlen(value)) < 0) {
+        fprintf(stderr, "write memory.high %s failed: %m\n", value);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+int reclaim_apply(int cgroup_fd, struct reclaim_state *state, enum reclaim_action action) {
+    if (action == RECLAIM_SHRINK) {
+        state->pending = state->request;
+        state->progress = 0;
+        return 0;
+    }
+    if (action != RECLAIM_RELAX) {
+        return 0;
+    }
+    return write_memory_high(cgroup_fd, &state->high);
+}
+
+int reclaim_step(int cgroup_fd, struct reclaim_state *state, uint64_t chunk) {
+    if (state->pending == 0) {
+        return 0;
+    }
+    if (chunk > state->pending) {
+        chunk = state->pending;
+    }
+    int64_t got = cgroup_reclaim(cgroup_fd, chunk);
+    if (got < 0) {
+        state->pending = 0;
+        return -1;
+    }
+    state->progress += (uint64_t)got;
+    state->pending -= chunk;
+    // 1 回分を押し出しきれなければ, 残りを書いても回収できるものはもう無い
+    if ((uint64_t)got < chunk) {
+        state->pending = 0;
+    }
+    if (state->pending) {
+        return 1;
+    }
+
+    uint64_t reclaimed = state->progress;
+    state->last_reclaimed = reclaimed;
+    state->reclaimed_total += reclaimed;
+    // 押し出しきれなかった分 (swap の無い anon など) は memory.high に残しておく
+    if (state->high && reclaimed < state->request) {
+        state->high += state->request - reclaimed;
+        if (state->limit && state->high >= state->limit) {
+            state->high = 0;
+        }
+    }
+    return write_memory_high(cgroup_fd, &state->high) == 0 ? 0 : -1;
+}
+
+void reclaim_reset(int cgroup_fd) {
+    uint64_t high = 0;
+    write_memory_high(cgroup_fd, &high);
+}
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <sys/file.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/resource.h>
@@ -10,8 +11,12 @@
 #include <fcntl.h>
 #include <string.h>
 #include <limits.h>
+#include <signal.h>
 
 #include "container.h"
+#include "resources.h"
+#include "teardown.h"
+#include "trace.h"
 
 // cgroup v2 用リソース設定リスト
 static struct cgrp_setting {
@@ -27,77 +32,566 @@ static struct cgrp_setting {
     { "", "" } // 終端
 };
 
-// cgroup v2のディレクトリを作成し、リソースを設定する
-int resources(struct child_config *config)
+// config->cgroup_limits に同名の設定があればその値を返す
+static const char *find_cgroup_limit(struct child_config *config, const char *name) {
+    size_t len = strlen(name);
+    for (char **limit = config->cgroup_limits; limit && *limit; limit++) {
+        if (!strncmp(*limit, name, len) && (*limit)[len] == '=') {
+            return *limit + len + 1;
+        }
+    }
+    return NULL;
+}
+
+// -l で書いてよいコントローラ (cgroup.procs/cgroup.kill などのコアファイルは外からプロセスを出し入れできるので除く)
+static const char *const cgroup_limit_controllers[] = {
+    "memory", "cpu", "cpuset", "io", "pids", "hugetlb", NULL,
+};
+
+static int cgroup_setting_name_valid(const char *name) {
+    // <controller>.<knob> (knob は hugetlb.2MB.max のように "." を含んでよい)
+    size_t controller = strspn(name, "abcdefghijklmnopqrstuvwxyz0123456789_");
+    if (controller == 0 || name[controller] != '.' || name[controller + 1] == '\0') {
+        return 0;
+    }
+    const char *const *known = cgroup_limit_controllers;
+    while (*known && (strlen(*known) != controller || strncmp(name, *known, controller) != 0)) {
+        known++;
+    }
+    if (!*known) {
+        return 0;
+    }
+    const char *knob = name + controller + 1;
+    return strspn(knob, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_.-") == strlen(knob);
+}
+
+int cgroup_limit_valid(const char *limit) {
+    const char *eq = strchr(limit, '=');
+    char name[256];
+    if (!eq || (size_t)(eq - limit) >= sizeof(name)) {
+        return 0;
+    }
+    snprintf(name, sizeof(name), "%.*s", (int)(eq - limit), limit);
+    return cgroup_setting_name_valid(name);
+}
+
+static int write_cgroup_setting(struct child_config *config, const char *dir,
+                                const char *name, const char *value) {
+    // openat() に渡すので "../" などで cgroup の外に出られないようにする
+    if (!cgroup_setting_name_valid(name)) {
+        fprintf(stderr, "invalid cgroup setting name: %s\n", name);
+        return -1;
+    }
+    int fd = openat(config->cgroup_fd, name, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "open %s/%s failed: %m\n", dir, name);
+        return -1;
+    }
+    if (write(fd, value, strlen(value)) == -1) {
+        fprintf(stderr, "write to %s/%s failed: %m\n", dir, name);
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+// /sys/fs/cgroup の dirfd とコントローラ有効化はプロセス内で使い回す
+static int cgroup_root_fd = -1;
+static int cgroup_cpuset = 0;
+
+void set_cgroup_cpuset(int enabled) {
+    cgroup_cpuset = enabled;
+}
+
+// 有効にしたいコントローラ: memory, cpu, pids, io (配置を行うときは cpuset も)
+static const char *cgroup_controllers(void) {
+    return cgroup_cpuset ? "+memory +cpu +pids +io +cpuset" : "+memory +cpu +pids +io";
+}
+
+int setup_cgroup_root(void)
 {
-    fprintf(stderr, "=> setting cgroups (v2)...\n");
+    if (cgroup_root_fd >= 0) {
+        return EXIT_SUCCESS;
+    }
 
-    // 1. 親cgroupの subtree_control を有効化
-    //    (root cgroupの "/sys/fs/cgroup/cgroup.subtree_control" などに書き込み)
-    {
-        const char *parent_control = "/sys/fs/cgroup/cgroup.subtree_control";
-        int fd = open(parent_control, O_WRONLY);
-        if (fd < 0) {
-            fprintf(stderr, "open %s failed: %m\n", parent_control);
+    int root_fd = open("/sys/fs/cgroup", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (root_fd < 0) {
+        fprintf(stderr, "open /sys/fs/cgroup failed: %m\n");
+        return -1;
+    }
+
+    // 親cgroupの subtree_control を有効化
+    // (root cgroupの "/sys/fs/cgroup/cgroup.subtree_control" などに書き込み)
+    const char *parent_control = "/sys/fs/cgroup/cgroup.subtree_control";
+    int fd = openat(root_fd, "cgroup.subtree_control", O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "open %s failed: %m\n", parent_control);
+        close(root_fd);
+        return -1;
+    }
+    const char *controllers = cgroup_controllers();
+    if (write(fd, controllers, strlen(controllers)) == -1) {
+        fprintf(stderr, "writing to %s failed: %m\n", parent_control);
+        close(fd);
+        close(root_fd);
+        return -1;
+    }
+    close(fd);
+
+    cgroup_root_fd = root_fd;
+    return EXIT_SUCCESS;
+}
+
+// 既定値 (cgrp_settings[]) のうち、-l で上書きされないものを書き込む
+static int write_default_settings(struct child_config *config, const char *dir) {
+    for (int i = 0; cgrp_settings[i].name[0] != '\0'; i++) {
+        if (find_cgroup_limit(config, cgrp_settings[i].name)) {
+            continue;
+        }
+        if (write_cgroup_setting(config, dir, cgrp_settings[i].name, cgrp_settings[i].value) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// コンテナごとの指定 (-l name=value) を書き込む
+// restore が真なら逆に既定値へ戻す (プールに返すとき)
+static int write_limit_settings(struct child_config *config, const char *dir, int restore) {
+    for (char **limit = config->cgroup_limits; limit && *limit; limit++) {
+        char name[256];
+        const char *eq = strchr(*limit, '=');
+        if (!eq || (size_t)(eq - *limit) >= sizeof(name)) {
+            fprintf(stderr, "invalid cgroup limit: %s\n", *limit);
+            return -1;
+        }
+        snprintf(name, sizeof(name), "%.*s", (int)(eq - *limit), *limit);
+        if (!cgroup_setting_name_valid(name)) {
+            fprintf(stderr, "invalid cgroup limit: %s\n", *limit);
             return -1;
         }
-        // 有効にしたいコントローラ: memory, cpu, pids, ioなど
-        const char *controllers = "+memory +cpu +pids +io";
-        if (write(fd, controllers, strlen(controllers)) == -1) {
-            fprintf(stderr, "writing to %s failed: %m\n", parent_control);
+
+        const char *value = eq + 1;
+        if (restore) {
+            value = NULL;
+            for (int i = 0; cgrp_settings[i].name[0] != '\0'; i++) {
+                if (!strcmp(cgrp_settings[i].name, name)) {
+                    value = cgrp_settings[i].value;
+                }
+            }
+            // 既定値の無い設定はカーネルの初期値に戻す
+            size_t len = strlen(name);
+            if (!value && len > 4 && (!strcmp(name + len - 4, ".max") || !strcmp(name + len - 5, ".high"))) {
+                value = "max";
+            } else if (!value && len > 7 && !strcmp(name + len - 7, ".weight")) {
+                value = "100";
+            }
+            if (!value) {
+                fprintf(stderr, "cannot restore %s/%s, leaving as is\n", dir, name);
+                continue;
+            }
+        }
+        if (write_cgroup_setting(config, dir, name, value) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+//------------------------------------------------------
+// hugetlb
+//   コントローラは使うコンテナが現れたときに有効にする
+//   (hugetlb の無いカーネルでも他のコンテナの起動を妨げない)
+//------------------------------------------------------
+
+static int hugetlb_enabled = 0;       // /sys/fs/cgroup
+static int hugetlb_pool_enabled = 0;  // /sys/fs/cgroup/mycontainer-pool
+
+static int needs_hugetlb(struct child_config *config) {
+    if (config->hugepages.enabled && config->hugepages.max) {
+        return 1;
+    }
+    for (char **limit = config->cgroup_limits; limit && *limit; limit++) {
+        if (!strncmp(*limit, "hugetlb.", 8)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int enable_hugetlb(int parent_fd, const char *parent) {
+    int fd = openat(parent_fd, "cgroup.subtree_control", O_WRONLY | O_CLOEXEC);
+    if (fd < 0 || write(fd, "+hugetlb", strlen("+hugetlb")) == -1) {
+        fprintf(stderr, "enabling hugetlb in %s failed: %m\n", parent);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+/**
+ * @brief hugetlb.<size>.max と hugetlb.<size>.rsvd.max を書く
+ *        rsvd は mmap 時点で課金するので、上限超過は fault 時の SIGBUS ではなく mmap の ENOMEM になる
+ *        restore が真なら "max" に戻す (プールに返すとき)
+ */
+static int write_hugetlb_limit(struct child_config *config, const char *dir, int restore) {
+    const struct hugepage_config *huge = &config->hugepages;
+    if (!huge->enabled || !huge->max) {
+        return 0;
+    }
+    char name[64], value[32];
+    snprintf(value, sizeof(value), "%llu", (unsigned long long)huge->max);
+    snprintf(name, sizeof(name), "hugetlb.%s.rsvd.max", huge->size);
+    // rsvd は 5.7 以降なので無ければ max だけにする
+    int fd = openat(config->cgroup_fd, name, O_WRONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        const char *v = restore ? "max" : value;
+        if (write(fd, v, strlen(v)) == -1) {
+            fprintf(stderr, "write to %s/%s failed: %m\n", dir, name);
             close(fd);
             return -1;
         }
         close(fd);
     }
+    snprintf(name, sizeof(name), "hugetlb.%s.max", huge->size);
+    return write_cgroup_setting(config, dir, name, restore ? "max" : value);
+}
 
-    // 2. cgroupディレクトリ "/sys/fs/cgroup/<hostname>" を作成
-    char dir[PATH_MAX];
-    snprintf(dir, sizeof(dir), "/sys/fs/cgroup/%s", config->hostname);
+//------------------------------------------------------
+// ブロック I/O の QoS (-q)
+//   rootfs と dev= のパスを置いているディスクごとに io.max/io.latency を書く
+//------------------------------------------------------
 
-    if (mkdir(dir, 0755) && errno != EEXIST) {
-        fprintf(stderr, "mkdir %s failed: %m\n", dir);
+/**
+ * @brief io.max (帯域/IOPS の上限) と io.latency (守りたい遅延の目標) を書く
+ *        io.latency は目標を外したときに兄弟の cgroup を絞る仕組みで,
+ *        カーネルの設定 (CONFIG_BLK_CGROUP_IOLATENCY) やデバイスによっては使えないので警告だけにする
+ *        restore が真なら制限を外す (プールに返すとき)
+ */
+static int write_io_limits(struct child_config *config, const char *dir, int restore) {
+    struct io_config *io = &config->io;
+    if (!io->enabled) {
+        return 0;
+    }
+    if (!restore) {
+        io_resolve_devices(io, config->mount_dir);
+        if (io->ndevices == 0) {
+            fprintf(stderr, "=> io: no block device behind %s, skipping io limits\n", config->mount_dir);
+            return 0;
+        }
+    }
+    char line[160];
+    for (size_t i = 0; i < io->ndevices; i++) {
+        if (io_format_max(io, io->devices[i], restore, line, sizeof(line)) > 0
+            && write_cgroup_setting(config, dir, "io.max", line) != 0) {
+            return -1;
+        }
+        int len = io_format_latency(io, io->devices[i], restore, line, sizeof(line));
+        if (len > 0) {
+            int fd = openat(config->cgroup_fd, "io.latency", O_WRONLY | O_CLOEXEC);
+            if (fd < 0 || write(fd, line, (size_t)len) == -1) {
+                fprintf(stderr, "=> io.latency \"%s\" unavailable in %s: %m\n", line, dir);
+            }
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+    return 0;
+}
+
+//------------------------------------------------------
+// cgroup プール
+//   /sys/fs/cgroup/mycontainer-pool/slot-N を作り置きして使い回す
+//   (mkdir/rmdir と既定値の書き込みを起動のたびに行わない)
+//   使用中のスロットは flock で排他するので、複数プロセスで共有できる
+//------------------------------------------------------
+
+#define CGROUP_POOL_PARENT "mycontainer-pool"
+
+static size_t cgroup_pool_size = 0;
+static int cgroup_pool_fd = -1;
+
+void set_cgroup_pool(size_t size) {
+    cgroup_pool_size = size;
+}
+
+static int setup_cgroup_pool(void) {
+    if (cgroup_pool_fd >= 0) {
+        return 0;
+    }
+    if (mkdirat(cgroup_root_fd, CGROUP_POOL_PARENT, 0755) && errno != EEXIST) {
+        fprintf(stderr, "mkdir /sys/fs/cgroup/%s failed: %m\n", CGROUP_POOL_PARENT);
+        return -1;
+    }
+    int fd = openat(cgroup_root_fd, CGROUP_POOL_PARENT, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "open /sys/fs/cgroup/%s failed: %m\n", CGROUP_POOL_PARENT);
         return -1;
     }
+    // スロットでもコントローラを使えるよう親でも有効化する
+    int control = openat(fd, "cgroup.subtree_control", O_WRONLY | O_CLOEXEC);
+    const char *controllers = cgroup_controllers();
+    if (control < 0 || write(control, controllers, strlen(controllers)) == -1) {
+        fprintf(stderr, "enabling controllers in /sys/fs/cgroup/%s failed: %m\n", CGROUP_POOL_PARENT);
+        if (control >= 0) {
+            close(control);
+        }
+        close(fd);
+        return -1;
+    }
+    close(control);
+    cgroup_pool_fd = fd;
+    return 0;
+}
 
-    // 3. cgroup設定ファイル (memory.max 等) に値を書き込み
-    for (int i = 0; cgrp_settings[i].name[0] != '\0'; i++) {
-        char path[PATH_MAX * 2];
-        snprintf(path, sizeof(path), "%s/%s", dir, cgrp_settings[i].name);
+// cgroup.events の populated (プロセスが残っているか)
+int cgroup_populated(int cgroup_fd) {
+    char buf[256];
+    int fd = openat(cgroup_fd, "cgroup.events", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0) {
+        return -1;
+    }
+    buf[n] = '\0';
+    char *p = strstr(buf, "populated ");
+    return p ? atoi(p + strlen("populated ")) : -1;
+}
 
-        int fd = open(path, O_WRONLY);
-        if (fd < 0) {
-            fprintf(stderr, "open %s failed: %m\n", path);
-            return -1;
+int cgroup_kill(int cgroup_fd) {
+    int fd = openat(cgroup_fd, "cgroup.kill", O_WRONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        ssize_t n = write(fd, "1", 1);
+        close(fd);
+        if (n == 1) {
+            return 0;
         }
-        if (write(fd, cgrp_settings[i].value, strlen(cgrp_settings[i].value)) == -1) {
-            fprintf(stderr, "write to %s failed: %m\n", path);
+    }
+    // cgroup.kill の無いカーネル (5.14 未満): cgroup.procs の pid に 1 つずつ SIGKILL を送る
+    fd = openat(cgroup_fd, "cgroup.procs", O_RDONLY | O_CLOEXEC);
+    FILE *procs = fd >= 0 ? fdopen(fd, "r") : NULL;
+    if (!procs) {
+        fprintf(stderr, "open cgroup.procs failed: %m\n");
+        if (fd >= 0) {
             close(fd);
-            return -1;
         }
+        return -1;
+    }
+    int pid;
+    while (fscanf(procs, "%d", &pid) == 1) {
+        kill(pid, SIGKILL);
+    }
+    fclose(procs);
+    return 0;
+}
+
+int cgroup_freeze(int cgroup_fd, int frozen) {
+    int fd = openat(cgroup_fd, "cgroup.freeze", O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "open cgroup.freeze failed: %m\n");
+        return -1;
+    }
+    if (write(fd, frozen ? "1" : "0", 1) != 1) {
+        fprintf(stderr, "write to cgroup.freeze failed: %m\n");
         close(fd);
+        return -1;
     }
+    close(fd);
+    return 0;
+}
 
-    // 4. cgroup.procs に "0" を書き込んで、このプロセスを所属させる
-    {
-        char procs_path[PATH_MAX * 2];
-        snprintf(procs_path, sizeof(procs_path), "%s/cgroup.procs", dir);
+int64_t cgroup_memory_current(int cgroup_fd) {
+    char buf[32];
+    int fd = openat(cgroup_fd, "memory.current", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0) {
+        return -1;
+    }
+    buf[n] = '\0';
+    return strtoll(buf, NULL, 10);
+}
 
-        int fd = open(procs_path, O_WRONLY);
-        if (fd < 0) {
-            fprintf(stderr, "open %s failed: %m\n", procs_path);
+int64_t cgroup_reclaim(int cgroup_fd, uint64_t bytes) {
+    int64_t before = cgroup_memory_current(cgroup_fd);
+    int fd = openat(cgroup_fd, "memory.reclaim", O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "open memory.reclaim failed: %m\n");
+        return -1;
+    }
+    char value[32];
+    int len = snprintf(value, sizeof(value), "%llu", (unsigned long long)bytes);
+    // 要求量を回収しきれなかったときは EAGAIN (それでも回収できた分は減っている)
+    if (write(fd, value, (size_t)len) == -1 && errno != EAGAIN) {
+        fprintf(stderr, "write to memory.reclaim failed: %m\n");
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    int64_t after = cgroup_memory_current(cgroup_fd);
+    return before > after && after >= 0 ? before - after : 0;
+}
+
+/**
+ * @brief 空いているスロットを取得する
+ * @return 0 on success, -1 if none available
+ */
+static int acquire_pooled_cgroup(struct child_config *config) {
+    if (setup_cgroup_pool() != 0) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < cgroup_pool_size; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "slot-%zu", i);
+
+        int created = mkdirat(cgroup_pool_fd, name, 0755) == 0;
+        if (!created && errno != EEXIST) {
+            fprintf(stderr, "mkdir /sys/fs/cgroup/%s/%s failed: %m\n", CGROUP_POOL_PARENT, name);
             return -1;
         }
-        if (write(fd, "0", 1) == -1) {
-            fprintf(stderr, "write to %s failed: %m\n", procs_path);
+        int fd = openat(cgroup_pool_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+        // 他のランチャーが使用中
+        if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+            close(fd);
+            continue;
+        }
+        // 前のコンテナのプロセスが残っているスロットは使わない
+        if (cgroup_populated(fd) != 0) {
             close(fd);
+            continue;
+        }
+
+        snprintf(config->cgroup, sizeof(config->cgroup), "%s/%s", CGROUP_POOL_PARENT, name);
+        config->cgroup_fd = fd;
+        config->cgroup_pooled = 1;
+
+        // 既定値はスロットを作ったときだけ書く (返却時に既定値へ戻している)
+        if (created) {
+            char dir[PATH_MAX];
+            snprintf(dir, sizeof(dir), "/sys/fs/cgroup/%s", config->cgroup);
+            for (int j = 0; cgrp_settings[j].name[0] != '\0'; j++) {
+                if (write_cgroup_setting(config, dir, cgrp_settings[j].name, cgrp_settings[j].value) != 0) {
+                    // 既定値の揃っていないスロットは次に作り直させる (close で flock も外れる)
+                    close(fd);
+                    unlinkat(cgroup_pool_fd, name, AT_REMOVEDIR);
+                    config->cgroup_fd = -1;
+                    config->cgroup_pooled = 0;
+                    config->cgroup[0] = '\0';
+                    return -1;
+                }
+            }
+        }
+        return 0;
+    }
+    return -1;
+}
+
+// cgroup v2のディレクトリを作成し、リソースを設定する
+int resources(struct child_config *config)
+{
+    // 起動の最初の処理なので、ここでコンテナの track を決める (以降の親側の記録はこの track に付く)
+    config->trace_track = trace_new_track();
+    trace_begin(TRACE_CGROUPS);
+
+    // -l の名前は openat() に渡すので, 何かを作る前に確かめる
+    for (char **limit = config->cgroup_limits; limit && *limit; limit++) {
+        if (!cgroup_limit_valid(*limit)) {
+            fprintf(stderr, "invalid cgroup limit: %s\n", *limit);
             return -1;
         }
-        close(fd);
     }
 
-    // 5. 他のリソース制限 (ulimit相当)
-    fprintf(stderr, "=> setting rlimit NOFILE to 64...\n");
+    // 1. /sys/fs/cgroup を開いてコントローラを有効化 (初回のみ)
+    if (setup_cgroup_root() != 0) {
+        return -1;
+    }
+    config->cgroup_entered = 0;
+    config->cgroup_pooled = 0;
+    config->cgroup_fd = -1;
+    config->ids.lock_fd = -1;
+    config->scratch_dir[0] = '\0';
+    if (needs_hugetlb(config) && !hugetlb_enabled) {
+        if (enable_hugetlb(cgroup_root_fd, "/sys/fs/cgroup") != 0) {
+            return -1;
+        }
+        hugetlb_enabled = 1;
+    }
+
+    char dir[PATH_MAX];
+
+    // 2'. プールが有効なら作り置きのスロットを使う (-l の分だけ書き込む)
+    if (cgroup_pool_size > 0) {
+        if (acquire_pooled_cgroup(config) == 0) {
+            snprintf(dir, sizeof(dir), "/sys/fs/cgroup/%s", config->cgroup);
+            if (needs_hugetlb(config) && !hugetlb_pool_enabled) {
+                if (enable_hugetlb(cgroup_pool_fd, "/sys/fs/cgroup/" CGROUP_POOL_PARENT) != 0) {
+                    free_resources(config);
+                    return -1;
+                }
+                hugetlb_pool_enabled = 1;
+            }
+            // 途中まで書いた -l は free_resources が戻してからスロットを返す
+            if (write_limit_settings(config, dir, 0) != 0 || write_hugetlb_limit(config, dir, 0) != 0
+                || write_io_limits(config, dir, 0) != 0) {
+                free_resources(config);
+                return -1;
+            }
+            trace_end(TRACE_CGROUPS);
+            return EXIT_SUCCESS;
+        }
+        fprintf(stderr, "=> cgroup pool exhausted, creating a dedicated cgroup\n");
+    }
+
+    // 2. cgroupディレクトリ "/sys/fs/cgroup/<hostname>" を作成
+    snprintf(config->cgroup, sizeof(config->cgroup), "%s", config->hostname);
+    snprintf(dir, sizeof(dir), "/sys/fs/cgroup/%s", config->cgroup);
+
+    if (mkdirat(cgroup_root_fd, config->cgroup, 0755) && errno != EEXIST) {
+        fprintf(stderr, "mkdir %s failed: %m\n", dir);
+        return -1;
+    }
+
+    // 3. clone3(CLONE_INTO_CGROUP) 用にディレクトリを開いておく
+    //    (ランチャー自身は cgroup に入らない)
+    config->cgroup_fd = openat(cgroup_root_fd, config->cgroup, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (config->cgroup_fd < 0) {
+        fprintf(stderr, "open %s failed: %m\n", dir);
+        unlinkat(cgroup_root_fd, config->cgroup, AT_REMOVEDIR);
+        config->cgroup[0] = '\0';
+        return -1;
+    }
+
+    // 4. cgroup設定ファイル (memory.max 等) に値を書き込み
+    //    既定値は cgrp_settings[], コンテナごとの指定 (-l name=value) があればそちらを優先
+    //    失敗したら fd を閉じて cgroup も片付ける (呼び出し側は free_resources を呼ばない)
+    if (write_default_settings(config, dir) != 0 || write_limit_settings(config, dir, 0) != 0
+        || write_hugetlb_limit(config, dir, 0) != 0 || write_io_limits(config, dir, 0) != 0) {
+        free_resources(config);
+        return -1;
+    }
+
+    trace_end(TRACE_CGROUPS);
+    return EXIT_SUCCESS;
+}
+
+// 他のリソース制限 (ulimit相当)
+// ランチャー自身 (プールなど多数の fd を持つ) を縛らないよう子プロセス側で設定する
+int set_rlimits(void) {
     struct rlimit rl = {
         .rlim_cur = 64,
         .rlim_max = 64
@@ -106,40 +600,92 @@ int resources(struct child_config *config)
         fprintf(stderr, "setrlimit(RLIMIT_NOFILE) failed: %m\n");
         return -1;
     }
-
-    fprintf(stderr, "=> cgroup v2 done.\n");
     return EXIT_SUCCESS;
 }
 
-int free_resources(struct child_config *config) {
-    fprintf(stderr, "=> cleaning cgroups (v2)...\n");
+// clone() 用のフォールバック:
+// cgroup.procs に "0" を書き込んで、このプロセスを所属させる (子が継承する)
+int enter_cgroup(struct child_config *config) {
+    char procs_path[PATH_MAX * 2];
+    snprintf(procs_path, sizeof(procs_path), "/sys/fs/cgroup/%s/cgroup.procs", config->cgroup);
+
+    int fd = open(procs_path, O_WRONLY);
+    if (fd < 0) {
+        fprintf(stderr, "open %s failed: %m\n", procs_path);
+        return -1;
+    }
+    if (write(fd, "0", 1) == -1) {
+        fprintf(stderr, "write to %s failed: %m\n", procs_path);
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    config->cgroup_entered = 1;
+    return EXIT_SUCCESS;
+}
 
-    // プロセスが残っていると削除できないので
-    // move processes out from /sys/fs/cgroup/testhostname
+int leave_cgroup(void) {
+    // move processes out from /sys/fs/cgroup/<cgroup>
     char parent_cgroup[] = "/sys/fs/cgroup/cgroup.procs"; // root cgroup
     char my_pid[32];
     snprintf(my_pid, sizeof(my_pid), "%d", getpid());
 
     int fd = open(parent_cgroup, O_WRONLY);
-    if (fd >= 0) {
-        if (write(fd, my_pid, strlen(my_pid)) < 0) {
-	    fprintf(stderr, "write to %s failed: %m\n", parent_cgroup);
-	}
+    if (fd < 0) {
+        fprintf(stderr, "open %s failed: %m\n", parent_cgroup);
+        return -1;
+    }
+    if (write(fd, my_pid, strlen(my_pid)) < 0) {
+        fprintf(stderr, "write to %s failed: %m\n", parent_cgroup);
         close(fd);
+        return -1;
+    }
+    close(fd);
+    return EXIT_SUCCESS;
+}
+
+int free_resources(struct child_config *config) {
+    trace_begin(TRACE_CLEANUP);
+
+    // ランチャーが cgroup に入ったままだと cgroup.kill で自分も止まるので
+    if (config->cgroup_entered && leave_cgroup() == 0) {
+        config->cgroup_entered = 0;
     }
 
-    // cgroupディレクトリを削除する
+    // 残っているプロセスを cgroup ごと 1 回で止める (populated 0 になるのは片付け側で待つ)
+    if (config->cgroup_fd >= 0 && !config->cgroup_entered) {
+        cgroup_kill(config->cgroup_fd);
+    }
+
+    // uid/gid 範囲を返す (残りのプロセスも SIGKILL 済みなので次のコンテナが使ってよい)
+    id_range_release(&config->ids);
+
     char dir[PATH_MAX * 2];
-    snprintf(dir, sizeof(dir), "/sys/fs/cgroup/%s", config->hostname);
+    snprintf(dir, sizeof(dir), "/sys/fs/cgroup/%s", config->cgroup);
+    int ret = 0;
 
-    // cgroup内のプロセスを抜いてから (parent cgroupに移動)
-    if (rmdir(dir) < 0) {
-        fprintf(stderr, "rmdir %s failed: %m\n", dir);
-        // 続行は可能だが、ここではエラー扱い
-        return -1;
+    // プールのスロットは削除せず、-l で変えた設定を戻して返却する (close で flock も外れる)
+    // 空になるまでは resources() が populated を見て使わない
+    if (config->cgroup_pooled) {
+        ret = write_limit_settings(config, dir, 1) | write_hugetlb_limit(config, dir, 1)
+            | write_io_limits(config, dir, 1);
+        close(config->cgroup_fd);
+        config->cgroup_fd = -1;
+        config->cgroup_pooled = 0;
+        config->cgroup[0] = '\0';
+    }
+    if (config->cgroup_fd >= 0) {
+        close(config->cgroup_fd);
+        config->cgroup_fd = -1;
     }
 
-    fprintf(stderr, "done.\n");
-    return EXIT_SUCCESS;
-}
+    // cgroup と bind/overlay 用の一時ディレクトリは, 空になってから片付け用のプロセスが消す
+    if (teardown_submit(config->cgroup[0] ? dir : NULL, config->scratch_dir) != 0) {
+        ret = -1;
+    }
+    config->cgroup[0] = '\0';
+    config->scratch_dir[0] = '\0';
 
+    trace_end(TRACE_CLEANUP);
+    return ret == 0 ? EXIT_SUCCESS : -1;
+}
@@ -0,0 +1,253 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include "teardown.h"
+#include "timing.h"
+
+// 片付け用のプロセスに 1 メッセージで渡す (SOCK_SEQPACKET なので途中で切れない)
+struct teardown_job {
+    char cgroup_dir[256];     // 空なら cgroup は消さない (プールのスロットなど)
+    char scratch_dir[64];     // 空なら一時ディレクトリは無い
+};
+
+struct pending_job {
+    struct teardown_job job;
+    int events_fd;            // cgroup.events (-1 なら populated を見ない)
+};
+
+static int worker_fd = -1;
+static pid_t worker_pid = -1;
+
+// cgroup.events の populated (1: プロセスが残っている, 0: 空, -1: 読めない)
+static int events_populated(int events_fd) {
+    char buf[256];
+    ssize_t n = pread(events_fd, buf, sizeof(buf) - 1, 0);
+    if (n <= 0) {
+        return -1;
+    }
+    buf[n] = '\0';
+    char *p = strstr(buf, "populated ");
+    return p ? atoi(p + strlen("populated ")) : -1;
+}
+
+static int open_events(const char *cgroup_dir) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/cgroup.events", cgroup_dir);
+    return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+int teardown_wait_empty(const char *cgroup_dir, int timeout_ms) {
+    int fd = open_events(cgroup_dir);
+    if (fd < 0) {
+        // cgroup がもう無い (or cgroup v2 でない)
+        return 0;
+    }
+    uint64_t deadline = timing_now_ns() + (uint64_t)timeout_ms * 1000000;
+    int ret = 0;
+    // populated が変わると cgroup.events に POLLPRI が立つ (再試行のループは要らない)
+    while (events_populated(fd) == 1) {
+        uint64_t now = timing_now_ns();
+        if (now >= deadline) {
+            ret = -1;
+            break;
+        }
+        struct pollfd pfd = { .fd = fd, .events = POLLPRI };
+        if (poll(&pfd, 1, (int)((deadline - now + 999999) / 1000000)) < 0 && errno != EINTR) {
+            perror("poll cgroup.events failed");
+            ret = -1;
+            break;
+        }
+    }
+    close(fd);
+    return ret;
+}
+
+/**
+ * @brief cgroup と一時ディレクトリを消す
+ * @return 1 when done, 0 if the cgroup is still busy (後で再試行), -1 on failure
+ */
+static int remove_dirs(const struct teardown_job *job) {
+    int ret = 1;
+    if (job->cgroup_dir[0] && rmdir(job->cgroup_dir) != 0 && errno != ENOENT) {
+        if (errno == EBUSY) {
+            return 0;
+        }
+        fprintf(stderr, "rmdir %s failed: %m\n", job->cgroup_dir);
+        ret = -1;
+    }
+    // 子のマウントは子の mount namespace の中だけなので, ホスト側には空のディレクトリが残っている
+    if (job->scratch_dir[0] && rmdir(job->scratch_dir) != 0 && errno != ENOENT) {
+        fprintf(stderr, "rmdir %s failed: %m\n", job->scratch_dir);
+        ret = -1;
+    }
+    return ret;
+}
+
+// 空になっていれば消す. 1 なら待ち行列から外してよい
+static int try_finish(struct pending_job *p) {
+    if (p->events_fd >= 0 && events_populated(p->events_fd) == 1) {
+        return 0;
+    }
+    return remove_dirs(&p->job) != 0;
+}
+
+static void worker_loop(int fd) {
+    static struct pending_job pending[TEARDOWN_MAX_PENDING];
+    static struct pollfd pfds[1 + TEARDOWN_MAX_PENDING];
+    size_t npending = 0;
+    int input_open = 1;
+    uint64_t deadline = 0;
+
+    while (input_open || npending > 0) {
+        if (!input_open && timing_now_ns() >= deadline) {
+            fprintf(stderr, "teardown: %zu cgroup(s) still populated, giving up\n", npending);
+            break;
+        }
+        nfds_t nfds = 0;
+        pfds[nfds++] = (struct pollfd){ .fd = input_open ? fd : -1, .events = POLLIN };
+        for (size_t i = 0; i < npending; i++) {
+            pfds[nfds++] = (struct pollfd){ .fd = pending[i].events_fd, .events = POLLPRI };
+        }
+        if (poll(pfds, nfds, TEARDOWN_RETRY_MS) < 0 && errno != EINTR) {
+            perror("teardown: poll failed");
+            break;
+        }
+
+        if (input_open && pfds[0].revents) {
+            struct teardown_job job;
+            ssize_t n = recv(fd, &job, sizeof(job), MSG_DONTWAIT);
+            if (n == (ssize_t)sizeof(job)) {
+                struct pending_job p = { .job = job, .events_fd = -1 };
+                if (job.cgroup_dir[0]) {
+                    p.events_fd = open_events(job.cgroup_dir);
+                }
+                if (npending < TEARDOWN_MAX_PENDING) {
+                    pending[npending++] = p;
+                } else {
+                    // 待ち行列が一杯ならここで待つ (ランチャーは待たない)
+                    teardown_wait_empty(job.cgroup_dir, TEARDOWN_SYNC_TIMEOUT_MS);
+                    remove_dirs(&job);
+                    if (p.events_fd >= 0) {
+                        close(p.events_fd);
+                    }
+                }
+            } else if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+                // ランチャーが終わった: 残りは上限時間まで片付ける
+                input_open = 0;
+                deadline = timing_now_ns() + (uint64_t)TEARDOWN_DRAIN_MS * 1000000;
+            }
+        }
+
+        // 通知の来たものだけでなく全部を見る (取りこぼしは TEARDOWN_RETRY_MS ごとに拾う)
+        for (size_t i = 0; i < npending;) {
+            if (try_finish(&pending[i])) {
+                if (pending[i].events_fd >= 0) {
+                    close(pending[i].events_fd);
+                }
+                pending[i] = pending[--npending];
+            } else {
+                i++;
+            }
+        }
+    }
+}
+
+static int start_worker(void) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) != 0) {
+        perror("socketpair failed");
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork teardown worker failed");
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        // 端末のシグナルでランチャーと一緒に止まらないようにする
+        setsid();
+        // デーモン/プールは signalfd のために SIGTERM や SIGCHLD を止めている. 引き継ぐと SIGTERM で止められない
+        sigset_t empty;
+        sigemptyset(&empty);
+        sigprocmask(SIG_SETMASK, &empty, NULL);
+        // 受け取り口以外を閉じる (id 範囲や cgroup プールの flock を持ったままにしない)
+        if (dup2(fds[1], 3) < 0) {
+            _exit(EXIT_FAILURE);
+        }
+        if (syscall(SYS_close_range, 4U, ~0U, 0) != 0) {
+            for (long i = 4; i < sysconf(_SC_OPEN_MAX); i++) {
+                close(i);
+            }
+        }
+        // stdout を持ち続けると, 出力を読んでいる側が片付けの終わりまで待たされる
+        int null_fd = open("/dev/null", O_RDWR);
+        if (null_fd >= 0) {
+            dup2(null_fd, STDIN_FILENO);
+            dup2(null_fd, STDOUT_FILENO);
+            close(null_fd);
+        }
+        worker_loop(3);
+        _exit(EXIT_SUCCESS);
+    }
+    close(fds[1]);
+    worker_fd = fds[0];
+    worker_pid = pid;
+    return 0;
+}
+
+void teardown_finish(void) {
+    if (worker_fd < 0) {
+        return;
+    }
+    // 閉じると片付け用プロセスは残りを片付けて終わる
+    close(worker_fd);
+    worker_fd = -1;
+    while (waitpid(worker_pid, NULL, 0) < 0 && errno == EINTR) {
+    }
+    worker_pid = -1;
+}
+
+int teardown_submit(const char *cgroup_dir, const char *scratch_dir) {
+    struct teardown_job job;
+    memset(&job, 0, sizeof(job));
+    if (cgroup_dir) {
+        snprintf(job.cgroup_dir, sizeof(job.cgroup_dir), "%s", cgroup_dir);
+    }
+    if (scratch_dir) {
+        snprintf(job.scratch_dir, sizeof(job.scratch_dir), "%s", scratch_dir);
+    }
+    if (!job.cgroup_dir[0] && !job.scratch_dir[0]) {
+        return 0;
+    }
+
+    if (worker_fd < 0) {
+        start_worker();
+    }
+    if (worker_fd >= 0) {
+        if (send(worker_fd, &job, sizeof(job), MSG_NOSIGNAL) == (ssize_t)sizeof(job)) {
+            return 0;
+        }
+        // 片付け用プロセスが居なくなった (次の依頼で作り直す)
+        fprintf(stderr, "teardown worker is gone: %m\n");
+        teardown_finish();
+    }
+
+    // その場で片付ける
+    if (job.cgroup_dir[0] && teardown_wait_empty(job.cgroup_dir, TEARDOWN_SYNC_TIMEOUT_MS) != 0) {
+        fprintf(stderr, "%s is still populated\n", job.cgroup_dir);
+    }
+    return remove_dirs(&job) == 1 ? 0 : -1;
+}
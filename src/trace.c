@@ -0,0 +1,132 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "timing.h"
+#include "trace.h"
+
+#define TRACE_CAPACITY (1 << 16)   // 24B x 65536 = 1.5MB
+
+struct trace_ring *trace_ring = NULL;
+
+static uint32_t current_track;
+static enum trace_side current_side = TRACE_LAUNCHER;
+static const char *dump_path;
+static pid_t owner_pid;
+
+static const char *event_names[TRACE_EVENT_MAX] = {
+    [TRACE_CGROUPS] = "cgroups",
+    [TRACE_LOOP_REUSE] = "loop_reuse",
+    [TRACE_CLONE]   = "clone",
+    [TRACE_UID_MAP] = "uid_map",
+    [TRACE_NET]     = "net",
+    [TRACE_RLIMITS] = "rlimits",
+    [TRACE_MOUNTS]  = "mounts",
+    [TRACE_USERNS]  = "userns",
+    [TRACE_SETUID]  = "setuid",
+    [TRACE_CAPS]    = "caps",
+    [TRACE_SECCOMP] = "seccomp",
+    [TRACE_EXECVE]  = "execve",
+    [TRACE_WAIT]    = "wait",
+    [TRACE_CLEANUP] = "cleanup",
+};
+
+// 子やバッチのワーカーは exit() しても書き出さない (リングは共有しているので親がまとめて出す)
+static void dump_at_exit(void) {
+    if (getpid() == owner_pid) {
+        trace_dump(dump_path);
+    }
+}
+
+int trace_start(const char *path) {
+    if (trace_ring) {
+        return 0;
+    }
+    size_t bytes = sizeof(struct trace_ring) + TRACE_CAPACITY * sizeof(struct trace_record);
+    struct trace_ring *ring = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) {
+        perror("mmap trace ring failed");
+        return -1;
+    }
+    ring->capacity = TRACE_CAPACITY;
+    ring->start_ns = timing_now_ns();
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->next_track, 1);
+    trace_ring = ring;
+    dump_path = path;
+    owner_pid = getpid();
+    atexit(dump_at_exit);
+    return 0;
+}
+
+uint32_t trace_new_track(void) {
+    if (!trace_ring) {
+        return 0;
+    }
+    uint32_t track = atomic_fetch_add(&trace_ring->next_track, 1);
+    trace_attach(track, TRACE_LAUNCHER);
+    return track;
+}
+
+void trace_attach(uint32_t track, enum trace_side side) {
+    current_track = track;
+    current_side = side;
+}
+
+void trace_record(enum trace_event event, char phase) {
+    uint64_t pos = atomic_fetch_add_explicit(&trace_ring->head, 1, memory_order_relaxed);
+    struct trace_record *r = &trace_ring->records[pos & (trace_ring->capacity - 1)];
+    atomic_store_explicit(&r->seq, 0, memory_order_relaxed);
+    r->ts_ns = timing_now_ns();
+    r->track = current_track;
+    r->event = (uint16_t)event;
+    r->phase = (uint8_t)phase;
+    r->side = (uint8_t)current_side;
+    atomic_store_explicit(&r->seq, (unsigned int)(pos + 1), memory_order_release);
+}
+
+int trace_dump(const char *path) {
+    if (!trace_ring || !path) {
+        return -1;
+    }
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        fprintf(stderr, "open %s failed: %m\n", path);
+        return -1;
+    }
+    uint64_t head = atomic_load_explicit(&trace_ring->head, memory_order_acquire);
+    uint64_t first = head > trace_ring->capacity ? head - trace_ring->capacity : 0;
+    uint32_t tracks = atomic_load(&trace_ring->next_track);
+
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    // 表示名 (track = コンテナ, スレッド = ランチャー/子)
+    for (uint32_t track = 1; track < tracks; track++) {
+        fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,\"args\":{\"name\":\"container %u\"}},\n",
+                track, track);
+        fprintf(out, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%d,\"args\":{\"name\":\"launcher\"}},\n",
+                track, TRACE_LAUNCHER);
+        fprintf(out, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%d,\"args\":{\"name\":\"child\"}},\n",
+                track, TRACE_CHILD);
+    }
+    for (uint64_t pos = first; pos < head; pos++) {
+        const struct trace_record *r = &trace_ring->records[pos & (trace_ring->capacity - 1)];
+        if (atomic_load_explicit(&r->seq, memory_order_acquire) != (unsigned int)(pos + 1)
+            || r->event >= TRACE_EVENT_MAX) {
+            continue;
+        }
+        uint64_t ts = r->ts_ns - trace_ring->start_ns;
+        fprintf(out, "{\"name\":\"%s\",\"ph\":\"%c\",%s\"ts\":%llu.%03llu,\"pid\":%u,\"tid\":%u},\n",
+                event_names[r->event], r->phase, r->phase == 'i' ? "\"s\":\"t\"," : "",
+                (unsigned long long)(ts / 1000), (unsigned long long)(ts % 1000), r->track, r->side);
+    }
+    // 末尾のカンマを避けるための終端 (メタデータイベント)
+    fprintf(out, "{\"name\":\"trace_end\",\"ph\":\"M\",\"pid\":0,\"args\":{\"records\":%llu}}\n]}\n",
+            (unsigned long long)(head - first));
+    if (fclose(out) != 0) {
+        fprintf(stderr, "write %s failed: %m\n", path);
+        return -1;
+    }
+    return 0;
+}
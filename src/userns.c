@@ -10,12 +10,10 @@
 #include <string.h>
 #include <errno.h>
 
+#include "trace.h"
 #include "userns.h"
 
-#define USERNS_OFFSET 10000
-#define USERNS_COUNT  2000
-
-int handle_child_uid_map(pid_t child_pid, int fd) {
+int handle_child_uid_map(pid_t child_pid, int fd, const struct id_range *ids, const struct net_config *net) {
     int has_userns = -1;
     ssize_t read_bytes = read(fd, &has_userns, sizeof(has_userns));
     if (read_bytes != sizeof(has_userns)) {
@@ -24,18 +22,21 @@ int handle_child_uid_map(pid_t child_pid, int fd) {
     }
 
     if (has_userns) {
-        char path[PATH_MAX];
-        for (char **file = (char*[]){"uid_map","gid_map",NULL}; *file; file++) {
-            snprintf(path, sizeof(path), "/proc/%d/%s", child_pid, *file);
-            fprintf(stderr, "writing %s...\n", path);
-            int uid_map_fd = open(path, O_WRONLY);
-            if (uid_map_fd < 0) {
-                perror("open uid_map failed");
-                return -1;
-            }
-            dprintf(uid_map_fd, "0 %d %d\n", USERNS_OFFSET, USERNS_COUNT);
-            close(uid_map_fd);
+        trace_begin(TRACE_UID_MAP);
+        // コンテナごとに割り当てた範囲 (spawn_container の id_range_acquire)
+        if (id_range_write_maps(child_pid, ids) != 0) {
+            return -1;
+        }
+        trace_end(TRACE_UID_MAP);
+    }
+
+    // 子の netns は init userns の所有なので, 子が再開する前に親が設定しておく
+    if (net && net->enabled) {
+        trace_begin(TRACE_NET);
+        if (setup_container_net(child_pid, net) != 0) {
+            return -1;
         }
+        trace_end(TRACE_NET);
     }
 
     // 書き戻す（子プロセスを再開させる）
@@ -48,8 +49,6 @@ int handle_child_uid_map(pid_t child_pid, int fd) {
 }
 
 int userns(struct child_config *config) {
-    fprintf(stderr, "=> trying a user namespace...\n");
-
     int has_userns = !unshare(CLONE_NEWUSER);
     // 親プロセスへ "usernsが使えたか" を通知
     if (write(config->fd, &has_userns, sizeof(has_userns)) != sizeof(has_userns)) {
@@ -68,9 +67,7 @@ int userns(struct child_config *config) {
         return -1;
     }
 
-    if (has_userns) {
-        fprintf(stderr, "=> userns done.\n");
-    } else {
+    if (!has_userns) {
         fprintf(stderr, "=> userns unsupported? continuing.\n");
     }
     return 0;
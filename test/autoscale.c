@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <string.h>
+#include "../include/autoscale.h"
+
+#define TEST_NAME "autoscale"
+#include "expect.h"
+
+/*
+ * cpu.max 自動調整の判断：
+ *  - 上限から始まるか？
+ *  - 圧力/throttle があれば 1 回で上がり, 上限で止まるか？
+ *  - 落ち着いた状態が続いたときだけ下がり, 使用率が 50% を超えたら止まるか？
+ *  - 間隔が短すぎるサンプルは無視するか？
+ */
+
+#define SEC 1000000000ULL
+
+static struct metrics_sample sample;
+
+// 1 秒進めて, その間の使用量/throttle/圧力 (usec) を足す
+static enum autoscale_action step(const struct autoscale_config *config, struct autoscale_state *state,
+                                  uint64_t usage, uint64_t throttled, uint64_t pressure) {
+    sample.timestamp_ns += SEC;
+    sample.cpu_usage_usec += usage;
+    if (throttled) {
+        sample.cpu_nr_throttled++;
+        sample.cpu_throttled_usec += throttled;
+    }
+    sample.psi[PSI_CPU].some_total_usec += pressure;
+    return autoscale_decide(config, state, &sample);
+}
+
+int test_autoscale(void) {
+    struct autoscale_config config;
+    struct autoscale_state state;
+    int fail = 0;
+
+    fail |= expect("reject bad range", parse_autoscale("2000:1000", &config) != 0);
+    fail |= expect("reject missing ceiling", parse_autoscale("500", &config) != 0);
+    if (parse_autoscale("500:2000", &config) != 0) {
+        return 1;
+    }
+    fail |= expect("floor 0.5 CPU", config.floor_usec == 50000 && config.ceiling_usec == 200000);
+
+    memset(&sample, 0, sizeof(sample));
+    autoscale_init(&config, &state);
+    fail |= expect("start at ceiling", state.quota_usec == 200000);
+    fail |= expect("first sample is baseline", step(&config, &state, 0, 0, 0) == AUTOSCALE_KEEP);
+    fail |= expect("keep at ceiling", step(&config, &state, 0, 0, 200000) == AUTOSCALE_KEEP);
+
+    // 短い間隔のサンプルは無視
+    sample.timestamp_ns += SEC / 10;
+    fail |= expect("ignore short interval", autoscale_decide(&config, &state, &sample) == AUTOSCALE_KEEP);
+    sample.timestamp_ns -= SEC / 10;
+
+    // 落ち着いたら 3 回目で下げる (使用量 0.6 CPU)
+    fail |= expect("calm 1", step(&config, &state, 600000, 0, 0) == AUTOSCALE_KEEP);
+    fail |= expect("calm 2", step(&config, &state, 600000, 0, 0) == AUTOSCALE_KEEP);
+    fail |= expect("scale down", step(&config, &state, 600000, 0, 0) == AUTOSCALE_DOWN);
+    fail |= expect("quota x0.8", state.quota_usec == 160000);
+
+    // 途中で少しでも圧力があれば数え直す
+    step(&config, &state, 600000, 0, 0);
+    step(&config, &state, 600000, 0, 50000);
+    fail |= expect("hysteresis resets", step(&config, &state, 600000, 0, 0) == AUTOSCALE_KEEP);
+
+    for (int i = 0; i < 30; i++) {
+        step(&config, &state, 600000, 0, 0);
+    }
+    // 160000 → 128000 → 102400 (使用率 58%) で止まる
+    fail |= expect("stop at usage headroom", state.quota_usec == 102400);
+
+    // 圧力 20% → 上げる (102400 → 153600 → 200000 で止まる)
+    fail |= expect("scale up on pressure", step(&config, &state, 500000, 0, 200000) == AUTOSCALE_UP);
+    fail |= expect("quota x1.5", state.quota_usec == 153600);
+    fail |= expect("scale up on throttling", step(&config, &state, 750000, 100000, 0) == AUTOSCALE_UP);
+    fail |= expect("capped at ceiling", state.quota_usec == 200000);
+    return fail;
+}
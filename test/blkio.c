@@ -0,0 +1,108 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include "../include/blkio.h"
+
+#define TEST_NAME "blkio"
+#include "expect.h"
+
+/*
+ * ブロック I/O の QoS (-q)：
+ *  - latency/rbps/wbps/riops/wiops/dev を読み, 値の無い指定や未知のキーを拒否するか？
+ *  - io.max/io.latency に書く行が指定した項目だけになり, 返却時は制限を外す値になるか？
+ *  - パーティションの上のパスが親のディスクの MAJ:MIN になるか？ (sysfs を作って読ませる)
+ */
+
+static int test_format(void) {
+    struct io_config io;
+    char line[160];
+    int fail = 0;
+
+    fail |= expect("parse", parse_io_config("latency=2000,rbps=1048576,wiops=100,dev=/var/scratch", &io) == 0);
+    fail |= expect("parsed values", io.latency_us == 2000 && io.rbps == 1048576 && io.wiops == 100
+                   && io.wbps == 0 && io.npaths == 1 && !strcmp(io.paths[0], "/var/scratch"));
+
+    io_format_max(&io, makedev(259, 0), 0, line, sizeof(line));
+    fail |= expect("io.max", !strcmp(line, "259:0 rbps=1048576 wiops=100"));
+    io_format_max(&io, makedev(259, 0), 1, line, sizeof(line));
+    fail |= expect("io.max restore", !strcmp(line, "259:0 rbps=max wiops=max"));
+    io_format_latency(&io, makedev(8, 0), 0, line, sizeof(line));
+    fail |= expect("io.latency", !strcmp(line, "8:0 target=2000"));
+    io_format_latency(&io, makedev(8, 0), 1, line, sizeof(line));
+    fail |= expect("io.latency restore", !strcmp(line, "8:0 target=0"));
+
+    fail |= expect("latency only", parse_io_config("latency=500", &io) == 0
+                   && io_format_max(&io, makedev(8, 0), 0, line, sizeof(line)) == 0);
+    fail |= expect("reject dev only", parse_io_config("dev=/data", &io) != 0);
+    fail |= expect("reject relative dev", parse_io_config("rbps=1,dev=data", &io) != 0);
+    fail |= expect("reject zero", parse_io_config("rbps=0", &io) != 0);
+    fail |= expect("reject unknown", parse_io_config("rbps=1,weight=10", &io) != 0);
+    return fail;
+}
+
+static int make_dir(const char *root, const char *rel) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", root, rel);
+    return mkdir(path, 0755);
+}
+
+static int write_file(const char *root, const char *rel, const char *value) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", root, rel);
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        return -1;
+    }
+    fputs(value, f);
+    return fclose(f);
+}
+
+// /sys/dev/block/MAJ:MIN を target へのリンクにする
+static int link_device(const char *root, dev_t dev, const char *target) {
+    char link[PATH_MAX], dest[PATH_MAX];
+    snprintf(link, sizeof(link), "%s/dev/block/%u:%u", root, major(dev), minor(dev));
+    snprintf(dest, sizeof(dest), "%s/%s", root, target);
+    unlink(link);
+    return symlink(dest, link);
+}
+
+static int test_backing_device(void) {
+    char root[] = "/tmp/test_blkio.XXXXXX";
+    if (!mkdtemp(root)) {
+        perror("mkdtemp failed");
+        return 1;
+    }
+    int fail = 0;
+    struct stat st;
+    // 匿名デバイス (overlay など) の上では sysfs を差し替えても意味が無いので確かめない
+    if (stat(root, &st) == 0 && major(st.st_dev) != 0) {
+        fail |= make_dir(root, "dev") | make_dir(root, "dev/block") | make_dir(root, "devices")
+              | make_dir(root, "devices/disk0") | make_dir(root, "devices/disk0/part1")
+              | make_dir(root, "devices/disk1");
+        fail |= write_file(root, "devices/disk0/dev", "9:0\n");
+        fail |= write_file(root, "devices/disk0/part1/partition", "1\n");
+        fail |= expect("fake sysfs", fail == 0);
+
+        fail |= link_device(root, st.st_dev, "devices/disk0/part1");
+        fail |= expect("partition -> disk", io_backing_device(root, root) == makedev(9, 0));
+        fail |= link_device(root, st.st_dev, "devices/disk1");
+        fail |= expect("whole disk", io_backing_device(root, root) == st.st_dev);
+    }
+    fail |= expect("missing path", io_backing_device(root, "/nonexistent/blkio") == 0);
+
+    char cmd[64];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", root);
+    if (system(cmd) != 0) {
+        fprintf(stderr, "cleanup failed: %s\n", root);
+    }
+    return fail;
+}
+
+int test_blkio(void) {
+    return test_format() | test_backing_device();
+}
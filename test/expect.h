@@ -0,0 +1,21 @@
+#ifndef TEST_EXPECT_H
+#define TEST_EXPECT_H
+
+#include <stdio.h>
+
+/*
+ * テスト共通の判定 (各テストは fail |= expect("...", 条件) で失敗を集める)
+ * 読み込む前に TEST_NAME (出力の先頭に付ける名前) を定義しておく
+ */
+
+static inline int expect_named(const char *name, const char *what, int cond) {
+    if (!cond) {
+        fprintf(stderr, "%s: %s\n", name, what);
+        return 1;
+    }
+    return 0;
+}
+
+#define expect(what, cond) expect_named(TEST_NAME, (what), (cond))
+
+#endif
@@ -0,0 +1,36 @@
+#include <stdio.h>
+#include <string.h>
+#include "../include/hugepage.h"
+
+#define TEST_NAME "hugepage"
+#include "expect.h"
+
+/*
+ * -H/-t の解釈：
+ *  - ページサイズがカーネルの hugetlb.<size>.* と同じ表記 (2MB, 1GB) になるか？
+ *  - max/mount を読み, -t の方針を上書きしないか？
+ *  - 2 のべき乗でない大きさや相対パスのマウント先を拒否するか？
+ */
+
+int test_hugepage(void) {
+    struct hugepage_config config;
+    int fail = 0;
+
+    memset(&config, 0, sizeof(config));
+    fail |= expect("parse -t madvise", parse_thp_policy("madvise", &config.thp) == 0);
+    fail |= expect("parse 2M spec", parse_hugepage_config("2M,max=1073741824,mount=/dev/hugepages", &config) == 0);
+    fail |= expect("2M => 2MB", !strcmp(config.size, "2MB") && config.page_size == 2ULL << 20);
+    fail |= expect("max", config.max == 1ULL << 30);
+    fail |= expect("mount", !strcmp(config.mount, "/dev/hugepages"));
+    fail |= expect("thp kept", config.thp == THP_POLICY_MADVISE);
+
+    fail |= expect("parse 1GB", parse_hugepage_config("1GB", &config) == 0 && !strcmp(config.size, "1GB"));
+    fail |= expect("no limit by default", config.max == 0 && config.mount[0] == '\0');
+    fail |= expect("parse 64kB", parse_hugepage_config("64kB", &config) == 0 && !strcmp(config.size, "64KB"));
+
+    fail |= expect("reject 3MB", parse_hugepage_config("3MB", &config) != 0);
+    fail |= expect("reject bare number", parse_hugepage_config("2097152", &config) != 0);
+    fail |= expect("reject relative mount", parse_hugepage_config("2MB,mount=hugepages", &config) != 0);
+    fail |= expect("reject unknown thp", parse_thp_policy("always", &config.thp) != 0);
+    return fail;
+}
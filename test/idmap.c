@@ -0,0 +1,75 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "../include/idmap.h"
+
+#define TEST_NAME "idmap"
+#include "expect.h"
+
+/*
+ * uid/gid 範囲の割り当て (-U)：
+ *  - FIRST:SIZE[:COUNT] を読み, 0 や 32bit を超える範囲を拒否するか？
+ *  - 同時に取った範囲が重ならず, 数を超えたら失敗し, 返せば再び使えるか？
+ *  - idmapped mount 用の user namespace に, rootfs の所有者を範囲の先頭に写す uid_map が書かれているか？
+ */
+
+// 子を userns_fd に入れて /proc/self/uid_map を読ませる
+static int check_userns_map(int userns_fd, const char *expected) {
+    pid_t pid = fork();
+    if (pid < 0) {
+        return 1;
+    }
+    if (pid == 0) {
+        char map[64] = {0};
+        unsigned int inside, outside, count;
+        FILE *f = NULL;
+        if (setns(userns_fd, CLONE_NEWUSER) != 0 || !(f = fopen("/proc/self/uid_map", "r"))
+            || fscanf(f, "%u %u %u", &inside, &outside, &count) != 3) {
+            _exit(1);
+        }
+        snprintf(map, sizeof(map), "%u %u %u", inside, outside, count);
+        _exit(strcmp(map, expected) != 0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+}
+
+int test_idmap(void) {
+    int fail = 0;
+    fail |= expect("reject missing size", parse_id_ranges("100000") != 0);
+    fail |= expect("reject zero size", parse_id_ranges("100000:0") != 0);
+    fail |= expect("reject host root", parse_id_ranges("0:65536") != 0);
+    fail |= expect("reject overflow", parse_id_ranges("4294900000:65536:2") != 0);
+    fail |= expect("reject too many", parse_id_ranges("100000:10:1000") != 0);
+
+    struct id_range a, b, c, d;
+    fail |= expect("parse 200000:65536:2", parse_id_ranges("200000:65536:2") == 0);
+    fail |= expect("acquire first", id_range_acquire(&a) == 0 && a.start == 200000 && a.size == 65536);
+    fail |= expect("acquire second", id_range_acquire(&b) == 0 && b.start == 265536);
+    fail |= expect("exhausted fails", id_range_acquire(&d) != 0 && d.lock_fd == -1);
+
+    int userns_fd = id_range_userns_fd(&b, 0, 0);
+    fail |= expect("userns fd", userns_fd >= 0);
+    if (userns_fd >= 0) {
+        fail |= expect("userns map", check_userns_map(userns_fd, "0 265536 65536") == 0);
+        fail |= expect("userns cached", id_range_userns_fd(&b, 0, 0) == userns_fd);
+    }
+    // 別の範囲へ chown 済みの rootfs はその所有者から写す
+    userns_fd = id_range_userns_fd(&b, 200000, 200000);
+    fail |= expect("userns from owner", userns_fd >= 0 && check_userns_map(userns_fd, "200000 265536 65536") == 0);
+
+    fail |= expect("no userns without a range", id_range_userns_fd(&d, 0, 0) < 0);
+
+    id_range_release(&a);
+    fail |= expect("reacquire", id_range_acquire(&c) == 0 && c.start == 200000);
+    id_range_release(&b);
+    id_range_release(&c);
+
+    parse_id_ranges("10000:2000:32");
+    return fail;
+}
@@ -0,0 +1,149 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/xattr.h>
+#include "../include/image.h"
+
+#define TEST_NAME "image"
+#include "expect.h"
+
+/*
+ * レイヤーストア (-I STORE LAYER...)：
+ *  - 別々のレイヤーにある同じファイル (内容と mode/uid/gid が同じ) が objects/ の 1 つの inode を共有するか？
+ *  - .wh.NAME が 0/0 のキャラクタデバイスに, .wh..wh..opq が親の trusted.overlay.opaque=y になるか？
+ *  - ".." を含むパスや, レイヤー内のシンボリックリンクを通るパスを拒否し, 外に何も書かないか？
+ *  - gzip/zstd で圧縮したレイヤーが, 非圧縮と同じ layers/<sha256> になるか？
+ *  - 同じレイヤー内で後から来たファイルが, 中身のあるディレクトリを置き換えられるか？
+ *  - 展開したレイヤーは image_store_layer() でストアのものと分かり, ほかのディレクトリは分からないか？
+ */
+
+// cmd の %1$s を作業ディレクトリにして sh で実行する
+static int sh(const char *dir, const char *cmd) {
+    char line[2048];
+    snprintf(line, sizeof(line), cmd, dir);
+    return system(line);
+}
+
+// dir/<name> を展開して layers/<sha256> を layer に返す
+static int unpack(const char *dir, const char *name, char *layer, size_t len) {
+    char store[PATH_MAX], archive[PATH_MAX];
+    snprintf(store, sizeof(store), "%s/store", dir);
+    snprintf(archive, sizeof(archive), "%s/%s", dir, name);
+    layer[0] = '\0';
+    return image_unpack_layer(store, archive, layer, len);
+}
+
+static int exists_at(const char *layer, const char *name, struct stat *st) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", layer, name);
+    return lstat(path, st) == 0;
+}
+
+static int test_dedupe(const char *dir) {
+    int fail = expect("make dedupe archives",
+                      sh(dir, "mkdir -p %1$s/d1 %1$s/d2 && echo same > %1$s/d1/x && echo same > %1$s/d2/y"
+                              " && chmod 0644 %1$s/d1/x %1$s/d2/y"
+                              " && tar -cf %1$s/d1.tar -C %1$s/d1 x && tar -cf %1$s/d2.tar -C %1$s/d2 y") == 0);
+    char l1[PATH_MAX], l2[PATH_MAX];
+    fail |= expect("unpack dedupe", unpack(dir, "d1.tar", l1, sizeof(l1)) == 0
+                   && unpack(dir, "d2.tar", l2, sizeof(l2)) == 0);
+    struct stat x, y;
+    fail |= expect("identical files share an object", exists_at(l1, "x", &x) && exists_at(l2, "y", &y)
+                   && x.st_ino == y.st_ino && x.st_nlink >= 3);
+    return fail;
+}
+
+static int test_whiteouts(const char *dir) {
+    int fail = expect("make whiteout archive",
+                      sh(dir, "mkdir -p %1$s/w/opaque && touch %1$s/w/.wh.gone %1$s/w/opaque/.wh..wh..opq"
+                              " && tar -cf %1$s/w.tar -C %1$s/w .") == 0);
+    char layer[PATH_MAX];
+    fail |= expect("unpack whiteouts", unpack(dir, "w.tar", layer, sizeof(layer)) == 0);
+    struct stat st;
+    fail |= expect("whiteout is a 0/0 char device", exists_at(layer, "gone", &st)
+                   && S_ISCHR(st.st_mode) && st.st_rdev == makedev(0, 0));
+    fail |= expect("whiteout marker removed", !exists_at(layer, ".wh.gone", &st)
+                   && !exists_at(layer, "opaque/.wh..wh..opq", &st));
+    char path[PATH_MAX], value[4] = "";
+    snprintf(path, sizeof(path), "%s/opaque", layer);
+    fail |= expect("opaque xattr", getxattr(path, "trusted.overlay.opaque", value, sizeof(value)) == 1
+                   && value[0] == 'y');
+    return fail;
+}
+
+static int test_escapes(const char *dir) {
+    // "../escaped" (-P で先頭の ".." を残す) と, link -> outside を通る link/pwned
+    int fail = expect("make escape archives",
+                      sh(dir, "mkdir -p %1$s/e/sub %1$s/outside %1$s/s1 %1$s/s2/link && echo x > %1$s/e/escaped"
+                              " && tar -P -cf %1$s/dotdot.tar -C %1$s/e/sub ../escaped"
+                              " && ln -s %1$s/outside %1$s/s1/link && echo x > %1$s/s2/link/pwned"
+                              " && tar -cf %1$s/symlink.tar -C %1$s/s1 link && tar -rf %1$s/symlink.tar -C %1$s/s2 link/pwned") == 0);
+    char layer[PATH_MAX], path[PATH_MAX];
+    struct stat st;
+    fail |= expect("reject ..", unpack(dir, "dotdot.tar", layer, sizeof(layer)) != 0);
+    snprintf(path, sizeof(path), "%s/store/tmp/escaped", dir);  // 展開中のレイヤー (tmp/layer.XXXXXX) から見た ../escaped
+    fail |= expect("nothing written for ..", stat(path, &st) != 0);
+    fail |= expect("reject path through symlink", unpack(dir, "symlink.tar", layer, sizeof(layer)) != 0);
+    snprintf(path, sizeof(path), "%s/outside/pwned", dir);
+    fail |= expect("nothing written through symlink", stat(path, &st) != 0);
+    return fail;
+}
+
+static int test_compressed(const char *dir) {
+    int fail = expect("make compressed archives",
+                      sh(dir, "mkdir -p %1$s/c && echo compressed > %1$s/c/f && tar -cf %1$s/c.tar -C %1$s/c f"
+                              " && gzip -c %1$s/c.tar > %1$s/c.tar.gz") == 0);
+    char plain[PATH_MAX], layer[PATH_MAX];
+    fail |= expect("unpack plain", unpack(dir, "c.tar", plain, sizeof(plain)) == 0);
+    fail |= expect("gzip same layer", unpack(dir, "c.tar.gz", layer, sizeof(layer)) == 0 && !strcmp(layer, plain));
+    // zstd は入っていない環境もある
+    if (system("command -v zstd >/dev/null 2>&1") == 0) {
+        fail |= expect("make zstd archive", sh(dir, "zstd -q -c %1$s/c.tar > %1$s/c.tar.zst") == 0);
+        fail |= expect("zstd same layer", unpack(dir, "c.tar.zst", layer, sizeof(layer)) == 0 && !strcmp(layer, plain));
+    }
+    return fail;
+}
+
+static int test_replace_directory(const char *dir) {
+    // d/ (中にファイルあり) の後に, 同じ名前の通常ファイル d を追記した tar
+    int fail = expect("make replace archive",
+                      sh(dir, "mkdir -p %1$s/a/d/sub %1$s/b && echo x > %1$s/a/d/sub/f && echo y > %1$s/b/d"
+                              " && tar -cf %1$s/layer.tar -C %1$s/a d && tar -rf %1$s/layer.tar -C %1$s/b d") == 0);
+    char layer[PATH_MAX], store[PATH_MAX];
+    fail |= expect("unpack replace", unpack(dir, "layer.tar", layer, sizeof(layer)) == 0);
+    struct stat st;
+    fail |= expect("directory replaced by file", exists_at(layer, "d", &st) && S_ISREG(st.st_mode));
+
+    snprintf(store, sizeof(store), "%s/store", dir);
+    fail |= expect("store layer", image_store_layer(layer));
+    fail |= expect("plain directory", !image_store_layer(dir));
+    fail |= expect("store itself", !image_store_layer(store));
+    fail |= expect("missing", !image_store_layer("/nonexistent/layers/abc"));
+    return fail;
+}
+
+int test_image(void) {
+    char dir[] = "/tmp/test_image.XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp failed");
+        return 1;
+    }
+    int fail = 0;
+    fail |= test_dedupe(dir);
+    fail |= test_whiteouts(dir);
+    fail |= test_escapes(dir);
+    fail |= test_compressed(dir);
+    fail |= test_replace_directory(dir);
+
+    char cmd[64];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    if (system(cmd) != 0) {
+        fprintf(stderr, "cleanup failed: %s\n", dir);
+    }
+    return fail;
+}
@@ -0,0 +1,71 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "../include/loopdev.h"
+
+#define TEST_NAME "loopdev"
+#include "expect.h"
+
+/*
+ * イメージファイルの rootfs (-m IMAGE)：
+ *  - 先頭の magic で squashfs ("hsqs") と EROFS (1024 バイト目の 0xE0F5E1E2) を見分けるか？
+ *  - ディレクトリ, 短いファイル, 知らない形式は NONE (従来どおりディレクトリとして扱う) になるか？
+ *  - fsopen() に渡すファイルシステム名が合っているか？
+ */
+
+static int write_image(const char *path, size_t offset, const unsigned char *magic, size_t size) {
+    unsigned char buf[4096];
+    memset(buf, 0, sizeof(buf));
+    if (magic) {
+        memcpy(buf + offset, magic, 4);
+    }
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        return -1;
+    }
+    fwrite(buf, 1, size, f);
+    return fclose(f);
+}
+
+int test_loopdev(void) {
+    char dir[] = "/tmp/test_loopdev.XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp failed");
+        return 1;
+    }
+    static const unsigned char squashfs[] = { 'h', 's', 'q', 's' };
+    static const unsigned char erofs[] = { 0xE2, 0xE1, 0xF5, 0xE0 };
+    char squashfs_path[PATH_MAX], erofs_path[PATH_MAX], short_path[PATH_MAX], plain_path[PATH_MAX];
+    snprintf(squashfs_path, sizeof(squashfs_path), "%s/root.sqfs", dir);
+    snprintf(erofs_path, sizeof(erofs_path), "%s/root.erofs", dir);
+    snprintf(short_path, sizeof(short_path), "%s/short.erofs", dir);
+    snprintf(plain_path, sizeof(plain_path), "%s/plain.img", dir);
+    int fail = 0;
+
+    fail |= expect("write images", write_image(squashfs_path, 0, squashfs, 4096) == 0
+                   && write_image(erofs_path, 1024, erofs, 4096) == 0
+                   && write_image(short_path, 1024, erofs, 1026) == 0
+                   && write_image(plain_path, 0, NULL, 4096) == 0);
+
+    fail |= expect("squashfs", rootfs_image_type(squashfs_path) == ROOTFS_IMAGE_SQUASHFS);
+    fail |= expect("erofs", rootfs_image_type(erofs_path) == ROOTFS_IMAGE_EROFS);
+    fail |= expect("truncated superblock", rootfs_image_type(short_path) == ROOTFS_IMAGE_NONE);
+    fail |= expect("unknown format", rootfs_image_type(plain_path) == ROOTFS_IMAGE_NONE);
+    fail |= expect("directory", rootfs_image_type(dir) == ROOTFS_IMAGE_NONE);
+    fail |= expect("missing", rootfs_image_type("/nonexistent/root.erofs") == ROOTFS_IMAGE_NONE);
+
+    fail |= expect("erofs fstype", !strcmp(rootfs_image_fstype(ROOTFS_IMAGE_EROFS), "erofs"));
+    fail |= expect("squashfs fstype", !strcmp(rootfs_image_fstype(ROOTFS_IMAGE_SQUASHFS), "squashfs"));
+    fail |= expect("no fstype", rootfs_image_fstype(ROOTFS_IMAGE_NONE) == NULL);
+
+    unlink(squashfs_path);
+    unlink(erofs_path);
+    unlink(short_path);
+    unlink(plain_path);
+    rmdir(dir);
+    return fail;
+}
@@ -2,6 +2,21 @@
 
 // テスト用ヘッダ
 int test_resources(void);
+int test_cgroup_pool(void);
+int test_sha256(void);
+int test_metrics(void);
+int test_autoscale(void);
+int test_net(void);
+int test_trace(void);
+int test_logs(void);
+int test_loopdev(void);
+int test_blkio(void);
+int test_hugepage(void);
+int test_idmap(void);
+int test_image(void);
+int test_placement(void);
+int test_reclaim(void);
+int test_teardown(void);
 
 int main(void) {
     int fail_count = 0;
@@ -14,6 +29,126 @@ int main(void) {
         fprintf(stderr, "[OK] test_resources\n");
     }
 
+    fprintf(stderr, "[TEST] test_cgroup_pool...\n");
+    if (test_cgroup_pool() != 0) {
+        fprintf(stderr, "[FAIL] test_cgroup_pool\n");
+        fail_count++;
+    } else {
+        fprintf(stderr, "[OK] test_cgroup_pool\n");
+    }
+
+    fprintf(stderr, "[TEST] test_sha256...\n");
+    if (test_sha256() != 0) {
+        fprintf(stderr, "[FAIL] test_sha256\n");
+        fail_count++;
+    } else {
+        fprintf(stderr, "[OK] test_sha256\n");
+    }
+
+    fprintf(stderr, "[TEST] test_metrics...\n");
+    if (test_metrics() != 0) {
+        fprintf(stderr, "[FAIL] test_metrics\n");
+        fail_count++;
+    } else {
+        fprintf(stderr, "[OK] test_metrics\n");
+    }
+
+    fprintf(stderr, "[TEST] test_autoscale...\n");
+    if (test_autoscale() != 0) {
+        fprintf(stderr, "[FAIL] test_autoscale\n");
+        fail_count++;
+    } else {
+        fprintf(stderr, "[OK] test_autoscale\n");
+    }
+
+    fprintf(stderr, "[TEST] test_net...\n");
+    if (test_net() != 0) {
+        fprintf(stderr, "[FAIL] test_net\n");
+        fail_count++;
+    } else {
+        fprintf(stderr, "[OK] test_net\n");
+    }
+
+    fprintf(stderr, "[TEST] test_blkio...\n");
+    if (test_blkio() != 0) {
+        fprintf(stderr, "[FAIL] test_blkio\n");
+        fail_count++;
+    } else {
+        fprintf(stderr, "[OK] test_blkio\n");
+    }
+
+    fprintf(stderr, "[TEST] test_hugepage...\n");
+    if (test_hugepage() != 0) {
+        fprintf(stderr, "[FAIL] test_hugepage\n");
+        fail_count++;
+    } else {
+        fprintf(stderr, "[OK] test_hugepage\n");
+    }
+
+    fprintf(stderr, "[TEST] test_idmap...\n");
+    if (test_idmap() != 0) {
+        fprintf(stderr, "[FAIL] test_idmap\n");
+        fail_count++;
+    } else {
+        fprintf(stderr, "[OK] test_idmap\n");
+    }
+
+    fprintf(stderr, "[TEST] test_image...\n");
+    if (test_image() != 0) {
+        fprintf(stderr, "[FAIL] test_image\n");
+        fail_count++;
+    } else {
+        fprintf(stderr, "[OK] test_image\n");
+    }
+
+    fprintf(stderr, "[TEST] test_logs...\n");
+    if (test_logs() != 0) {
+        fprintf(stderr, "[FAIL] test_logs\n");
+        fail_count++;
+    } else {
+        fprintf(stderr, "[OK] test_logs\n");
+    }
+
+    fprintf(stderr, "[TEST] test_loopdev...\n");
+    if (test_loopdev() != 0) {
+        fprintf(stderr, "[FAIL] test_loopdev\n");
+        fail_count++;
+    } else {
+        fprintf(stderr, "[OK] test_loopdev\n");
+    }
+
+    fprintf(stderr, "[TEST] test_placement...\n");
+    if (test_placement() != 0) {
+        fprintf(stderr, "[FAIL] test_placement\n");
+        fail_count++;
+    } else {
+        fprintf(stderr, "[OK] test_placement\n");
+    }
+
+    fprintf(stderr, "[TEST] test_reclaim...\n");
+    if (test_reclaim() != 0) {
+        fprintf(stderr, "[FAIL] test_reclaim\n");
+        fail_count++;
+    } else {
+        fprintf(stderr, "[OK] test_reclaim\n");
+    }
+
+    fprintf(stderr, "[TEST] test_teardown...\n");
+    if (test_teardown() != 0) {
+        fprintf(stderr, "[FAIL] test_teardown\n");
+        fail_count++;
+    } else {
+        fprintf(stderr, "[OK] test_teardown\n");
+    }
+
+    fprintf(stderr, "[TEST] test_trace...\n");
+    if (test_trace() != 0) {
+        fprintf(stderr, "[FAIL] test_trace\n");
+        fail_count++;
+    } else {
+        fprintf(stderr, "[OK] test_trace\n");
+    }
+
     if (fail_count == 0) {
         fprintf(stderr, "All tests passed.\n");
     } else {
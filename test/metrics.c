@@ -0,0 +1,120 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "../include/metrics.h"
+
+/*
+ * メトリクスの確認：
+ *  - リングが一周したら古い位置は読めず、新しい位置は読めるか？
+ *  - 一時ディレクトリに置いた cgroup ファイルを解析し、Prometheus 形式で出力できるか？
+ */
+
+static int test_ring(void) {
+    struct metrics_ring *ring = metrics_ring_create(5);
+    if (!ring || ring->capacity != 8) {
+        fprintf(stderr, "ring capacity should round up to 8\n");
+        metrics_ring_destroy(ring);
+        return 1;
+    }
+    struct metrics_sample s, out;
+    memset(&s, 0, sizeof(s));
+    for (unsigned long i = 0; i < 10; i++) {
+        s.id = i;
+        metrics_ring_push(ring, &s);
+    }
+    int fail = 0;
+    if (metrics_ring_read(ring, 1, &out) == 0) {
+        fprintf(stderr, "overwritten slot should not be readable\n");
+        fail = 1;
+    }
+    if (metrics_ring_read(ring, 9, &out) != 0 || out.id != 9) {
+        fprintf(stderr, "latest slot should be readable\n");
+        fail = 1;
+    }
+    if (metrics_ring_read(ring, 10, &out) == 0) {
+        fprintf(stderr, "unwritten slot should not be readable\n");
+        fail = 1;
+    }
+    metrics_ring_destroy(ring);
+    return fail;
+}
+
+static void put(int dir, const char *name, const char *content) {
+    int fd = openat(dir, name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+        if (write(fd, content, strlen(content)) < 0) {
+            perror("write failed");
+        }
+        close(fd);
+    }
+}
+
+static int test_render(void) {
+    char dir[] = "/tmp/test_metrics.XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp failed");
+        return 1;
+    }
+    int dirfd = open(dir, O_RDONLY | O_DIRECTORY);
+    put(dirfd, "memory.current", "4096\n");
+    put(dirfd, "memory.stat", "anon 1024\nfile 2048\nanon_thp 0\ninactive_anon 512\nactive_anon 512\n"
+                              "inactive_file 1536\nactive_file 512\nworkingset_refault_anon 2\nworkingset_refault_file 5\n");
+    put(dirfd, "memory.events", "low 0\nhigh 3\nmax 0\noom 1\noom_kill 1\n");
+    put(dirfd, "cpu.stat", "usage_usec 500\nuser_usec 300\nsystem_usec 200\nnr_periods 0\nnr_throttled 2\nthrottled_usec 70\n");
+    put(dirfd, "io.stat", "8:0 rbytes=100 wbytes=10 rios=1 wios=2 dbytes=0 dios=0\n"
+                          "8:16 rbytes=50 wbytes=5 rios=3 wios=4 dbytes=0 dios=0\n");
+
+    int fail = 0;
+    struct metrics *m = metrics_create(NULL, 1);
+    struct metrics_target t;
+    metrics_target_open(m, &t, dirfd, 7, "c7");
+    metrics_sample(m, &t);
+    size_t len = 0;
+    char *text = metrics_render(m, &len);
+    static const char *expected[] = {
+        "mycontainer_memory_current_bytes{container=\"c7\",id=\"7\"} 4096\n",
+        "mycontainer_memory_anon_bytes{container=\"c7\",id=\"7\"} 1024\n",
+        "mycontainer_memory_lru_bytes{container=\"c7\",id=\"7\",lru=\"inactive_file\"} 1536\n",
+        "mycontainer_memory_workingset_refault_total{container=\"c7\",id=\"7\"} 7\n",
+        "mycontainer_memory_events_total{container=\"c7\",id=\"7\",event=\"oom_kill\"} 1\n",
+        "mycontainer_cpu_throttled_usec_total{container=\"c7\",id=\"7\"} 70\n",
+        "mycontainer_io_read_bytes_total{container=\"c7\",id=\"7\"} 150\n",
+        "mycontainer_io_write_ios_total{container=\"c7\",id=\"7\"} 6\n",
+        "mycontainer_metrics_samples_total 1\n",
+    };
+    for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+        if (!text || !strstr(text, expected[i])) {
+            fprintf(stderr, "missing: %s", expected[i]);
+            fail = 1;
+        }
+    }
+    // ファミリの HELP/TYPE はそのファミリのサンプルの直前 (別ファミリのヘッダが間に挟まらない)
+    const char *some = text ? strstr(text, "mycontainer_pressure_some_usec_total{") : NULL;
+    const char *full_type = text ? strstr(text, "# TYPE mycontainer_pressure_full_usec_total ") : NULL;
+    const char *full = text ? strstr(text, "mycontainer_pressure_full_usec_total{") : NULL;
+    if (!some || !full_type || !full || !(some < full_type && full_type < full)) {
+        fprintf(stderr, "pressure families are interleaved\n");
+        fail = 1;
+    }
+    free(text);
+    metrics_target_close(m, &t);
+    metrics_destroy(m);
+
+    close(dirfd);
+    char cmd[64];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    if (system(cmd) != 0) {
+        fprintf(stderr, "cleanup failed: %s\n", dir);
+    }
+    return fail;
+}
+
+int test_metrics(void) {
+    int fail = 0;
+    fail |= test_ring();
+    fail |= test_render();
+    return fail;
+}
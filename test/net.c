@@ -0,0 +1,98 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <sys/wait.h>
+#include "../include/net.h"
+
+/*
+ * ネットワーク設定の確認：
+ *  - -n の書式を解釈できるか？不正な指定を弾くか？
+ *  - 新しい netns を持つ子に veth を設定すると, 子から eth0 が up で見えるか？
+ *    (権限が無い, veth に対応していない環境だけスキップ)
+ */
+
+static int test_parse(void) {
+    struct net_config net;
+    int fail = 0;
+    if (parse_net_config("10.88.0.2/16,gw=10.88.0.1,bridge=mc0,mtu=9000,queues=4,gro=on", &net) != 0
+        || net.prefix != 16 || !net.has_gateway || strcmp(net.bridge, "mc0") != 0
+        || net.mtu != 9000 || net.queues != 4 || net.gro != 1) {
+        fprintf(stderr, "parse full spec failed\n");
+        fail = 1;
+    }
+    if (parse_net_config("10.88.0.2/24", &net) != 0 || net.has_gateway || net.bridge[0] || net.gro != -1) {
+        fprintf(stderr, "parse address only failed\n");
+        fail = 1;
+    }
+    static const char *invalid[] = { "10.88.0.2", "10.88.0.2/33", "gw=10.0.0.1", "10.88.0.2/24,foo=1",
+                                     "10.88.0.2/24,gro=maybe", "10.88.0.2/24,bridge=averyverylongname" };
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        if (parse_net_config(invalid[i], &net) == 0) {
+            fprintf(stderr, "should reject: %s\n", invalid[i]);
+            fail = 1;
+        }
+    }
+    return fail;
+}
+
+static int test_veth(void) {
+    int ready[2], resume[2];
+    if (pipe(ready) != 0 || pipe(resume) != 0) {
+        return 1;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        char c = 0;
+        int ok = unshare(CLONE_NEWNET) == 0;
+        if (write(ready[1], &ok, sizeof(ok)) != sizeof(ok) || read(resume[0], &c, 1) != 1) {
+            _exit(2);
+        }
+        // ifindex は決め打ちしない (lo 以外のデバイスがある netns でも名前で見つかればよい)
+        struct ifreq ifr;
+        memset(&ifr, 0, sizeof(ifr));
+        strcpy(ifr.ifr_name, "eth0");
+        int sock = socket(AF_INET, SOCK_DGRAM, 0);
+        _exit(sock >= 0 && ioctl(sock, SIOCGIFFLAGS, &ifr) == 0 && (ifr.ifr_flags & IFF_UP) ? 0 : 1);
+    }
+    int ok = 0;
+    if (read(ready[0], &ok, sizeof(ok)) != sizeof(ok)) {
+        ok = 0;
+    }
+    struct net_config net;
+    parse_net_config("10.199.0.2/24,gw=10.199.0.1,mtu=1400", &net);
+    int configured = ok ? setup_container_net(pid, &net) : -1;
+    int setup_errno = ok ? errno : EPERM;
+    if (write(resume[1], "x", 1) != 1) {
+        perror("write failed");
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    close(ready[0]); close(ready[1]); close(resume[0]); close(resume[1]);
+    if (configured != 0) {
+        if (setup_errno == EPERM || setup_errno == EOPNOTSUPP || setup_errno == EACCES) {
+            fprintf(stderr, "veth unavailable (%s), skipped\n", strerror(setup_errno));
+            return 0;
+        }
+        fprintf(stderr, "setup_container_net failed: %s\n", strerror(setup_errno));
+        return 1;
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "eth0 not found in child netns\n");
+        return 1;
+    }
+    return 0;
+}
+
+int test_net(void) {
+    int fail = 0;
+    fail |= test_parse();
+    fail |= test_veth();
+    return fail;
+}
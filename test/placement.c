@@ -0,0 +1,160 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include "../include/placement.h"
+
+/*
+ * cpuset 配置の確認 (2 ノード x L3 2 つ x 2 CPU の sysfs を作って読ませる)：
+ *  - 幅 1 のコンテナが空いている L3 ドメインに散らばるか？
+ *  - ドメインに収まらない幅はノード全体、ノードに収まらない幅は全 CPU/全ノードになるか？
+ *  - コンテナが去ったあと、混んだドメインから空いたドメインへ移し直されるか？
+ */
+
+static int write_file(const char *root, const char *rel, const char *value) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", root, rel);
+    // 親ディレクトリを順に作る
+    for (char *slash = strchr(path + strlen(root) + 1, '/'); slash; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        mkdir(path, 0755);
+        *slash = '/';
+    }
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        return -1;
+    }
+    fputs(value, f);
+    return fclose(f);
+}
+
+static int make_sysfs(const char *root) {
+    char rel[128], list[16];
+    int fail = write_file(root, "cpu/online", "0-7\n");
+    fail |= write_file(root, "node/node0/cpulist", "0-3\n");
+    fail |= write_file(root, "node/node1/cpulist", "4-7\n");
+    for (int cpu = 0; cpu < 8; cpu++) {
+        // index0: L1d (CPU 単体), index1: L1i, index2: L3 (2 CPU で共有)
+        const char *types[3] = { "Data\n", "Instruction\n", "Unified\n" };
+        const char *levels[3] = { "1\n", "1\n", "3\n" };
+        for (int index = 0; index < 3; index++) {
+            if (index == 2) {
+                snprintf(list, sizeof(list), "%d-%d\n", cpu & ~1, (cpu & ~1) + 1);
+            } else {
+                snprintf(list, sizeof(list), "%d\n", cpu);
+            }
+            snprintf(rel, sizeof(rel), "cpu/cpu%d/cache/index%d/level", cpu, index);
+            fail |= write_file(root, rel, levels[index]);
+            snprintf(rel, sizeof(rel), "cpu/cpu%d/cache/index%d/type", cpu, index);
+            fail |= write_file(root, rel, types[index]);
+            snprintf(rel, sizeof(rel), "cpu/cpu%d/cache/index%d/shared_cpu_list", cpu, index);
+            fail |= write_file(root, rel, list);
+        }
+    }
+    return fail;
+}
+
+static int expect_slot(struct placement *p, struct placement_slot *slot, const char *cpus, const char *mems) {
+    char got_cpus[64], got_mems[16];
+    placement_cpus(p, slot, got_cpus, sizeof(got_cpus));
+    placement_mems(p, slot, got_mems, sizeof(got_mems));
+    if (strcmp(got_cpus, cpus) || strcmp(got_mems, mems)) {
+        fprintf(stderr, "placement %lu: cpus %s mems %s (expected %s / %s)\n",
+                slot->id, got_cpus, got_mems, cpus, mems);
+        return 1;
+    }
+    return 0;
+}
+
+static int test_assign(struct placement *p) {
+    struct placement_slot slots[4], wide, whole;
+    const char *expected[4] = { "0-1", "2-3", "4-5", "6-7" };
+    int fail = 0;
+
+    for (int i = 0; i < 4; i++) {
+        if (placement_assign(p, &slots[i], i, 1, -1) != 0) {
+            return 1;
+        }
+        fail |= expect_slot(p, &slots[i], expected[i], i < 2 ? "0" : "1");
+    }
+    // L3 (2 CPU) に収まらない → 空いているノード (同じならノード 0) 全体
+    fail |= placement_assign(p, &wide, 4, 3, -1) != 0;
+    fail |= expect_slot(p, &wide, "0-3", "0");
+    // ノード (4 CPU) にも収まらない → 全体
+    fail |= placement_assign(p, &whole, 5, 6, -1) != 0;
+    fail |= expect_slot(p, &whole, "0-7", "0-1");
+
+    placement_release(p, &whole);
+    placement_release(p, &wide);
+    for (int i = 0; i < 4; i++) {
+        placement_release(p, &slots[i]);
+    }
+    return fail;
+}
+
+static int test_rebalance(struct placement *p) {
+    struct placement_slot slots[6];
+    int fail = 0;
+    // 0,1,2,3 → ドメイン 0..3, 4,5 → ドメイン 0,1 (同じ負荷なら番号の小さい方)
+    for (int i = 0; i < 6; i++) {
+        if (placement_assign(p, &slots[i], i, 1, -1) != 0) {
+            return 1;
+        }
+    }
+    fail |= expect_slot(p, &slots[4], "0-1", "0");
+    fail |= expect_slot(p, &slots[5], "2-3", "0");
+
+    // ドメイン 2, 3 が空く → 0, 1 から 1 つずつ移る
+    placement_release(p, &slots[2]);
+    placement_release(p, &slots[3]);
+    unsigned int moved = placement_rebalance(p);
+    uint64_t used = 0;
+    for (int i = 0; i < 6; i++) {
+        if (i != 2 && i != 3) {
+            used |= slots[i].domains;
+        }
+    }
+    if (moved != 2 || used != 0xf) {
+        fprintf(stderr, "rebalance: moved %u, domains in use %#llx\n", moved, (unsigned long long)used);
+        fail = 1;
+    }
+    // 偏りが無ければ動かさない
+    if (placement_rebalance(p) != 0) {
+        fprintf(stderr, "rebalance: moved a balanced placement\n");
+        fail = 1;
+    }
+    return fail;
+}
+
+int test_placement(void) {
+    char root[] = "/tmp/test_placement.XXXXXX";
+    if (!mkdtemp(root)) {
+        perror("mkdtemp failed");
+        return 1;
+    }
+    int fail = 0;
+    if (placement_width(NULL) != 1 || placement_width("max 100000") != 1 ||
+        placement_width("250000 100000") != 3 || placement_width("50000") != 1) {
+        fprintf(stderr, "placement_width: wrong width\n");
+        fail = 1;
+    }
+
+    struct placement *p = NULL;
+    if (make_sysfs(root) != 0 || !(p = placement_create(root))) {
+        fail = 1;
+    } else {
+        fail |= test_assign(p);
+        fail |= test_rebalance(p);
+        placement_destroy(p);
+    }
+
+    char cmd[64];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", root);
+    if (system(cmd) != 0) {
+        fprintf(stderr, "cleanup failed: %s\n", root);
+    }
+    return fail;
+}
@@ -0,0 +1,161 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "../include/reclaim.h"
+
+#define TEST_NAME "reclaim"
+#include "expect.h"
+
+/*
+ * 先回りのメモリ回収の判断：
+ *  - 圧力の低い状態が続いたときだけ, 冷えたページの STEP% を押し出して memory.high を下げるか？
+ *  - 圧力が閾値を超えるか, 押し出した分がすぐ refault したら memory.high を緩め, memory.max で max に戻すか？
+ *  - 押し出しきれなかった分を memory.high に足して書き込むか？ (cgroup のファイルを模したディレクトリで)
+ */
+
+#define SEC 1000000000ULL
+#define MiB (1ULL << 20)
+
+static struct metrics_sample sample;
+
+// 1 秒進めて, その間の memory の some (usec) と refault (pages) を足す
+static enum reclaim_action step(const struct reclaim_config *config, struct reclaim_state *state,
+                                uint64_t pressure, uint64_t refault) {
+    sample.timestamp_ns += SEC;
+    sample.psi[PSI_MEMORY].some_total_usec += pressure;
+    sample.memory_refault += refault;
+    return reclaim_decide(config, state, &sample);
+}
+
+static int test_decide(void) {
+    struct reclaim_config config;
+    struct reclaim_state state;
+    int fail = 0;
+
+    fail |= expect("reject zero", parse_reclaim("0", &config) != 0);
+    fail |= expect("reject text", parse_reclaim("low", &config) != 0);
+    fail |= expect("reject step 0", parse_reclaim("1:0", &config) != 0);
+    fail |= expect("reject step 200", parse_reclaim("1:200", &config) != 0);
+    fail |= expect("parse default step", parse_reclaim("2", &config) == 0 && config.step_percent == 10);
+    if (parse_reclaim("0.5:10", &config) != 0) {
+        return 1;
+    }
+    fail |= expect("0.5% => 50", config.pressure_permyriad == 50);
+
+    memset(&sample, 0, sizeof(sample));
+    memset(&state, 0, sizeof(state));
+    state.limit = 1024 * MiB;
+    sample.memory_current = 512 * MiB;
+    sample.memory_inactive_file = 300 * MiB;
+    sample.memory_inactive_anon = 100 * MiB;
+
+    fail |= expect("first sample is baseline", step(&config, &state, 0, 0) == RECLAIM_KEEP);
+    fail |= expect("calm 1", step(&config, &state, 1000, 0) == RECLAIM_KEEP);
+    fail |= expect("calm 2", step(&config, &state, 0, 0) == RECLAIM_KEEP);
+    // 冷えたページ 400MiB の 10% を押し出し, 残り 472MiB + 1/4 を memory.high にする
+    fail |= expect("shrink", step(&config, &state, 0, 0) == RECLAIM_SHRINK);
+    fail |= expect("request 40MiB", state.request == 40 * MiB);
+    fail |= expect("high 590MiB", state.high == 590 * MiB);
+
+    // 押し出した 40MiB のうち 20% 以上が戻ってきた → 緩める
+    state.last_reclaimed = 40 * MiB;
+    fail |= expect("relax on refault", step(&config, &state, 0, 3000) == RECLAIM_RELAX);
+    fail |= expect("high x1.5", state.high == 885 * MiB);
+    fail |= expect("refault rate", state.refault_per_sec == 3000);
+    // 圧力 1% → 緩める. memory.max を超えるので max に戻る
+    fail |= expect("relax on pressure", step(&config, &state, 10000, 0) == RECLAIM_RELAX);
+    fail |= expect("back to max", state.high == 0);
+    fail |= expect("keep at max", step(&config, &state, 10000, 0) == RECLAIM_KEEP);
+
+    // 短い間隔のサンプルは無視
+    sample.timestamp_ns += SEC / 10;
+    fail |= expect("ignore short interval", reclaim_decide(&config, &state, &sample) == RECLAIM_KEEP);
+    sample.timestamp_ns -= SEC / 10;
+
+    // 冷えたページがほとんど無ければ何もしない
+    sample.memory_inactive_file = 4 * MiB;
+    sample.memory_inactive_anon = 0;
+    for (int i = 0; i < 5; i++) {
+        fail |= expect("nothing cold", step(&config, &state, 0, 0) == RECLAIM_KEEP);
+    }
+    return fail;
+}
+
+static int put(int dirfd, const char *name, const char *value) {
+    int fd = openat(dirfd, name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    int ret = write(fd, value, strlen(value)) < 0 ? -1 : 0;
+    close(fd);
+    return ret;
+}
+
+static int get(int dirfd, const char *name, char *buf, size_t len) {
+    int fd = openat(dirfd, name, O_RDONLY);
+    ssize_t n = fd >= 0 ? read(fd, buf, len - 1) : -1;
+    if (fd >= 0) {
+        close(fd);
+    }
+    buf[n > 0 ? n : 0] = '\0';
+    return n > 0 ? 0 : -1;
+}
+
+static int test_apply(void) {
+    char dir[] = "/tmp/test_reclaim.XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp failed");
+        return 1;
+    }
+    int dirfd = open(dir, O_RDONLY | O_DIRECTORY);
+    int fail = put(dirfd, "memory.max", "1073741824\n") | put(dirfd, "memory.current", "536870912\n")
+             | put(dirfd, "memory.reclaim", "") | put(dirfd, "memory.high", "max\n");
+    char buf[64];
+
+    struct reclaim_state state;
+    reclaim_init(dirfd, &state);
+    fail |= expect("limit from memory.max", state.limit == 1024 * MiB && state.high == 0);
+
+    // ただのファイルなので memory.current は減らない → 要求量をそのまま memory.high に足す
+    state.high = 590 * MiB;
+    state.request = 40 * MiB;
+    fail |= expect("apply only queues", reclaim_apply(dirfd, &state, RECLAIM_SHRINK) == 0 && state.pending == 40 * MiB
+                   && get(dirfd, "memory.reclaim", buf, sizeof(buf)) != 0);
+    fail |= expect("step finishes", reclaim_step(dirfd, &state, 64 * MiB) == 0 && state.pending == 0);
+    fail |= expect("nothing reclaimed", state.reclaimed_total == 0 && state.last_reclaimed == 0);
+    fail |= expect("memory.reclaim written", get(dirfd, "memory.reclaim", buf, sizeof(buf)) == 0
+                   && !strcmp(buf, "41943040"));
+    fail |= expect("memory.high raised by shortfall", get(dirfd, "memory.high", buf, sizeof(buf)) == 0
+                   && !strcmp(buf, "660602880"));
+
+    // 1 回に書くのは chunk まで. 減らなければ残りは書かずに終える
+    state.request = 40 * MiB;
+    fail |= put(dirfd, "memory.reclaim", "");
+    reclaim_apply(dirfd, &state, RECLAIM_SHRINK);
+    fail |= expect("chunked step", reclaim_step(dirfd, &state, 4 * MiB) == 0 && state.pending == 0
+                   && get(dirfd, "memory.reclaim", buf, sizeof(buf)) == 0 && !strcmp(buf, "4194304"));
+
+    // 使用量 (512MiB) より下の memory.high は書かない (書いた側で同期的に回収が走る)
+    state.high = 256 * MiB;
+    fail |= expect("relax", reclaim_apply(dirfd, &state, RECLAIM_RELAX) == 0);
+    fail |= expect("memory.high not below usage", get(dirfd, "memory.high", buf, sizeof(buf)) == 0
+                   && !strcmp(buf, "536870912") && state.high == 512 * MiB);
+
+    reclaim_reset(dirfd);
+    fail |= expect("reset to max", get(dirfd, "memory.high", buf, sizeof(buf)) == 0 && !strncmp(buf, "max", 3));
+
+    close(dirfd);
+    char cmd[64];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    if (system(cmd) != 0) {
+        fprintf(stderr, "cleanup failed: %s\n", dir);
+    }
+    return fail;
+}
+
+int test_reclaim(void) {
+    return test_decide() | test_apply();
+}
@@ -7,6 +7,7 @@
  * 簡易テスト：
  *  - resources() が -1 を返さないか？
  *  - free_resources() が -1 を返さないか？
+ *  - -l の名前で cgroup の外のファイル ("../" など) を指せないか？
  */
 
 // child_config のモック
@@ -19,7 +20,42 @@ static struct child_config dummy_config = {
     .mount_dir = "/"
 };
 
+static int test_limit_names(void) {
+    static const char *const bad[] = {
+        "../../../etc/foo=x", "memory.max/../../x=1", "..=1", ".=1", "memory=1", ".max=1",
+        "memory.=1", "memory.max", "/etc/passwd=x", "=1",
+        "cgroup.procs=1", "cgroup.subtree_control=+memory", "cgroup.kill=1", "cgroup.freeze=1",
+        "cgroup.threads=1", "foo.max=1", NULL,
+    };
+    int fail = 0;
+    for (const char *const *limit = bad; *limit; limit++) {
+        if (cgroup_limit_valid(*limit)) {
+            fprintf(stderr, "accepted invalid cgroup limit: %s\n", *limit);
+            fail = 1;
+        }
+    }
+    if (!cgroup_limit_valid("memory.max=64M") || !cgroup_limit_valid("hugetlb.2MB.max=0")
+        || !cgroup_limit_valid("cpu.max=50000 100000")) {
+        fprintf(stderr, "rejected valid cgroup limit\n");
+        fail = 1;
+    }
+
+    // 直接渡されても書き込まない
+    char *limits[] = { "../../../tmp/test_resources_escape=x", NULL };
+    struct child_config config = dummy_config;
+    config.cgroup_limits = limits;
+    if (resources(&config) == 0) {
+        fprintf(stderr, "resources() accepted a path traversal limit\n");
+        free_resources(&config);
+        fail = 1;
+    }
+    return fail;
+}
+
 int test_resources(void) {
+    if (test_limit_names() != 0) {
+        return 1;
+    }
     // 実際に /sys/fs/cgroup/... への書き込みができるかは
     // 環境依存なので、一旦呼び出してエラーが出ないか程度を見る
     if (resources(&dummy_config) != 0) {
@@ -32,3 +68,35 @@ int test_resources(void) {
     }
     return 0;
 }
+
+/*
+ * cgroup プール:
+ *  - 返却したスロットが次の resources() で再利用されるか？
+ *  - 返却後もスロットのディレクトリが残っているか？
+ */
+int test_cgroup_pool(void) {
+    struct child_config config = dummy_config;
+    char first[sizeof(config.cgroup)];
+
+    set_cgroup_pool(2);
+    if (resources(&config) != 0 || !config.cgroup_pooled) {
+        fprintf(stderr, "resources() did not use the cgroup pool\n");
+        set_cgroup_pool(0);
+        return 1;
+    }
+    snprintf(first, sizeof(first), "%s", config.cgroup);
+    if (free_resources(&config) != 0) {
+        fprintf(stderr, "free_resources() returned error\n");
+        set_cgroup_pool(0);
+        return 1;
+    }
+
+    if (resources(&config) != 0 || strcmp(first, config.cgroup) != 0) {
+        fprintf(stderr, "pooled cgroup was not reused (%s != %s)\n", first, config.cgroup);
+        set_cgroup_pool(0);
+        return 1;
+    }
+    free_resources(&config);
+    set_cgroup_pool(0);
+    return 0;
+}
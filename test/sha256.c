@@ -0,0 +1,38 @@
+#include <stdio.h>
+#include <string.h>
+#include "../include/sha256.h"
+
+/*
+ * SHA-256 の既知の値と比較する：
+ *  - 空文字列 / "abc" / 56 バイト (パディングが 2 ブロックになる境界)
+ *  - 1 バイトずつ update しても一括と同じ結果になるか？
+ */
+
+static int check(const char *input, const char *expected, size_t chunk) {
+    struct sha256_ctx ctx;
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    char hex[SHA256_HEX_SIZE];
+
+    sha256_init(&ctx);
+    size_t len = strlen(input);
+    for (size_t off = 0; off < len; off += chunk) {
+        sha256_update(&ctx, input + off, len - off < chunk ? len - off : chunk);
+    }
+    sha256_final(&ctx, digest);
+    sha256_hex(digest, hex);
+    if (strcmp(hex, expected) != 0) {
+        fprintf(stderr, "sha256(\"%s\") = %s, expected %s\n", input, hex, expected);
+        return 1;
+    }
+    return 0;
+}
+
+int test_sha256(void) {
+    static const char *abc56 = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    int fail = 0;
+    fail |= check("", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855", 1);
+    fail |= check("abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", 64);
+    fail |= check(abc56, "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1", 64);
+    fail |= check(abc56, "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1", 1);
+    return fail;
+}
@@ -0,0 +1,75 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "../include/teardown.h"
+#include "../include/timing.h"
+
+#define TEST_NAME "teardown"
+#include "expect.h"
+
+/*
+ * 後片付け (cgroup.kill のあと)：
+ *  - populated 0 ならすぐ, 1 なら上限時間まで待って -1 を返すか？ (cgroup.events を模したファイルで)
+ *  - 渡した cgroup と一時ディレクトリを, 空になってから片付け用のプロセスが消すか？
+ *  - populated 1 の cgroup を渡しても teardown_submit() がすぐ戻るか？
+ */
+
+static int write_events(const char *dir, int populated) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/cgroup.events", dir);
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        return -1;
+    }
+    fprintf(f, "populated %d\nfrozen 0\n", populated);
+    return fclose(f);
+}
+
+static int exists(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0;
+}
+
+int test_teardown(void) {
+    char cgroup[] = "/tmp/test_teardown_cg.XXXXXX";
+    char busy[] = "/tmp/test_teardown_busy.XXXXXX";
+    char scratch[] = "/tmp/test_teardown_tmp.XXXXXX";
+    if (!mkdtemp(cgroup) || !mkdtemp(busy) || !mkdtemp(scratch)) {
+        perror("mkdtemp failed");
+        return 1;
+    }
+    int fail = 0;
+    char events[PATH_MAX];
+    snprintf(events, sizeof(events), "%s/cgroup.events", busy);
+
+    fail |= expect("missing cgroup is empty", teardown_wait_empty("/nonexistent/teardown", 10) == 0);
+    fail |= expect("fake events", write_events(busy, 0) == 0);
+    fail |= expect("populated 0", teardown_wait_empty(busy, 10) == 0);
+    fail |= expect("fake events", write_events(busy, 1) == 0);
+    uint64_t start = timing_now_ns();
+    fail |= expect("populated 1 times out", teardown_wait_empty(busy, 50) == -1);
+    fail |= expect("waited until timeout", timing_now_ns() - start >= 50 * 1000000ULL);
+
+    // 空の cgroup と一時ディレクトリ / まだプロセスが残っている cgroup
+    fail |= expect("submit", teardown_submit(cgroup, scratch) == 0);
+    fail |= expect("submit busy", teardown_submit(busy, NULL) == 0);
+    fail |= expect("busy cgroup kept", exists(busy));
+
+    // プロセスが居なくなった: 中身を populated 0 にし, 本物の cgroup と同じく rmdir できるようにする
+    fail |= expect("fake events", write_events(busy, 0) == 0);
+    unlink(events);
+    teardown_finish();
+    fail |= expect("cgroup removed", !exists(cgroup));
+    fail |= expect("scratch removed", !exists(scratch));
+    fail |= expect("busy cgroup removed once empty", !exists(busy));
+
+    unlink(events);
+    rmdir(busy);
+    rmdir(cgroup);
+    rmdir(scratch);
+    return fail;
+}
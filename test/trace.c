@@ -0,0 +1,63 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "../include/trace.h"
+
+/*
+ * トレースの確認：
+ *  - 無効時は何も記録しないか？
+ *  - fork した子の記録も同じリングに入り、JSON に track と側 (tid) が出るか？
+ */
+
+int test_trace(void) {
+    int fail = 0;
+    trace_begin(TRACE_CGROUPS);
+    if (trace_ring) {
+        fprintf(stderr, "trace should be off by default\n");
+        return 1;
+    }
+
+    if (trace_start(NULL) != 0) {
+        return 1;
+    }
+    uint32_t track = trace_new_track();
+    trace_begin(TRACE_CLONE);
+    pid_t pid = fork();
+    if (pid == 0) {
+        trace_attach(track, TRACE_CHILD);
+        trace_begin(TRACE_MOUNTS);
+        trace_end(TRACE_MOUNTS);
+        trace_instant(TRACE_EXECVE);
+        _exit(0);
+    }
+    waitpid(pid, NULL, 0);
+    trace_end(TRACE_CLONE);
+
+    char path[] = "/tmp/test_trace.XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0 || trace_dump(path) != 0) {
+        perror("trace_dump failed");
+        return 1;
+    }
+    char buf[8192];
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    unlink(path);
+    buf[n > 0 ? n : 0] = '\0';
+
+    char expected[4][128];
+    snprintf(expected[0], sizeof(expected[0]), "\"name\":\"clone\",\"ph\":\"B\"");
+    snprintf(expected[1], sizeof(expected[1]), "\"pid\":%u,\"tid\":%d}", track, TRACE_CHILD);
+    snprintf(expected[2], sizeof(expected[2]), "\"name\":\"execve\",\"ph\":\"i\",\"s\":\"t\"");
+    snprintf(expected[3], sizeof(expected[3]), "\"records\":5}");
+    for (int i = 0; i < 4; i++) {
+        if (!strstr(buf, expected[i])) {
+            fprintf(stderr, "missing in trace: %s\n", expected[i]);
+            fail = 1;
+        }
+    }
+    return fail;
+}